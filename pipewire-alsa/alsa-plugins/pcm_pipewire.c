@@ -25,6 +25,8 @@
 #define __USE_GNU
 
 #include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
 #ifndef __FreeBSD__
 #include <byteswap.h>
 #endif
@@ -54,6 +56,28 @@
 
 #define MIN_PERIOD	64
 
+/* The connection to the server is shared by all open PCMs of a process that
+ * use the same server. When the last of them is closed, the connection is
+ * kept for the next PCM that is opened, applications often close and reopen
+ * their PCMs. Idle connections are destroyed when they have an error or when
+ * the plugin is unloaded. */
+struct connection {
+	struct spa_list link;
+	int ref;
+	pid_t pid;
+	char *server_name;
+
+	struct pw_thread_loop *main_loop;
+	struct pw_context *context;
+
+	struct pw_core *core;
+	struct spa_hook core_listener;
+	int error;		/* protected by connections_lock */
+};
+
+static pthread_mutex_t connections_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct spa_list connections = SPA_LIST_INIT(&connections);
+
 typedef struct {
 	snd_pcm_ioplug_t io;
 
@@ -76,10 +100,9 @@ typedef struct {
 	uint32_t stride;
 
 	struct spa_system *system;
+	struct connection *conn;
 	struct pw_thread_loop *main_loop;
 
-	struct pw_context *context;
-
 	struct pw_core *core;
 	struct spa_hook core_listener;
 
@@ -137,21 +160,205 @@ static inline int pcm_poll_unblock_check(snd_pcm_ioplug_t *io)
 	return 0;
 }
 
+static void connection_destroy(struct connection *conn)
+{
+	pw_log_debug(NAME" %p: destroy connection", conn);
+
+	pw_thread_loop_stop(conn->main_loop);
+	if (conn->core) {
+		spa_hook_remove(&conn->core_listener);
+		pw_core_disconnect(conn->core);
+	}
+	if (conn->context)
+		pw_context_destroy(conn->context);
+	pw_thread_loop_destroy(conn->main_loop);
+	free(conn->server_name);
+	free(conn);
+}
+
+/* take the idle connections that can't be used anymore, or all idle
+ * connections, from the list. Called with connections_lock held. */
+static void connections_take_idle(struct spa_list *idle, bool all)
+{
+	struct connection *conn, *t;
+
+	spa_list_for_each_safe(conn, t, &connections, link) {
+		if (conn->ref > 0 || (!all && conn->error == 0 && conn->pid == getpid()))
+			continue;
+		spa_list_remove(&conn->link);
+		spa_list_append(idle, &conn->link);
+	}
+}
+
+static void connections_destroy_idle(struct spa_list *idle)
+{
+	struct connection *conn;
+
+	/* not with the lock held, the loop thread can be waiting for it. After
+	 * a fork, the thread of the connection is gone and can't be stopped */
+	spa_list_consume(conn, idle, link) {
+		spa_list_remove(&conn->link);
+		if (conn->pid == getpid())
+			connection_destroy(conn);
+	}
+}
+
+static void connection_release(struct connection *conn)
+{
+	struct spa_list idle;
+
+	spa_list_init(&idle);
+
+	pthread_mutex_lock(&connections_lock);
+	if (--conn->ref == 0)
+		connections_take_idle(&idle, false);
+	pthread_mutex_unlock(&connections_lock);
+
+	connections_destroy_idle(&idle);
+}
+
+static void connections_cleanup(void) __attribute__ ((destructor));
+
+static void connections_cleanup(void)
+{
+	struct spa_list idle;
+
+	spa_list_init(&idle);
+
+	pthread_mutex_lock(&connections_lock);
+	connections_take_idle(&idle, true);
+	pthread_mutex_unlock(&connections_lock);
+
+	connections_destroy_idle(&idle);
+}
+
+static void on_connection_error(void *data, uint32_t id, int seq, int res, const char *message)
+{
+	struct connection *conn = data;
+
+	if (id == PW_ID_CORE) {
+		pthread_mutex_lock(&connections_lock);
+		conn->error = res;
+		pthread_mutex_unlock(&connections_lock);
+	}
+}
+
+static const struct pw_core_events connection_core_events = {
+	PW_VERSION_CORE_EVENTS,
+	.error = on_connection_error,
+};
+
+static struct connection *connection_new(const char *server_name)
+{
+	struct connection *conn;
+	struct pw_properties *props;
+	struct pw_loop *loop;
+	int res;
+
+	conn = calloc(1, sizeof(*conn));
+	if (conn == NULL)
+		return NULL;
+
+	spa_list_init(&conn->link);
+	conn->ref = 1;
+	conn->pid = getpid();
+	if (server_name != NULL &&
+	    (conn->server_name = strdup(server_name)) == NULL)
+		goto error;
+
+	conn->main_loop = pw_thread_loop_new("alsa-pipewire", NULL);
+	if (conn->main_loop == NULL)
+		goto error;
+
+	loop = pw_thread_loop_get_loop(conn->main_loop);
+	if ((conn->context = pw_context_new(loop, NULL, 0)) == NULL)
+		goto error;
+
+	props = pw_properties_new(NULL, NULL);
+	if (props == NULL)
+		goto error;
+
+	pw_properties_setf(props, PW_KEY_APP_NAME, "PipeWire ALSA [%s]",
+			pw_get_prgname());
+
+	if (server_name)
+		pw_properties_set(props, PW_KEY_REMOTE_NAME, server_name);
+
+	if ((res = pw_thread_loop_start(conn->main_loop)) < 0) {
+		pw_properties_free(props);
+		errno = -res;
+		goto error;
+	}
+
+	pw_thread_loop_lock(conn->main_loop);
+	conn->core = pw_context_connect(conn->context, props, 0);
+	if (conn->core == NULL) {
+		pw_thread_loop_unlock(conn->main_loop);
+		goto error;
+	}
+	pw_core_add_listener(conn->core, &conn->core_listener,
+			&connection_core_events, conn);
+	pw_thread_loop_unlock(conn->main_loop);
+
+	pw_log_debug(NAME" %p: new connection to %s", conn, server_name);
+
+	return conn;
+
+error:
+	res = -errno;
+	if (conn->main_loop)
+		connection_destroy(conn);
+	else
+		free(conn);
+	errno = -res;
+	return NULL;
+}
+
+static struct connection *connection_acquire(const char *server_name)
+{
+	struct connection *conn;
+	struct spa_list idle;
+
+	spa_list_init(&idle);
+
+	pthread_mutex_lock(&connections_lock);
+	connections_take_idle(&idle, false);
+	spa_list_for_each(conn, &connections, link) {
+		/* after a fork, the thread of the connection is gone */
+		if (conn->pid != getpid() || conn->error < 0 ||
+		    !spa_streq(conn->server_name, server_name))
+			continue;
+		conn->ref++;
+		goto done;
+	}
+	if ((conn = connection_new(server_name)) != NULL)
+		spa_list_append(&connections, &conn->link);
+done:
+	pthread_mutex_unlock(&connections_lock);
+
+	connections_destroy_idle(&idle);
+	return conn;
+}
+
 static void snd_pcm_pipewire_free(snd_pcm_pipewire_t *pw)
 {
 	if (pw == NULL)
 		return;
 
 	pw_log_debug(NAME" %p:", pw);
-	if (pw->main_loop)
-		pw_thread_loop_stop(pw->main_loop);
-	if (pw->context)
-		pw_context_destroy(pw->context);
+	if (pw->conn) {
+		pw_thread_loop_lock(pw->main_loop);
+		spa_hook_remove(&pw->core_listener);
+		if (pw->stream)
+			pw_stream_destroy(pw->stream);
+		pw_thread_loop_unlock(pw->main_loop);
+		connection_release(pw->conn);
+	}
 	if (pw->fd >= 0)
 		spa_system_close(pw->system, pw->fd);
-	if (pw->main_loop)
-		pw_thread_loop_destroy(pw->main_loop);
+	free(pw->node_name);
 	free(pw->target);
+	free(pw->role);
 	free(pw);
 }
 
@@ -974,7 +1181,6 @@ static int snd_pcm_pipewire_open(snd_pcm_t **pcmp, const char *name,
 	snd_pcm_pipewire_t *pw;
 	int err;
 	const char *str;
-	struct pw_properties *props = NULL;
 	struct pw_loop *loop;
 
 	assert(pcmp);
@@ -1020,37 +1226,17 @@ static int snd_pcm_pipewire_open(snd_pcm_t **pcmp, const char *name,
 
 	pw->role = (role && *role) ? strdup(role) : NULL;
 
-	pw->main_loop = pw_thread_loop_new("alsa-pipewire", NULL);
-	if (pw->main_loop == NULL) {
+	pw->conn = connection_acquire(server_name);
+	if (pw->conn == NULL) {
 		err = -errno;
 		goto error;
 	}
+	pw->main_loop = pw->conn->main_loop;
+	pw->core = pw->conn->core;
 	loop = pw_thread_loop_get_loop(pw->main_loop);
 	pw->system = loop->system;
-	if ((pw->context = pw_context_new(loop, NULL, 0)) == NULL) {
-		err = -errno;
-		goto error;
-	}
-
-	props = pw_properties_new(NULL, NULL);
-
-	pw_properties_setf(props, PW_KEY_APP_NAME, "PipeWire ALSA [%s]",
-			pw_get_prgname());
-
-	if (server_name)
-		pw_properties_set(props, PW_KEY_REMOTE_NAME, server_name);
-
-	if ((err = pw_thread_loop_start(pw->main_loop)) < 0)
-		goto error;
 
 	pw_thread_loop_lock(pw->main_loop);
-	pw->core = pw_context_connect(pw->context, props, 0);
-	props = NULL;
-	if (pw->core == NULL) {
-		err = -errno;
-		pw_thread_loop_unlock(pw->main_loop);
-		goto error;
-	}
 	pw_core_add_listener(pw->core, &pw->core_listener, &core_events, pw);
 	pw_thread_loop_unlock(pw->main_loop);
 
@@ -1084,7 +1270,6 @@ static int snd_pcm_pipewire_open(snd_pcm_t **pcmp, const char *name,
 	return 0;
 
 error:
-	pw_properties_free(props);
 	snd_pcm_pipewire_free(pw);
 	return err;
 }
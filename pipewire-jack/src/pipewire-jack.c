@@ -27,7 +27,6 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <sys/mman.h>
-#include <regex.h>
 #include <math.h>
 
 #include <jack/jack.h>
@@ -52,6 +51,11 @@
 #include "pipewire/extensions/client-node.h"
 #include "pipewire/extensions/metadata.h"
 #include "pipewire-jack-extensions.h"
+#include "port-pattern.h"
+
+#if defined(HAVE_AUDIOMIXER)
+#include "../../spa/plugins/audiomixer/mix-ops.h"
+#endif
 
 #define JACK_DEFAULT_VIDEO_TYPE	"32 bit float RGBA video"
 
@@ -68,6 +72,7 @@
 #define JACK_PORT_TYPE_SIZE             32
 #define CONNECTION_NUM_FOR_PORT		1024
 #define MONITOR_EXT			" Monitor"
+#define MAX_SPIN_MISSES			4
 
 #define MAX_BUFFER_FRAMES		8192
 
@@ -105,10 +110,6 @@ static bool mlock_warned = false;
 
 #define OBJECT_CHUNK	8
 
-typedef void (*mix2_func) (float *dst, float *src1, float *src2, int n_samples);
-
-static mix2_func mix2;
-
 struct object {
 	struct spa_list link;
 
@@ -147,6 +148,7 @@ struct object {
 			bool is_monitor;
 			struct object *node;
 			struct spa_latency_info latency[2];
+			struct spa_list hash_link;
 		} port;
 	};
 	struct pw_proxy *proxy;
@@ -228,6 +230,10 @@ struct port {
 	unsigned int empty_out:1;
 	unsigned int zeroed:1;
 
+	uint64_t mix_cycle;		/* cycle of the cached input mix */
+	uint32_t mix_frames;
+	void *mix_ptr;
+
 	float *emptyptr;
 	float empty[MAX_BUFFER_FRAMES + MAX_ALIGN];
 
@@ -242,6 +248,7 @@ struct link {
 	struct pw_memmap *mem;
 	struct pw_node_activation *activation;
 	int signalfd;
+	unsigned int wakeup:1;
 };
 
 struct context {
@@ -256,6 +263,7 @@ struct context {
 	struct spa_list ports;
 	struct spa_list nodes;
 	struct spa_list links;
+	struct spa_list port_hash[PORT_HASH_SIZE];	/* ports by name */
 };
 
 #define GET_DIRECTION(f)	((f) & JackPortIsInput ? SPA_DIRECTION_INPUT : SPA_DIRECTION_OUTPUT)
@@ -303,6 +311,7 @@ struct client {
 
 	uint32_t node_id;
 	struct spa_source *socket_source;
+	struct spa_source *spin_timer;
 
 	JackThreadCallback thread_callback;
 	void *thread_arg;
@@ -360,6 +369,11 @@ struct client {
 	struct pw_memmap *mem;
 	struct pw_node_activation *activation;
 	uint32_t xrun_count;
+	uint64_t cycle;
+
+#if defined(HAVE_AUDIOMIXER)
+	struct mix_ops mix_ops;
+#endif
 
 	struct {
 		struct spa_io_position *position;
@@ -383,8 +397,11 @@ struct client {
 	unsigned int short_name:1;
 	unsigned int filter_name:1;
 	unsigned int freewheeling:1;
+	unsigned int activation_wakeup:1;
 	int self_connect_mode;
 	int rt_max;
+	uint64_t spin_nsec;
+	uint32_t spin_misses;
 
 	jack_position_t jack_position;
 	jack_transport_state_t jack_state;
@@ -418,6 +435,8 @@ static struct object * alloc_object(struct client *c, int type)
 	spa_list_remove(&o->link);
 	o->client = c;
 	o->type = type;
+	if (type == INTERFACE_Port)
+		spa_list_init(&o->port.hash_link);
 
 	return o;
 }
@@ -426,6 +445,28 @@ static void unlink_object(struct client *c, struct object *o)
 {
 	pthread_mutex_lock(&c->context.lock);
 	spa_list_remove(&o->link);
+	if (o->type == INTERFACE_Port)
+		spa_list_remove(&o->port.hash_link);
+	pthread_mutex_unlock(&c->context.lock);
+}
+
+static void set_port_name(struct client *c, struct object *o, const char *fmt, ...)
+	SPA_PRINTF_FUNC(3, 4);
+
+/* port names are only changed with this function so that the name
+ * index stays in sync */
+static void set_port_name(struct client *c, struct object *o, const char *fmt, ...)
+{
+	va_list args;
+
+	pthread_mutex_lock(&c->context.lock);
+	va_start(args, fmt);
+	vsnprintf(o->port.name, sizeof(o->port.name), fmt, args);
+	va_end(args);
+
+	spa_list_remove(&o->port.hash_link);
+	spa_list_append(&c->context.port_hash[port_name_hash(o->port.name)],
+			&o->port.hash_link);
 	pthread_mutex_unlock(&c->context.lock);
 }
 
@@ -552,6 +593,7 @@ static struct port * alloc_port(struct client *c, enum spa_direction direction)
 
 	p->valid = true;
 	p->zeroed = false;
+	p->mix_ptr = NULL;
 	p->client = c;
 	p->object = o;
 	spa_list_init(&p->mix);
@@ -613,6 +655,11 @@ static struct object *find_port(struct client *c, const char *name)
 {
 	struct object *o;
 
+	spa_list_for_each(o, &c->context.port_hash[port_name_hash(name)], port.hash_link) {
+		if (spa_streq(o->port.name, name))
+			return o;
+	}
+	/* aliases and system names are not indexed */
 	spa_list_for_each(o, &c->context.ports, link) {
 		if (spa_streq(o->port.name, name) ||
 		    spa_streq(o->port.alias1, name) ||
@@ -667,42 +714,23 @@ static struct buffer *dequeue_buffer(struct mix *mix)
 	return b;
 }
 
-#if defined (__SSE__)
-#include <xmmintrin.h>
-static void mix2_sse(float *dst, float *src1, float *src2, int n_samples)
+#if !defined(HAVE_AUDIOMIXER)
+static void mix_c(float *dst, const void *src[], uint32_t n_src, uint32_t n_samples)
 {
-	int n, unrolled;
-	__m128 in[2];
-
-	if (SPA_IS_ALIGNED(src1, 16) &&
-	    SPA_IS_ALIGNED(src2, 16) &&
-	    SPA_IS_ALIGNED(dst, 16))
-		unrolled = n_samples / 4;
-	else
-		unrolled = 0;
+	uint32_t i, n;
+	const float *s;
 
-	for (n = 0; unrolled--; n += 4) {
-		in[0] = _mm_load_ps(&src1[n]),
-		in[1] = _mm_load_ps(&src2[n]),
-		in[0] = _mm_add_ps(in[0], in[1]);
-		_mm_store_ps(&dst[n], in[0]);
-	}
-	for (; n < n_samples; n++) {
-		in[0] = _mm_load_ss(&src1[n]),
-		in[1] = _mm_load_ss(&src2[n]),
-		in[0] = _mm_add_ss(in[0], in[1]);
-		_mm_store_ss(&dst[n], in[0]);
+	s = src[0];
+	for (n = 0; n < n_samples; n++)
+		dst[n] = s[n];
+	for (i = 1; i < n_src; i++) {
+		s = src[i];
+		for (n = 0; n < n_samples; n++)
+			dst[n] += s[n];
 	}
 }
 #endif
 
-static void mix2_c(float *dst, float *src1, float *src2, int n_samples)
-{
-	int i;
-	for (i = 0; i < n_samples; i++)
-		dst[i] = src1[i] + src2[i];
-}
-
 SPA_EXPORT
 void jack_get_version(int *major_ptr, int *minor_ptr, int *micro_ptr, int *proto_ptr)
 {
@@ -850,6 +878,10 @@ do_remove_sources(struct spa_loop *loop,
 		pw_loop_destroy_source(c->loop->loop, c->socket_source);
 		c->socket_source = NULL;
 	}
+	if (c->spin_timer) {
+		pw_loop_destroy_source(c->loop->loop, c->spin_timer);
+		c->spin_timer = NULL;
+	}
 	return 0;
 }
 
@@ -1173,17 +1205,113 @@ static inline void check_sample_rate(struct client *c, struct spa_io_position *p
 	}
 }
 
-static inline uint32_t cycle_run(struct client *c)
+static inline void spin_pause(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+/* Get the time the next cycle is expected, returns false when we should
+ * not spin for it */
+static inline bool cycle_spin_expected(struct client *c, uint64_t *expected)
 {
-	uint64_t cmd;
+	struct pw_node_activation *activation = c->activation;
+	struct timespec ts;
+	uint64_t now, period;
+
+	if (SPA_LIKELY(c->spin_nsec == 0) || !c->activation_wakeup ||
+	    c->buffer_frames == (uint32_t)-1 || c->sample_rate == (uint32_t)-1 ||
+	    c->sample_rate == 0)
+		return false;
+
+	/* back off when the wakeups are not where we expect them, the
+	 * graph might be stopped or too irregular */
+	if (c->spin_misses >= MAX_SPIN_MISSES && (c->cycle & 127) != 0)
+		return false;
+
+	period = (uint64_t)c->buffer_frames * SPA_NSEC_PER_SEC / c->sample_rate;
+	*expected = activation->awake_time + period;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	now = SPA_TIMESPEC_TO_NSEC(&ts);
+	if (now > *expected + c->spin_nsec || *expected > now + period)
+		return false;
+
+	return true;
+}
+
+/* Spin on the activation until end instead of waiting on the eventfd.
+ * Nodes that wake us up while spinning skip the eventfd write, which saves
+ * the syscalls and the poll round trip. Returns true when woken up this
+ * way. */
+static inline bool cycle_spin_wait(struct client *c, uint64_t end)
+{
+	struct pw_node_activation *activation = c->activation;
+	struct timespec ts;
+	uint64_t now;
+	uint32_t i;
+
+	ATOMIC_STORE(activation->wakeup, PW_NODE_ACTIVATION_WAKEUP_SPIN);
+	do {
+		for (i = 0; i < 64; i++) {
+			if (ATOMIC_LOAD(activation->wakeup) == PW_NODE_ACTIVATION_WAKEUP_WOKEN)
+				goto woken;
+			/* triggered before we started spinning, the eventfd
+			 * was signaled */
+			if (ATOMIC_LOAD(activation->status) == PW_NODE_ACTIVATION_TRIGGERED)
+				goto done;
+			spin_pause();
+		}
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		now = SPA_TIMESPEC_TO_NSEC(&ts);
+	} while (now < end);
+
+	c->spin_misses++;
+done:
+	/* fails when we were woken up just now */
+	if (ATOMIC_CAS(activation->wakeup, PW_NODE_ACTIVATION_WAKEUP_SPIN,
+				PW_NODE_ACTIVATION_WAKEUP_IDLE))
+		return false;
+woken:
+	ATOMIC_STORE(activation->wakeup, PW_NODE_ACTIVATION_WAKEUP_IDLE);
+	c->spin_misses = 0;
+	return true;
+}
+
+/* Sleep until just before the next cycle is expected and then spin. This
+ * blocks the thread, it is used from jack_cycle_wait(), where the thread
+ * belongs to the client. */
+static inline bool cycle_spin(struct client *c)
+{
+	struct timespec ts;
+	uint64_t expected, start;
+
+	if (!cycle_spin_expected(c, &expected))
+		return false;
+
+	start = expected - c->spin_nsec;
+	ts.tv_sec = start / SPA_NSEC_PER_SEC;
+	ts.tv_nsec = start % SPA_NSEC_PER_SEC;
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+
+	return cycle_spin_wait(c, expected + c->spin_nsec);
+}
+
+static inline uint32_t cycle_run(struct client *c, bool woken)
+{
+	uint64_t cmd = 1;
 	struct timespec ts;
 	int fd = c->socket_source->fd;
 	struct spa_io_position *pos = c->rt.position;
 	struct pw_node_activation *activation = c->activation;
 	struct pw_node_activation *driver = c->rt.driver_activation;
 
-	/* this is blocking if nothing ready */
-	while (true) {
+	/* this is blocking if nothing ready, when we were woken up while
+	 * spinning, nothing was written to the eventfd */
+	while (!woken) {
 		if (SPA_UNLIKELY(read(fd, &cmd, sizeof(cmd)) != sizeof(cmd))) {
 			if (errno == EINTR)
 				continue;
@@ -1196,6 +1324,8 @@ static inline uint32_t cycle_run(struct client *c)
 	if (SPA_UNLIKELY(cmd > 1))
 		pw_log_warn(NAME" %p: missed %"PRIu64" wakeups", c, cmd - 1);
 
+	c->cycle++;
+
 	clock_gettime(CLOCK_MONOTONIC, &ts);
 	activation->status = PW_NODE_ACTIVATION_AWAKE;
 	activation->awake_time = SPA_TIMESPEC_TO_NSEC(&ts);
@@ -1238,12 +1368,15 @@ static inline uint32_t cycle_wait(struct client *c)
 {
 	int res;
 
+	if (cycle_spin(c))
+		return cycle_run(c, true);
+
 	res = pw_data_loop_wait(c->loop, -1);
 	if (SPA_UNLIKELY(res <= 0)) {
 		pw_log_warn(NAME" %p: wait error %m", c);
 		return 0;
 	}
-	return cycle_run(c);
+	return cycle_run(c, false);
 }
 
 static inline void signal_sync(struct client *c)
@@ -1278,6 +1411,9 @@ static inline void signal_sync(struct client *c)
 
 			pw_log_trace_fp(NAME" %p: signal %p %p", c, l, state);
 
+			if (l->wakeup && pw_node_activation_wakeup(l->activation))
+				continue;
+
 			if (SPA_UNLIKELY(write(l->signalfd, &cmd, sizeof(cmd)) != sizeof(cmd)))
 				pw_log_warn(NAME" %p: write failed %m", c);
 		}
@@ -1310,6 +1446,51 @@ static inline void cycle_signal(struct client *c, int status)
 	signal_sync(c);
 }
 
+static inline void cycle_process(struct client *c, bool woken)
+{
+	uint32_t buffer_frames;
+	int status = 0;
+
+	buffer_frames = cycle_run(c, woken);
+
+	status = do_rt_callback_res(c, process_callback, buffer_frames, c->process_arg);
+
+	cycle_signal(c, status);
+}
+
+/* The process callback runs from the data loop, which has to keep servicing
+ * its other sources. Instead of sleeping in the loop, a timer wakes it up
+ * just before the next cycle is expected and the spinning is done from
+ * there. */
+static inline void cycle_spin_schedule(struct client *c)
+{
+	struct timespec value;
+	uint64_t expected, start;
+
+	if (c->spin_timer == NULL || !cycle_spin_expected(c, &expected))
+		return;
+
+	start = expected - c->spin_nsec;
+	value.tv_sec = start / SPA_NSEC_PER_SEC;
+	value.tv_nsec = start % SPA_NSEC_PER_SEC;
+	pw_loop_update_timer(c->loop->loop, c->spin_timer, &value, NULL, true);
+}
+
+static void on_spin_timeout(void *data, uint64_t expirations)
+{
+	struct client *c = data;
+	uint64_t expected;
+
+	if (!c->started || c->thread_callback ||
+	    !cycle_spin_expected(c, &expected))
+		return;
+
+	if (cycle_spin_wait(c, expected + c->spin_nsec)) {
+		cycle_process(c, true);
+		cycle_spin_schedule(c);
+	}
+}
+
 static void
 on_rtsocket_condition(void *data, int fd, uint32_t mask)
 {
@@ -1326,14 +1507,8 @@ on_rtsocket_condition(void *data, int fd, uint32_t mask)
 			c->thread_callback(c->thread_arg);
 		}
 	} else if (SPA_LIKELY(mask & SPA_IO_IN)) {
-		uint32_t buffer_frames;
-		int status = 0;
-
-		buffer_frames = cycle_run(c);
-
-		status = do_rt_callback_res(c, process_callback, buffer_frames, c->process_arg);
-
-		cycle_signal(c, status);
+		cycle_process(c, false);
+		cycle_spin_schedule(c);
 	}
 }
 
@@ -1386,6 +1561,7 @@ static int client_node_transport(void *object,
 		return -errno;
 	}
 	c->activation = c->mem->ptr;
+	c->activation_wakeup = PW_NODE_ACTIVATION_HAS_WAKEUP(size);
 
 	pw_log_debug(NAME" %p: create client transport with fds %d %d for node %u",
 			c, readfd, writefd, c->node_id);
@@ -1395,6 +1571,8 @@ static int client_node_transport(void *object,
 					  readfd,
 					  SPA_IO_ERR | SPA_IO_HUP,
 					  true, on_rtsocket_condition, c);
+	if (c->spin_nsec > 0 && c->activation_wakeup)
+		c->spin_timer = pw_loop_add_timer(c->loop->loop, on_spin_timeout, c);
 
 	c->has_transport = true;
 	c->position = &c->activation->position;
@@ -2203,6 +2381,7 @@ static int client_node_set_activation(void *object,
 		link->mem = mm;
 		link->activation = ptr;
 		link->signalfd = signalfd;
+		link->wakeup = PW_NODE_ACTIVATION_HAS_WAKEUP(size);
 		spa_list_append(&c->links, &link->link);
 
 		pw_data_loop_invoke(c->loop,
@@ -2606,10 +2785,9 @@ static void registry_event_global(void *data, uint32_t id,
 
 		op = find_port(c, tmp);
 		if (op != NULL && op != o)
-			snprintf(o->port.name, sizeof(o->port.name), "%.*s-%d",
-					(int)(sizeof(tmp)-11), tmp, id);
+			set_port_name(c, o, "%.*s-%d", (int)(sizeof(tmp)-11), tmp, id);
 		else
-			snprintf(o->port.name, sizeof(o->port.name), "%s", tmp);
+			set_port_name(c, o, "%s", tmp);
 
 		pw_log_debug(NAME" %p: add port %d name:%s %d", c, id,
 				o->port.name, type_id);
@@ -2792,10 +2970,13 @@ jack_client_t * jack_client_open (const char *client_name,
                                   jack_status_t *status, ...)
 {
 	struct client *client;
+#if defined(HAVE_AUDIOMIXER)
 	const struct spa_support *support;
 	uint32_t n_support;
-	const char *str;
 	struct spa_cpu *cpu_iface;
+#endif
+	uint32_t i;
+	const char *str;
 	va_list ap;
 
         if (getenv("PIPEWIRE_NOJACK") != NULL ||
@@ -2871,6 +3052,8 @@ jack_client_t * jack_client_open (const char *client_name,
 	client->rt_max = DEFAULT_RT_MAX;
 	if ((str = pw_properties_get(client->props, "rt.prio")) != NULL)
 		client->rt_max = atoi(str);
+	if ((str = pw_properties_get(client->props, "jack.wakeup-spin-usec")) != NULL)
+		client->spin_nsec = atoi(str) * SPA_NSEC_PER_USEC;
 
 	spa_list_init(&client->context.free_objects);
 	pthread_mutex_init(&client->context.lock, NULL);
@@ -2878,18 +3061,20 @@ jack_client_t * jack_client_open (const char *client_name,
 	spa_list_init(&client->context.nodes);
 	spa_list_init(&client->context.ports);
 	spa_list_init(&client->context.links);
+	for (i = 0; i < PORT_HASH_SIZE; i++)
+		spa_list_init(&client->context.port_hash[i]);
 
+#if defined(HAVE_AUDIOMIXER)
 	support = pw_context_get_support(client->context.context, &n_support);
 
-	mix2 = mix2_c;
 	cpu_iface = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_CPU);
-	if (cpu_iface) {
-#if defined (__SSE__)
-		uint32_t flags = spa_cpu_get_flags(cpu_iface);
-		if (flags & SPA_CPU_FLAG_SSE)
-			mix2 = mix2_sse;
+	client->mix_ops.fmt = SPA_AUDIO_FORMAT_F32P;
+	client->mix_ops.n_channels = 1;
+	client->mix_ops.cpu_flags = cpu_iface ? spa_cpu_get_flags(cpu_iface) : 0;
+	/* there is always a C fallback for F32P */
+	mix_ops_init(&client->mix_ops);
 #endif
-	}
+
 	client->loop = client->context.context->data_loop_impl;
 
 	spa_list_init(&client->links);
@@ -3063,6 +3248,9 @@ int jack_client_close (jack_client_t *client)
 	pthread_mutex_destroy(&c->context.lock);
 	pthread_mutex_destroy(&c->rt_lock);
 	pw_properties_free(c->props);
+#if defined(HAVE_AUDIOMIXER)
+	mix_ops_free(&c->mix_ops);
+#endif
 	free(c);
 
 	return res;
@@ -3725,7 +3913,7 @@ jack_port_t * jack_port_register (jack_client_t *client,
 
 	o = p->object;
 	o->port.flags = flags;
-	snprintf(o->port.name, sizeof(o->port.name), "%s:%s", c->name, port_name);
+	set_port_name(c, o, "%s:%s", c->name, port_name);
 	o->port.type_id = type_id;
 
 	init_buffer(p);
@@ -3859,15 +4047,22 @@ done:
 
 static void *get_buffer_input_float(struct port *p, jack_nframes_t frames)
 {
+	struct client *c = p->client;
 	struct mix *mix;
 	struct buffer *b;
 	struct spa_io_buffers *io;
-	int layer = 0;
-	void *ptr = NULL;
+	const void *src[CONNECTION_NUM_FOR_PORT];
+	uint32_t n_src = 0;
+	void *ptr;
+
+	/* the input buffers are consumed by the first call, return the
+	 * same mix when the buffer is requested again in this cycle */
+	if (p->mix_ptr != NULL && p->mix_cycle == c->cycle && frames <= p->mix_frames)
+		return p->mix_ptr;
 
 	spa_list_for_each(mix, &p->mix, port_link) {
 		pw_log_trace_fp(NAME" %p: port %p mix %d.%d get buffer %d",
-				p->client, p, p->id, mix->id, frames);
+				c, p, p->id, mix->id, frames);
 		io = mix->io;
 		if (io == NULL ||
 		    io->status != SPA_STATUS_HAVE_DATA ||
@@ -3876,16 +4071,26 @@ static void *get_buffer_input_float(struct port *p, jack_nframes_t frames)
 
 		io->status = SPA_STATUS_NEED_DATA;
 		b = &mix->buffers[io->buffer_id];
-		if (layer++ == 0)
-			ptr = b->datas[0].data;
-		else  {
-			mix2(p->emptyptr, ptr, b->datas[0].data, frames);
-			ptr = p->emptyptr;
-			p->zeroed = false;
-		}
+		if (n_src < CONNECTION_NUM_FOR_PORT)
+			src[n_src++] = b->datas[0].data;
 	}
-	if (ptr == NULL)
+	if (n_src == 0) {
 		ptr = init_buffer(p);
+	} else if (n_src == 1) {
+		ptr = (void*)src[0];
+	} else {
+		ptr = p->emptyptr;
+#if defined(HAVE_AUDIOMIXER)
+		mix_ops_process(&c->mix_ops, ptr, src, n_src, frames);
+#else
+		mix_c(ptr, src, n_src, frames);
+#endif
+		p->zeroed = false;
+	}
+	p->mix_cycle = c->cycle;
+	p->mix_frames = frames;
+	p->mix_ptr = ptr;
+
 	return ptr;
 }
 
@@ -4188,7 +4393,7 @@ int jack_port_rename (jack_client_t* client, jack_port_t *port, const char *port
 
 
 	pw_properties_set(p->props, PW_KEY_PORT_NAME, port_name);
-	snprintf(o->port.name, sizeof(o->port.name), "%s:%s", c->name, port_name);
+	set_port_name(c, o, "%s:%s", c->name, port_name);
 
 	p->info.change_mask |= SPA_PORT_CHANGE_MASK_PROPS;
 	p->info.props = &p->props->dict;
@@ -4809,6 +5014,32 @@ static int port_compare_func(const void *v1, const void *v2)
 	return res;
 }
 
+static bool match_port(struct client *c, struct object *o,
+		const struct port_pattern *port_pat, bool check_system,
+		uint32_t type_mask, unsigned long flags, uint32_t id)
+{
+	pw_log_debug(NAME" %p: check port type:%d flags:%08lx name:\"%s\"", c,
+			o->port.type_id, o->port.flags, o->port.name);
+
+	if (o->port.type_id > TYPE_ID_VIDEO)
+		return false;
+	if (!SPA_FLAG_IS_SET(type_mask, 1u << o->port.type_id))
+		return false;
+	if (!SPA_FLAG_IS_SET(o->port.flags, flags))
+		return false;
+	if (id != SPA_ID_INVALID && o->port.node_id != id)
+		return false;
+
+	if (!port_pattern_match(port_pat, o->port.name) &&
+	    !(check_system && is_port_default(c, o) &&
+	      port_pattern_match(port_pat, o->port.system)))
+		return false;
+
+	pw_log_debug(NAME" %p: port \"%s\" prio:%d matches", c,
+			o->port.name, o->port.priority);
+	return true;
+}
+
 SPA_EXPORT
 const char ** jack_get_ports (jack_client_t *client,
                               const char *port_name_pattern,
@@ -4820,8 +5051,9 @@ const char ** jack_get_ports (jack_client_t *client,
 	struct object *o;
 	struct object *tmp[JACK_PORT_MAX];
 	const char *str;
-	uint32_t i, count, id;
-	regex_t port_regex, type_regex;
+	uint32_t i, count, id, type_mask = 0;
+	struct port_pattern port_pat, type_pat;
+	bool by_name;
 
 	spa_return_val_if_fail(c != NULL, NULL);
 
@@ -4830,45 +5062,46 @@ const char ** jack_get_ports (jack_client_t *client,
 	else
 		id = SPA_ID_INVALID;
 
-	if (port_name_pattern && port_name_pattern[0])
-		regcomp(&port_regex, port_name_pattern, REG_EXTENDED | REG_NOSUB);
-	if (type_name_pattern && type_name_pattern[0])
-		regcomp(&type_regex, type_name_pattern, REG_EXTENDED | REG_NOSUB);
+	if (port_pattern_init(&port_pat, port_name_pattern) < 0 ||
+	    port_pattern_init(&type_pat, type_name_pattern) < 0) {
+		pw_log_warn(NAME" %p: invalid pattern name:\"%s\" type:\"%s\"", c,
+				port_name_pattern, type_name_pattern);
+		port_pattern_clear(&port_pat);
+		return NULL;
+	}
+
+	/* there are only a few types, match them once instead of for each port */
+	for (i = 0; i <= TYPE_ID_VIDEO; i++) {
+		if (port_pattern_match(&type_pat, type_to_string(i)))
+			type_mask |= 1u << i;
+	}
+	port_pattern_clear(&type_pat);
+
+	/* an exact name can be looked up in the name index, unless it could
+	 * match the system name of a default port */
+	by_name = port_pat.type == PORT_PATTERN_EXACT &&
+		strncmp(port_pat.literal, "system:", 7) != 0;
 
 	pw_log_debug(NAME" %p: ports id:%d name:\"%s\" type:\"%s\" flags:%08lx", c, id,
 			port_name_pattern, type_name_pattern, flags);
 
 	pthread_mutex_lock(&c->context.lock);
 	count = 0;
-	spa_list_for_each(o, &c->context.ports, link) {
-		pw_log_debug(NAME" %p: check port type:%d flags:%08lx name:\"%s\"", c,
-				o->port.type_id, o->port.flags, o->port.name);
-		if (count == JACK_PORT_MAX)
-			break;
-		if (o->port.type_id > TYPE_ID_VIDEO)
-			continue;
-		if (!SPA_FLAG_IS_SET(o->port.flags, flags))
-			continue;
-		if (id != SPA_ID_INVALID && o->port.node_id != id)
-			continue;
-
-		if (port_name_pattern && port_name_pattern[0]) {
-			bool match;
-			match = regexec(&port_regex, o->port.name, 0, NULL, 0) == 0;
-			if (!match && is_port_default(c, o))
-				match = regexec(&port_regex, o->port.system, 0, NULL, 0) == 0;
-			if (!match)
-				continue;
+	if (by_name) {
+		uint32_t hash = port_name_hash(port_pat.literal);
+		spa_list_for_each(o, &c->context.port_hash[hash], port.hash_link) {
+			if (count == JACK_PORT_MAX)
+				break;
+			if (match_port(c, o, &port_pat, false, type_mask, flags, id))
+				tmp[count++] = o;
 		}
-		if (type_name_pattern && type_name_pattern[0]) {
-			if (regexec(&type_regex, type_to_string(o->port.type_id),
-						0, NULL, 0) == REG_NOMATCH)
-				continue;
+	} else {
+		spa_list_for_each(o, &c->context.ports, link) {
+			if (count == JACK_PORT_MAX)
+				break;
+			if (match_port(c, o, &port_pat, true, type_mask, flags, id))
+				tmp[count++] = o;
 		}
-
-		pw_log_debug(NAME" %p: port \"%s\" prio:%d matches (%d)",
-				c, o->port.name, o->port.priority, count);
-		tmp[count++] = o;
 	}
 	pthread_mutex_unlock(&c->context.lock);
 
@@ -4883,10 +5116,7 @@ const char ** jack_get_ports (jack_client_t *client,
 		res = NULL;
 	}
 
-	if (port_name_pattern && port_name_pattern[0])
-		regfree(&port_regex);
-	if (type_name_pattern && type_name_pattern[0])
-		regfree(&type_regex);
+	port_pattern_clear(&port_pat);
 
 	return res;
 }
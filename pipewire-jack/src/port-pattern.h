@@ -0,0 +1,165 @@
+/* PipeWire
+ *
+ * Copyright © 2021 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef PIPEWIRE_JACK_PORT_PATTERN_H
+#define PIPEWIRE_JACK_PORT_PATTERN_H
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <regex.h>
+
+/* Matching of the extended regular expressions passed to jack_get_ports().
+ * Most clients pass plain names, optionally anchored with ^ and $, so those
+ * are matched with string compares and only real expressions go to regex. */
+
+#define PORT_PATTERN_MAX	512
+
+enum port_pattern_type {
+	PORT_PATTERN_ANY,		/* NULL or empty, matches everything */
+	PORT_PATTERN_EXACT,		/* ^literal$ */
+	PORT_PATTERN_PREFIX,		/* ^literal */
+	PORT_PATTERN_SUFFIX,		/* literal$ */
+	PORT_PATTERN_SUBSTRING,		/* literal */
+	PORT_PATTERN_REGEX,
+};
+
+struct port_pattern {
+	enum port_pattern_type type;
+	size_t len;
+	char literal[PORT_PATTERN_MAX];
+	regex_t regex;
+};
+
+static inline bool port_pattern_is_special(char c)
+{
+	return strchr(".[]()*+?{}|^$\\", c) != NULL;
+}
+
+/* Parse pattern into a literal with anchors, returns false when the
+ * pattern needs the regex engine */
+static inline bool port_pattern_parse_literal(struct port_pattern *p, const char *pattern)
+{
+	bool start = false, end = false;
+	const char *s = pattern;
+	size_t len = 0;
+
+	if (*s == '^') {
+		start = true;
+		s++;
+	}
+	while (*s) {
+		char c = *s++;
+
+		if (c == '\\') {
+			/* only escaped special chars are literals, others
+			 * like \w or \< are GNU extensions */
+			if (*s == '\0' || !port_pattern_is_special(*s))
+				return false;
+			c = *s++;
+		} else if (c == '$' && *s == '\0') {
+			end = true;
+			break;
+		} else if (port_pattern_is_special(c)) {
+			return false;
+		}
+		if (len + 1 >= sizeof(p->literal))
+			return false;
+		p->literal[len++] = c;
+	}
+	p->literal[len] = '\0';
+	p->len = len;
+
+	if (start && end)
+		p->type = PORT_PATTERN_EXACT;
+	else if (start)
+		p->type = PORT_PATTERN_PREFIX;
+	else if (end)
+		p->type = PORT_PATTERN_SUFFIX;
+	else
+		p->type = PORT_PATTERN_SUBSTRING;
+
+	return true;
+}
+
+static inline int port_pattern_init(struct port_pattern *p, const char *pattern)
+{
+	if (pattern == NULL || pattern[0] == '\0') {
+		p->type = PORT_PATTERN_ANY;
+		return 0;
+	}
+	if (port_pattern_parse_literal(p, pattern))
+		return 0;
+
+	p->type = PORT_PATTERN_REGEX;
+	if (regcomp(&p->regex, pattern, REG_EXTENDED | REG_NOSUB) != 0) {
+		p->type = PORT_PATTERN_ANY;
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static inline bool port_pattern_match(const struct port_pattern *p, const char *str)
+{
+	size_t len;
+
+	switch (p->type) {
+	case PORT_PATTERN_ANY:
+		return true;
+	case PORT_PATTERN_EXACT:
+		return strcmp(str, p->literal) == 0;
+	case PORT_PATTERN_PREFIX:
+		return strncmp(str, p->literal, p->len) == 0;
+	case PORT_PATTERN_SUFFIX:
+		len = strlen(str);
+		return len >= p->len && strcmp(str + len - p->len, p->literal) == 0;
+	case PORT_PATTERN_SUBSTRING:
+		return strstr(str, p->literal) != NULL;
+	case PORT_PATTERN_REGEX:
+		return regexec(&p->regex, str, 0, NULL, 0) == 0;
+	}
+	return false;
+}
+
+static inline void port_pattern_clear(struct port_pattern *p)
+{
+	if (p->type == PORT_PATTERN_REGEX)
+		regfree(&p->regex);
+	p->type = PORT_PATTERN_ANY;
+}
+
+/* Ports are indexed by the hash of their name, an exact pattern only has
+ * to look at the ports in the bucket of its literal */
+#define PORT_HASH_SIZE	1024
+
+static inline uint32_t port_name_hash(const char *name)
+{
+	uint32_t hash = 5381;
+	while (*name)
+		hash = (hash << 5) + hash + (uint8_t)*name++;
+	return hash & (PORT_HASH_SIZE - 1);
+}
+
+#endif /* PIPEWIRE_JACK_PORT_PATTERN_H */
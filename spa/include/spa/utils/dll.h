@@ -1,4 +1,4 @@
-/* Simple DLL
+/* Simple Plugin API
  *
  * Copyright © 2019 Wim Taymans
  *
@@ -29,7 +29,13 @@
 extern "C" {
 #endif
 
+/**
+ * \addtogroup spa_utils
+ * \{
+ */
+
 #include <stddef.h>
+#include <stdint.h>
 #include <math.h>
 
 #define SPA_DLL_BW_MAX		0.128
@@ -64,6 +70,10 @@ static inline double spa_dll_update(struct spa_dll *dll, double err)
 	return 1.0 - (dll->z2 + dll->z3);
 }
 
+/**
+ * \}
+ */
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -26,6 +26,10 @@
 #include "alsa-mixer.h"
 #include "alsa-ucm.h"
 
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
 #include <spa/utils/string.h>
 
 int _acp_log_level = 1;
@@ -1470,50 +1474,357 @@ static const char *acp_dict_lookup(const struct acp_dict *dict, const char *key)
 	return NULL;
 }
 
-struct acp_card *acp_card_new(uint32_t index, const struct acp_dict *props)
+/* The probe cache remembers the result of probing a card: the supported
+ * profiles and the hw device, channel map and properties of their mappings.
+ * It is keyed by the card id and a fingerprint of the driver, the mixer
+ * controls, the probe options and the profile set. When the fingerprint
+ * still matches, the profile set is restored without opening any PCM and
+ * only the mixer paths are probed. UCM profiles are probed while the
+ * profile set is created and are not cached. */
+#define PROBE_CACHE_VERSION	2
+#define PROBE_CACHE_FP_MAX	512
+
+struct probe_info {
+	uint32_t index;
+	const char *profile_set;
+	bool use_ucm;
+	bool ignore_dB;
+	bool probe_cache;
+	bool probe_pcm;
+	char card_id[64];
+	char fp[PROBE_CACHE_FP_MAX];
+};
+
+static uint32_t probe_cache_hash(uint32_t hash, const char *str)
 {
-	pa_card *impl;
-	struct acp_card *card;
-	const char *s, *profile_set = NULL, *profile = NULL;
-	char device_id[16];
-	bool ignore_dB = false;
-	uint32_t profile_index;
+	/* FNV-1a */
+	while (*str)
+		hash = (hash ^ (uint8_t)*str++) * 16777619u;
+	return hash;
+}
+
+static int probe_cache_ensure_dir(char *path)
+{
+	char *p;
+
+	for (p = strchr(path + 1, '/'); ; p = strchr(p + 1, '/')) {
+		if (p)
+			*p = '\0';
+		if (mkdir(path, 0700) < 0 && errno != EEXIST)
+			return -errno;
+		if (p == NULL)
+			break;
+		*p = '/';
+	}
+	return 0;
+}
+
+static int probe_cache_path(char *path, size_t len, const char *card_id)
+{
+	const char *dir;
 	int res;
 
-	impl = calloc(1, sizeof(*impl));
-	if (impl == NULL)
-		return NULL;
+	if ((dir = getenv("XDG_CACHE_HOME")) != NULL && dir[0] == '/')
+		res = snprintf(path, len, "%s/pipewire/acp", dir);
+	else if ((dir = getenv("HOME")) != NULL && dir[0] == '/')
+		res = snprintf(path, len, "%s/.cache/pipewire/acp", dir);
+	else
+		return -ENOENT;
+	if (res < 0 || (size_t)res >= len)
+		return -ENAMETOOLONG;
 
-	pa_alsa_refcnt_inc();
+	if ((res = probe_cache_ensure_dir(path)) < 0)
+		return res;
 
-	snprintf(device_id, sizeof(device_id), "%d", index);
+	if (strlen(path) + strlen(card_id) + 2 > len)
+		return -ENAMETOOLONG;
+	strcat(path, "/");
+	strcat(path, card_id);
+	return 0;
+}
 
-	impl->proplist = pa_proplist_new_dict(props);
+/* Only uses the control device of the card, so this is safe before the
+ * device reservation is acquired. */
+static int probe_cache_fingerprint(struct probe_info *info)
+{
+	snd_ctl_t *ctl;
+	snd_ctl_card_info_t *cinfo;
+	snd_ctl_elem_list_t *list;
+	char name[16];
+	uint32_t i, n, hash = 2166136261u;
+	int res;
 
-	card = &impl->card;
-	card->index = index;
-	card->active_profile_index = ACP_INVALID_INDEX;
+	snprintf(name, sizeof(name), "hw:%u", info->index);
+	if ((res = snd_ctl_open(&ctl, name, 0)) < 0)
+		return res;
 
-	impl->use_ucm = true;
-	impl->auto_profile = true;
-	impl->auto_port = true;
+	snd_ctl_card_info_alloca(&cinfo);
+	if ((res = snd_ctl_card_info(ctl, cinfo)) < 0)
+		goto exit;
+
+	snd_ctl_elem_list_alloca(&list);
+	if ((res = snd_ctl_elem_list(ctl, list)) < 0)
+		goto exit;
+	n = snd_ctl_elem_list_get_count(list);
+	if ((res = snd_ctl_elem_list_alloc_space(list, n)) < 0)
+		goto exit;
+	if ((res = snd_ctl_elem_list(ctl, list)) < 0)
+		goto exit_free;
+	for (i = 0; i < snd_ctl_elem_list_get_used(list); i++)
+		hash = probe_cache_hash(hash, snd_ctl_elem_list_get_name(list, i));
+
+	snprintf(info->card_id, sizeof(info->card_id), "%s", snd_ctl_card_info_get_id(cinfo));
+	snprintf(info->fp, sizeof(info->fp), "%d;%s;%s;%s;%s;%s;%d;%d;%08x",
+			PROBE_CACHE_VERSION,
+			snd_ctl_card_info_get_driver(cinfo),
+			snd_ctl_card_info_get_mixername(cinfo),
+			snd_ctl_card_info_get_components(cinfo),
+			snd_ctl_card_info_get_longname(cinfo),
+			info->profile_set ? info->profile_set : "default",
+			info->use_ucm, info->ignore_dB,
+			hash);
+	res = 0;
+
+exit_free:
+	snd_ctl_elem_list_free_space(list);
+exit:
+	snd_ctl_close(ctl);
+	return res;
+}
+
+static char *probe_cache_strip(char *line)
+{
+	line[strcspn(line, "\n")] = '\0';
+	return line;
+}
+
+static bool probe_cache_valid(const char *str, const char *reject)
+{
+	return str && str[0] != '\0' && strpbrk(str, reject) == NULL;
+}
+
+/* Checks the entries of a cache file and, with apply, stores them in the
+ * profile set. Any entry that does not match the profile set makes the
+ * whole cache stale. */
+static int probe_cache_parse(pa_card *impl, FILE *f, bool apply)
+{
+	pa_alsa_profile_set *ps = impl->profile_set;
+	char line[1024];
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		char *type, *name, *arg, *val, *state = NULL;
+		pa_alsa_profile *p;
+		pa_alsa_mapping *m;
+
+		type = strtok_r(probe_cache_strip(line), " ", &state);
+		name = strtok_r(NULL, " ", &state);
+		arg = strtok_r(NULL, "", &state);
+		if (type == NULL || name == NULL)
+			return -EINVAL;
+
+		if (spa_streq(type, "profile")) {
+			if ((p = pa_hashmap_get(ps->profiles, name)) == NULL)
+				return -ENOENT;
+			if (apply)
+				p->supported = true;
+			continue;
+		}
+
+		if ((m = pa_hashmap_get(ps->mappings, name)) == NULL)
+			return -ENOENT;
+		if (arg == NULL)
+			return -EINVAL;
+
+		if (spa_streq(type, "mapping")) {
+			pa_channel_map map;
+			char *end;
+			long index;
+
+			index = strtol(arg, &end, 10);
+			if (end == arg || *end != ' ' ||
+			    pa_channel_map_parse(&map, end + 1) == NULL)
+				return -EINVAL;
+			if (apply) {
+				m->hw_device_index = index;
+				m->channel_map = map;
+			}
+		} else if (spa_streq(type, "output") || spa_streq(type, "input")) {
+			if ((val = strchr(arg, '=')) == NULL)
+				return -EINVAL;
+			*val++ = '\0';
+			if (apply)
+				pa_proplist_sets(type[0] == 'o' ?
+						m->output_proplist : m->input_proplist,
+						arg, val);
+		} else {
+			return -EINVAL;
+		}
+	}
+	return 0;
+}
+
+static bool probe_cache_load(pa_card *impl, const char *path, const char *header)
+{
+	char line[1024];
+	FILE *f;
+	bool hit = false;
+
+	if ((f = fopen(path, "re")) == NULL)
+		return false;
+
+	if (fgets(line, sizeof(line), f) == NULL ||
+	    !spa_streq(probe_cache_strip(line), header) ||
+	    probe_cache_parse(impl, f, false) < 0) {
+		pa_log_info("probe cache %s is stale", path);
+		goto exit;
+	}
+	rewind(f);
+	if (fgets(line, sizeof(line), f) == NULL ||
+	    probe_cache_parse(impl, f, true) < 0)
+		goto exit;
+
+	pa_log_info("using probe cache %s", path);
+	hit = true;
+exit:
+	fclose(f);
+	return hit;
+}
+
+static int probe_cache_save_proplist(FILE *f, const char *type,
+		const char *mapping, pa_proplist *props)
+{
+	pa_proplist_item *item;
+
+	pa_array_for_each(item, &props->array) {
+		if (!probe_cache_valid(item->key, " =\n") ||
+		    !probe_cache_valid(item->value, "\n"))
+			return -EINVAL;
+		fprintf(f, "%s %s %s=%s\n", type, mapping, item->key, item->value);
+	}
+	return 0;
+}
+
+static void probe_cache_save(pa_card *impl, const char *path, const char *header)
+{
+	pa_alsa_profile_set *ps = impl->profile_set;
+	pa_alsa_profile *p;
+	pa_alsa_mapping *m;
+	char tmp[PATH_MAX], map[PA_CHANNEL_MAP_SNPRINT_MAX];
+	void *state;
+	FILE *f;
+	int res = 0;
+
+	/* Some PCMs were busy or nothing could be opened. Don't remember
+	 * that or we would hide those profiles until the hardware changes. */
+	if (ps->busy || pa_hashmap_isempty(ps->profiles)) {
+		pa_log_info("not writing probe cache %s, card is busy", path);
+		return;
+	}
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	if ((f = fopen(tmp, "we")) == NULL) {
+		pa_log_warn("can't write probe cache %s: %m", tmp);
+		return;
+	}
+	fprintf(f, "%s\n", header);
+	PA_HASHMAP_FOREACH(p, ps->profiles, state) {
+		if (!probe_cache_valid(p->name, " \n")) {
+			res = -EINVAL;
+			break;
+		}
+		fprintf(f, "profile %s\n", p->name);
+	}
+	PA_HASHMAP_FOREACH(m, ps->mappings, state) {
+		if (res < 0 || !probe_cache_valid(m->name, " \n")) {
+			res = -EINVAL;
+			break;
+		}
+		fprintf(f, "mapping %s %d %s\n", m->name, m->hw_device_index,
+				pa_channel_map_snprint(map, sizeof(map), &m->channel_map));
+		if ((res = probe_cache_save_proplist(f, "output", m->name, m->output_proplist)) < 0 ||
+		    (res = probe_cache_save_proplist(f, "input", m->name, m->input_proplist)) < 0)
+			break;
+	}
+
+	if (res < 0) {
+		pa_log_info("not writing probe cache %s, names can't be stored", path);
+		fclose(f);
+		unlink(tmp);
+	} else if (fclose(f) != 0 || rename(tmp, path) < 0) {
+		pa_log_warn("can't write probe cache %s: %m", path);
+		unlink(tmp);
+	}
+}
+
+static void probe_info_init(struct probe_info *info, uint32_t index,
+		const struct acp_dict *props)
+{
+	const char *s;
+	int res;
+
+	spa_zero(*info);
+	info->index = index;
+	info->use_ucm = true;
+	info->probe_cache = true;
+	info->probe_pcm = true;
 
 	if (props) {
 		if ((s = acp_dict_lookup(props, "api.alsa.use-ucm")) != NULL)
-			impl->use_ucm = spa_atob(s);
-		if ((s = acp_dict_lookup(props, "api.alsa.soft-mixer")) != NULL)
-			impl->soft_mixer = spa_atob(s);
+			info->use_ucm = spa_atob(s);
 		if ((s = acp_dict_lookup(props, "api.alsa.ignore-dB")) != NULL)
-			ignore_dB = spa_atob(s);
+			info->ignore_dB = spa_atob(s);
 		if ((s = acp_dict_lookup(props, "device.profile-set")) != NULL)
-			profile_set = s;
-		if ((s = acp_dict_lookup(props, "device.profile")) != NULL)
-			profile = s;
-		if ((s = acp_dict_lookup(props, "api.acp.auto-profile")) != NULL)
-			impl->auto_profile = spa_atob(s);
-		if ((s = acp_dict_lookup(props, "api.acp.auto-port")) != NULL)
-			impl->auto_port = spa_atob(s);
+			info->profile_set = s;
+		if ((s = acp_dict_lookup(props, "api.acp.probe-cache")) != NULL)
+			info->probe_cache = spa_atob(s);
+		if ((s = acp_dict_lookup(props, "api.acp.probe-pcm")) != NULL)
+			info->probe_pcm = spa_atob(s);
+	}
+
+	if ((res = probe_cache_fingerprint(info)) < 0) {
+		pa_log_info("can't get fingerprint of card %u: %s", index, snd_strerror(res));
+		info->fp[0] = '\0';
 	}
+}
+
+static pa_card *card_alloc(const struct probe_info *info)
+{
+	pa_card *impl;
+
+	impl = calloc(1, sizeof(*impl));
+	if (impl == NULL)
+		return NULL;
+
+	pa_alsa_refcnt_inc();
+
+	impl->card.index = info->index;
+	impl->use_ucm = info->use_ucm;
+	return impl;
+}
+
+static void card_free_probe(pa_card *impl)
+{
+	if (impl->ucm.mixers)
+		pa_hashmap_free(impl->ucm.mixers);
+	if (impl->profile_set)
+		pa_alsa_profile_set_free(impl->profile_set);
+	pa_alsa_ucm_free(&impl->ucm);
+	pa_alsa_refcnt_dec();
+	free(impl);
+}
+
+/* Returns -EBUSY when the card can only be probed by opening its PCMs and
+ * info->probe_pcm is not set. */
+static int card_probe(pa_card *impl, const struct probe_info *info)
+{
+	char device_id[16], header[PROBE_CACHE_FP_MAX + 16], path[PATH_MAX];
+	bool probe_cache = info->probe_cache && info->fp[0] != '\0';
+	pa_alsa_profile *p;
+	uint32_t hash = 2166136261u;
+	void *state;
+	int res;
+
+	snprintf(device_id, sizeof(device_id), "%d", impl->card.index);
 
 	impl->ucm.default_sample_spec.format = PA_SAMPLE_S16NE;
 	impl->ucm.default_sample_spec.rate = 44100;
@@ -1526,33 +1837,42 @@ struct acp_card *acp_card_new(uint32_t index, const struct acp_dict *props)
 	impl->ucm.mixers = pa_hashmap_new_full(pa_idxset_string_hash_func,
 			pa_idxset_string_compare_func,
 			pa_xfree, (pa_free_cb_t) pa_alsa_mixer_free);
-	impl->profiles = pa_hashmap_new_full(pa_idxset_string_hash_func,
-			pa_idxset_string_compare_func, NULL,
-			(pa_free_cb_t) profile_free);
-	impl->ports = pa_hashmap_new_full(pa_idxset_string_hash_func,
-			pa_idxset_string_compare_func, NULL,
-			(pa_free_cb_t) port_free);
-
-	snd_config_update_free_global();
 
-	res = impl->use_ucm ? pa_alsa_ucm_query_profiles(&impl->ucm, card->index) : -1;
-	if (res == -PA_ALSA_ERR_UCM_LINKED) {
-		res = -ENOENT;
-		goto error;
-	}
+	res = impl->use_ucm ? pa_alsa_ucm_query_profiles(&impl->ucm, impl->card.index) : -1;
+	if (res == -PA_ALSA_ERR_UCM_LINKED)
+		return -ENOENT;
 	if (res == 0) {
 		pa_log_info("Found UCM profiles");
+		if (!info->probe_pcm)
+			return -EBUSY;
 		impl->profile_set = pa_alsa_ucm_add_profile_set(&impl->ucm, &impl->ucm.default_channel_map);
 	} else {
 		impl->use_ucm = false;
-		impl->profile_set = pa_alsa_profile_set_new(profile_set, &impl->ucm.default_channel_map);
-	}
-	if (impl->profile_set == NULL) {
-		res = -ENOTSUP;
-		goto error;
+		impl->profile_set = pa_alsa_profile_set_new(info->profile_set, &impl->ucm.default_channel_map);
 	}
+	if (impl->profile_set == NULL)
+		return -ENOTSUP;
+
+	impl->profile_set->ignore_dB = info->ignore_dB;
+
+	if (impl->profile_set->probed)
+		return 0;
 
-	impl->profile_set->ignore_dB = ignore_dB;
+	if (probe_cache) {
+		PA_HASHMAP_FOREACH(p, impl->profile_set->profiles, state)
+			hash = probe_cache_hash(hash, p->name);
+		snprintf(header, sizeof(header), "%s;%08x", info->fp, hash);
+
+		if (probe_cache_path(path, sizeof(path), info->card_id) < 0)
+			probe_cache = false;
+		else if (probe_cache_load(impl, path, header)) {
+			pa_alsa_profile_set_probe_supported(impl->profile_set,
+					impl->ucm.mixers, impl->card.index);
+			return 0;
+		}
+	}
+	if (!info->probe_pcm)
+		return -EBUSY;
 
 	pa_alsa_profile_set_probe(impl->profile_set, impl->ucm.mixers,
 			device_id,
@@ -1560,6 +1880,98 @@ struct acp_card *acp_card_new(uint32_t index, const struct acp_dict *props)
 			impl->ucm.default_n_fragments,
 			impl->ucm.default_fragment_size_msec);
 
+	if (probe_cache)
+		probe_cache_save(impl, path, header);
+
+	return 0;
+}
+
+/* Cards probed by acp_card_probe() wait here until acp_card_new() takes
+ * them. */
+#define MAX_PROBED_CARDS	32
+
+static pthread_mutex_t probed_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct {
+	pa_card *impl;
+	char fp[PROBE_CACHE_FP_MAX];
+} probed_cards[MAX_PROBED_CARDS];
+
+static pa_card *probed_card_swap(uint32_t index, pa_card *impl, const char *fp, bool match)
+{
+	pa_card *old;
+
+	pthread_mutex_lock(&probed_lock);
+	old = probed_cards[index].impl;
+	if (match && old && !spa_streq(probed_cards[index].fp, fp)) {
+		/* the card or the options changed since it was probed */
+		card_free_probe(old);
+		old = NULL;
+	}
+	probed_cards[index].impl = impl;
+	snprintf(probed_cards[index].fp, sizeof(probed_cards[index].fp), "%s", fp);
+	pthread_mutex_unlock(&probed_lock);
+
+	return old;
+}
+
+struct acp_card *acp_card_new(uint32_t index, const struct acp_dict *props)
+{
+	pa_card *impl = NULL;
+	struct acp_card *card;
+	struct probe_info info;
+	const char *s, *profile = NULL;
+	char device_id[16];
+	uint32_t profile_index;
+	int res;
+
+	probe_info_init(&info, index, props);
+	info.probe_pcm = true;
+
+	if (index < MAX_PROBED_CARDS && info.fp[0] != '\0' &&
+	    (impl = probed_card_swap(index, NULL, info.fp, true)) != NULL)
+		pa_log_info("using earlier probe of card %u", index);
+
+	if (impl == NULL) {
+		if ((impl = card_alloc(&info)) == NULL)
+			return NULL;
+
+		snd_config_update_free_global();
+
+		if ((res = card_probe(impl, &info)) < 0) {
+			card_free_probe(impl);
+			errno = -res;
+			return NULL;
+		}
+	}
+
+	snprintf(device_id, sizeof(device_id), "%d", index);
+
+	impl->proplist = pa_proplist_new_dict(props);
+
+	card = &impl->card;
+	card->active_profile_index = ACP_INVALID_INDEX;
+
+	impl->auto_profile = true;
+	impl->auto_port = true;
+
+	if (props) {
+		if ((s = acp_dict_lookup(props, "api.alsa.soft-mixer")) != NULL)
+			impl->soft_mixer = spa_atob(s);
+		if ((s = acp_dict_lookup(props, "device.profile")) != NULL)
+			profile = s;
+		if ((s = acp_dict_lookup(props, "api.acp.auto-profile")) != NULL)
+			impl->auto_profile = spa_atob(s);
+		if ((s = acp_dict_lookup(props, "api.acp.auto-port")) != NULL)
+			impl->auto_port = spa_atob(s);
+	}
+
+	impl->profiles = pa_hashmap_new_full(pa_idxset_string_hash_func,
+			pa_idxset_string_compare_func, NULL,
+			(pa_free_cb_t) profile_free);
+	impl->ports = pa_hashmap_new_full(pa_idxset_string_hash_func,
+			pa_idxset_string_compare_func, NULL,
+			(pa_free_cb_t) port_free);
+
 	pa_alsa_init_proplist_card(NULL, impl->proplist, impl->card.index);
 	pa_proplist_sets(impl->proplist, PA_PROP_DEVICE_STRING, device_id);
 	pa_alsa_init_description(impl->proplist, NULL);
@@ -1589,11 +2001,52 @@ struct acp_card *acp_card_new(uint32_t index, const struct acp_dict *props)
 	init_eld_ctls(impl);
 
 	return &impl->card;
-error:
-	pa_alsa_refcnt_dec();
-	free(impl);
-	errno = -res;
-	return NULL;
+}
+
+int acp_card_probe(uint32_t index, const struct acp_dict *props)
+{
+	struct probe_info info;
+	pa_card *impl;
+	int res;
+
+	if (index >= MAX_PROBED_CARDS)
+		return -ENOSPC;
+
+	probe_info_init(&info, index, props);
+	if (info.fp[0] == '\0')
+		return -ENODEV;
+	if (!info.probe_pcm && !info.probe_cache)
+		return 0;
+
+	if ((impl = card_alloc(&info)) == NULL)
+		return -errno;
+
+	if ((res = card_probe(impl, &info)) < 0) {
+		card_free_probe(impl);
+		if (res == -EBUSY) {
+			pa_log_info("card %u is probed when it is created", index);
+			res = 0;
+		}
+		return res;
+	}
+
+	if ((impl = probed_card_swap(index, impl, info.fp, false)) != NULL)
+		card_free_probe(impl);
+
+	return 0;
+}
+
+void acp_card_probe_release(uint32_t index)
+{
+	pa_card *impl;
+	uint32_t i;
+
+	for (i = 0; i < MAX_PROBED_CARDS; i++) {
+		if (index != ACP_INVALID_INDEX && index != i)
+			continue;
+		if ((impl = probed_card_swap(i, NULL, "", false)) != NULL)
+			card_free_probe(impl);
+	}
 }
 
 void acp_card_add_listener(struct acp_card *card,
@@ -261,6 +261,18 @@ struct acp_card {
 
 struct acp_card *acp_card_new(uint32_t index, const struct acp_dict *props);
 
+/** Probe the profiles of card \a index ahead of acp_card_new(), which
+ * takes the result when it is called with the same properties and the card
+ * did not change. This can run in parallel for different cards. With
+ * api.acp.probe-pcm=false in \a props no PCM is opened, so it is safe
+ * before the device reservation is acquired; the card is then only
+ * prepared when its probe cache is valid. */
+int acp_card_probe(uint32_t index, const struct acp_dict *props);
+
+/** Free the probe of card \a index, or of all cards with ACP_INVALID_INDEX,
+ * when acp_card_new() did not take it. */
+void acp_card_probe_release(uint32_t index);
+
 void acp_card_add_listener(struct acp_card *card,
 		const struct acp_card_events *events, void *user_data);
 
@@ -4415,7 +4415,7 @@ static void profile_set_set_availability_groups(pa_alsa_profile_set *ps) {
 
 static void mapping_paths_probe(pa_alsa_mapping *m, pa_alsa_profile *profile,
                                 pa_alsa_direction_t direction, pa_hashmap *used_paths,
-                                pa_hashmap *mixers) {
+                                pa_hashmap *mixers, int card_index) {
 
     pa_alsa_path *p;
     void *state;
@@ -4438,9 +4438,12 @@ static void mapping_paths_probe(pa_alsa_mapping *m, pa_alsa_profile *profile,
     if (!ps)
         return; /* No paths */
 
-    pa_assert(pcm_handle);
+    pa_assert(pcm_handle || card_index >= 0);
 
-    mixer_handle = pa_alsa_open_mixer_for_pcm(mixers, pcm_handle, true);
+    if (pcm_handle)
+        mixer_handle = pa_alsa_open_mixer_for_pcm(mixers, pcm_handle, true);
+    else
+        mixer_handle = pa_alsa_open_mixer(mixers, card_index, true);
     if (!mixer_handle) {
         /* Cannot open mixer, remove all entries */
         pa_hashmap_remove_all(ps->paths);
@@ -5162,6 +5165,8 @@ void pa_alsa_profile_set_probe(
                                                            default_n_fragments,
                                                            default_fragment_size_msec))) {
                         p->supported = false;
+                        if (errno == EBUSY || errno == EAGAIN)
+                            ps->busy = true;
                         if (pa_idxset_size(p->output_mappings) == 1 &&
                             ((!p->input_mappings) || pa_idxset_size(p->input_mappings) == 0)) {
                             pa_log_debug("Caching failure to open output:%s", m->name);
@@ -5186,6 +5191,8 @@ void pa_alsa_profile_set_probe(
                                                           default_n_fragments,
                                                           default_fragment_size_msec))) {
                         p->supported = false;
+                        if (errno == EBUSY || errno == EAGAIN)
+                            ps->busy = true;
                         if (pa_idxset_size(p->input_mappings) == 1 &&
                             ((!p->output_mappings) || pa_idxset_size(p->output_mappings) == 0)) {
                             pa_log_debug("Caching failure to open input:%s", m->name);
@@ -5213,7 +5220,7 @@ void pa_alsa_profile_set_probe(
                     if (p->fallback_output && selected_fallback_output == NULL) {
                         selected_fallback_output = m;
                     }
-                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_OUTPUT, used_paths, mixers);
+                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_OUTPUT, used_paths, mixers, -1);
                 }
 
         if (p->input_mappings)
@@ -5223,7 +5230,7 @@ void pa_alsa_profile_set_probe(
                     if (p->fallback_input && selected_fallback_input == NULL) {
                         selected_fallback_input = m;
                     }
-                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_INPUT, used_paths, mixers);
+                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_INPUT, used_paths, mixers, -1);
                 }
     }
 
@@ -5244,6 +5251,59 @@ void pa_alsa_profile_set_probe(
     ps->probed = true;
 }
 
+/* Finish the probe of a profile set whose supported profiles are already
+ * known, for example from a cache, without opening any PCM. The caller sets
+ * supported on the profiles and the hw_device_index, channel map and
+ * proplists on their mappings. */
+void pa_alsa_profile_set_probe_supported(
+        pa_alsa_profile_set *ps,
+        pa_hashmap *mixers,
+        int card_index) {
+
+    pa_alsa_profile *p;
+    pa_alsa_mapping *m;
+    pa_hashmap *used_paths;
+    void *state;
+    uint32_t idx;
+
+    pa_assert(ps);
+    pa_assert(card_index >= 0);
+
+    if (ps->probed)
+        return;
+
+    used_paths = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+
+    PA_HASHMAP_FOREACH(p, ps->profiles, state) {
+        if (!p->supported)
+            continue;
+
+        pa_log_debug("Profile %s supported.", p->name);
+
+        if (p->output_mappings)
+            PA_IDXSET_FOREACH(m, p->output_mappings, idx) {
+                m->supported++;
+                mapping_paths_probe(m, p, PA_ALSA_DIRECTION_OUTPUT, used_paths, mixers, card_index);
+            }
+
+        if (p->input_mappings)
+            PA_IDXSET_FOREACH(m, p->input_mappings, idx) {
+                m->supported++;
+                mapping_paths_probe(m, p, PA_ALSA_DIRECTION_INPUT, used_paths, mixers, card_index);
+            }
+    }
+
+    pa_alsa_profile_set_drop_unsupported(ps);
+
+    paths_drop_unused(ps->input_paths, used_paths);
+    paths_drop_unused(ps->output_paths, used_paths);
+    pa_hashmap_free(used_paths);
+
+    profile_set_set_availability_groups(ps);
+
+    ps->probed = true;
+}
+
 void pa_alsa_profile_set_dump(pa_alsa_profile_set *ps) {
     pa_alsa_profile *p;
     pa_alsa_mapping *m;
@@ -415,6 +415,7 @@ struct pa_alsa_profile_set {
     bool auto_profiles;
     bool ignore_dB:1;
     bool probed:1;
+    bool busy:1;
 };
 
 void pa_alsa_mapping_dump(pa_alsa_mapping *m);
@@ -424,6 +425,7 @@ pa_alsa_mapping *pa_alsa_mapping_get(pa_alsa_profile_set *ps, const char *name);
 
 pa_alsa_profile_set* pa_alsa_profile_set_new(const char *fname, const pa_channel_map *bonus);
 void pa_alsa_profile_set_probe(pa_alsa_profile_set *ps, pa_hashmap *mixers, const char *dev_id, const pa_sample_spec *ss, unsigned default_n_fragments, unsigned default_fragment_size_msec);
+void pa_alsa_profile_set_probe_supported(pa_alsa_profile_set *ps, pa_hashmap *mixers, int card_index);
 void pa_alsa_profile_set_free(pa_alsa_profile_set *s);
 void pa_alsa_profile_set_dump(pa_alsa_profile_set *s);
 void pa_alsa_profile_set_drop_unsupported(pa_alsa_profile_set *s);
@@ -21,6 +21,7 @@
 #include "config.h"
 
 #include <sys/types.h>
+#include <pthread.h>
 #include <alsa/asoundlib.h>
 
 #include "alsa-util.h"
@@ -752,6 +753,7 @@ snd_pcm_t *pa_alsa_open_by_device_string(
 fail:
     pa_xfree(d);
 
+    errno = err < 0 ? -err : EINVAL;
     return NULL;
 }
 
@@ -771,6 +773,7 @@ snd_pcm_t *pa_alsa_open_by_template(
 
     snd_pcm_t *pcm_handle;
     char **i;
+    int busy = 0;
 
     for (i = template; *i; i++) {
         char *d;
@@ -790,12 +793,18 @@ snd_pcm_t *pa_alsa_open_by_template(
                 use_tsched,
                 require_exact_channel_number);
 
-        pa_xfree(d);
-
-        if (pcm_handle)
+        if (pcm_handle) {
+            pa_xfree(d);
             return pcm_handle;
+        }
+        if (errno == EBUSY || errno == EAGAIN)
+            busy = errno;
+
+        pa_xfree(d);
     }
 
+    /* Report a busy device even when a later template failed differently */
+    errno = busy ? busy : EINVAL;
     return NULL;
 }
 
@@ -869,26 +878,31 @@ static PA_PRINTF_FUNC(5,6) void alsa_error_handler(const char *file, int line, c
 }
 
 static int n_error_handler_installed = 0;
+static pthread_mutex_t refcnt_lock = PTHREAD_MUTEX_INITIALIZER;
 
 typedef void (*snd_lib2_error_handler_t)(const char *file, int line, const char *function, int err, const char *fmt, ...) PA_PRINTF_FUNC(5,6) /* __attribute__ ((format (printf, 5, 6))) */;
 
 extern int snd_lib_error_set_handler(snd_lib2_error_handler_t handler);
 
 void pa_alsa_refcnt_inc(void) {
-    /* This is not really thread safe, but we do our best */
-   if (n_error_handler_installed++ == 0)
+    /* Cards can be probed from several threads, see acp_card_probe() */
+    pthread_mutex_lock(&refcnt_lock);
+    if (n_error_handler_installed++ == 0)
         snd_lib_error_set_handler(alsa_error_handler);
+    pthread_mutex_unlock(&refcnt_lock);
 }
 
 void pa_alsa_refcnt_dec(void) {
     int r;
 
+    pthread_mutex_lock(&refcnt_lock);
     pa_assert_se((r = n_error_handler_installed--) >= 1);
 
     if (r == 1) {
         snd_lib_error_set_handler(NULL);
         snd_config_update_free_global();
     }
+    pthread_mutex_unlock(&refcnt_lock);
 }
 
 bool pa_alsa_init_description(pa_proplist *p, pa_card *card) {
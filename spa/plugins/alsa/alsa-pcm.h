@@ -49,7 +49,7 @@ extern "C" {
 #include <spa/param/latency-utils.h>
 #include <spa/param/audio/format-utils.h>
 
-#include "dll.h"
+#include <spa/utils/dll.h>
 
 #define MIN_LATENCY	16
 #define MAX_LATENCY	8192
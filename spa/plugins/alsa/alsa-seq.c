@@ -39,7 +39,7 @@
 
 #define NAME "alsa-seq"
 
-#include "dll.h"
+#include <spa/utils/dll.h>
 #include "alsa-seq.h"
 
 #define CHECK(s,msg,...) if ((res = (s)) < 0) { spa_log_error(state->log, msg ": %s", ##__VA_ARGS__, snd_strerror(res)); return res; }
@@ -498,16 +498,137 @@ static int process_recycle(struct seq_state *state)
 	return 0;
 }
 
+/* Convert the common channel and realtime events straight from and to
+ * their MIDI bytes. This skips the snd_midi_event codec, which has to be
+ * reset for each event and goes through a generic lookup table. Returns 0
+ * for events that need the codec. */
+static long decode_event(const snd_seq_event_t *ev, uint8_t *data)
+{
+	switch (ev->type) {
+	case SND_SEQ_EVENT_NOTEOFF:
+	case SND_SEQ_EVENT_NOTEON:
+	case SND_SEQ_EVENT_KEYPRESS:
+		data[0] = (ev->type == SND_SEQ_EVENT_NOTEOFF ? 0x80 :
+			   ev->type == SND_SEQ_EVENT_NOTEON ? 0x90 : 0xa0) |
+			(ev->data.note.channel & 0x0f);
+		data[1] = ev->data.note.note & 0x7f;
+		data[2] = ev->data.note.velocity & 0x7f;
+		return 3;
+	case SND_SEQ_EVENT_CONTROLLER:
+		data[0] = 0xb0 | (ev->data.control.channel & 0x0f);
+		data[1] = ev->data.control.param & 0x7f;
+		data[2] = ev->data.control.value & 0x7f;
+		return 3;
+	case SND_SEQ_EVENT_PGMCHANGE:
+	case SND_SEQ_EVENT_CHANPRESS:
+		data[0] = (ev->type == SND_SEQ_EVENT_PGMCHANGE ? 0xc0 : 0xd0) |
+			(ev->data.control.channel & 0x0f);
+		data[1] = ev->data.control.value & 0x7f;
+		return 2;
+	case SND_SEQ_EVENT_PITCHBEND:
+	{
+		int value = ev->data.control.value + 8192;
+		data[0] = 0xe0 | (ev->data.control.channel & 0x0f);
+		data[1] = value & 0x7f;
+		data[2] = (value >> 7) & 0x7f;
+		return 3;
+	}
+	case SND_SEQ_EVENT_CLOCK:
+		data[0] = 0xf8;
+		return 1;
+	case SND_SEQ_EVENT_START:
+		data[0] = 0xfa;
+		return 1;
+	case SND_SEQ_EVENT_CONTINUE:
+		data[0] = 0xfb;
+		return 1;
+	case SND_SEQ_EVENT_STOP:
+		data[0] = 0xfc;
+		return 1;
+	}
+	return 0;
+}
+
+static long encode_event(const uint8_t *data, uint32_t size, snd_seq_event_t *ev)
+{
+	uint8_t channel;
+
+	if (size == 0 || data[0] < 0x80)
+		return 0;
+
+	channel = data[0] & 0x0f;
+
+	switch (data[0] & 0xf0) {
+	case 0x80:
+		if (size < 3)
+			return 0;
+		snd_seq_ev_set_noteoff(ev, channel, data[1], data[2]);
+		return 3;
+	case 0x90:
+		if (size < 3)
+			return 0;
+		snd_seq_ev_set_noteon(ev, channel, data[1], data[2]);
+		return 3;
+	case 0xa0:
+		if (size < 3)
+			return 0;
+		snd_seq_ev_set_keypress(ev, channel, data[1], data[2]);
+		return 3;
+	case 0xb0:
+		if (size < 3)
+			return 0;
+		snd_seq_ev_set_controller(ev, channel, data[1], data[2]);
+		return 3;
+	case 0xc0:
+		if (size < 2)
+			return 0;
+		snd_seq_ev_set_pgmchange(ev, channel, data[1]);
+		return 2;
+	case 0xd0:
+		if (size < 2)
+			return 0;
+		snd_seq_ev_set_chanpress(ev, channel, data[1]);
+		return 2;
+	case 0xe0:
+		if (size < 3)
+			return 0;
+		snd_seq_ev_set_pitchbend(ev, channel,
+				((data[2] << 7) | data[1]) - 8192);
+		return 3;
+	}
+	switch (data[0]) {
+	case 0xf8:
+		ev->type = SND_SEQ_EVENT_CLOCK;
+		break;
+	case 0xfa:
+		ev->type = SND_SEQ_EVENT_START;
+		break;
+	case 0xfb:
+		ev->type = SND_SEQ_EVENT_CONTINUE;
+		break;
+	case 0xfc:
+		ev->type = SND_SEQ_EVENT_STOP;
+		break;
+	default:
+		return 0;
+	}
+	snd_seq_ev_set_fixed(ev);
+	return 1;
+}
+
 static int process_read(struct seq_state *state)
 {
 	snd_seq_event_t *ev;
 	struct seq_stream *stream = &state->streams[SPA_DIRECTION_OUTPUT];
+	struct seq_port *last = NULL;
 	uint32_t i;
 	long size;
 	uint8_t data[MAX_EVENT_SIZE];
 	int res;
 
-	/* copy all new midi events into their port buffers */
+	/* copy all new midi events into their port buffers. The events
+	 * arrive in batches in the input buffer and mostly come from the same
+	 * port, so remember the last port we looked up. */
 	while (snd_seq_event_input(state->event.hndl, &ev) > 0) {
 		const snd_seq_addr_t *addr = &ev->source;
 		struct seq_port *port;
@@ -516,11 +637,17 @@ static int process_read(struct seq_state *state)
 
 		debug_event(state, ev);
 
-		if ((port = find_port(state, stream, addr)) == NULL) {
+		if (last != NULL &&
+		    last->addr.client == addr->client &&
+		    last->addr.port == addr->port) {
+			port = last;
+		} else if ((port = find_port(state, stream, addr)) == NULL) {
 			spa_log_debug(state->log, "unknown port %d.%d",
 					addr->client, addr->port);
 			continue;
 		}
+		last = port;
+
 		if (port->io == NULL || port->n_buffers == 0)
 			continue;
 
@@ -530,10 +657,12 @@ static int process_read(struct seq_state *state)
 			continue;
 		}
 
-		snd_midi_event_reset_decode(stream->codec);
-		if ((size = snd_midi_event_decode(stream->codec, data, MAX_EVENT_SIZE, ev)) < 0) {
-			spa_log_warn(state->log, "decode failed: %s", snd_strerror(size));
-			continue;
+		if ((size = decode_event(ev, data)) == 0) {
+			snd_midi_event_reset_decode(stream->codec);
+			if ((size = snd_midi_event_decode(stream->codec, data, MAX_EVENT_SIZE, ev)) < 0) {
+				spa_log_warn(state->log, "decode failed: %s", snd_strerror(size));
+				continue;
+			}
 		}
 
 		/* fixup NoteOn with vel 0 */
@@ -619,7 +748,7 @@ static int process_write(struct seq_state *state)
 {
 	struct seq_stream *stream = &state->streams[SPA_DIRECTION_INPUT];
 	uint32_t i;
-	int res = 0;
+	int err, res = 0;
 
 	for (i = 0; i < stream->last_port; i++) {
 		struct seq_port *port = &stream->ports[i];
@@ -661,13 +790,16 @@ static int process_write(struct seq_state *state)
 
 			snd_seq_ev_clear(&ev);
 
-			snd_midi_event_reset_encode(stream->codec);
-			if ((size = snd_midi_event_encode(stream->codec,
-						SPA_POD_BODY(&c->value),
-						SPA_POD_BODY_SIZE(&c->value), &ev)) <= 0) {
-				spa_log_warn(state->log, "failed to encode event: %s",
-						snd_strerror(size));
-	                        continue;
+			if ((size = encode_event(SPA_POD_BODY(&c->value),
+						SPA_POD_BODY_SIZE(&c->value), &ev)) == 0) {
+				snd_midi_event_reset_encode(stream->codec);
+				if ((size = snd_midi_event_encode(stream->codec,
+							SPA_POD_BODY(&c->value),
+							SPA_POD_BODY_SIZE(&c->value), &ev)) <= 0) {
+					spa_log_warn(state->log, "failed to encode event: %s",
+							snd_strerror(size));
+					continue;
+				}
 			}
 
 			snd_seq_ev_set_source(&ev, state->event.addr.port);
@@ -683,9 +815,9 @@ static int process_write(struct seq_state *state)
 			spa_log_trace_fp(state->log, "event time:%"PRIu64" offset:%d size:%ld port:%d.%d",
 				out_time, c->offset, size, port->addr.client, port->addr.port);
 
-			if ((res = snd_seq_event_output(state->event.hndl, &ev)) < 0) {
+			if ((err = snd_seq_event_output(state->event.hndl, &ev)) < 0) {
 				spa_log_warn(state->log, "failed to output event: %s",
-						snd_strerror(res));
+						snd_strerror(err));
 			}
 		}
 	}
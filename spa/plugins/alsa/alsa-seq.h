@@ -46,7 +46,7 @@ extern "C" {
 #include <spa/param/audio/format-utils.h>
 #include <spa/param/latency-utils.h>
 
-#include "dll.h"
+#include <spa/utils/dll.h>
 
 struct props {
 	char device[64];
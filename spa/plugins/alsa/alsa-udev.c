@@ -29,6 +29,7 @@
 #include <sys/stat.h>
 #include <sys/inotify.h>
 #include <fcntl.h>
+#include <pthread.h>
 
 #include <libudev.h>
 #include <alsa/asoundlib.h>
@@ -44,6 +45,8 @@
 #include <spa/monitor/device.h>
 #include <spa/monitor/utils.h>
 
+#include "acp/acp.h"
+
 #define NAME  "alsa-udev"
 
 #define MAX_DEVICES	64
@@ -81,6 +84,10 @@ struct impl {
 	struct spa_source source;
 	struct spa_source notify;
 	unsigned int use_acp:1;
+	unsigned int use_ucm:1;
+	unsigned int ignore_dB:1;
+	unsigned int reserve:1;
+	unsigned int probe_cache:1;
 };
 
 static int impl_udev_open(struct impl *this)
@@ -127,6 +134,7 @@ static struct device *find_device(struct impl *this, uint32_t id)
 
 static void remove_device(struct impl *this, struct device *device)
 {
+	acp_card_probe_release(device->id);
 	udev_device_unref(device->dev);
 	*device = this->devices[--this->n_devices];
 }
@@ -604,6 +612,90 @@ static int stop_monitor(struct impl *this)
 	return 0;
 }
 
+struct probe_card {
+	pthread_t thread;
+	struct impl *impl;
+	uint32_t index;
+	char *profile_set;
+};
+
+static void *probe_card_thread(void *data)
+{
+	struct probe_card *card = data;
+	struct impl *this = card->impl;
+	struct acp_dict_item items[5];
+	uint32_t n_items = 0;
+	int res;
+
+	items[n_items++] = ACP_DICT_ITEM_INIT("api.alsa.use-ucm", this->use_ucm ? "true" : "false");
+	items[n_items++] = ACP_DICT_ITEM_INIT("api.alsa.ignore-dB", this->ignore_dB ? "true" : "false");
+	items[n_items++] = ACP_DICT_ITEM_INIT("api.acp.probe-cache", this->probe_cache ? "true" : "false");
+	items[n_items++] = ACP_DICT_ITEM_INIT("api.acp.probe-pcm", this->reserve ? "false" : "true");
+	if (card->profile_set)
+		items[n_items++] = ACP_DICT_ITEM_INIT(SPA_KEY_DEVICE_PROFILE_SET, card->profile_set);
+
+	if ((res = acp_card_probe(card->index, &ACP_DICT_INIT(items, n_items))) < 0)
+		spa_log_info(this->log, NAME" %p: probe of card %u failed: %s",
+				this, card->index, spa_strerror(res));
+	return NULL;
+}
+
+/* Probing a card opens all its PCMs and walks the mixer paths, which takes a
+ * while. At startup we probe all cards in parallel and the devices, which are
+ * created one after the other, take the result. With device reservation the
+ * session manager only creates a device after it reserved it, so then the
+ * PCMs are not opened here and only cards with a valid probe cache are
+ * prepared; the others are probed when their device is created. The cards
+ * are probed with the monitor properties and the udev profile set; a device
+ * that is created with other properties probes again. */
+static void probe_cards(struct impl *this, struct udev_enumerate *enumerate)
+{
+	struct probe_card cards[MAX_DEVICES];
+	struct udev_list_entry *devices;
+	uint32_t i, n_cards = 0;
+
+	for (devices = udev_enumerate_get_list_entry(enumerate); devices;
+			devices = udev_list_entry_get_next(devices)) {
+		struct udev_device *dev;
+		struct probe_card *card;
+		const char *str;
+		uint32_t id;
+
+		if (n_cards >= MAX_DEVICES)
+			break;
+
+		dev = udev_device_new_from_syspath(this->udev, udev_list_entry_get_name(devices));
+		if (dev == NULL)
+			continue;
+
+		card = &cards[n_cards];
+		id = get_card_id(this, dev);
+		str = udev_device_get_property_value(dev, "ACP_PROFILE_SET");
+		card->profile_set = (id != SPA_ID_INVALID && str && *str) ? strdup(str) : NULL;
+		udev_device_unref(dev);
+
+		if (id == SPA_ID_INVALID)
+			continue;
+
+		card->impl = this;
+		card->index = id;
+		if (pthread_create(&card->thread, NULL, probe_card_thread, card) != 0) {
+			spa_log_warn(this->log, NAME" %p: can't start probe of card %u: %m",
+					this, id);
+			free(card->profile_set);
+			continue;
+		}
+		n_cards++;
+	}
+
+	spa_log_debug(this->log, NAME" %p: probing %u cards", this, n_cards);
+
+	for (i = 0; i < n_cards; i++) {
+		pthread_join(cards[i].thread, NULL);
+		free(cards[i].profile_set);
+	}
+}
+
 static int enum_devices(struct impl *this)
 {
 	struct udev_enumerate *enumerate;
@@ -616,6 +708,9 @@ static int enum_devices(struct impl *this)
 	udev_enumerate_add_match_subsystem(enumerate, "sound");
 	udev_enumerate_scan_devices(enumerate);
 
+	if (this->use_acp)
+		probe_cards(this, enumerate);
+
 	for (devices = udev_enumerate_get_list_entry(enumerate); devices;
 			devices = udev_list_entry_get_next(devices)) {
 		struct udev_device *dev;
@@ -719,6 +814,7 @@ static int impl_clear(struct spa_handle *handle)
 	struct impl *this = (struct impl *) handle;
 	stop_monitor(this);
 	impl_udev_close(this);
+	acp_card_probe_release(ACP_INVALID_INDEX);
 	return 0;
 }
 
@@ -767,9 +863,21 @@ impl_init(const struct spa_handle_factory *factory,
 			SPA_DEVICE_CHANGE_MASK_PROPS;
 	this->info.flags = 0;
 
+	this->use_ucm = true;
+	this->reserve = true;
+	this->probe_cache = true;
+
 	if (info) {
 		if ((str = spa_dict_lookup(info, "alsa.use-acp")) != NULL)
 			this->use_acp = spa_atob(str);
+		if ((str = spa_dict_lookup(info, "api.alsa.use-ucm")) != NULL)
+			this->use_ucm = spa_atob(str);
+		if ((str = spa_dict_lookup(info, "api.alsa.ignore-dB")) != NULL)
+			this->ignore_dB = spa_atob(str);
+		if ((str = spa_dict_lookup(info, "alsa.reserve")) != NULL)
+			this->reserve = spa_atob(str);
+		if ((str = spa_dict_lookup(info, "api.acp.probe-cache")) != NULL)
+			this->probe_cache = spa_atob(str);
 	}
 
 	return 0;
@@ -0,0 +1,401 @@
+/* Spa
+ *
+ * Copyright © 2021 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Checks the MIDI conversion of alsa-seq.c against the snd_midi_event
+ * codec and measures the delivery jitter of MIDI events sent through the
+ * sequencer the way alsa-seq.c does it: the events of a cycle are encoded
+ * with encode_event(), scheduled on a queue at their sample offsets and
+ * sent with one drain. The same client timestamps the events on arrival
+ * with the queue and decodes them with decode_event().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <math.h>
+#include <poll.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <alsa/asoundlib.h>
+
+#include "alsa-seq.c"
+
+#define NSEC_PER_SEC	1000000000ll
+#define TIMESPEC_TO_NSEC(ts) ((ts)->tv_sec * NSEC_PER_SEC + (ts)->tv_nsec)
+
+#define DEFAULT_RATE		48000
+#define DEFAULT_QUANTUM		256
+#define DEFAULT_EVENTS		64
+#define DEFAULT_CYCLES		1000
+
+struct state {
+	snd_seq_t *hndl;
+	int queue;
+	int out_port;
+	int in_port;
+
+	unsigned int rate;
+	unsigned int quantum;
+	unsigned int n_events;
+	unsigned int n_cycles;
+	bool immediate;
+
+	uint64_t n_received;
+	uint64_t n_corrupt;
+	int64_t min, max;
+	double sum, sum2;
+};
+
+static const struct {
+	uint8_t data[3];
+	uint32_t size;
+} midi_tests[] = {
+	{ { 0x80, 0x3c, 0x40 }, 3 },
+	{ { 0x91, 0x3c, 0x7f }, 3 },
+	{ { 0x92, 0x3c, 0x00 }, 3 },
+	{ { 0xa3, 0x40, 0x20 }, 3 },
+	{ { 0xb4, 0x07, 0x64 }, 3 },
+	{ { 0xc5, 0x0a }, 2 },
+	{ { 0xd6, 0x33 }, 2 },
+	{ { 0xe7, 0x00, 0x00 }, 3 },
+	{ { 0xe8, 0x00, 0x40 }, 3 },
+	{ { 0xef, 0x7f, 0x7f }, 3 },
+	{ { 0xf8 }, 1 },
+	{ { 0xfa }, 1 },
+	{ { 0xfb }, 1 },
+	{ { 0xfc }, 1 },
+};
+
+/* encode_event() must give an event that the codec decodes to the same
+ * bytes and decode_event() must give the bytes of the codec's event. */
+static int check_codec(void)
+{
+	snd_midi_event_t *codec;
+	snd_seq_event_t ev;
+	uint8_t data[MAX_EVENT_SIZE];
+	uint32_t i;
+	long size;
+	int res, failed = 0;
+
+	if ((res = snd_midi_event_new(MAX_EVENT_SIZE, &codec)) < 0)
+		return res;
+	snd_midi_event_no_status(codec, 1);
+
+	for (i = 0; i < SPA_N_ELEMENTS(midi_tests); i++) {
+		const uint8_t *msg = midi_tests[i].data;
+		uint32_t len = midi_tests[i].size;
+
+		snd_seq_ev_clear(&ev);
+		size = encode_event(msg, len, &ev);
+		snd_midi_event_reset_decode(codec);
+		if (size != (long)len ||
+		    snd_midi_event_decode(codec, data, sizeof(data), &ev) != (long)len ||
+		    memcmp(data, msg, len) != 0) {
+			fprintf(stderr, "encode_event() of %02x failed\n", msg[0]);
+			failed++;
+		}
+
+		snd_seq_ev_clear(&ev);
+		snd_midi_event_reset_encode(codec);
+		if (snd_midi_event_encode(codec, msg, len, &ev) != (long)len ||
+		    decode_event(&ev, data) != (long)len ||
+		    memcmp(data, msg, len) != 0) {
+			fprintf(stderr, "decode_event() of %02x failed\n", msg[0]);
+			failed++;
+		}
+	}
+	/* sysex goes through the codec */
+	snd_seq_ev_clear(&ev);
+	if (encode_event((const uint8_t[]) { 0xf0, 0x7e, 0xf7 }, 3, &ev) != 0) {
+		fprintf(stderr, "encode_event() of sysex failed\n");
+		failed++;
+	}
+	snd_midi_event_free(codec);
+
+	return failed ? -EINVAL : 0;
+}
+
+static uint64_t queue_time(struct state *state)
+{
+	snd_seq_queue_status_t *status;
+	snd_seq_queue_status_alloca(&status);
+	snd_seq_get_queue_status(state->hndl, state->queue, status);
+	return TIMESPEC_TO_NSEC(snd_seq_queue_status_get_real_time(status));
+}
+
+static int setup(struct state *state)
+{
+	snd_seq_port_info_t *pinfo;
+	snd_seq_queue_timer_t *timer;
+	int res;
+
+	if ((res = snd_seq_open(&state->hndl, "default", SND_SEQ_OPEN_DUPLEX, 0)) < 0)
+		return res;
+
+	snd_seq_set_client_name(state->hndl, "seq-jitter");
+	snd_seq_nonblock(state->hndl, 1);
+
+	if ((state->queue = snd_seq_alloc_queue(state->hndl)) < 0)
+		return state->queue;
+
+	snd_seq_queue_timer_alloca(&timer);
+	if (snd_seq_get_queue_timer(state->hndl, state->queue, timer) == 0) {
+		snd_seq_queue_timer_set_resolution(timer, INT_MAX);
+		snd_seq_set_queue_timer(state->hndl, state->queue, timer);
+	}
+
+	state->out_port = snd_seq_create_simple_port(state->hndl, "out",
+			SND_SEQ_PORT_CAP_READ, SND_SEQ_PORT_TYPE_MIDI_GENERIC);
+	if (state->out_port < 0)
+		return state->out_port;
+
+	snd_seq_port_info_alloca(&pinfo);
+	snd_seq_port_info_set_name(pinfo, "in");
+	snd_seq_port_info_set_type(pinfo, SND_SEQ_PORT_TYPE_MIDI_GENERIC);
+	snd_seq_port_info_set_capability(pinfo, SND_SEQ_PORT_CAP_WRITE);
+	snd_seq_port_info_set_timestamping(pinfo, 1);
+	snd_seq_port_info_set_timestamp_real(pinfo, 1);
+	snd_seq_port_info_set_timestamp_queue(pinfo, state->queue);
+	if ((res = snd_seq_create_port(state->hndl, pinfo)) < 0)
+		return res;
+	state->in_port = snd_seq_port_info_get_port(pinfo);
+
+	if ((res = snd_seq_connect_to(state->hndl, state->out_port,
+				snd_seq_client_id(state->hndl), state->in_port)) < 0)
+		return res;
+
+	snd_seq_start_queue(state->hndl, state->queue, NULL);
+	snd_seq_drain_output(state->hndl);
+
+	return 0;
+}
+
+static void make_event(uint8_t *data, uint32_t cycle, uint32_t i)
+{
+	data[0] = 0xb0;
+	data[1] = 1;
+	data[2] = (cycle + i) & 0x7f;
+}
+
+static void send_cycle(struct state *state, uint64_t cycle_time, uint32_t cycle)
+{
+	snd_seq_event_t ev;
+	uint64_t out_time;
+	snd_seq_real_time_t out_rt;
+	uint8_t data[3];
+	uint32_t i, offset;
+
+	for (i = 0; i < state->n_events; i++) {
+		offset = i * state->quantum / state->n_events;
+
+		make_event(data, cycle, i);
+		snd_seq_ev_clear(&ev);
+		encode_event(data, sizeof(data), &ev);
+		snd_seq_ev_set_source(&ev, state->out_port);
+		snd_seq_ev_set_subs(&ev);
+
+		out_time = cycle_time + (uint64_t)offset * NSEC_PER_SEC / state->rate;
+
+		if (state->immediate) {
+			snd_seq_ev_set_direct(&ev);
+			snd_seq_event_output_direct(state->hndl, &ev);
+		} else {
+			out_rt.tv_sec = out_time / NSEC_PER_SEC;
+			out_rt.tv_nsec = out_time % NSEC_PER_SEC;
+			snd_seq_ev_schedule_real(&ev, state->queue, 0, &out_rt);
+			snd_seq_event_output(state->hndl, &ev);
+		}
+	}
+	if (!state->immediate)
+		snd_seq_drain_output(state->hndl);
+}
+
+static void receive(struct state *state, uint64_t cycle_time, uint32_t cycle)
+{
+	snd_seq_event_t *ev;
+	uint8_t data[MAX_EVENT_SIZE], expect[3];
+	uint32_t idx = 0;
+
+	while (snd_seq_event_input(state->hndl, &ev) > 0) {
+		uint64_t expected, arrived;
+		int64_t diff;
+
+		make_event(expect, cycle, idx);
+		if (decode_event(ev, data) != (long)sizeof(expect) ||
+		    memcmp(data, expect, sizeof(expect)) != 0)
+			state->n_corrupt++;
+
+		/* direct events should all arrive right away, scheduled
+		 * events at their offset in the cycle */
+		expected = cycle_time;
+		if (!state->immediate)
+			expected += (uint64_t)(idx * state->quantum / state->n_events) *
+				NSEC_PER_SEC / state->rate;
+		idx++;
+
+		arrived = TIMESPEC_TO_NSEC(&ev->time.time);
+		diff = (int64_t)(arrived - expected);
+
+		if (state->n_received == 0 || diff < state->min)
+			state->min = diff;
+		if (state->n_received == 0 || diff > state->max)
+			state->max = diff;
+		state->sum += diff;
+		state->sum2 += (double)diff * diff;
+		state->n_received++;
+	}
+}
+
+static void sleep_until(uint64_t nsec)
+{
+	struct timespec ts;
+	ts.tv_sec = nsec / NSEC_PER_SEC;
+	ts.tv_nsec = nsec % NSEC_PER_SEC;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+static void run(struct state *state)
+{
+	uint64_t cycle_nsec = (uint64_t)state->quantum * NSEC_PER_SEC / state->rate;
+	uint64_t mono_start, queue_start, cycle_time = 0;
+	struct timespec ts;
+	uint32_t i;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	mono_start = TIMESPEC_TO_NSEC(&ts);
+	queue_start = queue_time(state);
+
+	/* like the node, wake up at the start of each cycle, pick up what
+	 * arrived during the previous cycle and send the events of this one */
+	for (i = 0; i <= state->n_cycles; i++) {
+		sleep_until(mono_start + i * cycle_nsec);
+
+		if (i > 0)
+			receive(state, cycle_time, i - 1);
+		if (i == state->n_cycles)
+			break;
+
+		cycle_time = state->immediate ?
+			queue_time(state) : queue_start + i * cycle_nsec;
+
+		send_cycle(state, cycle_time, i);
+	}
+}
+
+static void show_help(const char *name)
+{
+	fprintf(stdout, "%s [options]\n"
+		"  -h, --help                            Show this help\n"
+		"  -r  --rate                            Sample rate (default %d)\n"
+		"  -q  --quantum                         Quantum in samples (default %d)\n"
+		"  -e  --events                          Events per cycle (default %d)\n"
+		"  -c  --cycles                          Number of cycles (default %d)\n"
+		"  -i  --immediate                       Send events directly, unscheduled\n",
+		name, DEFAULT_RATE, DEFAULT_QUANTUM, DEFAULT_EVENTS, DEFAULT_CYCLES);
+}
+
+int main(int argc, char *argv[])
+{
+	struct state state = { 0, };
+	double avg, dev;
+	int c, res;
+	static const struct option long_options[] = {
+		{ "help",	no_argument,		NULL, 'h' },
+		{ "rate",	required_argument,	NULL, 'r' },
+		{ "quantum",	required_argument,	NULL, 'q' },
+		{ "events",	required_argument,	NULL, 'e' },
+		{ "cycles",	required_argument,	NULL, 'c' },
+		{ "immediate",	no_argument,		NULL, 'i' },
+		{ NULL, 0, NULL, 0}
+	};
+
+	state.rate = DEFAULT_RATE;
+	state.quantum = DEFAULT_QUANTUM;
+	state.n_events = DEFAULT_EVENTS;
+	state.n_cycles = DEFAULT_CYCLES;
+
+	while ((c = getopt_long(argc, argv, "hr:q:e:c:i", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'h':
+			show_help(argv[0]);
+			return 0;
+		case 'r':
+			state.rate = atoi(optarg);
+			break;
+		case 'q':
+			state.quantum = atoi(optarg);
+			break;
+		case 'e':
+			state.n_events = atoi(optarg);
+			break;
+		case 'c':
+			state.n_cycles = atoi(optarg);
+			break;
+		case 'i':
+			state.immediate = true;
+			break;
+		default:
+			show_help(argv[0]);
+			return -1;
+		}
+	}
+	if (state.rate == 0 || state.quantum == 0 || state.n_events == 0) {
+		show_help(argv[0]);
+		return -1;
+	}
+
+	if ((res = check_codec()) < 0) {
+		fprintf(stderr, "MIDI conversion differs from the codec\n");
+		return -1;
+	}
+
+	if ((res = setup(&state)) < 0) {
+		fprintf(stderr, "sequencer setup failed: %s\n", snd_strerror(res));
+		return -1;
+	}
+
+	run(&state);
+
+	if (state.n_received == 0) {
+		fprintf(stderr, "no events received\n");
+		return -1;
+	}
+
+	avg = state.sum / state.n_received;
+	dev = sqrt(state.sum2 / state.n_received - avg * avg);
+
+	fprintf(stdout, "%s: %"PRIu64"/%u events, %"PRIu64" corrupt, jitter min:%"PRIi64"ns "
+			"max:%"PRIi64"ns avg:%.0fns stddev:%.0fns\n",
+			state.immediate ? "immediate" : "scheduled",
+			state.n_received, state.n_cycles * state.n_events, state.n_corrupt,
+			state.min, state.max, avg, dev);
+
+	snd_seq_close(state.hndl);
+
+	return state.n_corrupt ? -1 : 0;
+}
@@ -0,0 +1,122 @@
+/* Spa
+ *
+ * Copyright © 2021 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <spa/utils/defs.h>
+
+#include "mix-ops.h"
+
+#define N_SAMPLES	1029
+#define MAX_SRC		16
+
+static float samp_in[MAX_SRC][N_SAMPLES + 8] SPA_ALIGNED(32);
+static float samp_out[N_SAMPLES + 8] SPA_ALIGNED(32);
+static float samp_ref[N_SAMPLES + 8] SPA_ALIGNED(32);
+
+static void run_test(const char *name, uint32_t n_src, uint32_t offset,
+		void (*func) (struct mix_ops *ops, void * SPA_RESTRICT dst,
+			const void * SPA_RESTRICT src[], uint32_t n_src, uint32_t n_samples))
+{
+	const void *src[MAX_SRC];
+	uint32_t i, n;
+
+	for (i = 0; i < n_src; i++)
+		src[i] = &samp_in[i][offset];
+
+	memset(samp_ref, 0, sizeof(samp_ref));
+	for (i = 0; i < n_src; i++)
+		for (n = 0; n < N_SAMPLES; n++)
+			samp_ref[n] += samp_in[i][n + offset];
+
+	memset(samp_out, 0xff, sizeof(samp_out));
+	func(NULL, &samp_out[offset], src, n_src, N_SAMPLES);
+
+	for (n = 0; n < N_SAMPLES; n++) {
+		if (fabsf(samp_out[n + offset] - samp_ref[n]) > 1e-6f) {
+			fprintf(stderr, "%s: %u sources, offset %u: sample %u %f != %f\n",
+					name, n_src, offset, n, samp_out[n + offset], samp_ref[n]);
+			spa_assert_not_reached();
+		}
+	}
+}
+
+static void test_f32(const char *name,
+		void (*func) (struct mix_ops *ops, void * SPA_RESTRICT dst,
+			const void * SPA_RESTRICT src[], uint32_t n_src, uint32_t n_samples))
+{
+	uint32_t n_src;
+
+	fprintf(stderr, "test %s:\n", name);
+	for (n_src = 0; n_src <= MAX_SRC; n_src++) {
+		/* aligned and unaligned buffers */
+		run_test(name, n_src, 0, func);
+		run_test(name, n_src, 1, func);
+	}
+}
+
+static void test_inplace(const char *name,
+		void (*func) (struct mix_ops *ops, void * SPA_RESTRICT dst,
+			const void * SPA_RESTRICT src[], uint32_t n_src, uint32_t n_samples))
+{
+	const void *src[3] = { samp_out, samp_in[1], samp_in[2] };
+	uint32_t n;
+
+	for (n = 0; n < N_SAMPLES; n++) {
+		samp_out[n] = samp_in[0][n];
+		samp_ref[n] = samp_in[0][n] + samp_in[1][n] + samp_in[2][n];
+	}
+	func(NULL, samp_out, src, 3, N_SAMPLES);
+
+	for (n = 0; n < N_SAMPLES; n++)
+		spa_assert(fabsf(samp_out[n] - samp_ref[n]) <= 1e-6f);
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t i, n;
+
+	for (i = 0; i < MAX_SRC; i++)
+		for (n = 0; n < N_SAMPLES + 8; n++)
+			samp_in[i][n] = drand48() * 2.0 - 1.0;
+
+	test_f32("mix_f32_c", mix_f32_c);
+	test_inplace("mix_f32_c", mix_f32_c);
+#if defined(HAVE_SSE)
+	if (__builtin_cpu_supports("sse")) {
+		test_f32("mix_f32_sse", mix_f32_sse);
+		test_inplace("mix_f32_sse", mix_f32_sse);
+	}
+#endif
+#if defined(HAVE_AVX)
+	if (__builtin_cpu_supports("avx")) {
+		test_f32("mix_f32_avx", mix_f32_avx);
+		test_inplace("mix_f32_avx", mix_f32_avx);
+	}
+#endif
+	return 0;
+}
@@ -0,0 +1,285 @@
+/* Spa SCO I/O benchmark
+ *
+ * Copyright © 2021 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Drives the SCO I/O layer used by the sco-sink and sco-source nodes over a
+ * SOCK_SEQPACKET socketpair that stands in for the SCO socket, so the packet
+ * path can be measured without Bluetooth hardware.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include <spa/support/loop.h>
+#include <spa/utils/defs.h>
+
+#include <sbc/sbc.h>
+
+#include "defs.h"
+
+#define N_PACKETS	(1 << 16)
+#define BURST		8
+#define TIMEOUT_MS	1000
+
+struct test_loop {
+	struct spa_loop loop;
+	struct spa_source *source;
+};
+
+static int loop_add_source(void *object, struct spa_source *source)
+{
+	struct test_loop *l = object;
+	source->loop = &l->loop;
+	l->source = source;
+	return 0;
+}
+
+static int loop_update_source(void *object, struct spa_source *source)
+{
+	return 0;
+}
+
+static int loop_remove_source(void *object, struct spa_source *source)
+{
+	struct test_loop *l = object;
+	source->loop = NULL;
+	l->source = NULL;
+	return 0;
+}
+
+static int loop_invoke(void *object, spa_invoke_func_t func, uint32_t seq,
+		const void *data, size_t size, bool block, void *user_data)
+{
+	struct test_loop *l = object;
+	return func(&l->loop, false, seq, data, size, user_data);
+}
+
+static const struct spa_loop_methods loop_methods = {
+	SPA_VERSION_LOOP_METHODS,
+	.add_source = loop_add_source,
+	.update_source = loop_update_source,
+	.remove_source = loop_remove_source,
+	.invoke = loop_invoke,
+};
+
+/* Dispatch the SCO source when the socket is ready, like the data loop would.
+ * Returns 0 when the socket did not become ready within timeout ms. */
+static int loop_iterate(struct test_loop *l, int timeout)
+{
+	struct pollfd pfd;
+	int res;
+
+	if (l->source == NULL)
+		return 0;
+
+	pfd.fd = l->source->fd;
+	pfd.events = 0;
+	if (l->source->mask & SPA_IO_IN)
+		pfd.events |= POLLIN;
+	if (l->source->mask & SPA_IO_OUT)
+		pfd.events |= POLLOUT;
+
+	if ((res = poll(&pfd, 1, timeout)) <= 0)
+		return res;
+
+	l->source->rmask = 0;
+	if (pfd.revents & POLLIN)
+		l->source->rmask |= SPA_IO_IN;
+	if (pfd.revents & POLLOUT)
+		l->source->rmask |= SPA_IO_OUT;
+	if (pfd.revents & POLLERR)
+		l->source->rmask |= SPA_IO_ERR;
+	if (pfd.revents & POLLHUP)
+		l->source->rmask |= SPA_IO_HUP;
+
+	l->source->func(l->source);
+	return res;
+}
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+struct source_data {
+	sbc_t msbc;
+	uint32_t n_packets;
+	uint32_t n_decoded;
+	int16_t decoded[MSBC_DECODED_SIZE / sizeof(int16_t)];
+};
+
+static int source_cb(void *userdata, uint8_t *data, int size)
+{
+	struct source_data *d = userdata;
+	size_t written;
+
+	spa_assert(size == MSBC_ENCODED_SIZE);
+	spa_assert(data[0] == 0x01);
+
+	if (sbc_decode(&d->msbc, data + 2, MSBC_ENCODED_SIZE - 3,
+				d->decoded, sizeof(d->decoded), &written) > 0)
+		d->n_decoded++;
+	d->n_packets++;
+	return 0;
+}
+
+/* Build a valid H2-framed mSBC packet for each of the 4 sequence numbers */
+static void make_msbc_packets(uint8_t packets[4][MSBC_ENCODED_SIZE])
+{
+	static const uint8_t h2[] = { 0x08, 0x38, 0xc8, 0xf8 };
+	int16_t pcm[MSBC_DECODED_SIZE / sizeof(int16_t)];
+	sbc_t enc;
+	ssize_t encoded;
+	size_t i;
+	int seq;
+
+	for (i = 0; i < SPA_N_ELEMENTS(pcm); i++)
+		pcm[i] = 8000 * sinf(2 * M_PI * i / SPA_N_ELEMENTS(pcm));
+
+	sbc_init_msbc(&enc, 0);
+	enc.endian = SBC_LE;
+
+	for (seq = 0; seq < 4; seq++) {
+		memset(packets[seq], 0, MSBC_ENCODED_SIZE);
+		packets[seq][0] = 0x01;
+		packets[seq][1] = h2[seq];
+		sbc_encode(&enc, pcm, sizeof(pcm), packets[seq] + 2,
+				MSBC_ENCODED_SIZE - 3, &encoded);
+		spa_assert(encoded == MSBC_ENCODED_SIZE - 3);
+	}
+	sbc_finish(&enc);
+}
+
+static void test_source(void)
+{
+	struct test_loop l = { 0 };
+	struct spa_bt_sco_io *io;
+	struct source_data d = { 0 };
+	uint8_t packets[4][MSBC_ENCODED_SIZE];
+	uint64_t t1, t2;
+	uint32_t i, j, sent = 0;
+	int fd[2];
+
+	l.loop.iface = SPA_INTERFACE_INIT(SPA_TYPE_INTERFACE_DataLoop,
+			SPA_VERSION_LOOP, &loop_methods, &l);
+
+	spa_assert_se(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, fd) == 0);
+
+	make_msbc_packets(packets);
+	sbc_init_msbc(&d.msbc, 0);
+	d.msbc.endian = SBC_LE;
+
+	io = spa_bt_sco_io_create(&l.loop, fd[0], MSBC_ENCODED_SIZE, MSBC_ENCODED_SIZE);
+	spa_assert(io != NULL);
+	spa_bt_sco_io_set_source_cb(io, source_cb, &d);
+
+	t1 = get_time_ns();
+	for (i = 0; i < N_PACKETS; i += BURST) {
+		for (j = 0; j < BURST; j++, sent++)
+			spa_assert_se(write(fd[1], packets[sent % 4], MSBC_ENCODED_SIZE) == MSBC_ENCODED_SIZE);
+		/* fail instead of waiting forever when packets got lost */
+		while (d.n_packets < sent)
+			spa_assert_se(loop_iterate(&l, TIMEOUT_MS) > 0);
+	}
+	t2 = get_time_ns();
+
+	spa_assert(d.n_packets == N_PACKETS);
+	spa_assert(d.n_decoded == N_PACKETS);
+
+	fprintf(stderr, "source: %u mSBC packets read+decoded in %f ms, %f ns/packet\n",
+			d.n_packets, (t2 - t1) / 1e6, (double)(t2 - t1) / d.n_packets);
+
+	spa_bt_sco_io_destroy(io);
+	sbc_finish(&d.msbc);
+	close(fd[0]);
+	close(fd[1]);
+}
+
+static void test_sink(uint32_t packet_size)
+{
+	struct test_loop l = { 0 };
+	struct spa_bt_sco_io *io;
+	uint8_t *data, buf[MSBC_ENCODED_SIZE];
+	uint32_t size = BURST * packet_size, received = 0, written = 0;
+	uint64_t t1, t2;
+	int fd[2], res;
+
+	l.loop.iface = SPA_INTERFACE_INIT(SPA_TYPE_INTERFACE_DataLoop,
+			SPA_VERSION_LOOP, &loop_methods, &l);
+
+	spa_assert_se(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, fd) == 0);
+
+	data = calloc(1, size);
+	spa_assert(data != NULL);
+
+	io = spa_bt_sco_io_create(&l.loop, fd[0], packet_size, packet_size);
+	spa_assert(io != NULL);
+
+	t1 = get_time_ns();
+	while (written < N_PACKETS * packet_size) {
+		struct pollfd pfd = { .fd = fd[1], .events = POLLIN };
+
+		res = spa_bt_sco_io_write(io, data, size);
+		spa_assert(res >= 0);
+		written += res;
+
+		/* everything written must arrive, don't spin when it doesn't */
+		if (received < written)
+			spa_assert_se(poll(&pfd, 1, TIMEOUT_MS) == 1);
+		while ((res = read(fd[1], buf, sizeof(buf))) > 0) {
+			spa_assert((uint32_t)res == packet_size);
+			received += res;
+		}
+	}
+	t2 = get_time_ns();
+
+	spa_assert(received == written);
+
+	fprintf(stderr, "sink: %u packets of %u bytes written in %f ms, %f ns/packet\n",
+			N_PACKETS, packet_size, (t2 - t1) / 1e6,
+			(double)(t2 - t1) / N_PACKETS);
+
+	spa_bt_sco_io_destroy(io);
+	free(data);
+	close(fd[0]);
+	close(fd[1]);
+}
+
+int main(int argc, char *argv[])
+{
+	test_source();
+	test_sink(MSBC_ENCODED_SIZE);
+	/* CVSD at the smallest (ALT1) packet size */
+	test_sink(24);
+	return 0;
+}
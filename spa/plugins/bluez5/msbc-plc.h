@@ -0,0 +1,74 @@
+/* Spa mSBC packet loss concealment
+ *
+ * Copyright © 2021 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SPA_BLUEZ5_MSBC_PLC_H
+#define SPA_BLUEZ5_MSBC_PLC_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <spa/utils/defs.h>
+
+/* Consecutive mSBC frames to conceal before falling back to silence */
+#define MSBC_PLC_MAX_FRAMES 4
+
+struct msbc_plc {
+	uint8_t count;		/* consecutive concealed frames */
+};
+
+static inline void msbc_plc_reset(struct msbc_plc *plc)
+{
+	plc->count = 0;
+}
+
+/* The number of frames lost between the expected and the received 2 bit
+ * mSBC sequence number. */
+static inline uint32_t msbc_plc_lost(uint8_t expected, uint8_t seq)
+{
+	return (seq - expected) & 3;
+}
+
+/* Conceal a lost or corrupt frame of frame_size bytes at offset in data.
+ * The previous frame in data is repeated with its level halved on each
+ * consecutive loss, so the gap fades out instead of clicking. Without a
+ * previous frame, or after MSBC_PLC_MAX_FRAMES losses, silence is written.
+ * Works in place, no history buffer is kept.
+ */
+static inline void msbc_plc_conceal(struct msbc_plc *plc, void *data,
+		uint32_t offset, uint32_t frame_size)
+{
+	int16_t *dst = SPA_MEMBER(data, offset, int16_t);
+	uint32_t i, n_samples = frame_size / sizeof(int16_t);
+
+	if (offset < frame_size || plc->count >= MSBC_PLC_MAX_FRAMES) {
+		memset(dst, 0, frame_size);
+	} else {
+		const int16_t *src = SPA_MEMBER(data, offset - frame_size, int16_t);
+		for (i = 0; i < n_samples; i++)
+			dst[i] = src[i] / 2;
+	}
+	plc->count++;
+}
+
+#endif /* SPA_BLUEZ5_MSBC_PLC_H */
@@ -27,6 +27,7 @@
 #include <stdio.h>
 #include <arpa/inet.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
 
 #include <spa/support/plugin.h>
 #include <spa/support/loop.h>
@@ -67,11 +68,20 @@
 
 #define MAX_MTU 1024
 
+/* Number of packets moved per recvmmsg/sendmmsg call. SCO packets are small
+ * (24..60 bytes for the common settings), so reading and writing several of
+ * them per syscall saves most of the per-packet overhead when the socket
+ * has a backlog.
+ */
+#define MAX_BATCH 8
+
 
 struct spa_bt_sco_io {
 	int started:1;
 
-	uint8_t read_buffer[MAX_MTU];
+	uint8_t read_buffer[MAX_BATCH][MAX_MTU];
+	struct iovec read_iov[MAX_BATCH];
+	struct mmsghdr read_msg[MAX_BATCH];
 	uint32_t read_size;
 
 	int fd;
@@ -116,7 +126,7 @@ static void sco_io_on_ready(struct spa_source *source)
 	struct spa_bt_sco_io *io = source->data;
 
 	if (SPA_FLAG_IS_SET(source->rmask, SPA_IO_IN)) {
-		int res;
+		int i, res;
 
 		/*
 		 * Note that we will read from the socket for a few times even
@@ -124,8 +134,11 @@ static void sco_io_on_ready(struct spa_source *source)
 		 */
 
 	read_again:
-		res = read(io->fd, io->read_buffer, SPA_MIN(io->read_mtu, MAX_MTU));
-		if (res <= 0) {
+		res = recvmmsg(io->fd, io->read_msg, MAX_BATCH, MSG_DONTWAIT, NULL);
+		if (res == 0) {
+			/* no packets: try it next time */
+			goto read_done;
+		} else if (res < 0) {
 			if (errno == EINTR) {
 				/* retry if interrupted */
 				goto read_again;
@@ -138,13 +151,18 @@ static void sco_io_on_ready(struct spa_source *source)
 			goto stop;
 		}
 
-		io->read_size = res;
+		for (i = 0; i < res; i++) {
+			if (io->read_msg[i].msg_len == 0)
+				goto stop;
 
-		if (io->source_cb) {
-			int res;
-			res = io->source_cb(io->source_userdata, io->read_buffer, io->read_size);
-			if (res) {
-				io->source_cb = NULL;
+			io->read_size = io->read_msg[i].msg_len;
+
+			if (io->source_cb) {
+				int res;
+				res = io->source_cb(io->source_userdata, io->read_buffer[i], io->read_size);
+				if (res) {
+					io->source_cb = NULL;
+				}
 			}
 		}
 	}
@@ -194,10 +212,22 @@ int spa_bt_sco_io_write(struct spa_bt_sco_io *io, uint8_t *buf, int size)
 	}
 
 	do {
-		int written;
+		struct mmsghdr msg[MAX_BATCH];
+		struct iovec iov[MAX_BATCH];
+		int i, n_packets, res;
+
+		/* Point the iovecs straight at the caller's data, one packet each */
+		n_packets = SPA_MIN(size / packet_size, MAX_BATCH);
+		for (i = 0; i < n_packets; i++) {
+			iov[i].iov_base = buf + i * packet_size;
+			iov[i].iov_len = packet_size;
+			spa_zero(msg[i]);
+			msg[i].msg_hdr.msg_iov = &iov[i];
+			msg[i].msg_hdr.msg_iovlen = 1;
+		}
 
-		written = write(io->fd, buf, packet_size);
-		if (written < 0) {
+		res = sendmmsg(io->fd, msg, n_packets, 0);
+		if (res < 0) {
 			if (errno == EINTR) {
 				/* retry if interrupted */
 				continue;
@@ -208,8 +238,14 @@ int spa_bt_sco_io_write(struct spa_bt_sco_io *io, uint8_t *buf, int size)
 			return -errno;
 		}
 
-		buf += written;
-		size -= written;
+		for (i = 0; i < res; i++) {
+			buf += msg[i].msg_len;
+			size -= msg[i].msg_len;
+		}
+
+		/* Socket is full, try the rest next time */
+		if (res < n_packets)
+			break;
 	} while (size >= packet_size);
 
 	return buf - buf_start;
@@ -222,6 +258,7 @@ struct spa_bt_sco_io *spa_bt_sco_io_create(struct spa_loop *data_loop,
                                            uint16_t write_mtu)
 {
 	struct spa_bt_sco_io *io;
+	int i;
 
 	io = calloc(1, sizeof(struct spa_bt_sco_io));
 	if (io == NULL)
@@ -234,6 +271,13 @@ struct spa_bt_sco_io *spa_bt_sco_io_create(struct spa_loop *data_loop,
 
 	io->read_size = 0;
 
+	for (i = 0; i < MAX_BATCH; i++) {
+		io->read_iov[i].iov_base = io->read_buffer[i];
+		io->read_iov[i].iov_len = SPA_MIN(io->read_mtu, MAX_MTU);
+		io->read_msg[i].msg_hdr.msg_iov = &io->read_iov[i];
+		io->read_msg[i].msg_hdr.msg_iovlen = 1;
+	}
+
 	/* Add the ready callback */
 	io->source.data = io;
 	io->source.fd = io->fd;
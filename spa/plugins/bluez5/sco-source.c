@@ -53,6 +53,7 @@
 #include <sbc/sbc.h>
 
 #include "defs.h"
+#include "msbc-plc.h"
 
 struct props {
 	uint32_t min_latency;
@@ -133,6 +134,7 @@ struct impl {
 	sbc_t msbc;
 	bool msbc_seq_initialized;
 	uint8_t msbc_seq;
+	struct msbc_plc msbc_plc;
 
 	/* mSBC frame parsing */
 	uint8_t msbc_buffer[MSBC_ENCODED_SIZE];
@@ -450,7 +452,7 @@ static void preprocess_and_decode_msbc_data(void *userdata, uint8_t *read_data,
 			spa_log_trace(this->log, "Received full mSBC packet, start processing it");
 
 			if (port->ready_offset + MSBC_DECODED_SIZE <= datas[0].maxsize) {
-				int seq, processed;
+				int seq, lost, processed;
 				size_t written;
 				spa_log_trace(this->log,
 					"Output buffer has space, processing mSBC packet");
@@ -466,8 +468,16 @@ static void preprocess_and_decode_msbc_data(void *userdata, uint8_t *read_data,
 				} else if (seq != this->msbc_seq) {
 					spa_log_info(this->log,
 						"missing mSBC packet: %u != %u", seq, this->msbc_seq);
+
+					/* Fill in the frames we missed, as far as they fit */
+					for (lost = msbc_plc_lost(this->msbc_seq, seq); lost > 0; lost--) {
+						if (port->ready_offset + 2 * MSBC_DECODED_SIZE > datas[0].maxsize)
+							break;
+						msbc_plc_conceal(&this->msbc_plc, datas[0].data,
+								port->ready_offset, MSBC_DECODED_SIZE);
+						port->ready_offset += MSBC_DECODED_SIZE;
+					}
 					this->msbc_seq = seq;
-					/* TODO: Implement PLC. */
 				}
 				this->msbc_seq = (this->msbc_seq + 1) % 4;
 
@@ -479,10 +489,13 @@ static void preprocess_and_decode_msbc_data(void *userdata, uint8_t *read_data,
 
 				if (processed < 0) {
 					spa_log_warn(this->log, "sbc_decode failed: %d", processed);
-					/* TODO: manage errors */
+					msbc_plc_conceal(&this->msbc_plc, datas[0].data,
+							port->ready_offset, MSBC_DECODED_SIZE);
+					port->ready_offset += MSBC_DECODED_SIZE;
 					continue;
 				}
 
+				msbc_plc_reset(&this->msbc_plc);
 				port->ready_offset += written;
 
 			} else {
@@ -633,6 +646,7 @@ static int do_start(struct impl *this)
 		/* Libsbc expects audio samples by default in host endianness, mSBC requires little endian */
 		this->msbc.endian = SBC_LE;
 		this->msbc_seq_initialized = false;
+		msbc_plc_reset(&this->msbc_plc);
 
 		this->msbc_buffer_pos = 0;
 	}
@@ -0,0 +1,108 @@
+/* Spa mSBC packet loss concealment test
+ *
+ * Copyright © 2021 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+#include <spa/utils/defs.h>
+
+#include "msbc-plc.h"
+
+#define FRAME_SIZE	240	/* MSBC_DECODED_SIZE */
+#define N_SAMPLES	(FRAME_SIZE / sizeof(int16_t))
+#define N_FRAMES	8
+
+static int16_t samples[N_FRAMES * N_SAMPLES];
+
+static void fill_frame(uint32_t frame, int16_t value)
+{
+	uint32_t n;
+	for (n = 0; n < N_SAMPLES; n++)
+		samples[frame * N_SAMPLES + n] = (n & 1) ? -value : value;
+}
+
+static void check_frame(uint32_t frame, int16_t value)
+{
+	uint32_t n;
+	for (n = 0; n < N_SAMPLES; n++)
+		spa_assert(samples[frame * N_SAMPLES + n] == ((n & 1) ? -value : value));
+}
+
+static void test_lost(void)
+{
+	spa_assert(msbc_plc_lost(0, 0) == 0);
+	spa_assert(msbc_plc_lost(1, 2) == 1);
+	spa_assert(msbc_plc_lost(1, 3) == 2);
+	spa_assert(msbc_plc_lost(2, 1) == 3);
+	/* the sequence number wraps around after 3 */
+	spa_assert(msbc_plc_lost(3, 0) == 1);
+	spa_assert(msbc_plc_lost(3, 1) == 2);
+}
+
+static void test_first_frame(void)
+{
+	struct msbc_plc plc;
+
+	/* nothing to repeat at the start of the buffer */
+	msbc_plc_reset(&plc);
+	fill_frame(0, 1234);
+	msbc_plc_conceal(&plc, samples, 0, FRAME_SIZE);
+	check_frame(0, 0);
+	spa_assert(plc.count == 1);
+}
+
+static void test_fade_out(void)
+{
+	struct msbc_plc plc;
+	uint32_t i;
+
+	msbc_plc_reset(&plc);
+	fill_frame(0, 1000);
+
+	/* each lost frame repeats the previous one at half the level */
+	for (i = 1; i <= MSBC_PLC_MAX_FRAMES; i++) {
+		fill_frame(i, 0x7fff);
+		msbc_plc_conceal(&plc, samples, i * FRAME_SIZE, FRAME_SIZE);
+		check_frame(i, 1000 >> i);
+	}
+	/* then silence */
+	fill_frame(i, 0x7fff);
+	msbc_plc_conceal(&plc, samples, i * FRAME_SIZE, FRAME_SIZE);
+	check_frame(i, 0);
+
+	/* a decoded frame starts over */
+	msbc_plc_reset(&plc);
+	fill_frame(6, 800);
+	msbc_plc_conceal(&plc, samples, 7 * FRAME_SIZE, FRAME_SIZE);
+	check_frame(7, 400);
+	check_frame(6, 800);
+}
+
+int main(int argc, char *argv[])
+{
+	test_lost();
+	test_first_frame();
+	test_fade_out();
+	return 0;
+}
@@ -1129,7 +1129,8 @@ int sm_alsa_monitor_start(struct sm_media_session *session)
 	    pw_properties_parse_bool(str))
 		impl->reserve = true;
 
-	impl->handle = pw_context_load_spa_handle(context, SPA_NAME_API_ALSA_ENUM_UDEV, NULL);
+	impl->handle = pw_context_load_spa_handle(context, SPA_NAME_API_ALSA_ENUM_UDEV,
+			&impl->props->dict);
 	if (impl->handle == NULL) {
 		res = -errno;
 		pw_log_info("can't load %s: %m", SPA_NAME_API_ALSA_ENUM_UDEV);
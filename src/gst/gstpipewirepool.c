@@ -67,6 +67,7 @@ pool_data_destroy (gpointer user_data)
 {
   GstPipeWirePoolData *data = user_data;
 
+  data->pool->datas = g_list_remove (data->pool->datas, data);
   gst_object_unref (data->pool);
   g_slice_free (GstPipeWirePoolData, data);
 }
@@ -111,6 +112,8 @@ void gst_pipewire_pool_wrap_buffer (GstPipeWirePool *pool, struct pw_buffer *b)
 
   data->pool = gst_object_ref (pool);
   data->owner = NULL;
+  data->queued = FALSE;
+  data->released = FALSE;
   data->header = spa_buffer_find_meta_data (b->buffer, SPA_META_Header, sizeof(*data->header));
   data->flags = GST_BUFFER_FLAGS (buf);
   data->b = b;
@@ -124,6 +127,7 @@ void gst_pipewire_pool_wrap_buffer (GstPipeWirePool *pool, struct pw_buffer *b)
                              data,
                              pool_data_destroy);
   b->user_data = data;
+  pool->datas = g_list_prepend (pool->datas, data);
 }
 
 GstPipeWirePoolData *gst_pipewire_pool_get_data (GstBuffer *buffer)
@@ -131,6 +135,35 @@ GstPipeWirePoolData *gst_pipewire_pool_get_data (GstBuffer *buffer)
   return gst_mini_object_get_qdata (GST_MINI_OBJECT_CAST (buffer), pool_data_quark);
 }
 
+/* Find the buffer that owns the fd of @mem. This also finds our memory when
+ * it was shared into another GstBuffer, for example after a copy of the
+ * buffer or when upstream replaced the buffer but kept the memory. */
+GstPipeWirePoolData *gst_pipewire_pool_find_memory_data (GstPipeWirePool *pool, GstMemory *mem)
+{
+  GList *walk;
+  int fd;
+
+  if (!gst_is_fd_memory (mem))
+    return NULL;
+
+  fd = gst_fd_memory_get_fd (mem);
+
+  for (walk = pool->datas; walk; walk = g_list_next (walk)) {
+    GstPipeWirePoolData *data = walk->data;
+    struct spa_buffer *b = data->b->buffer;
+    uint32_t i;
+
+    for (i = 0; i < b->n_datas; i++) {
+      struct spa_data *d = &b->datas[i];
+
+      if ((d->type == SPA_DATA_MemFd || d->type == SPA_DATA_DmaBuf) &&
+          d->fd == fd)
+        return data;
+    }
+  }
+  return NULL;
+}
+
 #if 0
 gboolean
 gst_pipewire_pool_add_buffer (GstPipeWirePool *pool, GstBuffer *buffer)
@@ -186,6 +219,8 @@ acquire_buffer (GstBufferPool * pool, GstBuffer ** buffer,
   }
 
   data = b->user_data;
+  data->queued = FALSE;
+  data->released = FALSE;
   *buffer = data->buf;
 
   GST_OBJECT_UNLOCK (pool);
@@ -220,7 +255,15 @@ flush_start (GstBufferPool * pool)
 static void
 release_buffer (GstBufferPool * pool, GstBuffer *buffer)
 {
+  GstPipeWirePoolData *data = gst_pipewire_pool_get_data (buffer);
+
   GST_DEBUG ("release buffer %p", buffer);
+
+  /* nobody uses the buffer anymore, only shared memory of it can remain */
+  GST_OBJECT_LOCK (pool);
+  if (data)
+    data->released = TRUE;
+  GST_OBJECT_UNLOCK (pool);
 }
 
 static gboolean
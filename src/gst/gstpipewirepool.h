@@ -57,6 +57,7 @@ struct _GstPipeWirePoolData {
   struct pw_buffer *b;
   GstBuffer *buf;
   gboolean queued;
+  gboolean released;
   struct spa_meta_region *crop;
 };
 
@@ -69,6 +70,8 @@ struct _GstPipeWirePool {
   GstAllocator *fd_allocator;
   GstAllocator *dmabuf_allocator;
 
+  GList *datas;
+
   GCond cond;
 };
 
@@ -83,6 +86,7 @@ GstPipeWirePool *  gst_pipewire_pool_new           (void);
 void gst_pipewire_pool_wrap_buffer (GstPipeWirePool *pool, struct pw_buffer *buffer);
 
 GstPipeWirePoolData *gst_pipewire_pool_get_data (GstBuffer *buffer);
+GstPipeWirePoolData *gst_pipewire_pool_find_memory_data (GstPipeWirePool *pool, GstMemory *mem);
 
 //gboolean        gst_pipewire_pool_add_buffer    (GstPipeWirePool *pool, GstBuffer *buffer);
 //gboolean        gst_pipewire_pool_remove_buffer (GstPipeWirePool *pool, GstBuffer *buffer);
@@ -129,12 +129,35 @@ gst_pipewire_sink_finalize (GObject * object)
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
+/* Offer our pool with the size of a frame so that upstream renders directly
+ * into the buffers of the stream and we don't need to copy. */
 static gboolean
 gst_pipewire_sink_propose_allocation (GstBaseSink * bsink, GstQuery * query)
 {
   GstPipeWireSink *pwsink = GST_PIPEWIRE_SINK (bsink);
+  GstBufferPool *pool = GST_BUFFER_POOL_CAST (pwsink->pool);
+  GstCaps *caps;
+  gboolean need_pool;
+  GstVideoInfo info;
+  guint size = 0;
+
+  gst_query_parse_allocation (query, &caps, &need_pool);
+
+  if (caps && gst_video_info_from_caps (&info, caps))
+    size = GST_VIDEO_INFO_SIZE (&info);
+
+  if (need_pool && !gst_buffer_pool_is_active (pool)) {
+    GstStructure *config;
+
+    config = gst_buffer_pool_get_config (pool);
+    gst_buffer_pool_config_set_params (config, caps, size, MIN_BUFFERS, 0);
+    if (!gst_buffer_pool_set_config (pool, config))
+      GST_WARNING_OBJECT (pwsink, "could not configure pool");
+  }
+
+  gst_query_add_allocation_pool (query, pool, size, MIN_BUFFERS, 0);
+  gst_query_add_allocation_meta (query, GST_VIDEO_CROP_META_API_TYPE, NULL);
 
-  gst_query_add_allocation_pool (query, GST_BUFFER_POOL_CAST (pwsink->pool), 0, 0, 0);
   return TRUE;
 }
 
@@ -404,7 +427,11 @@ static void
 on_add_buffer (void *_data, struct pw_buffer *b)
 {
   GstPipeWireSink *pwsink = _data;
+  GstPipeWirePoolData *data;
+
   gst_pipewire_pool_wrap_buffer (pwsink->pool, b);
+  data = b->user_data;
+  data->queued = TRUE;
 }
 
 static void
@@ -419,15 +446,12 @@ on_remove_buffer (void *_data, struct pw_buffer *b)
 }
 
 static void
-do_send_buffer (GstPipeWireSink *pwsink, GstBuffer *buffer)
+do_send_buffer (GstPipeWireSink *pwsink, GstBuffer *buffer, GstPipeWirePoolData *data)
 {
-  GstPipeWirePoolData *data;
   gboolean res;
   guint i;
   struct spa_buffer *b;
 
-  data = gst_pipewire_pool_get_data(buffer);
-
   b = data->b->buffer;
 
   if (data->header) {
@@ -451,12 +475,56 @@ do_send_buffer (GstPipeWireSink *pwsink, GstBuffer *buffer)
     d->chunk->size = mem->size;
   }
 
+  data->queued = TRUE;
   if ((res = pw_stream_queue_buffer (pwsink->stream, data->b)) < 0) {
     g_warning ("can't send buffer %s", spa_strerror(res));
   }
 }
 
 
+/* See if all memory of @buffer is the memory of one of our dequeued
+ * buffers, in the same order. This happens when our buffer was copied
+ * upstream and we can then send it without copying.
+ *
+ * The stream reuses the buffer as soon as the consumer is done with it, so
+ * @buffer must be ours alone: our pool buffer was released by upstream,
+ * nobody else holds @buffer and its memory is not in any other buffer. */
+static GstPipeWirePoolData *
+find_shared_data (GstPipeWireSink *pwsink, GstBuffer *buffer)
+{
+  GstPipeWirePoolData *data;
+  gboolean released;
+  guint i, n_mem;
+
+  n_mem = gst_buffer_n_memory (buffer);
+  if (n_mem == 0 || !gst_buffer_is_writable (buffer))
+    return NULL;
+
+  data = gst_pipewire_pool_find_memory_data (pwsink->pool,
+      gst_buffer_peek_memory (buffer, 0));
+  if (data == NULL || data->queued)
+    return NULL;
+
+  GST_OBJECT_LOCK (pwsink->pool);
+  released = data->released;
+  GST_OBJECT_UNLOCK (pwsink->pool);
+  if (!released)
+    return NULL;
+
+  if (gst_buffer_n_memory (data->buf) != n_mem)
+    return NULL;
+
+  for (i = 0; i < n_mem; i++) {
+    GstMemory *mem = gst_buffer_peek_memory (buffer, i);
+
+    /* one ref for our pool buffer and one for @buffer */
+    if (mem != gst_buffer_peek_memory (data->buf, i) ||
+        GST_MINI_OBJECT_REFCOUNT_VALUE (mem) != 2)
+      return NULL;
+  }
+  return data;
+}
+
 static void
 on_process (void *data)
 {
@@ -577,6 +645,7 @@ gst_pipewire_sink_render (GstBaseSink * bsink, GstBuffer * buffer)
   GstFlowReturn res = GST_FLOW_OK;
   const char *error = NULL;
   gboolean unref_buffer = FALSE;
+  GstPipeWirePoolData *data;
 
   pwsink = GST_PIPEWIRE_SINK (bsink);
 
@@ -604,13 +673,24 @@ gst_pipewire_sink_render (GstBaseSink * bsink, GstBuffer * buffer)
   if (pw_stream_get_state (pwsink->stream, &error) != PW_STREAM_STATE_STREAMING)
     goto done_unlock;
 
-  if (buffer->pool != GST_BUFFER_POOL_CAST (pwsink->pool)) {
+  if (buffer->pool == GST_BUFFER_POOL_CAST (pwsink->pool)) {
+    data = gst_pipewire_pool_get_data (buffer);
+    /* the same buffer can be rendered again while it is still queued */
+    if (data->queued)
+      data = NULL;
+  } else if ((data = find_shared_data (pwsink, buffer)) != NULL) {
+    GST_LOG_OBJECT (pwsink, "send shared memory of buffer %p", data->buf);
+  }
+
+  if (data == NULL) {
     GstBuffer *b = NULL;
     GstMapInfo info = { 0, };
     GstBufferPoolAcquireParams params = { 0, };
 
     pw_thread_loop_unlock (pwsink->core->loop);
 
+    GST_LOG_OBJECT (pwsink, "copy buffer %p", buffer);
+
     if ((res = gst_buffer_pool_acquire_buffer (GST_BUFFER_POOL_CAST (pwsink->pool), &b, &params)) != GST_FLOW_OK)
       goto done;
 
@@ -620,6 +700,7 @@ gst_pipewire_sink_render (GstBaseSink * bsink, GstBuffer * buffer)
     gst_buffer_resize (b, 0, gst_buffer_get_size (buffer));
     buffer = b;
     unref_buffer = TRUE;
+    data = gst_pipewire_pool_get_data (buffer);
 
     pw_thread_loop_lock (pwsink->core->loop);
     if (pw_stream_get_state (pwsink->stream, &error) != PW_STREAM_STATE_STREAMING)
@@ -627,7 +708,7 @@ gst_pipewire_sink_render (GstBaseSink * bsink, GstBuffer * buffer)
   }
 
   GST_DEBUG ("push buffer");
-  do_send_buffer (pwsink, buffer);
+  do_send_buffer (pwsink, buffer, data);
   if (unref_buffer)
     gst_buffer_unref (buffer);
 
@@ -41,7 +41,8 @@
 #include "pipewire/extensions/protocol-native.h"
 #include "pipewire/extensions/client-node.h"
 
-#define MAX_MIX	4096
+#define MAX_MIX		4096
+#define MIX_CHUNK	16
 
 /** \cond */
 static bool mlock_warned = false;
@@ -61,6 +62,13 @@ struct mix {
 	bool active;
 };
 
+/* mixes are allocated in chunks when needed, most nodes only ever
+ * use a few of them */
+struct mix_chunk {
+	struct spa_list link;
+	struct mix mix[MIX_CHUNK];
+};
+
 struct node_data {
 	struct pw_context *context;
 
@@ -70,7 +78,8 @@ struct node_data {
 	int rtwritefd;
 	struct pw_memmap *activation;
 
-	struct mix mix_pool[MAX_MIX];
+	struct spa_list mix_chunks;
+	uint32_t n_mix;
 	struct spa_list mix[2];
 	struct spa_list free_mix;
 
@@ -224,6 +233,41 @@ static struct mix *find_mix(struct node_data *data,
 	return NULL;
 }
 
+static int alloc_mix_chunk(struct node_data *data)
+{
+	struct mix_chunk *chunk;
+	uint32_t i;
+
+	if (data->n_mix + MIX_CHUNK > MAX_MIX)
+		return -ENOSPC;
+
+	chunk = calloc(1, sizeof(struct mix_chunk));
+	if (chunk == NULL)
+		return -errno;
+
+	spa_list_append(&data->mix_chunks, &chunk->link);
+	for (i = 0; i < MIX_CHUNK; i++)
+		spa_list_append(&data->free_mix, &chunk->mix[i].link);
+	data->n_mix += MIX_CHUNK;
+
+	pw_log_debug("%p: allocated mix chunk, %u mixes", data, data->n_mix);
+	return 0;
+}
+
+static void free_mix_chunks(struct node_data *data)
+{
+	struct mix_chunk *chunk;
+
+	spa_list_consume(chunk, &data->mix_chunks, link) {
+		spa_list_remove(&chunk->link);
+		free(chunk);
+	}
+	spa_list_init(&data->free_mix);
+	spa_list_init(&data->mix[SPA_DIRECTION_INPUT]);
+	spa_list_init(&data->mix[SPA_DIRECTION_OUTPUT]);
+	data->n_mix = 0;
+}
+
 static struct mix *ensure_mix(struct node_data *data,
 		enum spa_direction direction, uint32_t port_id, uint32_t mix_id)
 {
@@ -233,13 +277,13 @@ static struct mix *ensure_mix(struct node_data *data,
 	if ((mix = find_mix(data, direction, port_id, mix_id)))
 		return mix;
 
-	if (spa_list_is_empty(&data->free_mix))
-		return NULL;
-
 	port = pw_impl_node_find_port(data->node, direction, port_id);
 	if (port == NULL)
 		return NULL;
 
+	if (spa_list_is_empty(&data->free_mix) && alloc_mix_chunk(data) < 0)
+		return NULL;
+
 	mix = spa_list_first(&data->free_mix, struct mix, link);
 	spa_list_remove(&mix->link);
 
@@ -829,6 +873,10 @@ static int link_signal_func(void *user_data)
 	link->target.activation->status = PW_NODE_ACTIVATION_TRIGGERED;
 	link->target.activation->signal_time = SPA_TIMESPEC_TO_NSEC(&ts);
 
+	if (link->target.wakeup &&
+	    pw_node_activation_wakeup(link->target.activation))
+		return 0;
+
 	if (SPA_UNLIKELY(spa_system_eventfd_write(data_system, link->signalfd, 1) < 0))
 		pw_log_warn("link %p: write failed %m", link);
 
@@ -893,6 +941,7 @@ client_node_set_activation(void *object,
 		link->node_id = node_id;
 		link->map = mm;
 		link->target.activation = ptr;
+		link->target.wakeup = PW_NODE_ACTIVATION_HAS_WAKEUP(size);
 		link->signalfd = signalfd;
 		link->target.signal = link_signal_func;
 		link->target.data = link;
@@ -1107,6 +1156,7 @@ static void client_node_removed(void *_data)
 		if (data->do_free)
 			pw_impl_node_destroy(data->node);
 	}
+	free_mix_chunks(data);
 	data->client_node = NULL;
 }
 
@@ -1197,7 +1247,6 @@ static struct pw_proxy *node_export(struct pw_core *core, void *object, bool do_
 	struct pw_proxy *client_node;
 	struct node_data *data;
 	const char *str;
-	int i;
 
 	user_data_size = SPA_ROUND_UP_N(user_data_size, __alignof__(struct node_data));
 
@@ -1229,11 +1278,10 @@ static struct pw_proxy *node_export(struct pw_core *core, void *object, bool do_
 
 	node->exported = true;
 
+	spa_list_init(&data->mix_chunks);
 	spa_list_init(&data->free_mix);
 	spa_list_init(&data->mix[0]);
 	spa_list_init(&data->mix[1]);
-	for (i = 0; i < MAX_MIX; i++)
-		spa_list_append(&data->free_mix, &data->mix_pool[i].link);
 
 	spa_list_init(&data->links);
 
@@ -71,6 +71,10 @@
  * - `aec.method = <str>`: the echo cancellation method. Currently supported:
  * `webrtc`. Leave unset to use the default method (`webrtc`).
  * - `aec.args = <str>`: arguments to pass to the echo cancellation method
+ * - `aec.thread = <bool>`: run the echo canceller in a separate thread instead
+ *   of in the processing thread. The echo cancelled samples are then available
+ *   one cycle later, which adds one block of latency to the source. When the
+ *   thread falls more than MAX_WORK_BLOCKS behind, captured blocks are dropped.
  *
  * ## General options
  *
@@ -113,6 +117,8 @@
 /* Hopefully this is enough for any combination of AEC engine and resampler
  * input requirement for rate matching */
 #define MAX_BUFSIZE_MS 100
+/* the number of blocks that can be queued for the echo canceller thread */
+#define MAX_WORK_BLOCKS 4
 
 static const struct spa_dict_item module_props[] = {
 	{ PW_KEY_MODULE_AUTHOR, "Wim Taymans <wim.taymans@gmail.com>" },
@@ -124,11 +130,19 @@ static const struct spa_dict_item module_props[] = {
 				"[ audio.position=<channel map> ] "
 				"[ aec.method=<aec method> ] "
 				"[ aec.args=<aec arguments> ] "
+				"[ aec.thread=<run the aec in a thread> ] "
 				"[ source.props=<properties> ] "
 				"[ sink.props=<properties> ] " },
 	{ PW_KEY_MODULE_VERSION, PACKAGE_VERSION },
 };
 
+struct work_block {
+	float *rec[SPA_AUDIO_MAX_CHANNELS];
+	float *play[SPA_AUDIO_MAX_CHANNELS];
+	float *out[SPA_AUDIO_MAX_CHANNELS];
+	uint32_t size;
+};
+
 struct impl {
 	struct pw_context *context;
 
@@ -172,6 +186,17 @@ struct impl {
 	void *aec;
 	uint32_t aec_blocksize;
 
+	/* with aec.thread, the processing thread queues blocks at work_write
+	 * and takes them back at work_read, the worker thread runs the
+	 * canceller on the blocks up to work_write and advances work_done */
+	struct pw_thread_loop *worker;
+	struct spa_source *work_event;
+	struct work_block work_blocks[MAX_WORK_BLOCKS];
+	void *work_mem;
+	uint32_t work_write;
+	uint32_t work_done;
+	uint32_t work_read;
+
 	unsigned int capture_ready:1;
 	unsigned int sink_ready:1;
 
@@ -192,6 +217,72 @@ static void unload_module(struct impl *impl)
 	}
 }
 
+static void write_output(struct impl *impl, float *out[], uint32_t size)
+{
+	uint32_t i, oindex;
+	int32_t avail;
+
+	avail = spa_ringbuffer_get_write_index(&impl->out_ring, &oindex);
+	if (avail + size > impl->out_ringsize) {
+		uint32_t rindex, drop;
+
+		/* Drop enough so we have size bytes left */
+		drop = avail + size - impl->out_ringsize;
+		pw_log_debug("output ringbuffer xrun %d + %u > %u, dropping %u",
+				avail, size, impl->out_ringsize, drop);
+
+		spa_ringbuffer_get_read_index(&impl->out_ring, &rindex);
+		spa_ringbuffer_read_update(&impl->out_ring, rindex + drop);
+
+		avail += drop;
+	}
+
+	for (i = 0; i < impl->info.channels; i++) {
+		/* captured samples, with echo from sink */
+		spa_ringbuffer_write_data(&impl->out_ring, impl->out_buffer[i],
+				impl->out_ringsize, oindex % impl->out_ringsize,
+				(void *)out[i], size);
+	}
+
+	spa_ringbuffer_write_update(&impl->out_ring, oindex + size);
+}
+
+/* runs in the worker thread */
+static void do_work(void *data, uint64_t count)
+{
+	struct impl *impl = data;
+	struct work_block *block;
+	uint32_t index, write;
+
+	index = impl->work_done;
+	write = __atomic_load_n(&impl->work_write, __ATOMIC_ACQUIRE);
+
+	while (index != write) {
+		block = &impl->work_blocks[index % MAX_WORK_BLOCKS];
+
+		echo_cancel_run(impl->aec_info, impl->aec,
+				(const float **)block->rec, (const float **)block->play,
+				block->out, block->size / sizeof(float));
+
+		__atomic_store_n(&impl->work_done, ++index, __ATOMIC_RELEASE);
+	}
+}
+
+/* take the blocks that the worker finished */
+static void collect_work(struct impl *impl)
+{
+	struct work_block *block;
+	uint32_t done;
+
+	done = __atomic_load_n(&impl->work_done, __ATOMIC_ACQUIRE);
+
+	while (impl->work_read != done) {
+		block = &impl->work_blocks[impl->work_read % MAX_WORK_BLOCKS];
+		write_output(impl, block->out, block->size);
+		impl->work_read++;
+	}
+}
+
 static void process(struct impl *impl)
 {
 	struct pw_buffer *cout;
@@ -202,6 +293,7 @@ static void process(struct impl *impl)
 	const float *rec[impl->info.channels];
 	const float *play[impl->info.channels];
 	float *out[impl->info.channels];
+	struct work_block *block = NULL;
 	struct spa_data *dd;
 	uint32_t i, size;
 	uint32_t rindex, pindex, oindex, avail;
@@ -214,16 +306,31 @@ static void process(struct impl *impl)
 
 	size = impl->aec_blocksize;
 
+	if (impl->worker) {
+		collect_work(impl);
+
+		if (impl->work_write - impl->work_read < MAX_WORK_BLOCKS)
+			block = &impl->work_blocks[impl->work_write % MAX_WORK_BLOCKS];
+		else
+			pw_log_debug("echo canceller thread too slow, dropping block");
+	}
+
 	/* First read a block from the playback and capture ring buffers */
 
 	spa_ringbuffer_get_read_index(&impl->rec_ring, &rindex);
 	spa_ringbuffer_get_read_index(&impl->play_ring, &pindex);
 
 	for (i = 0; i < impl->info.channels; i++) {
-		/* captured samples, with echo from sink */
-		rec[i] = &rec_buf[i][0];
-		/* echo from sink */
-		play[i] = &play_buf[i][0];
+		if (block) {
+			/* read straight into the block for the worker */
+			rec[i] = block->rec[i];
+			play[i] = block->play[i];
+		} else {
+			/* captured samples, with echo from sink */
+			rec[i] = &rec_buf[i][0];
+			/* echo from sink */
+			play[i] = &play_buf[i][0];
+		}
 		/* filtered samples, without echo from sink */
 		out[i] = &out_buf[i][0];
 
@@ -251,34 +358,20 @@ static void process(struct impl *impl)
 
 	pw_stream_queue_buffer(impl->playback, pout);
 
-	/* Now run the canceller */
-	echo_cancel_run(impl->aec_info, impl->aec, rec,	play, out, size / sizeof(float));
-
-	/* Next, copy over the output to the output ringbuffer */
-	avail = spa_ringbuffer_get_write_index(&impl->out_ring, &oindex);
-	if (avail + size > impl->out_ringsize) {
-		uint32_t rindex, drop;
-
-		/* Drop enough so we have size bytes left */
-		drop = avail + size - impl->out_ringsize;
-		pw_log_debug("output ringbuffer xrun %d + %u > %u, dropping %u",
-				avail, size, impl->out_ringsize, drop);
-
-		spa_ringbuffer_get_read_index(&impl->out_ring, &rindex);
-		spa_ringbuffer_read_update(&impl->out_ring, rindex + drop);
-
-		avail += drop;
-	}
-
-	for (i = 0; i < impl->info.channels; i++) {
-		/* captured samples, with echo from sink */
-		spa_ringbuffer_write_data(&impl->out_ring, impl->out_buffer[i],
-				impl->out_ringsize, oindex % impl->out_ringsize,
-				(void *)out[i], size);
+	if (block) {
+		/* Let the worker run the canceller, we pick up the result
+		 * in the next cycle */
+		block->size = size;
+		__atomic_store_n(&impl->work_write, impl->work_write + 1, __ATOMIC_RELEASE);
+		pw_loop_signal_event(pw_thread_loop_get_loop(impl->worker), impl->work_event);
+	} else if (!impl->worker) {
+		/* Now run the canceller */
+		echo_cancel_run(impl->aec_info, impl->aec, rec,	play, out, size / sizeof(float));
+
+		/* Next, copy over the output to the output ringbuffer */
+		write_output(impl, out, size);
 	}
 
-	spa_ringbuffer_write_update(&impl->out_ring, oindex + size);
-
 	/* And finally take data from the output ringbuffer and make it
 	 * available on the source */
 
@@ -683,6 +776,43 @@ static int setup_streams(struct impl *impl)
 	return 0;
 }
 
+static int setup_worker(struct impl *impl)
+{
+	uint32_t i, j, size;
+	float *mem;
+	int res;
+
+	size = MAX_BUFSIZE_MS * impl->info.rate / 1000;
+	impl->work_mem = calloc(MAX_WORK_BLOCKS * 3 * impl->info.channels, size * sizeof(float));
+	if (impl->work_mem == NULL)
+		return -errno;
+
+	mem = impl->work_mem;
+	for (i = 0; i < MAX_WORK_BLOCKS; i++) {
+		struct work_block *block = &impl->work_blocks[i];
+		for (j = 0; j < impl->info.channels; j++) {
+			block->rec[j] = mem;
+			block->play[j] = mem + size;
+			block->out[j] = mem + 2 * size;
+			mem += 3 * size;
+		}
+	}
+
+	impl->worker = pw_thread_loop_new("echo-cancel", NULL);
+	if (impl->worker == NULL)
+		return -errno;
+
+	impl->work_event = pw_loop_add_event(pw_thread_loop_get_loop(impl->worker),
+			do_work, impl);
+	if (impl->work_event == NULL)
+		return -errno;
+
+	if ((res = pw_thread_loop_start(impl->worker)) < 0)
+		return res;
+
+	return 0;
+}
+
 static void core_error(void *data, uint32_t id, int seq, int res, const char *message)
 {
 	struct impl *impl = data;
@@ -724,6 +854,14 @@ static void impl_destroy(struct impl *impl)
 		pw_stream_destroy(impl->sink);
 	if (impl->core && impl->do_disconnect)
 		pw_core_disconnect(impl->core);
+	if (impl->worker) {
+		pw_thread_loop_stop(impl->worker);
+		if (impl->work_event)
+			pw_loop_destroy_source(pw_thread_loop_get_loop(impl->worker),
+					impl->work_event);
+		pw_thread_loop_destroy(impl->worker);
+	}
+	free(impl->work_mem);
 	if (impl->aec)
 		echo_cancel_destroy(impl->aec_info, impl->aec);
 	pw_properties_free(impl->source_props);
@@ -909,6 +1047,15 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 		impl->aec_blocksize = 0;
 	}
 
+	if ((str = pw_properties_get(props, "aec.thread")) != NULL &&
+	    pw_properties_parse_bool(str)) {
+		if ((res = setup_worker(impl)) < 0) {
+			pw_log_error("can't start echo canceller thread: %s",
+					spa_strerror(res));
+			goto error;
+		}
+	}
+
 	impl->core = pw_context_get_object(impl->context, PW_TYPE_INTERFACE_Core);
 	if (impl->core == NULL) {
 		str = pw_properties_get(props, PW_KEY_REMOTE_NAME);
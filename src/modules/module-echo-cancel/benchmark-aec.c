@@ -0,0 +1,159 @@
+/* PipeWire
+ *
+ * Copyright © 2021 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Feeds synthetic capture and playback signals in 10 ms blocks to the echo
+ * canceller backends and reports how long a block takes and how much of the
+ * echo was removed. The capture signal is a delayed and attenuated copy of
+ * the playback signal with a near end tone.
+ *
+ * Pass the name of a backend to only run that one.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include <spa/utils/defs.h>
+#include <spa/utils/string.h>
+
+#include "echo-cancel.h"
+
+#define RATE		48000
+#define CHANNELS	2
+#define BLOCK		(RATE / 100)
+#define N_BLOCKS	1000
+#define ECHO_DELAY	(RATE / 50)
+#define ECHO_GAIN	0.5f
+
+static float play_signal[CHANNELS][N_BLOCKS * BLOCK];
+static float rec_signal[CHANNELS][N_BLOCKS * BLOCK];
+static float out_signal[CHANNELS][N_BLOCKS * BLOCK];
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void make_signals(void)
+{
+	uint32_t c, n;
+
+	srand48(0);
+	for (c = 0; c < CHANNELS; c++) {
+		for (n = 0; n < N_BLOCKS * BLOCK; n++) {
+			/* far end, noisy speech like signal */
+			play_signal[c][n] = 0.3f * sinf(2.0f * (float)M_PI * 220.0f * n / RATE) *
+				sinf(2.0f * (float)M_PI * 3.0f * n / RATE) +
+				0.1f * (drand48() * 2.0 - 1.0);
+			/* near end tone plus the echo of the far end */
+			rec_signal[c][n] = 0.1f * sinf(2.0f * (float)M_PI * 1000.0f * n / RATE);
+			if (n >= ECHO_DELAY)
+				rec_signal[c][n] += ECHO_GAIN * play_signal[c][n - ECHO_DELAY];
+		}
+	}
+}
+
+static double power(float *data, uint32_t n_samples)
+{
+	double sum = 0.0;
+	uint32_t n;
+
+	for (n = 0; n < n_samples; n++)
+		sum += data[n] * data[n];
+	return sum / n_samples;
+}
+
+static void run_backend(const struct echo_cancel_info *info)
+{
+	struct spa_audio_info_raw raw = SPA_AUDIO_INFO_RAW_INIT(
+			.format = SPA_AUDIO_FORMAT_F32P,
+			.rate = RATE,
+			.channels = CHANNELS,
+			.position = { SPA_AUDIO_CHANNEL_FL, SPA_AUDIO_CHANNEL_FR });
+	struct pw_properties *props;
+	const float *rec[CHANNELS], *play[CHANNELS];
+	float *out[CHANNELS];
+	uint64_t t1, t2, total = 0, max = 0;
+	uint32_t b, c, last;
+	double in_power, out_power;
+	void *ec;
+
+	props = pw_properties_new(NULL, NULL);
+	spa_assert_se(props != NULL);
+	ec = echo_cancel_create(info, props, &raw);
+	pw_properties_free(props);
+	spa_assert_se(ec != NULL);
+
+	for (b = 0; b < N_BLOCKS; b++) {
+		for (c = 0; c < CHANNELS; c++) {
+			rec[c] = &rec_signal[c][b * BLOCK];
+			play[c] = &play_signal[c][b * BLOCK];
+			out[c] = &out_signal[c][b * BLOCK];
+		}
+		t1 = get_time_ns();
+		spa_assert_se(echo_cancel_run(info, ec, rec, play, out, BLOCK) >= 0);
+		t2 = get_time_ns();
+
+		total += t2 - t1;
+		max = SPA_MAX(max, t2 - t1);
+	}
+	echo_cancel_destroy(info, ec);
+
+	/* measure on the last second, after the canceller converged */
+	last = (N_BLOCKS - 100) * BLOCK;
+	in_power = power(&rec_signal[0][last], 100 * BLOCK);
+	out_power = power(&out_signal[0][last], 100 * BLOCK);
+
+	fprintf(stderr, "%-8s %u blocks of %u samples: %8.0f ns/block, max %8"PRIu64" ns, "
+			"%.3f%% of realtime, output/input power %.1f dB\n",
+			info->name, N_BLOCKS, BLOCK,
+			(double)total / N_BLOCKS, max,
+			100.0 * total / (N_BLOCKS * SPA_NSEC_PER_SEC / 100),
+			10.0 * log10(SPA_MAX(out_power, 1e-20) / SPA_MAX(in_power, 1e-20)));
+}
+
+int main(int argc, char *argv[])
+{
+	const struct echo_cancel_info *backends[] = {
+		echo_cancel_null,
+#ifdef HAVE_WEBRTC
+		echo_cancel_webrtc,
+#endif
+	};
+	uint32_t i;
+
+	make_signals();
+
+	for (i = 0; i < SPA_N_ELEMENTS(backends); i++) {
+		if (argc > 1 && !spa_streq(argv[1], backends[i]->name))
+			continue;
+		run_backend(backends[i]);
+	}
+	return 0;
+}
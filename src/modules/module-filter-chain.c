@@ -104,6 +104,7 @@ static const struct spa_dict_item module_props[] = {
 #define MAX_PORTS 64
 #define MAX_CONTROLS 256
 #define MAX_SAMPLES 8192
+#define MAX_BUFFERS 64
 
 struct ladspa_handle {
 	struct spa_list link;
@@ -145,6 +146,9 @@ struct port {
 
 	LADSPA_Data control_data;
 	LADSPA_Data *audio_data[MAX_HNDL];
+
+	uint32_t buffer;	/* index in the graph buffers of an output with links */
+	uint32_t last_step;	/* step of the last node that reads the output */
 };
 
 struct node {
@@ -165,6 +169,9 @@ struct node {
 
 	unsigned int n_deps;
 	unsigned int visited:1;
+
+	struct spa_list plan_link;
+	uint32_t step;
 };
 
 struct link {
@@ -181,11 +188,16 @@ struct graph_port {
 	const LADSPA_Descriptor *desc;
 	LADSPA_Handle hndl;
 	uint32_t port;
+	void *data;		/* currently connected memory */
 };
 
 struct graph_hndl {
 	const LADSPA_Descriptor *desc;
 	LADSPA_Handle hndl;
+	/* when set, run all n_hndl instances of the node at once */
+	void (*run_n) (LADSPA_Handle *hndl, uint32_t n_hndl, unsigned long SampleCount);
+	LADSPA_Handle *hndls;
+	uint32_t n_hndl;
 };
 
 struct graph {
@@ -206,6 +218,10 @@ struct graph {
 	uint32_t n_control;
 	struct port *control_port[MAX_CONTROLS];
 
+	/* buffers between the nodes, each with MAX_SAMPLES for every instance */
+	uint32_t n_buffers;
+	LADSPA_Data *buffers[MAX_BUFFERS];
+
 	LADSPA_Data silence_data[MAX_SAMPLES];
 	LADSPA_Data discard_data[MAX_SAMPLES];
 };
@@ -281,29 +297,38 @@ static void capture_process(void *d)
 	if (in == NULL || out == NULL)
 		goto done;
 
+	/* the streams cycle through a few buffers, only connect the ports
+	 * again when they got other memory */
 	for (i = 0; i < in->buffer->n_datas; i++) {
 		struct spa_data *ds = &in->buffer->datas[i];
 		struct graph_port *port = &graph->input[i];
-		if (port->desc)
-			port->desc->connect_port(port->hndl, port->port,
-				SPA_MEMBER(ds->data, ds->chunk->offset, void));
+		void *data = SPA_MEMBER(ds->data, ds->chunk->offset, void);
+		if (port->desc && port->data != data) {
+			port->desc->connect_port(port->hndl, port->port, data);
+			port->data = data;
+		}
 		size = SPA_MAX(size, ds->chunk->size);
 		stride = SPA_MAX(stride, ds->chunk->stride);
 	}
 	for (i = 0; i < out->buffer->n_datas; i++) {
 		struct spa_data *dd = &out->buffer->datas[i];
 		struct graph_port *port = &graph->output[i];
-		if (port->desc)
-			port->desc->connect_port(port->hndl, port->port, dd->data);
-		else
+		if (port->desc == NULL)
 			memset(dd->data, 0, size);
+		else if (port->data != dd->data) {
+			port->desc->connect_port(port->hndl, port->port, dd->data);
+			port->data = dd->data;
+		}
 		dd->chunk->offset = 0;
 		dd->chunk->size = size;
 		dd->chunk->stride = stride;
 	}
 	for (i = 0; i < n_hndl; i++) {
 		struct graph_hndl *hndl = &graph->hndl[i];
-		hndl->desc->run(hndl->hndl, size / sizeof(float));
+		if (hndl->run_n)
+			hndl->run_n(hndl->hndls, hndl->n_hndl, size / sizeof(float));
+		else
+			hndl->desc->run(hndl->hndl, size / sizeof(float));
 	}
 
 done:
@@ -560,14 +585,16 @@ static int parse_params(struct graph *graph, const struct spa_pod *pod)
 
 static void graph_reset(struct graph *graph)
 {
+	struct node *node;
 	uint32_t i;
-	for (i = 0; i < graph->n_hndl; i++) {
-		struct graph_hndl *hndl = &graph->hndl[i];
-		const LADSPA_Descriptor *d = hndl->desc;
-		if (d->deactivate)
-			d->deactivate(hndl->hndl);
-		if (d->activate)
-			d->activate(hndl->hndl);
+	spa_list_for_each(node, &graph->node_list, link) {
+		const LADSPA_Descriptor *d = node->desc->desc;
+		for (i = 0; i < node->n_hndl; i++) {
+			if (d->deactivate)
+				d->deactivate(node->hndl[i]);
+			if (d->activate)
+				d->activate(node->hndl[i]);
+		}
 	}
 }
 
@@ -1213,13 +1240,11 @@ static int load_node(struct graph *graph, struct spa_json *json)
 
 static void node_free(struct node *node)
 {
-	uint32_t i, j;
+	uint32_t i;
 	const LADSPA_Descriptor *d = node->desc->desc;
 
 	spa_list_remove(&node->link);
 	for (i = 0; i < node->n_hndl; i++) {
-		for (j = 0; j < node->desc->n_output; j++)
-			free(node->output_port[j].audio_data[i]);
 		if (node->hndl[i] == NULL)
 			continue;
 		if (d->deactivate)
@@ -1242,7 +1267,7 @@ static struct node *find_next_node(struct graph *graph)
 	return NULL;
 }
 
-static int setup_input_port(struct graph *graph, struct port *port)
+static void setup_input_port(struct graph *graph, struct port *port)
 {
 	struct ladspa_descriptor *desc = port->node->desc;
 	const LADSPA_Descriptor *d = desc->desc;
@@ -1258,32 +1283,164 @@ static int setup_input_port(struct graph *graph, struct port *port)
 			d->connect_port(port->node->hndl[i], port->p, peer->audio_data[i]);
 		}
 	}
-	return 0;
 }
 
-static int setup_output_port(struct graph *graph, struct port *port)
+static int setup_output_port(struct graph *graph, struct port *port, bool *used)
 {
 	struct ladspa_descriptor *desc = port->node->desc;
 	const LADSPA_Descriptor *d = desc->desc;
-	struct link *link;
 	uint32_t i, n_hndl = port->node->n_hndl;
 
-	spa_list_for_each(link, &port->link_list, output_link) {
-		for (i = 0; i < n_hndl; i++) {
-			float *data;
-			if ((data = port->audio_data[i]) == NULL) {
-				data = calloc(1, MAX_SAMPLES * sizeof(float));
-				if (data == NULL)
-					return -errno;
+	if (port->n_links == 0)
+		return 0;
+
+	/* take the first buffer that is not read anymore */
+	for (i = 0; i < graph->n_buffers; i++) {
+		if (!used[i])
+			break;
+	}
+	if (i == graph->n_buffers) {
+		if (i == MAX_BUFFERS)
+			return -ENOSPC;
+		graph->buffers[i] = calloc(n_hndl, MAX_SAMPLES * sizeof(float));
+		if (graph->buffers[i] == NULL)
+			return -errno;
+		graph->n_buffers++;
+	}
+	used[i] = true;
+	port->buffer = i;
+
+	for (i = 0; i < n_hndl; i++) {
+		port->audio_data[i] = graph->buffers[port->buffer] + i * MAX_SAMPLES;
+		pw_log_info("connect output port %s[%d]:%s %p",
+				port->node->name, i, d->PortNames[port->p],
+				port->audio_data[i]);
+		d->connect_port(port->node->hndl[i], port->p, port->audio_data[i]);
+	}
+	return 0;
+}
+
+/* the buffers of the outputs that are read for the last time by this node
+ * can be used again */
+static void release_input_buffers(struct node *node, bool *used)
+{
+	struct link *link;
+	uint32_t i;
+
+	for (i = 0; i < node->desc->n_input; i++) {
+		spa_list_for_each(link, &node->input_port[i].link_list, input_link) {
+			if (link->output->last_step == node->step)
+				used[link->output->buffer] = false;
+		}
+	}
+}
+
+/* Make the plan to run the graph. The nodes are ordered so that a node runs
+ * after the nodes it depends on. With this order, the buffers of the links
+ * are shared between the outputs that are not needed at the same time. The
+ * builtin plugins can also write into the buffer of their input. */
+static int plan_graph(struct graph *graph, uint32_t n_hndl)
+{
+	struct spa_list plan;
+	struct node *node;
+	struct port *port;
+	struct link *link;
+	struct graph_hndl *gh;
+	struct ladspa_descriptor *desc;
+	const LADSPA_Descriptor *d;
+	builtin_run_n_func_t run_n;
+	bool used[MAX_BUFFERS] = { false, }, in_place;
+	uint32_t i, n_steps = 0, n_links = 0;
+	int res;
+
+	spa_list_init(&plan);
+	while ((node = find_next_node(graph)) != NULL) {
+		node->step = n_steps++;
+		spa_list_append(&plan, &node->plan_link);
+		for (i = 0; i < node->desc->n_output; i++) {
+			port = &node->output_port[i];
+			spa_list_for_each(link, &port->link_list, output_link)
+				link->input->node->n_deps--;
+		}
+	}
+
+	spa_list_for_each(node, &plan, plan_link) {
+		for (i = 0; i < node->desc->n_output; i++) {
+			port = &node->output_port[i];
+			port->last_step = node->step;
+			spa_list_for_each(link, &port->link_list, output_link) {
+				if (link->input->node->visited)
+					port->last_step = SPA_MAX(port->last_step,
+							link->input->node->step);
+				n_links++;
 			}
-			port->audio_data[i] = data;
-			pw_log_info("connect output port %s[%d]:%s %p",
-					port->node->name, i, d->PortNames[port->p],
-					port->audio_data[i]);
-			d->connect_port(port->node->hndl[i], port->p, data);
 		}
-		link->input->node->n_deps--;
 	}
+
+	graph->n_hndl = 0;
+	spa_list_for_each(node, &plan, plan_link) {
+		desc = node->desc;
+		d = desc->desc;
+
+		in_place = desc->handle->desc_func == builtin_ladspa_descriptor &&
+			!LADSPA_IS_INPLACE_BROKEN(d->Properties);
+		run_n = desc->handle->desc_func == builtin_ladspa_descriptor ?
+			builtin_find_run_n(d) : NULL;
+		if (n_hndl == 1)
+			run_n = NULL;
+
+		for (i = 0; i < desc->n_input; i++)
+			setup_input_port(graph, &node->input_port[i]);
+
+		if (in_place)
+			release_input_buffers(node, used);
+		for (i = 0; i < desc->n_output; i++) {
+			if ((res = setup_output_port(graph, &node->output_port[i], used)) < 0) {
+				pw_log_error("can't get a buffer for %s:%s: %s", node->name,
+						d->PortNames[node->output_port[i].p],
+						spa_strerror(res));
+				return res;
+			}
+		}
+		if (!in_place)
+			release_input_buffers(node, used);
+
+		if (graph->n_hndl + (run_n ? 1 : n_hndl) > MAX_HNDL) {
+			pw_log_error("too many instances in the graph");
+			return -ENOSPC;
+		}
+		if (run_n != NULL) {
+			gh = &graph->hndl[graph->n_hndl++];
+			spa_zero(*gh);
+			gh->hndl = node->hndl[0];
+			gh->desc = d;
+			gh->run_n = run_n;
+			gh->hndls = node->hndl;
+			gh->n_hndl = n_hndl;
+		} else {
+			for (i = 0; i < n_hndl; i++) {
+				gh = &graph->hndl[graph->n_hndl++];
+				spa_zero(*gh);
+				gh->hndl = node->hndl[i];
+				gh->desc = d;
+			}
+		}
+
+		pw_log_info("plan step %u: %s (%s) %u instances%s%s", node->step,
+				node->name, d->Label, n_hndl,
+				run_n ? ", run together" : "",
+				in_place ? ", in place" : "");
+		for (i = 0; i < desc->n_output; i++) {
+			port = &node->output_port[i];
+			if (port->n_links > 0)
+				pw_log_info("plan step %u:   %s -> buffer %u, read until step %u",
+						node->step, d->PortNames[port->p],
+						port->buffer, port->last_step);
+		}
+	}
+	pw_log_info("plan: %u steps, %u links in %u buffers, %u runs per cycle",
+			n_steps, n_links, graph->n_buffers, graph->n_hndl);
+
 	return 0;
 }
 
@@ -1293,7 +1450,6 @@ static int setup_graph(struct graph *graph, struct spa_json *inputs, struct spa_
 	struct node *node, *first, *last;
 	struct port *port;
 	struct graph_port *gp;
-	struct graph_hndl *gh;
 	uint32_t i, j, n_input, n_output, n_hndl = 0;
 	int res;
 	unsigned long p;
@@ -1487,27 +1643,9 @@ static int setup_graph(struct graph *graph, struct spa_json *inputs, struct spa_
 		}
 	}
 
-	/* order all nodes based on dependencies */
-	graph->n_hndl = 0;
-	while (true) {
-		if ((node = find_next_node(graph)) == NULL)
-			break;
-
-		desc = node->desc;
-		d = desc->desc;
-
-		for (i = 0; i < desc->n_input; i++)
-			setup_input_port(graph, &node->input_port[i]);
-
-		for (i = 0; i < n_hndl; i++) {
-			gh = &graph->hndl[graph->n_hndl++];
-			gh->hndl = node->hndl[i];
-			gh->desc = d;
-		}
+	if ((res = plan_graph(graph, n_hndl)) < 0)
+		goto error;
 
-		for (i = 0; i < desc->n_output; i++)
-			setup_output_port(graph, &node->output_port[i]);
-	}
 	return 0;
 
 error:
@@ -1595,10 +1733,14 @@ static void graph_free(struct graph *graph)
 {
 	struct link *link;
 	struct node *node;
+	uint32_t i;
 	spa_list_consume(link, &graph->link_list, link)
 		link_free(link);
 	spa_list_consume(node, &graph->node_list, link)
 		node_free(node);
+	for (i = 0; i < graph->n_buffers; i++)
+		free(graph->buffers[i]);
+	graph->n_buffers = 0;
 }
 
 static void core_error(void *data, uint32_t id, int seq, int res, const char *message)
@@ -1716,9 +1858,16 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 	struct pw_properties *props;
 	struct impl *impl;
 	uint32_t id = pw_global_get_id(pw_impl_module_get_global(module));
+	const struct spa_support *support;
+	struct spa_cpu *cpu;
+	uint32_t n_support;
 	const char *str;
 	int res;
 
+	support = pw_context_get_support(context, &n_support);
+	cpu = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_CPU);
+	builtin_init(cpu ? spa_cpu_get_flags(cpu) : 0);
+
 	impl = calloc(1, sizeof(struct impl));
 	if (impl == NULL)
 		return -errno;
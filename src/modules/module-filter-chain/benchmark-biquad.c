@@ -0,0 +1,152 @@
+/* PipeWire
+ *
+ * Copyright © 2021 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Runs a parametric equalizer with N_SECTIONS peaking filters on every
+ * channel, like the filter-chain does with a node per band, and compares
+ * the time of the C and the SIMD versions. The output of the SIMD versions
+ * is checked against the C version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include <spa/utils/defs.h>
+
+#include "biquad.h"
+
+#define RATE		48000
+#define MAX_CHANNELS	8
+#define N_SECTIONS	16
+#define N_SAMPLES	1024
+#define N_BLOCKS	500
+
+typedef void (*run_n_func_t) (struct biquad *bq[], float *out[], const float *in[],
+		uint32_t n_bq, uint32_t n_samples);
+
+static float in_signal[MAX_CHANNELS][N_SAMPLES];
+static float out_signal[2][MAX_CHANNELS][N_SAMPLES];
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void make_signal(void)
+{
+	uint32_t c, n;
+
+	srand48(0);
+	for (c = 0; c < MAX_CHANNELS; c++)
+		for (n = 0; n < N_SAMPLES; n++)
+			in_signal[c][n] = drand48() * 2.0 - 1.0;
+}
+
+static void setup_filters(struct biquad bq[][N_SECTIONS], uint32_t n_channels)
+{
+	uint32_t c, s;
+
+	for (c = 0; c < n_channels; c++) {
+		for (s = 0; s < N_SECTIONS; s++) {
+			/* bands spread logarithmically from 30Hz to 16kHz */
+			double freq = 30.0 * pow(16000.0 / 30.0, (double)s / (N_SECTIONS - 1));
+			biquad_set(&bq[c][s], BQ_PEAKING, freq / (RATE / 2), 1.0,
+					(s & 1) ? 3.0 : -3.0);
+		}
+	}
+}
+
+static uint64_t run_eq(run_n_func_t func, float out[MAX_CHANNELS][N_SAMPLES],
+		uint32_t n_channels)
+{
+	struct biquad bq[MAX_CHANNELS][N_SECTIONS] = { 0 };
+	struct biquad *b[MAX_CHANNELS];
+	float *o[MAX_CHANNELS];
+	const float *i[MAX_CHANNELS];
+	uint64_t t1, t2;
+	uint32_t c, s, n;
+
+	setup_filters(bq, n_channels);
+
+	t1 = get_time_ns();
+	for (n = 0; n < N_BLOCKS; n++) {
+		for (s = 0; s < N_SECTIONS; s++) {
+			for (c = 0; c < n_channels; c++) {
+				b[c] = &bq[c][s];
+				i[c] = s == 0 ? in_signal[c] : out[c];
+				o[c] = out[c];
+			}
+			func(b, o, i, n_channels, N_SAMPLES);
+		}
+	}
+	t2 = get_time_ns();
+
+	return t2 - t1;
+}
+
+static void run_test(const char *name, run_n_func_t func, uint32_t n_channels, uint64_t ref)
+{
+	uint64_t t;
+	float diff = 0.0f;
+	uint32_t c, n;
+
+	t = run_eq(func, out_signal[1], n_channels);
+
+	for (c = 0; c < n_channels; c++)
+		for (n = 0; n < N_SAMPLES; n++)
+			diff = SPA_MAX(diff, fabsf(out_signal[1][c][n] - out_signal[0][c][n]));
+
+	fprintf(stderr, "%-4s %u channels x %u sections: %8.0f ns/block, "
+			"%.2fx, max difference %g\n",
+			name, n_channels, N_SECTIONS, (double)t / N_BLOCKS,
+			(double)ref / t, diff);
+
+	spa_assert(diff <= 1e-6f);
+}
+
+int main(int argc, char *argv[])
+{
+	static const uint32_t channel_counts[] = { 1, 2, 4, 6, 8 };
+	uint32_t i;
+	uint64_t ref;
+
+	make_signal();
+
+	for (i = 0; i < SPA_N_ELEMENTS(channel_counts); i++) {
+		uint32_t n_channels = channel_counts[i];
+
+		ref = run_eq(biquad_run_n_c, out_signal[0], n_channels);
+		run_test("c", biquad_run_n_c, n_channels, ref);
+#if defined(HAVE_SSE)
+		if (__builtin_cpu_supports("sse"))
+			run_test("sse", biquad_run_n_sse, n_channels, ref);
+#endif
+	}
+
+	return 0;
+}
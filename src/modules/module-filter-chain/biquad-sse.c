@@ -0,0 +1,128 @@
+/* PipeWire
+ *
+ * Copyright © 2021 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <spa/utils/defs.h>
+
+#include "biquad.h"
+
+#include <xmmintrin.h>
+
+/* run the filters of up to 4 channels in the lanes of the vectors. The
+ * samples are transposed in blocks of 4 so that every vector holds the same
+ * sample of all the channels. The operations are done in the same order as
+ * biquad_run so that the result is the same. */
+static void biquad_run_4_sse(struct biquad *bq[], float *out[], const float *in[],
+		uint32_t n_lanes, uint32_t n_samples)
+{
+	float b0[4] = { 0.0f, }, b1[4] = { 0.0f, }, b2[4] = { 0.0f, };
+	float a1[4] = { 0.0f, }, a2[4] = { 0.0f, };
+	float x1[4] = { 0.0f, }, x2[4] = { 0.0f, }, y1[4] = { 0.0f, }, y2[4] = { 0.0f, };
+	float t[4] SPA_ALIGNED(16);
+	__m128 vb0, vb1, vb2, va1, va2, vx1, vx2, vy1, vy2, x[4], y;
+	uint32_t i, l, n, unrolled;
+
+	for (l = 0; l < n_lanes; l++) {
+		b0[l] = bq[l]->b0;
+		b1[l] = bq[l]->b1;
+		b2[l] = bq[l]->b2;
+		a1[l] = bq[l]->a1;
+		a2[l] = bq[l]->a2;
+		x1[l] = bq[l]->x1;
+		x2[l] = bq[l]->x2;
+		y1[l] = bq[l]->y1;
+		y2[l] = bq[l]->y2;
+	}
+	vb0 = _mm_loadu_ps(b0);
+	vb1 = _mm_loadu_ps(b1);
+	vb2 = _mm_loadu_ps(b2);
+	va1 = _mm_loadu_ps(a1);
+	va2 = _mm_loadu_ps(a2);
+	vx1 = _mm_loadu_ps(x1);
+	vx2 = _mm_loadu_ps(x2);
+	vy1 = _mm_loadu_ps(y1);
+	vy2 = _mm_loadu_ps(y2);
+
+#define BIQUAD_STEP(x)						\
+	y = _mm_mul_ps(vb0, x);					\
+	y = _mm_add_ps(y, _mm_mul_ps(vb1, vx1));		\
+	y = _mm_add_ps(y, _mm_mul_ps(vb2, vx2));		\
+	y = _mm_sub_ps(y, _mm_mul_ps(va1, vy1));		\
+	y = _mm_sub_ps(y, _mm_mul_ps(va2, vy2));		\
+	vx2 = vx1;						\
+	vx1 = x;						\
+	vy2 = vy1;						\
+	vy1 = y;						\
+	x = y;
+
+	unrolled = n_samples & ~3;
+
+	for (n = 0; n < unrolled; n += 4) {
+		for (l = 0; l < 4; l++)
+			x[l] = l < n_lanes ? _mm_loadu_ps(&in[l][n]) : _mm_setzero_ps();
+
+		_MM_TRANSPOSE4_PS(x[0], x[1], x[2], x[3]);
+		for (i = 0; i < 4; i++) {
+			BIQUAD_STEP(x[i]);
+		}
+		_MM_TRANSPOSE4_PS(x[0], x[1], x[2], x[3]);
+
+		for (l = 0; l < n_lanes; l++)
+			_mm_storeu_ps(&out[l][n], x[l]);
+	}
+	for (; n < n_samples; n++) {
+		for (l = 0; l < 4; l++)
+			t[l] = l < n_lanes ? in[l][n] : 0.0f;
+		x[0] = _mm_load_ps(t);
+		BIQUAD_STEP(x[0]);
+		_mm_store_ps(t, x[0]);
+		for (l = 0; l < n_lanes; l++)
+			out[l][n] = t[l];
+	}
+#undef BIQUAD_STEP
+
+	_mm_storeu_ps(x1, vx1);
+	_mm_storeu_ps(x2, vx2);
+	_mm_storeu_ps(y1, vy1);
+	_mm_storeu_ps(y2, vy2);
+	for (l = 0; l < n_lanes; l++) {
+		bq[l]->x1 = x1[l];
+		bq[l]->x2 = x2[l];
+		bq[l]->y1 = y1[l];
+		bq[l]->y2 = y2[l];
+	}
+}
+
+void biquad_run_n_sse(struct biquad *bq[], float *out[], const float *in[],
+		uint32_t n_bq, uint32_t n_samples)
+{
+	uint32_t i, n_lanes;
+
+	for (i = 0; i < n_bq; i += n_lanes) {
+		n_lanes = SPA_MIN(n_bq - i, 4u);
+		if (n_lanes == 1)
+			biquad_run(bq[i], out[i], in[i], n_samples);
+		else
+			biquad_run_4_sse(&bq[i], &out[i], &in[i], n_lanes, n_samples);
+	}
+}
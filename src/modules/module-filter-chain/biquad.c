@@ -379,3 +379,41 @@ void biquad_set(struct biquad *bq, enum biquad_type type, double freq, double Q,
 		break;
 	}
 }
+
+void biquad_run(struct biquad *bq, float *out, const float *in, uint32_t n_samples)
+{
+	float x1, x2, y1, y2;
+	float b0, b1, b2, a1, a2;
+	uint32_t i;
+
+	x1 = bq->x1;
+	x2 = bq->x2;
+	y1 = bq->y1;
+	y2 = bq->y2;
+	b0 = bq->b0;
+	b1 = bq->b1;
+	b2 = bq->b2;
+	a1 = bq->a1;
+	a2 = bq->a2;
+	for (i = 0; i < n_samples; i++) {
+		float x = in[i];
+		float y = b0 * x + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2;
+		out[i] = y;
+		x2 = x1;
+		x1 = x;
+		y2 = y1;
+		y1 = y;
+	}
+	bq->x1 = x1;
+	bq->x2 = x2;
+	bq->y1 = y1;
+	bq->y2 = y2;
+}
+
+void biquad_run_n_c(struct biquad *bq[], float *out[], const float *in[],
+		uint32_t n_bq, uint32_t n_samples)
+{
+	uint32_t i;
+	for (i = 0; i < n_bq; i++)
+		biquad_run(bq[i], out[i], in[i], n_samples);
+}
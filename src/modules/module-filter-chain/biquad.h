@@ -6,6 +6,8 @@
 #ifndef BIQUAD_H_
 #define BIQUAD_H_
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -50,6 +52,22 @@ enum biquad_type {
 void biquad_set(struct biquad *bq, enum biquad_type type, double freq, double Q,
 		double gain);
 
+/* Run the biquad filter on n_samples of in and store the result in out. in
+ * and out can point to the same memory.
+ */
+void biquad_run(struct biquad *bq, float *out, const float *in, uint32_t n_samples);
+
+/* Run n_bq biquad filters, each with its own input and output, over the same
+ * number of samples. The SIMD versions run the filters of up to 4 channels in
+ * the lanes of a vector and produce the same output as biquad_run.
+ */
+void biquad_run_n_c(struct biquad *bq[], float *out[], const float *in[],
+		uint32_t n_bq, uint32_t n_samples);
+#if defined(HAVE_SSE)
+void biquad_run_n_sse(struct biquad *bq[], float *out[], const float *in[],
+		uint32_t n_bq, uint32_t n_samples);
+#endif
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -22,8 +22,16 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <spa/support/cpu.h>
+
 #include "biquad.h"
 
+typedef void (*builtin_run_n_func_t) (LADSPA_Handle *Instances,
+		uint32_t n_instances, unsigned long SampleCount);
+
+static void (*biquad_run_n) (struct biquad *bq[], float *out[], const float *in[],
+		uint32_t n_bq, uint32_t n_samples) = biquad_run_n_c;
+
 struct builtin {
 	unsigned long rate;
 	LADSPA_Data *port[64];
@@ -32,6 +40,14 @@ struct builtin {
 	float freq;
 	float Q;
 	float gain;
+
+	float *buffer;
+	uint32_t mask;
+	uint32_t pos;
+
+	float level;
+	float step;
+	uint32_t ramp;
 };
 
 static LADSPA_Handle builtin_instantiate(const struct _LADSPA_Descriptor * Descriptor,
@@ -58,6 +74,7 @@ static void builtin_connect_port(LADSPA_Handle Instance, unsigned long Port,
 static void builtin_cleanup(LADSPA_Handle Instance)
 {
 	struct builtin *impl = Instance;
+	free(impl->buffer);
 	free(impl);
 }
 
@@ -66,7 +83,8 @@ static void copy_run(LADSPA_Handle Instance, unsigned long SampleCount)
 {
 	struct builtin *impl = Instance;
 	float *in = impl->port[1], *out = impl->port[0];
-	memcpy(out, in, SampleCount * sizeof(float));
+	if (out != in)
+		memcpy(out, in, SampleCount * sizeof(float));
 }
 
 static const LADSPA_PortDescriptor copy_port_desc[] = {
@@ -173,46 +191,45 @@ static const LADSPA_PortRangeHint bq_range_hints[] = {
 		LADSPA_HINT_DEFAULT_0, -120.0, 5.0 },
 };
 
-static void bq_run(struct builtin *impl, unsigned long samples, int type)
+static void bq_update(struct builtin *impl, int type)
 {
-	struct biquad *bq = &impl->bq;
-	unsigned long i;
-	float *out = impl->port[0];
-	float *in = impl->port[1];
 	float freq = impl->port[2][0];
 	float Q = impl->port[3][0];
 	float gain = impl->port[4][0];
-	float x1, x2, y1, y2;
-	float b0, b1, b2, a1, a2;
 
 	if (impl->freq != freq || impl->Q != Q || impl->gain != gain) {
 		impl->freq = freq;
 		impl->Q = Q;
 		impl->gain = gain;
-		biquad_set(bq, type, freq / impl->rate, Q, gain);
+		biquad_set(&impl->bq, type, freq / impl->rate, Q, gain);
 	}
-	x1 = bq->x1;
-	x2 = bq->x2;
-	y1 = bq->y1;
-	y2 = bq->y2;
-	b0 = bq->b0;
-	b1 = bq->b1;
-	b2 = bq->b2;
-	a1 = bq->a1;
-	a2 = bq->a2;
-	for (i = 0; i < samples; i++) {
-		float x = in[i];
-		float y = b0 * x + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2;
-		out[i] = y;
-		x2 = x1;
-		x1 = x;
-		y2 = y1;
-		y1 = y;
+}
+
+static void bq_run(struct builtin *impl, unsigned long samples, int type)
+{
+	bq_update(impl, type);
+	biquad_run(&impl->bq, impl->port[0], impl->port[1], samples);
+}
+
+/* all instances of a node are the channels of the same filter, run them
+ * together so that the SIMD versions can process the channels in parallel */
+static void bq_run_n(LADSPA_Handle *Instances, uint32_t n_instances,
+		unsigned long samples, int type)
+{
+	struct biquad *bq[MAX_HNDL];
+	float *out[MAX_HNDL];
+	const float *in[MAX_HNDL];
+	uint32_t i;
+
+	n_instances = SPA_MIN(n_instances, (uint32_t)MAX_HNDL);
+	for (i = 0; i < n_instances; i++) {
+		struct builtin *impl = Instances[i];
+		bq_update(impl, type);
+		bq[i] = &impl->bq;
+		out[i] = impl->port[0];
+		in[i] = impl->port[1];
 	}
-	bq->x1 = x1;
-	bq->x2 = x2;
-	bq->y1 = y1;
-	bq->y2 = y2;
+	biquad_run_n(bq, out, in, n_instances, samples);
 }
 
 /** bq_lowpass */
@@ -222,6 +239,12 @@ static void bq_lowpass_run(LADSPA_Handle Instance, unsigned long SampleCount)
 	bq_run(impl, SampleCount, BQ_LOWPASS);
 }
 
+static void bq_lowpass_run_n(LADSPA_Handle *Instances, uint32_t n_instances,
+		unsigned long SampleCount)
+{
+	bq_run_n(Instances, n_instances, SampleCount, BQ_LOWPASS);
+}
+
 static const LADSPA_Descriptor bq_lowpass_desc = {
 	.Label = "bq_lowpass",
 	.Name = "Biquad lowpass filter",
@@ -244,6 +267,12 @@ static void bq_highpass_run(LADSPA_Handle Instance, unsigned long SampleCount)
 	bq_run(impl, SampleCount, BQ_HIGHPASS);
 }
 
+static void bq_highpass_run_n(LADSPA_Handle *Instances, uint32_t n_instances,
+		unsigned long SampleCount)
+{
+	bq_run_n(Instances, n_instances, SampleCount, BQ_HIGHPASS);
+}
+
 static const LADSPA_Descriptor bq_highpass_desc = {
 	.Label = "bq_highpass",
 	.Name = "Biquad highpass filter",
@@ -266,6 +295,12 @@ static void bq_bandpass_run(LADSPA_Handle Instance, unsigned long SampleCount)
 	bq_run(impl, SampleCount, BQ_BANDPASS);
 }
 
+static void bq_bandpass_run_n(LADSPA_Handle *Instances, uint32_t n_instances,
+		unsigned long SampleCount)
+{
+	bq_run_n(Instances, n_instances, SampleCount, BQ_BANDPASS);
+}
+
 static const LADSPA_Descriptor bq_bandpass_desc = {
 	.Label = "bq_bandpass",
 	.Name = "Biquad bandpass filter",
@@ -288,6 +323,12 @@ static void bq_lowshelf_run(LADSPA_Handle Instance, unsigned long SampleCount)
 	bq_run(impl, SampleCount, BQ_LOWSHELF);
 }
 
+static void bq_lowshelf_run_n(LADSPA_Handle *Instances, uint32_t n_instances,
+		unsigned long SampleCount)
+{
+	bq_run_n(Instances, n_instances, SampleCount, BQ_LOWSHELF);
+}
+
 static const LADSPA_Descriptor bq_lowshelf_desc = {
 	.Label = "bq_lowshelf",
 	.Name = "Biquad lowshelf filter",
@@ -310,6 +351,12 @@ static void bq_highshelf_run(LADSPA_Handle Instance, unsigned long SampleCount)
 	bq_run(impl, SampleCount, BQ_HIGHSHELF);
 }
 
+static void bq_highshelf_run_n(LADSPA_Handle *Instances, uint32_t n_instances,
+		unsigned long SampleCount)
+{
+	bq_run_n(Instances, n_instances, SampleCount, BQ_HIGHSHELF);
+}
+
 static const LADSPA_Descriptor bq_highshelf_desc = {
 	.Label = "bq_highshelf",
 	.Name = "Biquad highshelf filter",
@@ -332,6 +379,12 @@ static void bq_peaking_run(LADSPA_Handle Instance, unsigned long SampleCount)
 	bq_run(impl, SampleCount, BQ_PEAKING);
 }
 
+static void bq_peaking_run_n(LADSPA_Handle *Instances, uint32_t n_instances,
+		unsigned long SampleCount)
+{
+	bq_run_n(Instances, n_instances, SampleCount, BQ_PEAKING);
+}
+
 static const LADSPA_Descriptor bq_peaking_desc = {
 	.Label = "bq_peaking",
 	.Name = "Biquad peaking filter",
@@ -354,6 +407,12 @@ static void bq_notch_run(LADSPA_Handle Instance, unsigned long SampleCount)
 	bq_run(impl, SampleCount, BQ_NOTCH);
 }
 
+static void bq_notch_run_n(LADSPA_Handle *Instances, uint32_t n_instances,
+		unsigned long SampleCount)
+{
+	bq_run_n(Instances, n_instances, SampleCount, BQ_NOTCH);
+}
+
 static const LADSPA_Descriptor bq_notch_desc = {
 	.Label = "bq_notch",
 	.Name = "Biquad notch filter",
@@ -377,6 +436,12 @@ static void bq_allpass_run(LADSPA_Handle Instance, unsigned long SampleCount)
 	bq_run(impl, SampleCount, BQ_ALLPASS);
 }
 
+static void bq_allpass_run_n(LADSPA_Handle *Instances, uint32_t n_instances,
+		unsigned long SampleCount)
+{
+	bq_run_n(Instances, n_instances, SampleCount, BQ_ALLPASS);
+}
+
 static const LADSPA_Descriptor bq_allpass_desc = {
 	.Label = "bq_allpass",
 	.Name = "Biquad allpass filter",
@@ -392,6 +457,338 @@ static const LADSPA_Descriptor bq_allpass_desc = {
 	.cleanup = builtin_cleanup,
 };
 
+static uint32_t ring_size(float max_samples)
+{
+	uint32_t size = 1;
+	while (size < (uint32_t)max_samples + 2)
+		size <<= 1;
+	return size;
+}
+
+/** delay */
+#define DELAY_MAX	1.0f
+
+static LADSPA_Handle delay_instantiate(const struct _LADSPA_Descriptor * Descriptor,
+		unsigned long SampleRate)
+{
+	struct builtin *impl;
+	uint32_t size;
+
+	impl = builtin_instantiate(Descriptor, SampleRate);
+	if (impl == NULL)
+		return NULL;
+
+	/* room for the max delay and the sample before it to interpolate */
+	size = ring_size(DELAY_MAX * SampleRate);
+	impl->buffer = calloc(size, sizeof(float));
+	if (impl->buffer == NULL) {
+		free(impl);
+		return NULL;
+	}
+	impl->mask = size - 1;
+	return impl;
+}
+
+/* The input is written into the delay line before the delayed sample is
+ * read so that the output can be the same buffer as the input. A delay of a
+ * fraction of a sample is made by linear interpolation. */
+static void delay_run(LADSPA_Handle Instance, unsigned long SampleCount)
+{
+	struct builtin *impl = Instance;
+	float *out = impl->port[0], *in = impl->port[1];
+	float *buffer = impl->buffer;
+	float delay = SPA_CLAMP(impl->port[2][0] * impl->rate, 0.0f, (float)(impl->mask - 1));
+	uint32_t i, d, pos = impl->pos, mask = impl->mask;
+	float frac;
+
+	d = (uint32_t)delay;
+	frac = delay - d;
+
+	if (frac == 0.0f) {
+		for (i = 0; i < SampleCount; i++) {
+			buffer[pos] = in[i];
+			out[i] = buffer[(pos - d) & mask];
+			pos = (pos + 1) & mask;
+		}
+	} else {
+		for (i = 0; i < SampleCount; i++) {
+			float s0, s1;
+			buffer[pos] = in[i];
+			s0 = buffer[(pos - d) & mask];
+			s1 = buffer[(pos - d - 1) & mask];
+			out[i] = s0 + (s1 - s0) * frac;
+			pos = (pos + 1) & mask;
+		}
+	}
+	impl->pos = pos;
+}
+
+static const LADSPA_PortDescriptor delay_port_desc[] = {
+	LADSPA_PORT_OUTPUT | LADSPA_PORT_AUDIO,
+	LADSPA_PORT_INPUT | LADSPA_PORT_AUDIO,
+	LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+};
+
+static const char * const delay_port_names[] = {
+	"Out", "In", "Delay (s)"
+};
+
+static const LADSPA_PortRangeHint delay_range_hints[] = {
+	{ 0, }, { 0, },
+	{ LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE |
+		LADSPA_HINT_DEFAULT_0, 0.0, DELAY_MAX },
+};
+
+static const LADSPA_Descriptor delay_desc = {
+	.Label = "delay",
+	.Name = "Delay the input",
+	.Maker = "PipeWire",
+	.Copyright = "MIT",
+	.PortCount = 3,
+	.PortDescriptors = delay_port_desc,
+	.PortNames = delay_port_names,
+	.PortRangeHints = delay_range_hints,
+	.instantiate = delay_instantiate,
+	.connect_port = builtin_connect_port,
+	.run = delay_run,
+	.cleanup = builtin_cleanup,
+};
+
+/** gain */
+static void gain_run(LADSPA_Handle Instance, unsigned long SampleCount)
+{
+	struct builtin *impl = Instance;
+	float *out = impl->port[0], *in = impl->port[1];
+	float gain = impl->port[2][0];
+	float ramp = impl->port[3][0];
+	unsigned long i = 0;
+	float level;
+
+	/* a new gain is reached with a linear ramp over the ramp time, the
+	 * first gain is faded in from silence */
+	if (impl->gain != gain) {
+		impl->gain = gain;
+		impl->ramp = (uint32_t)SPA_MAX(ramp * impl->rate, 1.0f);
+		impl->step = (gain - impl->level) / impl->ramp;
+	}
+	if (impl->ramp > 0) {
+		level = impl->level;
+		for (; i < SampleCount && impl->ramp > 0; i++, impl->ramp--) {
+			level += impl->step;
+			out[i] = in[i] * level;
+		}
+		impl->level = impl->ramp > 0 ? level : gain;
+	}
+
+	level = impl->level;
+	if (i == SampleCount) {
+		return;
+	} else if (level == 1.0f) {
+		if (out != in)
+			memcpy(&out[i], &in[i], (SampleCount - i) * sizeof(float));
+	} else if (level == 0.0f) {
+		memset(&out[i], 0, (SampleCount - i) * sizeof(float));
+	} else {
+		for (; i < SampleCount; i++)
+			out[i] = in[i] * level;
+	}
+}
+
+static const LADSPA_PortDescriptor gain_port_desc[] = {
+	LADSPA_PORT_OUTPUT | LADSPA_PORT_AUDIO,
+	LADSPA_PORT_INPUT | LADSPA_PORT_AUDIO,
+	LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+	LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+};
+
+static const char * const gain_port_names[] = {
+	"Out", "In", "Gain", "Ramp (s)"
+};
+
+static const LADSPA_PortRangeHint gain_range_hints[] = {
+	{ 0, }, { 0, },
+	{ LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_DEFAULT_1, 0.0, 10.0 },
+	{ LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE |
+		LADSPA_HINT_LOGARITHMIC | LADSPA_HINT_DEFAULT_LOW, 0.001, 1.0 },
+};
+
+static const LADSPA_Descriptor gain_desc = {
+	.Label = "gain",
+	.Name = "Gain with a ramp",
+	.Maker = "PipeWire",
+	.Copyright = "MIT",
+	.PortCount = 4,
+	.PortDescriptors = gain_port_desc,
+	.PortNames = gain_port_names,
+	.PortRangeHints = gain_range_hints,
+	.instantiate = builtin_instantiate,
+	.connect_port = builtin_connect_port,
+	.run = gain_run,
+	.cleanup = builtin_cleanup,
+};
+
+/** limiter */
+#define LIMITER_LOOKAHEAD_MAX	0.02f
+
+struct limiter {
+	struct builtin builtin;
+
+	uint32_t lookahead;
+	float *env;
+	float *min_gain;
+	uint32_t *min_pos;
+	uint32_t head, tail;
+	float release;
+	double sum;
+};
+
+static void limiter_cleanup(LADSPA_Handle Instance)
+{
+	struct limiter *impl = Instance;
+	free(impl->env);
+	free(impl->min_gain);
+	free(impl->min_pos);
+	free(impl->builtin.buffer);
+	free(impl);
+}
+
+static LADSPA_Handle limiter_instantiate(const struct _LADSPA_Descriptor * Descriptor,
+		unsigned long SampleRate)
+{
+	struct limiter *impl;
+	uint32_t size;
+
+	impl = calloc(1, sizeof(*impl));
+	if (impl == NULL)
+		return NULL;
+
+	impl->builtin.rate = SampleRate;
+	impl->lookahead = SPA_ID_INVALID;
+
+	size = ring_size(LIMITER_LOOKAHEAD_MAX * SampleRate);
+	impl->builtin.mask = size - 1;
+	impl->builtin.buffer = calloc(size, sizeof(float));
+	impl->env = calloc(size, sizeof(float));
+	impl->min_gain = calloc(size, sizeof(float));
+	impl->min_pos = calloc(size, sizeof(uint32_t));
+	if (impl->builtin.buffer == NULL || impl->env == NULL ||
+	    impl->min_gain == NULL || impl->min_pos == NULL) {
+		limiter_cleanup(impl);
+		return NULL;
+	}
+	return impl;
+}
+
+static void limiter_reset(struct limiter *impl, uint32_t lookahead)
+{
+	uint32_t i, size = impl->builtin.mask + 1;
+
+	memset(impl->builtin.buffer, 0, size * sizeof(float));
+	for (i = 0; i < size; i++)
+		impl->env[i] = 1.0f;
+	impl->lookahead = lookahead;
+	impl->head = impl->tail = 0;
+	impl->release = 1.0f;
+	impl->sum = lookahead + 1;
+}
+
+/* A look-ahead limiter that never lets a sample over the threshold.
+ *
+ * The input is delayed by the look-ahead. For every sample, the gain that
+ * brings it down to the threshold is calculated and the minimum of these
+ * gains over the look-ahead window is kept in a queue of increasing gains.
+ * After the release, the minimum is averaged over the look-ahead window so
+ * that the gain goes down smoothly and has reached the gain of a peak when
+ * the peak leaves the delay line. */
+static void limiter_run(LADSPA_Handle Instance, unsigned long SampleCount)
+{
+	struct limiter *impl = Instance;
+	struct builtin *b = &impl->builtin;
+	float *out = b->port[0], *in = b->port[1];
+	float threshold = powf(10.0f, SPA_MIN(b->port[2][0], 0.0f) / 20.0f);
+	float lookahead = SPA_CLAMP(b->port[3][0] * b->rate, 0.0f, (float)(b->mask - 1));
+	float release = expf(-1.0f / (SPA_MAX(b->port[4][0], 0.0001f) * b->rate));
+	float *buffer = b->buffer, *env = impl->env, *min_gain = impl->min_gain;
+	uint32_t *min_pos = impl->min_pos;
+	uint32_t i, L, pos, mask = b->mask, head, tail;
+	double sum;
+
+	L = (uint32_t)lookahead;
+	if (L != impl->lookahead)
+		limiter_reset(impl, L);
+
+	pos = b->pos;
+	head = impl->head;
+	tail = impl->tail;
+	sum = impl->sum;
+
+	for (i = 0; i < SampleCount; i++) {
+		float x = in[i], a = fabsf(x), g, e;
+
+		g = a > threshold ? threshold / a : 1.0f;
+
+		while (head != tail && min_gain[(tail - 1) & mask] >= g)
+			tail--;
+		min_gain[tail & mask] = g;
+		min_pos[tail & mask] = pos;
+		tail++;
+		if (pos - min_pos[head & mask] > L)
+			head++;
+		g = min_gain[head & mask];
+
+		e = g < impl->release ? g : g + (impl->release - g) * release;
+		impl->release = e;
+
+		sum += e - env[(pos - L - 1) & mask];
+		env[pos & mask] = e;
+
+		buffer[pos & mask] = x;
+		out[i] = buffer[(pos - L) & mask] * (float)(sum / (L + 1));
+		pos++;
+	}
+	b->pos = pos;
+	impl->head = head;
+	impl->tail = tail;
+	impl->sum = sum;
+}
+
+static const LADSPA_PortDescriptor limiter_port_desc[] = {
+	LADSPA_PORT_OUTPUT | LADSPA_PORT_AUDIO,
+	LADSPA_PORT_INPUT | LADSPA_PORT_AUDIO,
+	LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+	LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+	LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+};
+
+static const char * const limiter_port_names[] = {
+	"Out", "In", "Threshold (dB)", "Lookahead (s)", "Release (s)"
+};
+
+static const LADSPA_PortRangeHint limiter_range_hints[] = {
+	{ 0, }, { 0, },
+	{ LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE |
+		LADSPA_HINT_DEFAULT_0, -60.0, 0.0 },
+	{ LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE |
+		LADSPA_HINT_DEFAULT_LOW, 0.0, LIMITER_LOOKAHEAD_MAX },
+	{ LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE |
+		LADSPA_HINT_LOGARITHMIC | LADSPA_HINT_DEFAULT_MIDDLE, 0.001, 1.0 },
+};
+
+static const LADSPA_Descriptor limiter_desc = {
+	.Label = "limiter",
+	.Name = "Look-ahead limiter",
+	.Maker = "PipeWire",
+	.Copyright = "MIT",
+	.PortCount = 5,
+	.PortDescriptors = limiter_port_desc,
+	.PortNames = limiter_port_names,
+	.PortRangeHints = limiter_range_hints,
+	.instantiate = limiter_instantiate,
+	.connect_port = builtin_connect_port,
+	.run = limiter_run,
+	.cleanup = limiter_cleanup,
+};
+
 static const LADSPA_Descriptor * builtin_ladspa_descriptor(unsigned long Index)
 {
 	switch(Index) {
@@ -415,7 +812,44 @@ static const LADSPA_Descriptor * builtin_ladspa_descriptor(unsigned long Index)
 		return &bq_allpass_desc;
 	case 9:
 		return &copy_desc;
+	case 10:
+		return &delay_desc;
+	case 11:
+		return &gain_desc;
+	case 12:
+		return &limiter_desc;
 	}
 	return NULL;
 }
 
+
+/* Returns a function to run all the instances of a node at once or NULL
+ * when the instances need to be run one by one. */
+static builtin_run_n_func_t builtin_find_run_n(const LADSPA_Descriptor *desc)
+{
+	if (desc == &bq_lowpass_desc)
+		return bq_lowpass_run_n;
+	if (desc == &bq_highpass_desc)
+		return bq_highpass_run_n;
+	if (desc == &bq_bandpass_desc)
+		return bq_bandpass_run_n;
+	if (desc == &bq_lowshelf_desc)
+		return bq_lowshelf_run_n;
+	if (desc == &bq_highshelf_desc)
+		return bq_highshelf_run_n;
+	if (desc == &bq_peaking_desc)
+		return bq_peaking_run_n;
+	if (desc == &bq_notch_desc)
+		return bq_notch_run_n;
+	if (desc == &bq_allpass_desc)
+		return bq_allpass_run_n;
+	return NULL;
+}
+
+static void builtin_init(uint32_t cpu_flags)
+{
+#if defined(HAVE_SSE)
+	if (SPA_FLAG_IS_SET(cpu_flags, SPA_CPU_FLAG_SSE))
+		biquad_run_n = biquad_run_n_sse;
+#endif
+}
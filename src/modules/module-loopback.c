@@ -142,21 +142,32 @@ static void capture_process(void *d)
 			dd = &out->buffer->datas[i];
 
 			if (i < in->buffer->n_datas) {
+				uint32_t offset;
+
 				ds = &in->buffer->datas[i];
 
-				memcpy(dd->data,
-					SPA_PTROFF(ds->data, ds->chunk->offset, void),
-					ds->chunk->size);
+				offset = SPA_MIN(ds->chunk->offset, ds->maxsize);
+				size = SPA_MIN(ds->chunk->size, ds->maxsize - offset);
+				size = SPA_MIN(size, dd->maxsize);
+
+				memcpy(dd->data, SPA_PTROFF(ds->data, offset, void), size);
 
-				size = SPA_MAX(size, ds->chunk->size);
 				stride = SPA_MAX(stride, ds->chunk->stride);
 			} else {
+				size = SPA_MIN(size, dd->maxsize);
 				memset(dd->data, 0, size);
 			}
 			dd->chunk->offset = 0;
 			dd->chunk->size = size;
 			dd->chunk->stride = stride;
 		}
+	} else if (out != NULL) {
+		/* don't play the old contents again */
+		for (i = 0; i < out->buffer->n_datas; i++) {
+			struct spa_chunk *chunk = out->buffer->datas[i].chunk;
+			chunk->offset = 0;
+			chunk->size = 0;
+		}
 	}
 
 	if (in != NULL)
@@ -0,0 +1,210 @@
+/* PipeWire
+ *
+ * Copyright © 2021 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Encodes the replies of the GET_*_INFO_LIST commands for a session with
+ * many nodes, like pavucontrol does when it refreshes, and compares
+ * encoding the proplists for each reply with the cached encoding.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <spa/utils/defs.h>
+#include <pipewire/keys.h>
+
+#include "defs.h"
+#include "format.h"
+#include "internal.h"
+#include "manager.h"
+#include "message.h"
+#include "volume.h"
+
+#define N_OBJECTS	96
+#define N_PROPS		40
+#define N_LISTS		200
+
+struct object {
+	struct pw_manager_object this;
+	struct spa_dict_item items[N_PROPS];
+	char keys[N_PROPS][64];
+	char values[N_PROPS][128];
+	struct spa_dict props;
+};
+
+static struct object objects[N_OBJECTS];
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void make_objects(void)
+{
+	static const char * const keys[] = {
+		PW_KEY_NODE_NAME, PW_KEY_NODE_DESCRIPTION, PW_KEY_MEDIA_CLASS,
+		PW_KEY_MEDIA_ROLE, PW_KEY_APP_NAME, PW_KEY_APP_ID,
+		PW_KEY_DEVICE_API, PW_KEY_DEVICE_ID, PW_KEY_OBJECT_PATH,
+	};
+	uint32_t i, j;
+
+	for (i = 0; i < N_OBJECTS; i++) {
+		struct object *o = &objects[i];
+
+		for (j = 0; j < N_PROPS; j++) {
+			if (j < SPA_N_ELEMENTS(keys))
+				snprintf(o->keys[j], sizeof(o->keys[j]), "%s", keys[j]);
+			else
+				snprintf(o->keys[j], sizeof(o->keys[j]), "api.alsa.property.%u", j);
+
+			if (j == 2)
+				snprintf(o->values[j], sizeof(o->values[j]),
+						i & 1 ? "Stream/Output/Audio" : "Audio/Sink");
+			else
+				snprintf(o->values[j], sizeof(o->values[j]),
+						"value of property %u for object %u", j, i);
+
+			o->items[j] = SPA_DICT_ITEM_INIT(o->keys[j], o->values[j]);
+		}
+		o->props = SPA_DICT_INIT(o->items, N_PROPS);
+		o->this.id = i;
+	}
+}
+
+/* roughly the fields of a sink info reply */
+static int fill_info(struct message *m, struct object *o, bool cached)
+{
+	struct sample_spec ss = { .format = SPA_AUDIO_FORMAT_F32, .rate = 48000, .channels = 2 };
+	struct channel_map map = { .channels = 2, .map = { SPA_AUDIO_CHANNEL_FL, SPA_AUDIO_CHANNEL_FR } };
+	struct volume volume = { .channels = 2, .values = { 0.5f, 0.5f } };
+
+	message_put(m,
+		TAG_U32, o->this.id,
+		TAG_STRING, o->values[0],
+		TAG_STRING, o->values[1],
+		TAG_SAMPLE_SPEC, &ss,
+		TAG_CHANNEL_MAP, &map,
+		TAG_U32, SPA_ID_INVALID,
+		TAG_CVOLUME, &volume,
+		TAG_BOOLEAN, false,
+		TAG_U32, o->this.id + 1,
+		TAG_STRING, "monitor",
+		TAG_USEC, (uint64_t)0,
+		TAG_STRING, "driver",
+		TAG_U32, 0,
+		TAG_INVALID);
+
+	if (cached)
+		message_put(m,
+			TAG_OBJECT_PROPLIST, &o->this, &o->props,
+			TAG_INVALID);
+	else
+		message_put(m,
+			TAG_PROPLIST, &o->props,
+			TAG_INVALID);
+
+	return message_put(m,
+		TAG_USEC, (uint64_t)0,
+		TAG_VOLUME, 1.0f,
+		TAG_U32, 0,
+		TAG_U32, 0,
+		TAG_INVALID);
+}
+
+static uint32_t run_list(struct impl *impl, bool cached)
+{
+	struct message *m;
+	uint32_t i, length;
+
+	m = message_alloc(impl, -1, 0);
+	spa_assert(m != NULL);
+	for (i = 0; i < N_OBJECTS; i++)
+		spa_assert(fill_info(m, &objects[i], cached) == 0);
+	length = m->length;
+	message_free(impl, m, false, false);
+
+	return length;
+}
+
+static void compare_lists(struct impl *impl)
+{
+	struct message *m1, *m2;
+
+	m1 = message_alloc(impl, -1, 0);
+	m2 = message_alloc(impl, -1, 0);
+	spa_assert(m1 != NULL && m2 != NULL);
+
+	/* the second cached run copies from the cache */
+	spa_assert(fill_info(m1, &objects[0], false) == 0);
+	spa_assert(fill_info(m2, &objects[0], true) == 0);
+	spa_assert(m1->length == m2->length);
+	spa_assert(memcmp(m1->data, m2->data, m1->length) == 0);
+	m1->length = m2->length = 0;
+	spa_assert(fill_info(m1, &objects[0], false) == 0);
+	spa_assert(fill_info(m2, &objects[0], true) == 0);
+	spa_assert(m1->length == m2->length);
+	spa_assert(memcmp(m1->data, m2->data, m1->length) == 0);
+
+	message_free(impl, m1, false, true);
+	message_free(impl, m2, false, true);
+}
+
+int main(int argc, char *argv[])
+{
+	struct impl impl;
+	struct message *m;
+	uint64_t t1, t2, t3;
+	uint32_t i, len1 = 0, len2 = 0;
+
+	spa_zero(impl);
+	spa_list_init(&impl.free_messages);
+
+	make_objects();
+	compare_lists(&impl);
+
+	t1 = get_time_ns();
+	for (i = 0; i < N_LISTS; i++)
+		len1 = run_list(&impl, false);
+	t2 = get_time_ns();
+	for (i = 0; i < N_LISTS; i++)
+		len2 = run_list(&impl, true);
+	t3 = get_time_ns();
+
+	spa_assert(len1 == len2);
+
+	fprintf(stderr, "%d objects, %u bytes: proplist: %8.0f ns/list, cached: %8.0f ns/list (%.1fx)\n",
+			N_OBJECTS, len1,
+			(double)(t2 - t1) / N_LISTS, (double)(t3 - t2) / N_LISTS,
+			(double)(t2 - t1) / SPA_MAX(t3 - t2, 1u));
+
+	spa_list_consume(m, &impl.free_messages, link)
+		message_free(&impl, m, true, true);
+	for (i = 0; i < N_OBJECTS; i++)
+		free(objects[i].this.props_cache);
+
+	return 0;
+}
@@ -22,14 +22,17 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <errno.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #include <spa/utils/defs.h>
 #include <spa/utils/list.h>
+#include <pipewire/client.h>
 #include <pipewire/core.h>
 #include <pipewire/log.h>
 #include <pipewire/loop.h>
@@ -102,8 +105,13 @@ void client_disconnect(struct client *client)
 	if (client->source)
 		pw_loop_destroy_source(impl->loop, client->source);
 
-	if (client->manager)
+	if (client->shared_manager) {
+		client_leave_shared_manager(client);
+	} else if (client->manager) {
+		spa_hook_remove(&client->manager_listener);
 		pw_manager_destroy(client->manager);
+		client->manager = NULL;
+	}
 }
 
 void client_free(struct client *client)
@@ -132,6 +140,7 @@ void client_free(struct client *client)
 
 	if (client->core) {
 		client->disconnecting = true;
+		spa_hook_remove(&client->core_listener);
 		pw_core_disconnect(client->core);
 	}
 
@@ -182,58 +191,83 @@ error:
 	return res;
 }
 
+/* messages are sent with one sendmsg() call for at most this many
+ * messages, each message uses one iovec for the descriptor and one
+ * for the data */
+#define MAX_FLUSH_MESSAGES	64u
+
 int client_flush_messages(struct client *client)
 {
 	struct impl *impl = client->impl;
-	int res;
-
-	while (true) {
-		struct message *m;
-		struct descriptor desc;
-		void *data;
-		size_t size;
-
-		if (spa_list_is_empty(&client->out_messages))
-			break;
-
-		m = spa_list_first(&client->out_messages, struct message, link);
-
-		if (client->out_index < sizeof(desc)) {
-			desc.length = htonl(m->length);
-			desc.channel = htonl(m->channel);
-			desc.offset_hi = 0;
-			desc.offset_lo = 0;
-			desc.flags = 0;
-
-			data = SPA_PTROFF(&desc, client->out_index, void);
-			size = sizeof(desc) - client->out_index;
-		} else if (client->out_index < m->length + sizeof(desc)) {
-			uint32_t idx = client->out_index - sizeof(desc);
-			data = m->data + idx;
-			size = m->length - idx;
-		} else {
-			if (debug_messages && m->channel == SPA_ID_INVALID)
-				message_dump(SPA_LOG_LEVEL_INFO, m);
-			message_free(impl, m, true, false);
-			client->out_index = 0;
-			continue;
+	struct descriptor desc[MAX_FLUSH_MESSAGES];
+	struct iovec iov[MAX_FLUSH_MESSAGES * 2];
+
+	while (!spa_list_is_empty(&client->out_messages)) {
+		struct message *m, *t;
+		struct msghdr msg;
+		uint32_t n_desc = 0, n_iov = 0, offset = client->out_index;
+		ssize_t res;
+		size_t size = 0;
+
+		spa_list_for_each(m, &client->out_messages, link) {
+			struct descriptor *d;
+
+			if (n_desc == MAX_FLUSH_MESSAGES)
+				break;
+
+			d = &desc[n_desc++];
+			d->length = htonl(m->length);
+			d->channel = htonl(m->channel);
+			d->offset_hi = 0;
+			d->offset_lo = 0;
+			d->flags = 0;
+
+			/* only the first message can be partially sent */
+			if (offset < sizeof(*d)) {
+				iov[n_iov].iov_base = SPA_PTROFF(d, offset, void);
+				iov[n_iov].iov_len = sizeof(*d) - offset;
+				size += iov[n_iov++].iov_len;
+				offset = 0;
+			} else {
+				offset -= sizeof(*d);
+			}
+			iov[n_iov].iov_base = m->data + offset;
+			iov[n_iov].iov_len = m->length - offset;
+			size += iov[n_iov++].iov_len;
+			offset = 0;
 		}
 
+		spa_zero(msg);
+		msg.msg_iov = iov;
+		msg.msg_iovlen = n_iov;
+
 		while (true) {
-			res = send(client->source->fd, data, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+			res = sendmsg(client->source->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
 			if (res < 0) {
 				res = -errno;
 				if (res == -EINTR)
 					continue;
 				if (res != -EAGAIN && res != -EWOULDBLOCK)
-					pw_log_warn("client %p: send channel:%d %zu, error %d: %m",
-						    client, m->channel, size, res);
+					pw_log_warn("client %p: send %u messages %zu bytes, error %zd: %m",
+						    client, n_desc, size, res);
 				return res;
 			}
-
-			client->out_index += res;
 			break;
 		}
+
+		/* release all messages that were completely sent */
+		client->out_index += res;
+		spa_list_for_each_safe(m, t, &client->out_messages, link) {
+			uint32_t length = m->length + sizeof(struct descriptor);
+
+			if (client->out_index < length)
+				break;
+
+			if (debug_messages && m->channel == SPA_ID_INVALID)
+				message_dump(SPA_LOG_LEVEL_INFO, m);
+			message_free(impl, m, true, false);
+			client->out_index -= length;
+		}
 	}
 
 	return 0;
@@ -257,6 +291,10 @@ int client_queue_subscribe_event(struct client *client, uint32_t mask, uint32_t
 				continue;
 			if (m->extra[2] != id)
 				continue;
+			/* the event that is being sent can't be changed anymore */
+			if (client->out_index > 0 &&
+			    m == spa_list_first(&client->out_messages, struct message, link))
+				continue;
 
 			if ((event & SUBSCRIPTION_EVENT_TYPE_MASK) == SUBSCRIPTION_EVENT_REMOVE) {
 				/* This object is being removed, hence there is
@@ -290,3 +328,27 @@ int client_queue_subscribe_event(struct client *client, uint32_t mask, uint32_t
 
 	return client_queue_message(client, reply);
 }
+
+int client_sync(struct client *client)
+{
+	if (!client->shared_manager)
+		return pw_manager_sync(client->manager, &client->manager_listener);
+
+	/* the shared manager is on another connection, it is synced when the
+	 * daemon handled everything the client did on its own connection.
+	 * The permissions of the client arrive before that. */
+	pw_client_get_permissions(pw_core_get_client(client->core), 0, UINT32_MAX);
+	client->sync_seq = pw_core_sync(client->core, PW_ID_CORE, client->sync_seq);
+	return client->sync_seq;
+}
+
+void client_leave_shared_manager(struct client *client)
+{
+	if (!client->shared_manager)
+		return;
+
+	spa_hook_remove(&client->client_listener);
+	spa_hook_remove(&client->manager_listener);
+	client->manager = NULL;
+	client->shared_manager = false;
+}
@@ -67,8 +67,16 @@ struct client {
 	uint64_t quirks;
 
 	struct pw_core *core;
+	struct spa_hook core_listener;
 	struct pw_manager *manager;
 	struct spa_hook manager_listener;
+	int sync_seq;
+
+	/* the shared manager shows and changes everything, it is only used
+	 * while the permissions of the client connection allow everything.
+	 * They are checked again at every sync. */
+	unsigned int shared_manager:1;
+	struct spa_hook client_listener;
 
 	uint32_t subscribed;
 
@@ -84,6 +92,9 @@ struct client {
 	uint32_t out_index;
 	struct descriptor desc;
 	struct message *message;
+	/* memblock being received straight into a stream ringbuffer */
+	uint32_t in_ring_index;
+	unsigned int in_direct:1;
 
 	struct pw_map streams;
 	struct spa_list out_messages;
@@ -107,6 +118,9 @@ int client_queue_message(struct client *client, struct message *msg);
 int client_flush_messages(struct client *client);
 int client_queue_subscribe_event(struct client *client, uint32_t mask, uint32_t event, uint32_t id);
 
+int client_sync(struct client *client);
+void client_leave_shared_manager(struct client *client);
+
 static inline void client_unref(struct client *client)
 {
 	if (--client->ref == 0)
@@ -47,28 +47,108 @@ void select_best(struct selector *s, struct pw_manager_object *o)
 	}
 }
 
-struct pw_manager_object *select_object(struct pw_manager *m, struct selector *s)
+struct select_data {
+	struct selector *s;
+	struct pw_manager_object *found;
+};
+
+static inline bool select_match_type(struct selector *s, struct pw_manager_object *o)
 {
-	struct pw_manager_object *o;
+	return o != NULL && !o->creating && !o->removing &&
+		(s->type == NULL || s->type(o));
+}
+
+static int select_scan(void *data, struct pw_manager_object *o)
+{
+	struct select_data *d = data;
+	struct selector *s = d->s;
 	const char *str;
 
-	spa_list_for_each(o, &m->object_list, link) {
-		if (o->creating || o->removing)
-			continue;
-		if (s->type != NULL && !s->type(o))
-			continue;
-		if (o->id == s->id)
-			return o;
-		if (s->accumulate)
-			s->accumulate(s, o);
-		if (o->props && s->key != NULL && s->value != NULL &&
-		    (str = pw_properties_get(o->props, s->key)) != NULL &&
-		    spa_streq(str, s->value))
+	if (o->removing)
+		return 0;
+	if (s->type != NULL && !s->type(o))
+		return 0;
+	if (o->id == s->id)
+		goto found;
+	if (s->accumulate)
+		s->accumulate(s, o);
+	if (o->props && s->key != NULL && s->value != NULL &&
+	    (str = pw_properties_get(o->props, s->key)) != NULL &&
+	    spa_streq(str, s->value))
+		goto found;
+	if (s->value != NULL && (uint32_t)atoi(s->value) == o->id)
+		goto found;
+	return 0;
+found:
+	d->found = o;
+	return 1;
+}
+
+static int select_name(void *data, struct pw_manager_object *o)
+{
+	struct select_data *d = data;
+	if (!select_match_type(d->s, o))
+		return 0;
+	d->found = o;
+	return 1;
+}
+
+/* the interface of the objects the selector type can match */
+static const char *select_interface(struct selector *s)
+{
+	if (s->type == pw_manager_object_is_client)
+		return PW_TYPE_INTERFACE_Client;
+	if (s->type == pw_manager_object_is_module)
+		return PW_TYPE_INTERFACE_Module;
+	if (s->type == pw_manager_object_is_card)
+		return PW_TYPE_INTERFACE_Device;
+	if (s->type == pw_manager_object_is_link)
+		return PW_TYPE_INTERFACE_Link;
+	if (s->type == pw_manager_object_is_sink ||
+	    s->type == pw_manager_object_is_source ||
+	    s->type == pw_manager_object_is_monitor ||
+	    s->type == pw_manager_object_is_virtual ||
+	    s->type == pw_manager_object_is_source_or_monitor ||
+	    s->type == pw_manager_object_is_sink_input ||
+	    s->type == pw_manager_object_is_source_output ||
+	    s->type == pw_manager_object_is_recordable)
+		return PW_TYPE_INTERFACE_Node;
+	return NULL;
+}
+
+struct pw_manager_object *select_object(struct pw_manager *m, struct selector *s)
+{
+	struct select_data d = { .s = s, };
+	struct pw_manager_object *o;
+	const char *type;
+
+	/* without accumulate, use the indexes to look up by id,
+	 * by name and by the name parsed as an index */
+	if (s->accumulate == NULL &&
+	    (s->key == NULL ||
+	     spa_streq(s->key, PW_KEY_NODE_NAME) ||
+	     spa_streq(s->key, PW_KEY_DEVICE_NAME))) {
+		o = pw_manager_find_object(m, s->id);
+		if (select_match_type(s, o))
 			return o;
-		if (s->value != NULL && (uint32_t)atoi(s->value) == o->id)
+		if (s->value == NULL)
+			return s->best;
+		if (s->key != NULL &&
+		    pw_manager_for_each_object_name(m, s->key, s->value,
+				select_name, &d) > 0)
+			return d.found;
+		o = pw_manager_find_object(m, (uint32_t)atoi(s->value));
+		if (select_match_type(s, o))
 			return o;
+		return s->best;
 	}
-	return s->best;
+
+	if ((type = select_interface(s)) != NULL)
+		pw_manager_for_each_object_type(m, type, select_scan, &d);
+	else
+		pw_manager_for_each_object(m, select_scan, &d);
+
+	return d.found ? d.found : s->best;
 }
 
 bool collect_is_linked(struct pw_manager *m, uint32_t obj_id, enum pw_direction direction)
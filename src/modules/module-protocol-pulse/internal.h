@@ -39,6 +39,8 @@
 
 struct pw_loop;
 struct pw_context;
+struct pw_core;
+struct pw_manager;
 struct pw_work_queue;
 struct pw_properties;
 
@@ -76,6 +78,20 @@ struct impl {
 	struct pw_work_queue *work_queue;
 	struct spa_list cleanup_clients;
 
+	/* objects shared by all unrestricted clients */
+	struct pw_core *core;
+	struct spa_hook core_listener;
+	struct pw_manager *manager;
+	struct spa_hook manager_listener;
+
+	struct spa_list sample_players;
+
+	/* streams with a pw_stream, progress of the process threads is
+	 * collected for all of them with one wakeup */
+	struct spa_list process_streams;
+	struct spa_source *process_source;
+	int process_pending;
+
 	struct pw_map samples;
 	struct pw_map modules;
 
@@ -31,8 +31,9 @@
 #include <pipewire/extensions/metadata.h>
 
 #define MAX_PARAMS 32
+#define MAX_OBJECT_TYPES 8
+#define HASH_SIZE 256
 
-#define manager_emit_sync(m) spa_hook_list_call(&m->hooks, struct pw_manager_events, sync, 0)
 #define manager_emit_added(m,o) spa_hook_list_call(&m->hooks, struct pw_manager_events, added, 0, o)
 #define manager_emit_updated(m,o) spa_hook_list_call(&m->hooks, struct pw_manager_events, updated, 0, o)
 #define manager_emit_removed(m,o) spa_hook_list_call(&m->hooks, struct pw_manager_events, removed, 0, o)
@@ -40,19 +41,32 @@
 
 struct object;
 
+/* a listener waiting for the reply of its own sync */
+struct manager_sync {
+	struct spa_list link;
+	struct spa_hook *listener;
+	int seq;
+};
+
 struct manager {
 	struct pw_manager this;
 
 	struct spa_hook core_listener;
 	struct spa_hook registry_listener;
-	int sync_seq;
+	struct spa_list sync_list;
 
 	struct spa_hook_list hooks;
+
+	/* indexes of object_list */
+	struct spa_list id_hash[HASH_SIZE];
+	struct spa_list name_hash[HASH_SIZE];
+	struct spa_list type_list[MAX_OBJECT_TYPES];
 };
 
 struct object_info {
 	const char *type;
 	uint32_t version;
+	const char *name_key;		/* property indexed as the name */
 	const void *events;
 	void (*init) (struct object *object);
 	void (*destroy) (struct object *object);
@@ -64,6 +78,14 @@ struct object_data {
 	size_t size;
 };
 
+struct object_metadata {
+	struct spa_list link;
+	uint32_t subject;
+	char *key;
+	char *type;
+	char *value;
+};
+
 struct object {
 	struct pw_manager_object this;
 
@@ -77,15 +99,37 @@ struct object {
 	struct spa_hook object_listener;
 
 	int param_seq[MAX_PARAMS];
+	int sync_seq;
 
 	struct spa_list data_list;
+	struct spa_list metadata_list;
+
+	struct spa_list id_link;
+	struct spa_list name_link;
+	struct spa_list type_link;
+	const char *name;
 };
 
+static inline uint32_t name_hash(const char *name)
+{
+	uint32_t hash = 5381;
+	while (*name)
+		hash = (hash << 5) + hash + (uint8_t)*name++;
+	return hash;
+}
+
 static int core_sync(struct manager *m)
 {
-	m->sync_seq = pw_core_sync(m->this.core, PW_ID_CORE, m->sync_seq);
-	pw_log_debug("sync start %u", m->sync_seq);
-	return m->sync_seq;
+	int seq = pw_core_sync(m->this.core, PW_ID_CORE, 0);
+	pw_log_debug("sync start %u", seq);
+	return seq;
+}
+
+/* the changes of an object are complete when the last sync that was
+ * started after them is done */
+static void object_sync(struct object *o)
+{
+	o->sync_seq = core_sync(o->manager);
 }
 
 static uint32_t clear_params(struct spa_list *param_list, uint32_t id)
@@ -162,7 +206,7 @@ static bool has_param(struct spa_list *param_list, struct pw_manager_param *p)
 static struct object *find_object(struct manager *m, uint32_t id)
 {
 	struct object *o;
-	spa_list_for_each(o, &m->this.object_list, this.link) {
+	spa_list_for_each(o, &m->id_hash[id % HASH_SIZE], id_link) {
 		if (o->this.creating)
 			continue;
 		if (o->this.id == id)
@@ -186,23 +230,48 @@ static void object_update_params(struct object *o)
 	}
 }
 
+static void metadata_entry_free(struct object_metadata *e)
+{
+	spa_list_remove(&e->link);
+	free(e->key);
+	free(e->type);
+	free(e->value);
+	free(e);
+}
+
+static void object_clear_props_cache(struct object *o)
+{
+	free(o->this.props_cache);
+	o->this.props_cache = NULL;
+	o->this.props_cache_dict = NULL;
+	o->this.props_cache_size = 0;
+}
+
 static void object_destroy(struct object *o)
 {
 	struct manager *m = o->manager;
 	struct object_data *d;
+	struct object_metadata *e;
 	spa_list_remove(&o->this.link);
+	spa_list_remove(&o->id_link);
+	spa_list_remove(&o->type_link);
+	if (o->name != NULL)
+		spa_list_remove(&o->name_link);
 	m->this.n_objects--;
 	if (o->this.proxy)
 		pw_proxy_destroy(o->this.proxy);
 	pw_properties_free(o->this.props);
 	if (o->this.message_object_path)
 		free(o->this.message_object_path);
+	object_clear_props_cache(o);
 	clear_params(&o->this.param_list, SPA_ID_INVALID);
 	clear_params(&o->pending_list, SPA_ID_INVALID);
 	spa_list_consume(d, &o->data_list, link) {
 		spa_list_remove(&d->link);
 		free(d);
 	}
+	spa_list_consume(e, &o->metadata_list, link)
+		metadata_entry_free(e);
 	free(o);
 }
 
@@ -222,12 +291,14 @@ static void client_event_info(void *object, const struct pw_client_info *info)
 
         info = o->this.info = pw_client_info_update(o->this.info, info);
 
-	if (info->change_mask & PW_CLIENT_CHANGE_MASK_PROPS)
+	if (info->change_mask & PW_CLIENT_CHANGE_MASK_PROPS) {
+		object_clear_props_cache(o);
 		changed++;
+	}
 
 	if (changed) {
 		o->this.changed += changed;
-		core_sync(o->manager);
+		object_sync(o);
 	}
 }
 
@@ -261,12 +332,14 @@ static void module_event_info(void *object, const struct pw_module_info *info)
 
         info = o->this.info = pw_module_info_update(o->this.info, info);
 
-	if (info->change_mask & PW_MODULE_CHANGE_MASK_PROPS)
+	if (info->change_mask & PW_MODULE_CHANGE_MASK_PROPS) {
+		object_clear_props_cache(o);
 		changed++;
+	}
 
 	if (changed) {
 		o->this.changed += changed;
-		core_sync(o->manager);
+		object_sync(o);
 	}
 }
 
@@ -300,8 +373,10 @@ static void device_event_info(void *object, const struct pw_device_info *info)
 
 	info = o->this.info = pw_device_info_update(o->this.info, info);
 
-	if (info->change_mask & PW_DEVICE_CHANGE_MASK_PROPS)
+	if (info->change_mask & PW_DEVICE_CHANGE_MASK_PROPS) {
+		object_clear_props_cache(o);
 		changed++;
+	}
 
 	if (info->change_mask & PW_DEVICE_CHANGE_MASK_PARAMS) {
 		for (i = 0; i < info->n_params; i++) {
@@ -338,7 +413,7 @@ static void device_event_info(void *object, const struct pw_device_info *info)
 	}
 	if (changed) {
 		o->this.changed += changed;
-		core_sync(o->manager);
+		object_sync(o);
 	}
 }
 static struct object *find_device(struct manager *m, uint32_t card_id, uint32_t device)
@@ -384,7 +459,7 @@ static void device_event_param(void *object, int seq,
 
 		if ((dev = find_device(m, o->this.id, device)) != NULL) {
 			dev->this.changed++;
-			core_sync(o->manager);
+			object_sync(dev);
 		}
 	}
 }
@@ -406,6 +481,7 @@ static void device_destroy(struct object *o)
 static const struct object_info device_info = {
 	.type = PW_TYPE_INTERFACE_Device,
 	.version = PW_VERSION_DEVICE,
+	.name_key = PW_KEY_DEVICE_NAME,
 	.events = &device_events,
 	.destroy = device_destroy,
 };
@@ -423,8 +499,10 @@ static void node_event_info(void *object, const struct pw_node_info *info)
 	if (info->change_mask & PW_NODE_CHANGE_MASK_STATE)
 		changed++;
 
-	if (info->change_mask & PW_NODE_CHANGE_MASK_PROPS)
+	if (info->change_mask & PW_NODE_CHANGE_MASK_PROPS) {
+		object_clear_props_cache(o);
 		changed++;
+	}
 
 	if (info->change_mask & PW_NODE_CHANGE_MASK_PARAMS) {
 		for (i = 0; i < info->n_params; i++) {
@@ -453,7 +531,7 @@ static void node_event_info(void *object, const struct pw_node_info *info)
 	}
 	if (changed) {
 		o->this.changed += changed;
-		core_sync(o->manager);
+		object_sync(o);
 	}
 }
 
@@ -482,6 +560,7 @@ static void node_destroy(struct object *o)
 static const struct object_info node_info = {
 	.type = PW_TYPE_INTERFACE_Node,
 	.version = PW_VERSION_NODE,
+	.name_key = PW_KEY_NODE_NAME,
 	.events = &node_events,
 	.destroy = node_destroy,
 };
@@ -493,6 +572,42 @@ static const struct object_info link_info = {
 };
 
 /* metadata */
+static void metadata_update(struct object *o, uint32_t subject,
+		const char *key, const char *type, const char *value)
+{
+	struct object_metadata *e, *t;
+
+	/* keep the properties so that they can be replayed to listeners
+	 * that are added later */
+	spa_list_for_each_safe(e, t, &o->metadata_list, link) {
+		if (e->subject != subject)
+			continue;
+		if (key == NULL) {
+			metadata_entry_free(e);
+		} else if (spa_streq(e->key, key)) {
+			if (value == NULL) {
+				metadata_entry_free(e);
+			} else {
+				free(e->type);
+				free(e->value);
+				e->type = type ? strdup(type) : NULL;
+				e->value = strdup(value);
+			}
+			return;
+		}
+	}
+	if (key == NULL || value == NULL)
+		return;
+
+	if ((e = calloc(1, sizeof(*e))) == NULL)
+		return;
+	e->subject = subject;
+	e->key = strdup(key);
+	e->type = type ? strdup(type) : NULL;
+	e->value = strdup(value);
+	spa_list_append(&o->metadata_list, &e->link);
+}
+
 static int metadata_property(void *object,
 			uint32_t subject,
 			const char *key,
@@ -501,6 +616,7 @@ static int metadata_property(void *object,
 {
 	struct object *o = object;
 	struct manager *m = o->manager;
+	metadata_update(o, subject, key, type, value);
 	manager_emit_metadata(m, &o->this, subject, key, type, value);
 	return 0;
 }
@@ -536,15 +652,22 @@ static const struct object_info *objects[] =
 	&metadata_info,
 };
 
-static const struct object_info *find_info(const char *type, uint32_t version)
+static int find_type(const char *type)
 {
 	size_t i;
 	for (i = 0; i < SPA_N_ELEMENTS(objects); i++) {
-		if (spa_streq(objects[i]->type, type) &&
-		    objects[i]->version <= version)
-			return objects[i];
+		if (objects[i]->type == type || spa_streq(objects[i]->type, type))
+			return i;
 	}
-	return NULL;
+	return -1;
+}
+
+static const struct object_info *find_info(const char *type, uint32_t version)
+{
+	int i = find_type(type);
+	if (i < 0 || objects[i]->version > version)
+		return NULL;
+	return objects[i];
 }
 
 static void
@@ -611,10 +734,18 @@ static void registry_event_global(void *data, uint32_t id,
 	spa_list_init(&o->this.param_list);
 	spa_list_init(&o->pending_list);
 	spa_list_init(&o->data_list);
+	spa_list_init(&o->metadata_list);
 
 	o->manager = m;
 	o->info = info;
 	spa_list_append(&m->this.object_list, &o->this.link);
+	spa_list_append(&m->id_hash[id % HASH_SIZE], &o->id_link);
+	spa_list_append(&m->type_list[find_type(info->type)], &o->type_link);
+	/* global properties don't change, the name can be indexed once */
+	if (info->name_key != NULL && o->this.props != NULL &&
+	    (o->name = pw_properties_get(o->this.props, info->name_key)) != NULL)
+		spa_list_append(&m->name_hash[name_hash(o->name) % HASH_SIZE],
+				&o->name_link);
 	m->this.n_objects++;
 
 	if (info->events)
@@ -628,7 +759,7 @@ static void registry_event_global(void *data, uint32_t id,
 	if (info->init)
 		info->init(o);
 
-	core_sync(m);
+	object_sync(o);
 }
 
 static void registry_event_global_remove(void *object, uint32_t id)
@@ -658,23 +789,43 @@ static void on_core_info(void *data, const struct pw_core_info *info)
 	m->this.info = pw_core_info_update(m->this.info, info);
 }
 
+static struct manager_sync *find_sync(struct manager *m, int seq)
+{
+	struct manager_sync *s;
+	spa_list_for_each(s, &m->sync_list, link) {
+		if (s->seq == seq)
+			return s;
+	}
+	return NULL;
+}
+
 static void on_core_done(void *data, uint32_t id, int seq)
 {
 	struct manager *m = data;
+	struct manager_sync *s;
+	struct spa_hook *listener;
 	struct object *o;
 
 	if (id == PW_ID_CORE) {
-		if (m->sync_seq != seq)
-			return;
+		/* the sync callback can remove other listeners and their
+		 * pending syncs, look up the next one every time */
+		while ((s = find_sync(m, seq)) != NULL) {
+			listener = s->listener;
+			spa_list_remove(&s->link);
+			free(s);
+			spa_callbacks_call(&listener->cb, struct pw_manager_events, sync, 0, seq);
+		}
 
-		pw_log_debug("sync end %u/%u", m->sync_seq, seq);
+		pw_log_debug("sync end %u", seq);
 
-		manager_emit_sync(m);
+		/* other objects still wait for a later sync, they don't hold
+		 * back the objects that are complete */
+		spa_list_for_each(o, &m->this.object_list, this.link) {
+			if (o->sync_seq != seq)
+				continue;
 
-		spa_list_for_each(o, &m->this.object_list, this.link)
 			object_update_params(o);
 
-		spa_list_for_each(o, &m->this.object_list, this.link) {
 			if (o->this.creating) {
 				o->this.creating = false;
 				manager_emit_added(m, &o->this);
@@ -696,6 +847,9 @@ static const struct pw_core_events core_events = {
 struct pw_manager *pw_manager_new(struct pw_core *core)
 {
 	struct manager *m;
+	uint32_t i;
+
+	spa_assert(SPA_N_ELEMENTS(objects) <= MAX_OBJECT_TYPES);
 
 	m = calloc(1, sizeof(*m));
 	if (m == NULL)
@@ -710,8 +864,15 @@ struct pw_manager *pw_manager_new(struct pw_core *core)
 	}
 
 	spa_hook_list_init(&m->hooks);
+	spa_list_init(&m->sync_list);
 
 	spa_list_init(&m->this.object_list);
+	for (i = 0; i < HASH_SIZE; i++) {
+		spa_list_init(&m->id_hash[i]);
+		spa_list_init(&m->name_hash[i]);
+	}
+	for (i = 0; i < MAX_OBJECT_TYPES; i++)
+		spa_list_init(&m->type_list[i]);
 
 	pw_core_add_listener(m->this.core,
 			&m->core_listener,
@@ -723,13 +884,50 @@ struct pw_manager *pw_manager_new(struct pw_core *core)
 	return &m->this;
 }
 
+static void remove_syncs(struct manager *m, struct spa_hook *listener)
+{
+	struct manager_sync *s, *t;
+
+	spa_list_for_each_safe(s, t, &m->sync_list, link) {
+		if (listener == NULL || s->listener == listener) {
+			spa_list_remove(&s->link);
+			free(s);
+		}
+	}
+}
+
+static void listener_removed(struct spa_hook *listener)
+{
+	struct manager *m = listener->priv;
+	remove_syncs(m, listener);
+	listener->priv = NULL;
+	listener->removed = NULL;
+}
+
 void pw_manager_add_listener(struct pw_manager *manager,
 		struct spa_hook *listener,
 		const struct pw_manager_events *events, void *data)
 {
 	struct manager *m = SPA_CONTAINER_OF(manager, struct manager, this);
+	struct object *o;
+	struct object_metadata *e;
+
 	spa_hook_list_append(&m->hooks, listener, events, data);
-	core_sync(m);
+	listener->removed = listener_removed;
+	listener->priv = m;
+
+	/* a shared manager can already have objects, announce them to
+	 * the new listener like they were just added */
+	spa_list_for_each(o, &m->this.object_list, this.link) {
+		if (o->this.creating || o->this.removing)
+			continue;
+		spa_callbacks_call(&listener->cb, struct pw_manager_events,
+				added, 0, &o->this);
+		spa_list_for_each(e, &o->metadata_list, link)
+			spa_callbacks_call(&listener->cb, struct pw_manager_events,
+					metadata, 0, &o->this, e->subject,
+					e->key, e->type, e->value);
+	}
 }
 
 int pw_manager_set_metadata(struct pw_manager *manager,
@@ -787,13 +985,68 @@ int pw_manager_for_each_object(struct pw_manager *manager,
 	return 0;
 }
 
+struct pw_manager_object *pw_manager_find_object(struct pw_manager *manager, uint32_t id)
+{
+	struct manager *m = SPA_CONTAINER_OF(manager, struct manager, this);
+	struct object *o = find_object(m, id);
+	return o ? &o->this : NULL;
+}
+
+int pw_manager_for_each_object_type(struct pw_manager *manager, const char *type,
+		int (*callback) (void *data, struct pw_manager_object *object),
+		void *data)
+{
+	struct manager *m = SPA_CONTAINER_OF(manager, struct manager, this);
+	struct object *o;
+	int i, res;
+
+	if ((i = find_type(type)) < 0)
+		return 0;
+
+	spa_list_for_each(o, &m->type_list[i], type_link) {
+		if (o->this.creating)
+			continue;
+		if ((res = callback(data, &o->this)) != 0)
+			return res;
+	}
+	return 0;
+}
+
+int pw_manager_for_each_object_name(struct pw_manager *manager, const char *key,
+		const char *name,
+		int (*callback) (void *data, struct pw_manager_object *object),
+		void *data)
+{
+	struct manager *m = SPA_CONTAINER_OF(manager, struct manager, this);
+	struct object *o;
+	int res;
+
+	spa_list_for_each(o, &m->name_hash[name_hash(name) % HASH_SIZE], name_link) {
+		if (o->this.creating)
+			continue;
+		if (!spa_streq(o->info->name_key, key) || !spa_streq(o->name, name))
+			continue;
+		if ((res = callback(data, &o->this)) != 0)
+			return res;
+	}
+	return 0;
+}
+
 void pw_manager_destroy(struct pw_manager *manager)
 {
 	struct manager *m = SPA_CONTAINER_OF(manager, struct manager, this);
 	struct object *o;
 
+	struct spa_hook *h;
+
 	spa_hook_remove(&m->core_listener);
 
+	remove_syncs(m, NULL);
+	spa_list_for_each(h, &m->hooks.list, link) {
+		h->removed = NULL;
+		h->priv = NULL;
+	}
+
 	spa_list_consume(o, &m->this.object_list, this.link)
 		object_destroy(o);
 
@@ -839,10 +1092,20 @@ done:
 	return SPA_PTROFF(d, sizeof(struct object_data), void);
 }
 
-int pw_manager_sync(struct pw_manager *manager)
+int pw_manager_sync(struct pw_manager *manager, struct spa_hook *listener)
 {
 	struct manager *m = SPA_CONTAINER_OF(manager, struct manager, this);
-	return core_sync(m);
+	struct manager_sync *s;
+
+	s = calloc(1, sizeof(*s));
+	if (s == NULL)
+		return -errno;
+
+	s->listener = listener;
+	s->seq = core_sync(m);
+	spa_list_append(&m->sync_list, &s->link);
+
+	return s->seq;
 }
 
 bool pw_manager_object_is_client(struct pw_manager_object *o)
@@ -42,7 +42,7 @@ struct pw_manager_events {
 
 	void (*destroy) (void *data);
 
-	void (*sync) (void *data);
+	void (*sync) (void *data, int seq);
 
 	void (*added) (void *data, struct pw_manager_object *object);
 
@@ -85,6 +85,10 @@ struct pw_manager_object {
 
 	int changed;
 	void *info;
+	/* props of info encoded as a proplist, see TAG_OBJECT_PROPLIST */
+	const struct spa_dict *props_cache_dict;
+	void *props_cache;
+	uint32_t props_cache_size;
 	struct spa_list param_list;
 	unsigned int creating:1;
 	unsigned int removing:1;
@@ -92,11 +96,14 @@ struct pw_manager_object {
 
 struct pw_manager *pw_manager_new(struct pw_core *core);
 
+/* Existing objects and their metadata are emitted to the new listener */
 void pw_manager_add_listener(struct pw_manager *manager,
 		struct spa_hook *listener,
 		const struct pw_manager_events *events, void *data);
 
-int pw_manager_sync(struct pw_manager *manager);
+/* Emit the sync event on \a listener only, when the events that were
+ * pending on the connection of the manager were received */
+int pw_manager_sync(struct pw_manager *manager, struct spa_hook *listener);
 
 void pw_manager_destroy(struct pw_manager *manager);
 
@@ -109,6 +116,19 @@ int pw_manager_for_each_object(struct pw_manager *manager,
 		int (*callback) (void *data, struct pw_manager_object *object),
 		void *data);
 
+struct pw_manager_object *pw_manager_find_object(struct pw_manager *manager, uint32_t id);
+
+/* iterate the objects of one interface type */
+int pw_manager_for_each_object_type(struct pw_manager *manager, const char *type,
+		int (*callback) (void *data, struct pw_manager_object *object),
+		void *data);
+
+/* iterate the nodes or devices with the given node.name or device.name */
+int pw_manager_for_each_object_name(struct pw_manager *manager, const char *key,
+		const char *name,
+		int (*callback) (void *data, struct pw_manager_object *object),
+		void *data);
+
 void *pw_manager_object_add_data(struct pw_manager_object *o, const char *id, size_t size);
 
 bool pw_manager_object_is_client(struct pw_manager_object *o);
@@ -34,6 +34,7 @@
 #include "defs.h"
 #include "format.h"
 #include "internal.h"
+#include "manager.h"
 #include "media-roles.h"
 #include "message.h"
 #include "volume.h"
@@ -547,36 +548,84 @@ static void add_stream_group(struct message *m, struct spa_dict *dict, const cha
 	write_arbitrary(m, b, l);
 }
 
+static inline uint8_t *put_8(uint8_t *p, uint8_t val)
+{
+	*p = val;
+	return p + 1;
+}
+
+static inline uint8_t *put_32(uint8_t *p, uint32_t val)
+{
+	val = htonl(val);
+	memcpy(p, &val, 4);
+	return p + 4;
+}
+
+static inline uint8_t *put_string(uint8_t *p, const char *s, uint32_t len)
+{
+	p = put_8(p, TAG_STRING);
+	memcpy(p, s, len);
+	return p + len;
+}
+
+static void remap_dict_item(const struct spa_dict_item *it, bool remap,
+		const char **key, const char **val)
+{
+	const struct str_map *map;
+
+	*key = it->key;
+	*val = it->value;
+	if (remap && (map = str_map_find(key_table, *key, NULL)) != NULL) {
+		*key = map->pa_str;
+		if (map->child != NULL &&
+		    (map = str_map_find(map->child, *val, NULL)) != NULL)
+			*val = map->pa_str;
+	}
+}
+
 static void write_dict(struct message *m, struct spa_dict *dict, bool remap)
 {
 	const struct spa_dict_item *it;
 
 	write_8(m, TAG_PROPLIST);
-	if (dict != NULL) {
+	if (dict != NULL && dict->n_items > 0) {
 		const char *media_class = NULL, *media_role = NULL;
+		const char *key, *val;
+		uint32_t kl, vl, size = 0;
+		uint8_t *p;
+
+		/* remap and measure all items first so that the message
+		 * only needs to grow once, the items are remapped again
+		 * when writing them */
 		spa_dict_for_each(it, dict) {
-			const char *key = it->key;
-			const char *val = it->value;
-			int l;
-			const struct str_map *map;
-
-			if (remap && (map = str_map_find(key_table, key, NULL)) != NULL) {
-				key = map->pa_str;
-				if (map->child != NULL &&
-				    (map = str_map_find(map->child, val, NULL)) != NULL)
-					val = map->pa_str;
-			}
+			remap_dict_item(it, remap, &key, &val);
+
 			if (spa_streq(key, "media.class"))
 				media_class = val;
 			if (spa_streq(key, "media.role"))
 				media_role = val;
 
-			write_string(m, key);
-			l = strlen(val) + 1;
-			write_u32(m, l);
-			write_arbitrary(m, val, l);
+			/* key string, value length as u32 and value as arbitrary */
+			size += 1 + strlen(key) + 1 + 5 + 5 + strlen(val) + 1;
+		}
 
+		if (ensure_size(m, size) > 0) {
+			p = m->data + m->length;
+			spa_dict_for_each(it, dict) {
+				remap_dict_item(it, remap, &key, &val);
+				kl = strlen(key) + 1;
+				vl = strlen(val) + 1;
+				p = put_string(p, key, kl);
+				p = put_8(p, TAG_U32);
+				p = put_32(p, vl);
+				p = put_8(p, TAG_ARBITRARY);
+				p = put_32(p, vl);
+				memcpy(p, val, vl);
+				p += vl;
+			}
 		}
+		m->length += size;
+
 		if (remap)
 			add_stream_group(m, dict, "module-stream-restore.id",
 					media_class, media_role);
@@ -584,6 +633,33 @@ static void write_dict(struct message *m, struct spa_dict *dict, bool remap)
 	write_string(m, NULL);
 }
 
+/* write the props of an object as a proplist, the encoded proplist is kept
+ * in the object and copied as is until the props of the object change */
+static void write_object_dict(struct message *m, struct pw_manager_object *o,
+		struct spa_dict *dict)
+{
+	uint32_t start = m->length;
+
+	if (o->props_cache != NULL && o->props_cache_dict == dict) {
+		if (ensure_size(m, o->props_cache_size) > 0)
+			memcpy(m->data + m->length, o->props_cache, o->props_cache_size);
+		m->length += o->props_cache_size;
+		return;
+	}
+
+	write_dict(m, dict, true);
+
+	if (m->length <= m->allocated) {
+		void *cache = realloc(o->props_cache, m->length - start);
+		if (cache == NULL)
+			return;
+		o->props_cache = cache;
+		o->props_cache_size = m->length - start;
+		o->props_cache_dict = dict;
+		memcpy(cache, m->data + start, o->props_cache_size);
+	}
+}
+
 static void write_format_info(struct message *m, struct format_info *info)
 {
 	write_8(m, TAG_FORMAT_INFO);
@@ -645,6 +721,13 @@ int message_put(struct message *m, ...)
 		case TAG_PROPLIST:
 			write_dict(m, va_arg(va, struct spa_dict*), true);
 			break;
+		case TAG_OBJECT_PROPLIST:
+		{
+			struct pw_manager_object *o = va_arg(va, struct pw_manager_object*);
+			struct spa_dict *dict = va_arg(va, struct spa_dict*);
+			write_object_dict(m, o, dict);
+			break;
+		}
 		case TAG_VOLUME:
 			write_volume(m, va_arg(va, double));
 			break;
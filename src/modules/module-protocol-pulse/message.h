@@ -66,6 +66,11 @@ enum {
 	TAG_PROPLIST = 'P',
 	TAG_VOLUME = 'V',
 	TAG_FORMAT_INFO = 'f',
+
+	/* only for message_put(), a TAG_PROPLIST with the props of a
+	 * manager object that is encoded once and cached in the object.
+	 * Takes a struct pw_manager_object * and its struct spa_dict * */
+	TAG_OBJECT_PROPLIST = 0x100,
 };
 
 struct message *message_alloc(struct impl *impl, uint32_t channel, uint32_t size);
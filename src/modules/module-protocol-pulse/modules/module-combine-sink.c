@@ -23,9 +23,13 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <spa/node/io.h>
 #include <spa/param/audio/format-utils.h>
+#include <spa/utils/dll.h>
+#include <spa/utils/ringbuffer.h>
 
 #include <pipewire/pipewire.h>
+#include <pipewire/private.h>
 #include <pipewire/utils.h>
 
 #include "../manager.h"
@@ -34,6 +38,12 @@
 
 #define MAX_SINKS 64 /* ... good enough for anyone */
 
+/* per channel, samples are planar floats */
+#define RINGBUFFER_SIZE		(1u << 18)
+#define RINGBUFFER_MASK		(RINGBUFFER_SIZE-1)
+
+#define DEFAULT_LATENCY_MSEC	50
+
 static const struct spa_dict_item module_combine_sink_info[] = {
 	{ PW_KEY_MODULE_AUTHOR, "Arun Raghavan <arun@asymptotic.io>" },
 	{ PW_KEY_MODULE_DESCRIPTION, "Combine multiple sinks into a single sink" },
@@ -43,7 +53,8 @@ static const struct spa_dict_item module_combine_sink_info[] = {
 				"slaves=<sinks to combine> "
 				"rate=<sample rate> "
 				"channels=<number of channels> "
-				"channel_map=<channel map> " },
+				"channel_map=<channel map> "
+				"latency_msec=<buffered audio per sink> " },
 	{ PW_KEY_MODULE_VERSION, PACKAGE_VERSION },
 };
 
@@ -55,6 +66,17 @@ struct combine_stream {
 	struct pw_stream *stream;
 	struct spa_hook stream_listener;
 	struct module_combine_sink_data *data;
+	struct spa_io_rate_match *rate_match;
+
+	/* written by the combine sink, read by the stream, each
+	 * stream follows the clock of its own sink */
+	struct spa_ringbuffer ring;
+	void *buffer;
+	struct spa_dll dll;
+	uint64_t next_log;
+
+	bool active;
+	bool started;
 	bool cleanup;
 };
 
@@ -75,8 +97,15 @@ struct module_combine_sink_data {
 	struct combine_stream streams[MAX_SINKS];
 
 	struct spa_source *cleanup;
+	struct pw_loop *data_loop;
 
 	struct spa_audio_info_raw info;
+	uint32_t latency_msec;
+
+	/* used in the data thread, the rate is 0 until the format of the
+	 * combine sink is negotiated */
+	uint32_t rate;
+	uint32_t latency;	/* target fill level of the rings in bytes per channel */
 };
 
 /* Core connection: mainly to unload the module if the connection errors out */
@@ -102,58 +131,57 @@ static void capture_process(void *d)
 {
 	struct module_combine_sink_data *data = d;
 	struct pw_buffer *in;
-	int i;
+	uint32_t i, j, size;
 
 	if ((in = pw_stream_dequeue_buffer(data->sink)) == NULL) {
 		pw_log_warn("out of capture buffers: %m");
 		return;
 	}
 
-	for (i = 0; i < MAX_SINKS; i++) {
-		struct pw_buffer *out;
-		uint32_t j, size = 0;
-		int32_t stride = 0;
+	size = in->buffer->n_datas > 0 ? RINGBUFFER_SIZE : 0;
+	for (j = 0; j < in->buffer->n_datas; j++) {
+		struct spa_data *ds = &in->buffer->datas[j];
+		size = SPA_MIN(size, SPA_MIN(ds->chunk->size, ds->maxsize));
+	}
+	size = SPA_ROUND_DOWN_N(size, sizeof(float));
 
-		if (data->streams[i].stream == NULL || data->streams[i].cleanup)
-			continue;
+	/* the input is already in the format of the streams, each stream
+	 * gets a copy in its ring and its adapter resamples on its own */
+	for (i = 0; i < MAX_SINKS; i++) {
+		struct combine_stream *s = &data->streams[i];
+		uint32_t index;
+		int32_t filled;
 
-		if ((out = pw_stream_dequeue_buffer(data->streams[i].stream)) == NULL) {
-			pw_log_warn("out of playback buffers: %m");
+		if (!s->active || s->cleanup)
 			continue;
-		}
 
-		if (in->buffer->n_datas != out->buffer->n_datas) {
-			pw_log_error("incompatible buffer planes");
+		filled = spa_ringbuffer_get_write_index(&s->ring, &index);
+		if (filled < 0 || (uint32_t)filled + size > RINGBUFFER_SIZE) {
+			pw_log_debug("%p: stream %u overrun filled:%d size:%u",
+					data, i, filled, size);
 			continue;
 		}
-
-		for (j = 0; j < out->buffer->n_datas; j++) {
-			struct spa_data *ds, *dd;
-
-			dd = &out->buffer->datas[j];
+		for (j = 0; j < data->info.channels; j++) {
+			void *src = NULL;
 
 			if (j < in->buffer->n_datas) {
-				ds = &in->buffer->datas[j];
-
-				memcpy(dd->data,
-					SPA_PTROFF(ds->data, ds->chunk->offset, void),
-					ds->chunk->size);
-
-				size = SPA_MAX(size, ds->chunk->size);
-				stride = SPA_MAX(stride, ds->chunk->stride);
-			} else {
-				memset(dd->data, 0, size);
+				struct spa_data *ds = &in->buffer->datas[j];
+				if (ds->data != NULL)
+					src = SPA_PTROFF(ds->data,
+						SPA_MIN(ds->chunk->offset, ds->maxsize - size), void);
 			}
-			dd->chunk->offset = 0;
-			dd->chunk->size = size;
-			dd->chunk->stride = stride;
-		}
+			if (src == NULL)
+				continue;
 
-		pw_stream_queue_buffer(data->streams[i].stream, out);
+			spa_ringbuffer_write_data(&s->ring,
+					SPA_PTROFF(s->buffer, j * RINGBUFFER_SIZE, void),
+					RINGBUFFER_SIZE, index & RINGBUFFER_MASK,
+					src, size);
+		}
+		spa_ringbuffer_write_update(&s->ring, index + size);
 	}
 
-	if (in != NULL)
-		pw_stream_queue_buffer(data->sink, in);
+	pw_stream_queue_buffer(data->sink, in);
 }
 
 static void on_in_stream_state_changed(void *d, enum pw_stream_state old,
@@ -168,13 +196,178 @@ static void on_in_stream_state_changed(void *d, enum pw_stream_state old,
 	}
 }
 
+static void reset_stream(struct combine_stream *s)
+{
+	s->started = false;
+	spa_dll_init(&s->dll);
+	if (s->rate_match) {
+		s->rate_match->rate = 1.0;
+		SPA_FLAG_CLEAR(s->rate_match->flags, SPA_IO_RATE_MATCH_FLAG_ACTIVE);
+	}
+}
+
+static int do_set_rate(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct module_combine_sink_data *d = user_data;
+	uint32_t i, rate = *(const uint32_t *)data;
+
+	d->rate = rate;
+	d->latency = rate == 0 ? 0 :
+		SPA_CLAMP((uint64_t)d->latency_msec * rate / 1000, 1u,
+			RINGBUFFER_SIZE / sizeof(float) / 4) * sizeof(float);
+
+	for (i = 0; i < MAX_SINKS; i++) {
+		if (d->streams[i].active)
+			reset_stream(&d->streams[i]);
+	}
+	return 0;
+}
+
+static void on_in_stream_param_changed(void *d, uint32_t id, const struct spa_pod *param)
+{
+	struct module_combine_sink_data *data = d;
+	struct spa_audio_info_raw info;
+	uint32_t rate = 0;
+
+	if (id != SPA_PARAM_Format)
+		return;
+
+	spa_zero(info);
+	if (param != NULL && spa_format_audio_raw_parse(param, &info) >= 0)
+		rate = info.rate;
+
+	pw_log_info("%p: combine sink rate %u", data, rate);
+	pw_loop_invoke(data->data_loop, do_set_rate, 0,
+			&rate, sizeof(rate), true, data);
+}
+
 static const struct pw_stream_events in_stream_events = {
 	PW_VERSION_STREAM_EVENTS,
 	.state_changed = on_in_stream_state_changed,
+	.param_changed = on_in_stream_param_changed,
 	.process = capture_process
 };
 
 /* Output streams: one per sink we have combined output to */
+
+/* Adjust the resampler of the stream so that the fill level of the ring stays
+ * around the target. This compensates the drift between the clock of the
+ * combine sink and the clock of the sink the stream plays to. */
+static void update_rate(struct combine_stream *s, uint32_t avail, uint32_t size)
+{
+	struct module_combine_sink_data *data = s->data;
+	uint32_t rate = data->rate;
+	double err, corr;
+
+	if (s->rate_match == NULL || rate == 0 || size == 0)
+		return;
+
+	err = ((double)avail - (double)data->latency) / sizeof(float);
+	err = SPA_CLAMP(err, -(double)rate / 100, (double)rate / 100);
+
+	if (SPA_UNLIKELY(s->dll.bw == 0.0)) {
+		spa_dll_set_bw(&s->dll, SPA_DLL_BW_MIN, size / sizeof(float), rate);
+		s->next_log = 0;
+	}
+	corr = spa_dll_update(&s->dll, err);
+
+	if (SPA_UNLIKELY(s->next_log-- == 0)) {
+		pw_log_debug("%p: stream %p avail:%u target:%u err:%f rate:%f",
+				data, s, avail, data->latency, err, corr);
+		s->next_log = 1000;
+	}
+
+	s->rate_match->rate = corr;
+	SPA_FLAG_SET(s->rate_match->flags, SPA_IO_RATE_MATCH_FLAG_ACTIVE);
+}
+
+static void playback_process(void *d)
+{
+	struct combine_stream *s = d;
+	struct module_combine_sink_data *data = s->data;
+	struct pw_buffer *out;
+	uint32_t j, index, size, req, n_read = 0;
+	int32_t avail;
+
+	if ((out = pw_stream_dequeue_buffer(s->stream)) == NULL) {
+		pw_log_warn("out of playback buffers: %m");
+		return;
+	}
+
+	if (s->rate_match)
+		req = s->rate_match->size * sizeof(float);
+	else
+		req = 4096;
+
+	size = SPA_MIN(req, RINGBUFFER_SIZE);
+	for (j = 0; j < out->buffer->n_datas; j++)
+		size = SPA_MIN(size, out->buffer->datas[j].maxsize);
+	size = SPA_ROUND_DOWN_N(size, sizeof(float));
+
+	avail = spa_ringbuffer_get_read_index(&s->ring, &index);
+	if (avail < 0 || (uint32_t)avail > RINGBUFFER_SIZE || data->rate == 0) {
+		/* without the rate, the target fill level is not known */
+		avail = 0;
+	} else if ((uint32_t)avail > data->latency * 2 + size) {
+		/* way too much data, we were not scheduled for a while,
+		 * drop the excess and start over */
+		uint32_t skip = avail - data->latency - size;
+		pw_log_debug("%p: stream %p skip %u", data, s, skip);
+		index += skip;
+		avail -= skip;
+		reset_stream(s);
+	}
+
+	if (!s->started && (uint32_t)avail >= data->latency + size)
+		s->started = true;
+
+	if (s->started) {
+		if ((uint32_t)avail < size) {
+			pw_log_debug("%p: stream %p underrun avail:%d size:%u",
+					data, s, avail, size);
+			n_read = avail;
+			reset_stream(s);
+		} else {
+			n_read = size;
+			update_rate(s, avail, size);
+		}
+	}
+
+	for (j = 0; j < out->buffer->n_datas; j++) {
+		struct spa_data *dd = &out->buffer->datas[j];
+
+		if (dd->data == NULL)
+			continue;
+
+		if (j < data->info.channels && n_read > 0)
+			spa_ringbuffer_read_data(&s->ring,
+					SPA_PTROFF(s->buffer, j * RINGBUFFER_SIZE, void),
+					RINGBUFFER_SIZE, index & RINGBUFFER_MASK,
+					dd->data, n_read);
+		if (n_read < size)
+			memset(SPA_PTROFF(dd->data, n_read, void), 0, size - n_read);
+
+		dd->chunk->offset = 0;
+		dd->chunk->size = size;
+		dd->chunk->stride = sizeof(float);
+	}
+	spa_ringbuffer_read_update(&s->ring, index + n_read);
+
+	pw_stream_queue_buffer(s->stream, out);
+}
+
+static void on_out_stream_io_changed(void *data, uint32_t id, void *area, uint32_t size)
+{
+	struct combine_stream *s = data;
+
+	switch (id) {
+	case SPA_IO_RateMatch:
+		s->rate_match = area;
+		break;
+	}
+}
+
 static void on_out_stream_state_changed(void *data, enum pw_stream_state old,
 		enum pw_stream_state state, const char *error)
 {
@@ -189,8 +382,24 @@ static void on_out_stream_state_changed(void *data, enum pw_stream_state old,
 static const struct pw_stream_events out_stream_events = {
 	PW_VERSION_STREAM_EVENTS,
 	.state_changed = on_out_stream_state_changed,
+	.io_changed = on_out_stream_io_changed,
+	.process = playback_process,
 };
 
+static int do_activate_stream(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct combine_stream *s = user_data;
+	s->active = *(bool *)data;
+	return 0;
+}
+
+static void activate_stream(struct combine_stream *s, bool active)
+{
+	pw_loop_invoke(s->data->data_loop, do_activate_stream, 0,
+			&active, sizeof(active), true, s);
+}
+
 static void manager_added(void *d, struct pw_manager_object *o)
 {
 	struct module_combine_sink_data *data = d;
@@ -244,9 +453,20 @@ static void manager_added(void *d, struct pw_manager_object *o)
 	snprintf(buffer, sizeof(buffer), "Simultaneous output on %s",
 			pw_properties_get(o->props, PW_KEY_NODE_DESCRIPTION));
 
+	cstream->buffer = calloc(data->info.channels, RINGBUFFER_SIZE);
+	if (cstream->buffer == NULL) {
+		pw_log_error("Could not allocate ringbuffer: %m");
+		return;
+	}
+	spa_ringbuffer_init(&cstream->ring);
+	spa_dll_init(&cstream->dll);
+	cstream->rate_match = NULL;
+	cstream->started = false;
+
+	/* no node group, the stream follows the clock of its sink and the
+	 * ringbuffer absorbs the drift with the combine sink */
 	props = pw_properties_new(NULL, NULL);
 	pw_properties_set(props, PW_KEY_NODE_TARGET, sink_name);
-	pw_properties_setf(props, PW_KEY_NODE_GROUP, "combine_sink-%u", data->module->idx);
 	pw_properties_setf(props, PW_KEY_NODE_LINK_GROUP, "combine_sink-%u", data->module->idx);
 	pw_properties_set(props, PW_KEY_NODE_DONT_RECONNECT, "true");
 	pw_properties_set(props, PW_KEY_NODE_VIRTUAL, "true");
@@ -256,6 +476,8 @@ static void manager_added(void *d, struct pw_manager_object *o)
 	cstream->stream = pw_stream_new(data->core, buffer, props);
 	if (cstream->stream == NULL) {
 		pw_log_error("Could not create stream");
+		free(cstream->buffer);
+		cstream->buffer = NULL;
 		return;
 	}
 
@@ -278,6 +500,7 @@ static void manager_added(void *d, struct pw_manager_object *o)
 		pw_log_error("Could not connect to sink '%s'", sink_name);
 		return;
 	}
+	activate_stream(cstream, true);
 }
 
 static const struct pw_manager_events manager_events = {
@@ -287,10 +510,16 @@ static const struct pw_manager_events manager_events = {
 
 static void cleanup_stream(struct combine_stream *s)
 {
+	if (s->active)
+		activate_stream(s, false);
+
 	spa_hook_remove(&s->stream_listener);
 	pw_stream_destroy(s->stream);
+	free(s->buffer);
 
 	s->stream = NULL;
+	s->buffer = NULL;
+	s->rate_match = NULL;
 	s->data = NULL;
 	s->cleanup = false;
 }
@@ -316,6 +545,7 @@ static int module_combine_sink_load(struct client *client, struct module *module
 	uint8_t buffer[1024];
 	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
 
+	data->data_loop = module->impl->context->data_loop;
 	data->core = pw_context_connect(module->impl->context,
 			pw_properties_copy(client->props),
 			0);
@@ -330,7 +560,6 @@ static int module_combine_sink_load(struct client *client, struct module *module
 	pw_properties_set(props, PW_KEY_NODE_NAME, data->sink_name);
 	pw_properties_set(props, PW_KEY_NODE_DESCRIPTION, data->sink_name);
 	pw_properties_set(props, PW_KEY_MEDIA_CLASS, "Audio/Sink");
-	pw_properties_setf(props, PW_KEY_NODE_GROUP, "combine_sink-%u", data->module->idx);
 	pw_properties_setf(props, PW_KEY_NODE_LINK_GROUP, "combine_sink-%u", data->module->idx);
 	pw_properties_set(props, PW_KEY_NODE_VIRTUAL, "true");
 
@@ -416,6 +645,7 @@ struct module *create_module_combine_sink(struct impl *impl, const char *argumen
 	const char *str;
 	char *sink_name = NULL, **sink_names = NULL;
 	struct spa_audio_info_raw info = { 0 };
+	uint32_t latency_msec = DEFAULT_LATENCY_MSEC;
 	int i, n, res;
 
 	props = pw_properties_new_dict(&SPA_DICT_INIT_ARRAY(module_combine_sink_info));
@@ -443,6 +673,11 @@ struct module *create_module_combine_sink(struct impl *impl, const char *argumen
 		pw_properties_set(props, "adjust_time", NULL);
 	}
 
+	if ((str = pw_properties_get(props, "latency_msec")) != NULL) {
+		latency_msec = atoi(str);
+		pw_properties_set(props, "latency_msec", NULL);
+	}
+
 	if ((str = pw_properties_get(props, "resample_method")) != NULL) {
 		pw_log_info("The `resample_method` modarg is ignored");
 		pw_properties_set(props, "resample_method", NULL);
@@ -452,6 +687,10 @@ struct module *create_module_combine_sink(struct impl *impl, const char *argumen
 		res = -EINVAL;
 		goto out;
 	}
+	/* the streams to the sinks play the samples of the combine sink
+	 * as they are, they all need the same rate */
+	if (info.rate == 0)
+		info.rate = impl->defs.sample_spec.rate;
 
 	module = module_new(impl, &module_combine_sink_methods, sizeof(*d));
 	if (module == NULL) {
@@ -465,8 +704,11 @@ struct module *create_module_combine_sink(struct impl *impl, const char *argumen
 	d->info = info;
 	d->sink_name = sink_name;
 	d->sink_names = sink_names;
+	d->latency_msec = latency_msec;
 	for (i = 0; i < MAX_SINKS; i++) {
 		d->streams[i].stream = NULL;
+		d->streams[i].buffer = NULL;
+		d->streams[i].active = false;
 		d->streams[i].cleanup = false;
 	}
 
@@ -33,10 +33,14 @@
 #include <spa/utils/hook.h>
 
 #include "../defs.h"
+#include "../format.h"
+#include "../internal.h"
 #include "../module.h"
+#include "../../pcm-ring.h"
 #include "registry.h"
 
 #define DEFAULT_FILE_NAME "/tmp/music.output"
+#define RING_SECONDS 1
 
 struct module_pipesink_data {
 	struct module *module;
@@ -54,6 +58,13 @@ struct module_pipesink_data {
 	char *filename;
 	int fd;
 	bool do_unlink_fifo;
+
+	/* with ring=<path>, the samples go to a ring in shared memory that
+	 * is handed to the readers connecting to the socket at path */
+	struct pcm_ring ring;
+	int ring_fd;
+	struct spa_source *ring_source;
+	struct sockaddr_un ring_addr;
 };
 
 static void capture_process(void *data)
@@ -74,6 +85,13 @@ static void capture_process(void *data)
 		size = d->chunk->size;
 		offset = d->chunk->offset;
 
+		if (impl->ring.header != NULL) {
+			offset = SPA_MIN(offset, d->maxsize);
+			size = SPA_MIN(size, d->maxsize - offset);
+			pcm_ring_write(&impl->ring, SPA_PTROFF(d->data, offset, void), size);
+			continue;
+		}
+
 		while (size > 0) {
 			written = write(impl->fd, SPA_MEMBER(d->data, offset, void), size);
 			if (written < 0) {
@@ -95,6 +113,15 @@ static void capture_process(void *data)
 	pw_stream_queue_buffer(impl->capture, in);
 }
 
+static void on_ring_connect(void *data, int fd, uint32_t mask)
+{
+	struct module_pipesink_data *impl = data;
+	int res;
+
+	if ((res = pcm_ring_accept(&impl->ring, fd)) < 0)
+		pw_log_warn("can't send ring to reader: %s", spa_strerror(res));
+}
+
 static void on_core_error(void *data, uint32_t id, int seq, int res, const char *message)
 {
 	struct module_pipesink_data *d = data;
@@ -144,6 +171,13 @@ static int module_pipesink_load(struct client *client, struct module *module)
 	uint8_t buffer[1024];
 	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
 
+	if (data->ring_fd >= 0) {
+		data->ring_source = pw_loop_add_io(module->impl->loop, data->ring_fd,
+				SPA_IO_IN, true, on_ring_connect, data);
+		if (data->ring_source == NULL)
+			return -errno;
+	}
+
 	data->core = pw_context_connect(module->impl->context,
 			pw_properties_copy(client->props),
 			0);
@@ -196,6 +230,13 @@ static int module_pipesink_unload(struct client *client, struct module *module)
 	}
 	if (d->fd >= 0)
 		close(d->fd);
+	if (d->ring_source != NULL)
+		pw_loop_destroy_source(module->impl->loop, d->ring_source);
+	else if (d->ring_fd >= 0)
+		close(d->ring_fd);
+	if (d->ring_fd >= 0)
+		unlink(d->ring_addr.sun_path);
+	pcm_ring_clear(&d->ring);
 
 	return 0;
 }
@@ -210,6 +251,7 @@ static const struct spa_dict_item module_pipesink_info[] = {
 	{ PW_KEY_MODULE_AUTHOR, "Sanchayan Maity <sanchayan@asymptotic.io>" },
 	{ PW_KEY_MODULE_DESCRIPTION, "Pipe sink" },
 	{ PW_KEY_MODULE_USAGE, "file=<name of the FIFO special file to use> "
+				"ring=<socket to share a ring in memory instead of the FIFO> "
 				"sink_name=<name for the sink> "
 				"format=<sample format> "
 				"rate=<sample rate> "
@@ -224,12 +266,15 @@ struct module *create_module_pipe_sink(struct impl *impl, const char *argument)
 	struct module_pipesink_data *d;
 	struct pw_properties *props = NULL, *capture_props = NULL;
 	struct spa_audio_info_raw info = { 0 };
+	struct sample_spec ss;
+	struct pcm_ring ring = PCM_RING_INIT;
+	struct sockaddr_un ring_addr = { 0 };
 	struct stat st;
 	const char *str;
 	char *filename = NULL;
-	bool do_unlink_fifo;
+	bool do_unlink_fifo = false;
 	int res = 0;
-	int fd = -1;
+	int fd = -1, ring_fd = -1;
 
 	props = pw_properties_new_dict(&SPA_DICT_INIT_ARRAY(module_pipesink_info));
 	capture_props = pw_properties_new(NULL, NULL);
@@ -255,6 +300,38 @@ struct module *create_module_pipe_sink(struct impl *impl, const char *argument)
 		pw_properties_set(props, "sink_name", NULL);
 	}
 
+	if ((str = pw_properties_get(props, "ring")) != NULL) {
+		ss = SAMPLE_SPEC_INIT;
+		ss.format = info.format;
+		ss.rate = info.rate;
+		ss.channels = info.channels;
+		if (!sample_spec_valid(&ss)) {
+			pw_log_error("invalid sample spec for ring");
+			res = -EINVAL;
+			goto out;
+		}
+		if ((res = pcm_ring_create(&ring, "pipe-sink-ring",
+				RING_SECONDS * ss.rate * sample_spec_frame_size(&ss),
+				sample_spec_frame_size(&ss),
+				ss.format, ss.rate, ss.channels)) < 0) {
+			pw_log_error("can't create ring: %s", spa_strerror(res));
+			goto out;
+		}
+		/* older kernels can't seal against new writable mappings */
+		if ((res = pcm_ring_seal_readers(&ring)) == -EINVAL) {
+			pw_log_warn("can't seal ring for readers: %s", spa_strerror(res));
+		} else if (res < 0) {
+			pw_log_error("can't seal ring: %s", spa_strerror(res));
+			goto out;
+		}
+		if ((ring_fd = res = pcm_ring_listen(str, &ring_addr)) < 0) {
+			pw_log_error("can't listen on '%s': %s", str, spa_strerror(res));
+			goto out;
+		}
+		pw_properties_set(props, "ring", NULL);
+		goto create;
+	}
+
 	if ((str = pw_properties_get(props, "file")) != NULL) {
 		filename = strdup(str);
 		pw_properties_set(props, "file", NULL);
@@ -262,7 +339,6 @@ struct module *create_module_pipe_sink(struct impl *impl, const char *argument)
 		filename = strdup(DEFAULT_FILE_NAME);
 	}
 
-	do_unlink_fifo = false;
 	if (mkfifo(filename, 0666) < 0) {
 		if (errno != EEXIST) {
 			res = -errno;
@@ -296,6 +372,7 @@ struct module *create_module_pipe_sink(struct impl *impl, const char *argument)
 		goto out;
 	}
 
+create:
 	if ((str = pw_properties_get(props, PW_KEY_MEDIA_CLASS)) == NULL)
 		pw_properties_set(props, PW_KEY_MEDIA_CLASS, "Audio/Sink");
 
@@ -313,6 +390,9 @@ struct module *create_module_pipe_sink(struct impl *impl, const char *argument)
 	d->fd = fd;
 	d->filename = filename;
 	d->do_unlink_fifo = do_unlink_fifo;
+	d->ring = ring;
+	d->ring_fd = ring_fd;
+	d->ring_addr = ring_addr;
 
 	pw_log_info("Successfully loaded module-pipe-sink");
 
@@ -327,6 +407,11 @@ out:
 	}
 	if (fd >= 0)
 		close(fd);
+	if (ring_fd >= 0) {
+		close(ring_fd);
+		unlink(ring_addr.sun_path);
+	}
+	pcm_ring_clear(&ring);
 	errno = -res;
 
 	return NULL;
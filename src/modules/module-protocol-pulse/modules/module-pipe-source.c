@@ -33,10 +33,13 @@
 #include <spa/utils/hook.h>
 
 #include "../defs.h"
+#include "../internal.h"
 #include "../module.h"
+#include "../../pcm-ring.h"
 #include "registry.h"
 
 #define DEFAULT_FILE_NAME "/tmp/music.input"
+#define RING_SECONDS 1
 
 struct module_pipesrc_data {
 	struct module *module;
@@ -57,6 +60,13 @@ struct module_pipesrc_data {
 
 	uint32_t stride;
 
+	/* with ring=<path>, a writer connecting to the socket at path gets
+	 * a ring in shared memory to write the samples in */
+	struct pcm_ring ring;
+	int ring_fd;
+	struct spa_source *ring_source;
+	struct sockaddr_un ring_addr;
+
 	uint32_t leftover_count;
 	uint8_t leftover[]; /* `stride` bytes for storing a partial sample */
 };
@@ -79,11 +89,30 @@ static void playback_process(void *data)
 	if (d->data == NULL)
 		return;
 
+	chunk = d->chunk;
+
+	if (impl->ring.header != NULL) {
+		int32_t avail = pcm_ring_avail(&impl->ring);
+
+		left = SPA_MIN((uint32_t)SPA_MAX(avail, 0), d->maxsize);
+		left -= left % impl->stride;
+		if ((avail = pcm_ring_read(&impl->ring, d->data, left)) < 0) {
+			pw_log_debug("ring overrun");
+			avail = 0;
+		}
+		/* we are the only reader, let the writer know */
+		spa_ringbuffer_read_update(&impl->ring.header->ring, impl->ring.index);
+
+		chunk->offset = 0;
+		chunk->stride = impl->stride;
+		chunk->size = avail;
+		pw_stream_queue_buffer(impl->playback, buffer);
+		return;
+	}
+
 	left = d->maxsize;
 	spa_assert(left >= impl->leftover_count);
 
-	chunk = d->chunk;
-
 	chunk->offset = 0;
 	chunk->stride = impl->stride;
 	chunk->size = impl->leftover_count;
@@ -115,6 +144,15 @@ static void playback_process(void *data)
 	pw_stream_queue_buffer(impl->playback, buffer);
 }
 
+static void on_ring_connect(void *data, int fd, uint32_t mask)
+{
+	struct module_pipesrc_data *impl = data;
+	int res;
+
+	if ((res = pcm_ring_accept(&impl->ring, fd)) < 0)
+		pw_log_warn("can't send ring to writer: %s", spa_strerror(res));
+}
+
 static void on_core_error(void *data, uint32_t id, int seq, int res, const char *message)
 {
 	struct module_pipesrc_data *d = data;
@@ -164,6 +202,13 @@ static int module_pipesource_load(struct client *client, struct module *module)
 	uint8_t buffer[1024];
 	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
 
+	if (data->ring_fd >= 0) {
+		data->ring_source = pw_loop_add_io(module->impl->loop, data->ring_fd,
+				SPA_IO_IN, true, on_ring_connect, data);
+		if (data->ring_source == NULL)
+			return -errno;
+	}
+
 	data->core = pw_context_connect(module->impl->context,
 			pw_properties_copy(client->props),
 			0);
@@ -214,6 +259,13 @@ static int module_pipesource_unload(struct client *client, struct module *module
 	free(d->filename);
 	if (d->fd >= 0)
 		close(d->fd);
+	if (d->ring_source != NULL)
+		pw_loop_destroy_source(module->impl->loop, d->ring_source);
+	else if (d->ring_fd >= 0)
+		close(d->ring_fd);
+	if (d->ring_fd >= 0)
+		unlink(d->ring_addr.sun_path);
+	pcm_ring_clear(&d->ring);
 
 	return 0;
 }
@@ -228,6 +280,7 @@ static const struct spa_dict_item module_pipesource_info[] = {
 	{ PW_KEY_MODULE_AUTHOR, "Sanchayan Maity <sanchayan@asymptotic.io>" },
 	{ PW_KEY_MODULE_DESCRIPTION, "Pipe source" },
 	{ PW_KEY_MODULE_USAGE, "file=<name of the FIFO special file to use> "
+				"ring=<socket to share a ring in memory instead of the FIFO> "
 				"source_name=<name for the source> "
 				"format=<sample format> "
 				"rate=<sample rate> "
@@ -242,12 +295,14 @@ struct module *create_module_pipe_source(struct impl *impl, const char *argument
 	struct module_pipesrc_data *d;
 	struct pw_properties *props = NULL, *playback_props = NULL;
 	struct spa_audio_info_raw info = { 0 };
+	struct pcm_ring ring = PCM_RING_INIT;
+	struct sockaddr_un ring_addr = { 0 };
 	struct stat st;
 	const char *str;
 	bool do_unlink = false;
 	char *filename = NULL;
 	int stride, res = 0;
-	int fd = -1;
+	int fd = -1, ring_fd = -1;
 
 	props = pw_properties_new_dict(&SPA_DICT_INIT_ARRAY(module_pipesource_info));
 	playback_props = pw_properties_new(NULL, NULL);
@@ -304,6 +359,21 @@ struct module *create_module_pipe_source(struct impl *impl, const char *argument
 		pw_properties_set(props, "source_name", NULL);
 	}
 
+	if ((str = pw_properties_get(props, "ring")) != NULL) {
+		if ((res = pcm_ring_create(&ring, "pipe-source-ring",
+				RING_SECONDS * info.rate * stride, stride,
+				info.format, info.rate, info.channels)) < 0) {
+			pw_log_error("can't create ring: %s", spa_strerror(res));
+			goto out;
+		}
+		if ((ring_fd = res = pcm_ring_listen(str, &ring_addr)) < 0) {
+			pw_log_error("can't listen on '%s': %s", str, spa_strerror(res));
+			goto out;
+		}
+		pw_properties_set(props, "ring", NULL);
+		goto create;
+	}
+
 	if ((str = pw_properties_get(props, "file")) != NULL) {
 		filename = strdup(str);
 		pw_properties_set(props, "file", NULL);
@@ -353,6 +423,7 @@ struct module *create_module_pipe_source(struct impl *impl, const char *argument
 		goto out;
 	}
 
+create:
 	if ((str = pw_properties_get(props, PW_KEY_MEDIA_CLASS)) == NULL)
 		pw_properties_set(props, PW_KEY_MEDIA_CLASS, "Audio/Source");
 
@@ -371,6 +442,9 @@ struct module *create_module_pipe_source(struct impl *impl, const char *argument
 	d->filename = filename;
 	d->do_unlink = do_unlink;
 	d->stride = stride;
+	d->ring = ring;
+	d->ring_fd = ring_fd;
+	d->ring_addr = ring_addr;
 
 	pw_log_info("Successfully loaded module-pipe-source");
 
@@ -383,6 +457,11 @@ out:
 	free(filename);
 	if (fd >= 0)
 		close(fd);
+	if (ring_fd >= 0) {
+		close(ring_fd);
+		unlink(ring_addr.sun_path);
+	}
+	pcm_ring_clear(&ring);
 	errno = -res;
 
 	return NULL;
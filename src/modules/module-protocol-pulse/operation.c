@@ -43,7 +43,7 @@ int operation_new(struct client *client, uint32_t tag)
 	o->tag = tag;
 
 	spa_list_append(&client->operations, &o->link);
-	pw_manager_sync(client->manager);
+	client_sync(client);
 
 	pw_log_debug("client %p [%s]: new operation tag:%u", client, client->name, tag);
 
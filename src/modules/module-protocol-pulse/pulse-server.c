@@ -97,6 +97,7 @@ bool debug_messages = false;
 struct latency_offset_data {
 	int64_t prev_latency_offset;
 	unsigned int initialized:1;
+	unsigned int changed:1;
 };
 
 static struct sample *find_sample(struct impl *impl, uint32_t idx, const char *name)
@@ -183,7 +184,7 @@ static int reply_set_client_name(struct client *client, uint32_t tag)
 	return client_queue_message(client, reply);
 }
 
-static void manager_sync(void *data)
+static void manager_sync(void *data, int seq)
 {
 	struct client *client = data;
 	struct operation *o;
@@ -276,14 +277,31 @@ static int64_t get_node_latency_offset(struct pw_manager_object *o)
 	return latency_offset;
 }
 
+static void update_latency_offset(struct pw_manager_object *o)
+{
+	struct latency_offset_data *d;
+	int64_t latency_offset;
+
+	if (!pw_manager_object_is_sink(o) && !pw_manager_object_is_source_or_monitor(o))
+		return;
+
+	d = pw_manager_object_add_data(o, "latency_offset_data", sizeof(struct latency_offset_data));
+	if (d == NULL)
+		return;
+
+	latency_offset = get_node_latency_offset(o);
+	d->changed = (!d->initialized || latency_offset != d->prev_latency_offset);
+
+	d->prev_latency_offset = latency_offset;
+	d->initialized = true;
+}
+
 static void send_latency_offset_subscribe_event(struct client *client, struct pw_manager_object *o)
 {
 	struct latency_offset_data *d;
 	struct pw_node_info *info;
 	const char *str;
 	uint32_t card_id = SPA_ID_INVALID;
-	int64_t latency_offset = 0LL;
-	bool changed = false;
 
 	if (!pw_manager_object_is_sink(o) && !pw_manager_object_is_source_or_monitor(o))
 		return;
@@ -302,13 +320,7 @@ static void send_latency_offset_subscribe_event(struct client *client, struct pw
 	if (d == NULL)
 		return;
 
-	latency_offset = get_node_latency_offset(o);
-	changed = (!d->initialized || latency_offset != d->prev_latency_offset);
-
-	d->prev_latency_offset = latency_offset;
-	d->initialized = true;
-
-	if (changed)
+	if (d->changed)
 		client_queue_subscribe_event(client,
 				SUBSCRIPTION_MASK_CARD,
 				SUBSCRIPTION_EVENT_CARD | SUBSCRIPTION_EVENT_CHANGE,
@@ -380,6 +392,10 @@ static void manager_updated(void *data, struct pw_manager_object *o)
 {
 	struct client *client = data;
 
+	/* the shared manager does this once for all its clients */
+	if (!client->shared_manager)
+		update_latency_offset(o);
+
 	send_object_event(client, o, SUBSCRIPTION_EVENT_CHANGE);
 
 	send_latency_offset_subscribe_event(client, o);
@@ -483,6 +499,211 @@ static const struct pw_manager_events manager_events = {
 	.metadata = manager_metadata,
 };
 
+static void shared_manager_updated(void *data, struct pw_manager_object *o)
+{
+	/* called before the client listeners */
+	update_latency_offset(o);
+}
+
+static const struct pw_manager_events shared_manager_events = {
+	PW_VERSION_MANAGER_EVENTS,
+	.updated = shared_manager_updated,
+};
+
+/* Clients without access restrictions see the same registry, they share
+ * one manager so that the objects and their params are only mirrored once.
+ * Restricted clients get their own manager on their own connection, with
+ * the view of the registry that the daemon filtered for them. The shared
+ * manager is only used while the permissions of the client connection
+ * allow everything, otherwise the client moves to its own manager. */
+static bool client_can_share_manager(struct client *client)
+{
+	const char *str = pw_properties_get(client->props, PW_KEY_CLIENT_ACCESS);
+	return str == NULL || spa_streq(str, "unrestricted");
+}
+
+static void on_shared_manager_error(void *obj, void *data, int res, uint32_t id);
+
+static void shared_core_error(void *data, uint32_t id, int seq, int res, const char *message)
+{
+	struct impl *impl = data;
+
+	pw_log_error(NAME" %p: shared connection error id:%u seq:%d res:%d (%s): %s",
+			impl, id, seq, res, spa_strerror(res), message);
+
+	if (id == PW_ID_CORE && res == -EPIPE)
+		pw_work_queue_add(impl->work_queue, impl->core, 0,
+				on_shared_manager_error, impl);
+}
+
+static const struct pw_core_events shared_core_events = {
+	PW_VERSION_CORE_EVENTS,
+	.error = shared_core_error,
+};
+
+static struct pw_manager *get_shared_manager(struct impl *impl)
+{
+	int res;
+
+	if (impl->manager != NULL)
+		return impl->manager;
+
+	impl->core = pw_context_connect(impl->context,
+			pw_properties_new(
+				PW_KEY_CLIENT_API, "pipewire-pulse",
+				PW_KEY_APP_NAME, "pipewire-pulse",
+				NULL), 0);
+	if (impl->core == NULL)
+		return NULL;
+
+	pw_core_add_listener(impl->core, &impl->core_listener,
+			&shared_core_events, impl);
+
+	impl->manager = pw_manager_new(impl->core);
+	if (impl->manager == NULL) {
+		res = -errno;
+		spa_hook_remove(&impl->core_listener);
+		pw_core_disconnect(impl->core);
+		impl->core = NULL;
+		errno = -res;
+		return NULL;
+	}
+	pw_manager_add_listener(impl->manager, &impl->manager_listener,
+			&shared_manager_events, impl);
+
+	return impl->manager;
+}
+
+static void clear_shared_manager(struct impl *impl)
+{
+	if (impl->manager != NULL) {
+		spa_hook_remove(&impl->manager_listener);
+		pw_manager_destroy(impl->manager);
+		impl->manager = NULL;
+	}
+	if (impl->core != NULL) {
+		pw_work_queue_cancel(impl->work_queue, impl->core, SPA_ID_INVALID);
+		spa_hook_remove(&impl->core_listener);
+		pw_core_disconnect(impl->core);
+		impl->core = NULL;
+	}
+}
+
+static void client_core_done(void *data, uint32_t id, int seq)
+{
+	struct client *client = data;
+
+	/* the client connection is synced, now sync the shared manager */
+	if (id == PW_ID_CORE && seq == client->sync_seq && client->shared_manager)
+		pw_manager_sync(client->manager, &client->manager_listener);
+}
+
+static const struct pw_core_events client_core_events = {
+	PW_VERSION_CORE_EVENTS,
+	.done = client_core_done,
+};
+
+static int client_use_private_manager(struct client *client);
+
+static void client_permissions(void *data, uint32_t index,
+		uint32_t n_permissions, const struct pw_permission *permissions)
+{
+	struct client *client = data;
+	uint32_t i;
+
+	for (i = 0; i < n_permissions; i++) {
+		if (permissions[i].permissions == PW_PERM_INVALID ||
+		    SPA_FLAG_IS_SET(permissions[i].permissions, PW_PERM_ALL))
+			continue;
+
+		pw_log_info(NAME" %p: [%s] object %u is restricted for the client",
+				client->impl, client->name, permissions[i].id);
+		/* the private manager syncs and finishes the operations */
+		client_use_private_manager(client);
+		return;
+	}
+}
+
+static const struct pw_client_events client_events = {
+	PW_VERSION_CLIENT_EVENTS,
+	.permissions = client_permissions,
+};
+
+static int client_use_shared_manager(struct client *client)
+{
+	struct pw_manager *manager;
+	struct pw_client *c;
+
+	if ((manager = get_shared_manager(client->impl)) == NULL)
+		return -errno;
+	if ((c = pw_core_get_client(client->core)) == NULL)
+		return -ENOENT;
+
+	pw_client_add_listener(c, &client->client_listener,
+			&client_events, client);
+
+	client->manager = manager;
+	client->shared_manager = true;
+	pw_manager_add_listener(manager, &client->manager_listener,
+			&manager_events, client);
+
+	return client_sync(client);
+}
+
+static int client_use_private_manager(struct client *client)
+{
+	struct pw_manager *manager;
+	int res;
+
+	if ((manager = pw_manager_new(client->core)) == NULL) {
+		res = -errno;
+		pw_log_error(NAME" %p: [%s] can't create manager: %s",
+				client->impl, client->name, spa_strerror(res));
+		return res;
+	}
+
+	if (client->manager != NULL) {
+		pw_log_info(NAME" %p: [%s] leaving the shared manager",
+				client->impl, client->name);
+		client_leave_shared_manager(client);
+		client->metadata_default = NULL;
+		client->metadata_routes = NULL;
+		client->prev_default_sink = NULL;
+		client->prev_default_source = NULL;
+	}
+
+	client->manager = manager;
+	pw_manager_add_listener(manager, &client->manager_listener,
+			&manager_events, client);
+
+	return pw_manager_sync(manager, &client->manager_listener);
+}
+
+/* the shared connection is gone, move its clients to their own manager,
+ * the next client makes a new shared manager */
+static void on_shared_manager_error(void *obj, void *data, int res, uint32_t id)
+{
+	struct impl *impl = data;
+	struct server *s;
+	struct client *c, *t;
+
+	spa_list_for_each(s, &impl->servers, link) {
+		spa_list_for_each_safe(c, t, &s->clients, link) {
+			if (!c->shared_manager)
+				continue;
+			if (client_use_private_manager(c) >= 0)
+				continue;
+
+			c->ref++;
+			if (client_detach(c))
+				client_unref(c);
+			client_disconnect(c);
+			client_unref(c);
+		}
+	}
+	clear_shared_manager(impl);
+}
+
 static int do_set_client_name(struct client *client, uint32_t command, uint32_t tag, struct message *m)
 {
 	struct impl *impl = client->impl;
@@ -516,14 +737,17 @@ static int do_set_client_name(struct client *client, uint32_t command, uint32_t
 			res = -errno;
 			goto error;
 		}
-		client->manager = pw_manager_new(client->core);
-		if (client->manager == NULL) {
-			res = -errno;
-			goto error;
-		}
+		pw_core_add_listener(client->core, &client->core_listener,
+				&client_core_events, client);
+
+		/* the reply is sent after the first sync */
 		client->connect_tag = tag;
-		pw_manager_add_listener(client->manager, &client->manager_listener,
-				&manager_events, client);
+		if (!client_can_share_manager(client) ||
+		    client_use_shared_manager(client) < 0)
+			res = client_use_private_manager(client);
+		if (res < 0)
+			goto error;
+		res = 0;
 	} else {
 		if (changed)
 			pw_core_update_properties(client->core, &client->props->dict);
@@ -1031,67 +1255,81 @@ static void stream_io_changed(void *data, uint32_t id, void *area, uint32_t size
 	}
 }
 
-struct process_data {
-	struct pw_time pwt;
-	uint32_t read_inc;
-	uint32_t write_inc;
-	uint32_t underrun_for;
-	uint32_t playing_for;
-	uint32_t missing;
-	unsigned int underrun:1;
-};
-
-static int
-do_process_done(struct spa_loop *loop,
-                 bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+static void stream_collect_progress(struct stream *stream)
 {
-	struct stream *stream = user_data;
 	struct client *client = stream->client;
 	struct impl *impl = client->impl;
-	const struct process_data *pd = data;
+	struct stream_progress *rt = &stream->rt_progress;
+	struct stream_progress *last = &stream->progress;
+	struct stream_progress pd, now;
+	struct pw_time pwt;
 	uint32_t index, towrite;
 	int32_t avail;
 
-	stream->timestamp = pd->pwt.now;
-	if (pd->pwt.rate.denom > 0)
-		stream->delay = pd->pwt.delay * SPA_USEC_PER_SEC / pd->pwt.rate.denom;
+	now.read_inc = ATOMIC_LOAD(rt->read_inc);
+	now.write_inc = ATOMIC_LOAD(rt->write_inc);
+	now.underrun_for = ATOMIC_LOAD(rt->underrun_for);
+	now.playing_for = ATOMIC_LOAD(rt->playing_for);
+	now.missing = ATOMIC_LOAD(rt->missing);
+	now.underruns = ATOMIC_LOAD(rt->underruns);
+	now.underrun = ATOMIC_LOAD(rt->underrun);
+
+	pd.read_inc = now.read_inc - last->read_inc;
+	pd.write_inc = now.write_inc - last->write_inc;
+	pd.underrun_for = now.underrun_for - last->underrun_for;
+	pd.playing_for = now.playing_for - last->playing_for;
+	pd.missing = now.missing - last->missing;
+	pd.underruns = now.underruns - last->underruns;
+	pd.underrun = now.underrun;
+	*last = now;
+
+	pw_stream_get_time(stream->stream, &pwt);
+	stream->timestamp = pwt.now;
+	if (pwt.rate.denom > 0)
+		stream->delay = pwt.delay * SPA_USEC_PER_SEC / pwt.rate.denom;
 	else
 		stream->delay = 0;
 
 	if (stream->direction == PW_DIRECTION_OUTPUT) {
-		stream->read_index += pd->read_inc;
+		stream->read_index += pd.read_inc;
 		if (stream->corked) {
 			if (stream->underrun_for != (uint64_t)-1)
-				stream->underrun_for += pd->underrun_for;
+				stream->underrun_for += pd.underrun_for;
 			stream->playing_for = 0;
-			return 0;
+			return;
 		}
-		if (pd->underrun != stream->is_underrun) {
-			stream->is_underrun = pd->underrun;
+		/* several cycles can be collected at once, report an
+		 * underrun that started in between even when we are
+		 * playing again now */
+		if (pd.underruns > 0 && !stream->is_underrun) {
+			stream->is_underrun = true;
 			stream->underrun_for = 0;
 			stream->playing_for = 0;
-			if (pd->underrun)
-				stream_send_underflow(stream, stream->read_index, pd->underrun_for);
-			else
-				stream_send_started(stream);
+			stream_send_underflow(stream, stream->read_index, pd.underrun_for);
+		}
+		if (!pd.underrun && stream->is_underrun) {
+			stream->is_underrun = false;
+			stream->underrun_for = 0;
+			stream->playing_for = 0;
+			stream_send_started(stream);
 		}
-		stream->missing += pd->missing;
+		stream->missing += pd.missing;
 		stream->missing = SPA_MIN(stream->missing, stream->attr.tlength);
-		stream->playing_for += pd->playing_for;
+		stream->playing_for += pd.playing_for;
 		if (stream->underrun_for != (uint64_t)-1)
-			stream->underrun_for += pd->underrun_for;
+			stream->underrun_for += pd.underrun_for;
 
 		stream_send_request(stream);
 	} else {
 		struct message *msg;
-		stream->write_index += pd->write_inc;
+		stream->write_index += pd.write_inc;
 
 		avail = spa_ringbuffer_get_read_index(&stream->ring, &index);
 
 		if (!spa_list_is_empty(&client->out_messages)) {
 			pw_log_debug(NAME" %p: [%s] pending read:%u avail:%d",
 					stream, client->name, index, avail);
-			return 0;
+			return;
 		}
 
 		if (avail <= 0) {
@@ -1117,7 +1355,7 @@ do_process_done(struct spa_loop *loop,
 
 				msg = message_alloc(impl, stream->channel, towrite);
 				if (msg == NULL)
-					return -errno;
+					return;
 
 				spa_ringbuffer_read_data(&stream->ring,
 						stream->buffer, stream->attr.maxlength,
@@ -1133,9 +1371,28 @@ do_process_done(struct spa_loop *loop,
 			spa_ringbuffer_read_update(&stream->ring, index);
 		}
 	}
-	return 0;
 }
 
+/* called in the main thread when one or more streams made progress */
+static void on_process(void *data, uint64_t count)
+{
+	struct impl *impl = data;
+	struct stream *s, *t;
+
+	ATOMIC_STORE(impl->process_pending, 0);
+
+	spa_list_for_each_safe(s, t, &impl->process_streams, process_link) {
+		if (ATOMIC_XCHG(s->process_pending, 0))
+			stream_collect_progress(s);
+	}
+}
+
+static inline void stream_progress_underrun(struct stream_progress *pd, bool underrun)
+{
+	if (underrun && !pd->underrun)
+		pd->underruns++;
+	pd->underrun = underrun;
+}
 
 static void stream_process(void *data)
 {
@@ -1146,7 +1403,7 @@ static void stream_process(void *data)
 	struct pw_buffer *buffer;
 	struct spa_buffer *buf;
 	uint32_t size, minreq, index;
-	struct process_data pd;
+	struct stream_progress *pd = &stream->rt_progress;
 
 	pw_log_trace_fp(NAME" %p: process", stream);
 
@@ -1158,8 +1415,6 @@ static void stream_process(void *data)
         if ((p = buf->datas[0].data) == NULL)
 		return;
 
-	spa_zero(pd);
-
 	if (stream->direction == PW_DIRECTION_OUTPUT) {
 		int32_t avail = spa_ringbuffer_get_read_index(&stream->ring, &index);
 
@@ -1177,14 +1432,14 @@ static void stream_process(void *data)
 				stream->draining = false;
 				pw_stream_flush(stream->stream, true);
 			} else {
-				pd.underrun_for = size;
-				pd.underrun = true;
+				pd->underrun_for += size;
+				stream_progress_underrun(pd, true);
 			}
 			if (stream->attr.prebuf == 0 && !stream->corked) {
-				pd.missing = size;
-				pd.playing_for = size;
+				pd->missing += size;
+				pd->playing_for += size;
 				index += size;
-				pd.read_inc = size;
+				pd->read_inc += size;
 				spa_ringbuffer_read_update(&stream->ring, index);
 			}
 		} else {
@@ -1196,7 +1451,7 @@ static void stream_process(void *data)
 						stream, client->name, index, avail,
 						stream->attr.maxlength, skip);
 				index += skip;
-				pd.read_inc = skip;
+				pd->read_inc += skip;
 				avail = stream->attr.maxlength;
 			}
 			size = SPA_MIN(buf->datas[0].maxsize, (uint32_t)avail);
@@ -1208,12 +1463,12 @@ static void stream_process(void *data)
 					p, size);
 
 			index += size;
-			pd.read_inc += size;
+			pd->read_inc += size;
 			spa_ringbuffer_read_update(&stream->ring, index);
 
-			pd.playing_for = size;
-			pd.missing = size;
-			pd.underrun = false;
+			pd->playing_for += size;
+			pd->missing += size;
+			stream_progress_underrun(pd, false);
 		}
 	        buf->datas[0].chunk->offset = 0;
 	        buf->datas[0].chunk->stride = stream->frame_size;
@@ -1243,15 +1498,16 @@ static void stream_process(void *data)
 				SPA_MIN(size, stream->attr.maxlength));
 
 		index += size;
-		pd.write_inc = size;
+		pd->write_inc += size;
 		spa_ringbuffer_write_update(&stream->ring, index);
 	}
 	pw_stream_queue_buffer(stream->stream, buffer);
 
-	pw_stream_get_time(stream->stream, &pd.pwt);
-
-	pw_loop_invoke(impl->loop,
-			do_process_done, 1, &pd, sizeof(pd), false, stream);
+	/* wake up the main thread once for all streams that made
+	 * progress since it last looked */
+	ATOMIC_STORE(stream->process_pending, 1);
+	if (ATOMIC_CAS(impl->process_pending, 0, 1))
+		pw_loop_signal_event(impl->loop, impl->process_source);
 }
 
 static void stream_drained(void *data)
@@ -1472,6 +1728,7 @@ static int do_create_playback_stream(struct client *client, uint32_t command, ui
 	stream->muted_set = muted_set;
 	stream->attr = attr;
 	stream->is_underrun = true;
+	stream->rt_progress.underrun = stream->progress.underrun = true;
 	stream->underrun_for = -1;
 
 	if (no_remix)
@@ -1497,6 +1754,7 @@ static int do_create_playback_stream(struct client *client, uint32_t command, ui
 	pw_stream_add_listener(stream->stream,
 			&stream->stream_listener,
 			&stream_events, stream);
+	spa_list_append(&impl->process_streams, &stream->process_link);
 
 	pw_stream_connect(stream->stream,
 			PW_DIRECTION_OUTPUT,
@@ -1751,6 +2009,7 @@ static int do_create_record_stream(struct client *client, uint32_t command, uint
 	pw_stream_add_listener(stream->stream,
 			&stream->stream_listener,
 			&stream_events, stream);
+	spa_list_append(&impl->process_streams, &stream->process_link);
 
 	pw_stream_connect(stream->stream,
 			PW_DIRECTION_INPUT,
@@ -2005,7 +2264,7 @@ static int do_finish_upload_stream(struct client *client, uint32_t command, uint
 	struct impl *impl = client->impl;
 	uint32_t channel, event;
 	struct stream *stream = NULL;
-	struct sample *sample;
+	struct sample *sample, *old;
 	const char *name;
 	int res;
 
@@ -2028,24 +2287,13 @@ static int do_finish_upload_stream(struct client *client, uint32_t command, uint
 			impl, client->name, commands[command].name, tag,
 			channel, name);
 
-	sample = find_sample(impl, SPA_ID_INVALID, name);
-	if (sample == NULL) {
-		sample = calloc(1, sizeof(struct sample));
-		if (sample == NULL)
-			goto error_errno;
-
-		sample->index = pw_map_insert_new(&impl->samples, sample);
-		if (sample->index == SPA_ID_INVALID)
-			goto error_errno;
+	sample = calloc(1, sizeof(struct sample));
+	if (sample == NULL)
+		goto error_errno;
 
-		event = SUBSCRIPTION_EVENT_NEW;
-	} else {
-		pw_properties_free(sample->props);
-		free(sample->buffer);
-		event = SUBSCRIPTION_EVENT_CHANGE;
-	}
 	sample->ref = 1;
 	sample->impl = impl;
+	sample->index = SPA_ID_INVALID;
 	sample->name = name;
 	sample->props = stream->props;
 	sample->ss = stream->ss;
@@ -2053,12 +2301,35 @@ static int do_finish_upload_stream(struct client *client, uint32_t command, uint
 	sample->buffer = stream->buffer;
 	sample->length = stream->attr.maxlength;
 
-	impl->stat.sample_cache += sample->length;
-
 	stream->props = NULL;
 	stream->buffer = NULL;
 	stream_free(stream);
 
+	if ((res = sample_convert(sample)) < 0) {
+		sample_free(sample);
+		return res;
+	}
+
+	/* the old sample can still be playing, it is freed when the
+	 * last play is done */
+	old = find_sample(impl, SPA_ID_INVALID, name);
+	if (old == NULL) {
+		sample->index = pw_map_insert_new(&impl->samples, sample);
+		if (sample->index == SPA_ID_INVALID) {
+			res = -errno;
+			sample_free(sample);
+			return res;
+		}
+		event = SUBSCRIPTION_EVENT_NEW;
+	} else {
+		sample->index = old->index;
+		pw_map_insert_at(&impl->samples, sample->index, sample);
+		old->index = SPA_ID_INVALID;
+		sample_unref(old);
+		event = SUBSCRIPTION_EVENT_CHANGE;
+	}
+	impl->stat.sample_cache += sample->length;
+
 	broadcast_subscribe_event(impl,
 			SUBSCRIPTION_MASK_SAMPLE_CACHE,
 			event | SUBSCRIPTION_EVENT_SAMPLE_CACHE,
@@ -2068,9 +2339,6 @@ static int do_finish_upload_stream(struct client *client, uint32_t command, uint
 
 error_errno:
 	res = -errno;
-	if (sample != NULL) {
-		free(sample);
-	}
 	goto error;
 error_invalid:
 	res = -EINVAL;
@@ -2268,9 +2536,8 @@ static int do_play_sample(struct client *client, uint32_t command, uint32_t tag,
 	if (sample == NULL)
 		goto error_noent;
 
-	pw_properties_setf(props, PW_KEY_NODE_TARGET, "%u", o->id);
-
-	play = sample_play_new(client->core, sample, props, sizeof(struct pending_sample));
+	play = sample_play_new(client->core, &impl->sample_players, sample, props,
+			o->id, sizeof(struct pending_sample));
 	props = NULL;
 	if (play == NULL)
 		goto error_errno;
@@ -2328,7 +2595,10 @@ static int do_remove_sample(struct client *client, uint32_t command, uint32_t ta
 			SUBSCRIPTION_EVENT_SAMPLE_CACHE,
 			sample->index);
 
-	sample_free(sample);
+	/* plays can still use the sample, only remove it from the cache */
+	pw_map_remove(&impl->samples, sample->index);
+	sample->index = SPA_ID_INVALID;
+	sample_unref(sample);
 
 	return reply_simple_ack(client, tag);
 }
@@ -3156,7 +3426,7 @@ static int fill_client_info(struct client *client, struct message *m,
 		TAG_INVALID);
 	if (client->version >= 13) {
 		message_put(m,
-			TAG_PROPLIST, info->props,
+			TAG_OBJECT_PROPLIST, o, info->props,
 			TAG_INVALID);
 	}
 	return 0;
@@ -3184,7 +3454,7 @@ static int fill_module_info(struct client *client, struct message *m,
 	}
 	if (client->version >= 15) {
 		message_put(m,
-			TAG_PROPLIST, info->props,
+			TAG_OBJECT_PROPLIST, o, info->props,
 			TAG_INVALID);
 	}
 	return 0;
@@ -3310,7 +3580,7 @@ static int fill_card_info(struct client *client, struct message *m,
 	}
 	message_put(m,
 		TAG_STRING, card_info.active_profile_name,	/* active profile name */
-		TAG_PROPLIST, info->props,
+		TAG_OBJECT_PROPLIST, o, info->props,
 		TAG_INVALID);
 
 	if (client->version >= 26) {
@@ -3475,7 +3745,7 @@ static int fill_sink_info(struct client *client, struct message *m,
 
 	if (client->version >= 13) {
 		message_put(m,
-			TAG_PROPLIST, info->props,
+			TAG_OBJECT_PROPLIST, o, info->props,
 			TAG_USEC, 0LL,			/* requested latency */
 			TAG_INVALID);
 	}
@@ -3630,7 +3900,7 @@ static int fill_source_info(struct client *client, struct message *m,
 
 	if (client->version >= 13) {
 		message_put(m,
-			TAG_PROPLIST, info->props,
+			TAG_OBJECT_PROPLIST, o, info->props,
 			TAG_USEC, 0LL,			/* requested latency */
 			TAG_INVALID);
 	}
@@ -3752,7 +4022,7 @@ static int fill_sink_input_info(struct client *client, struct message *m,
 			TAG_INVALID);
 	if (client->version >= 13)
 		message_put(m,
-			TAG_PROPLIST, info->props,
+			TAG_OBJECT_PROPLIST, o, info->props,
 			TAG_INVALID);
 	if (client->version >= 19)
 		message_put(m,
@@ -3825,7 +4095,7 @@ static int fill_source_output_info(struct client *client, struct message *m,
 		TAG_INVALID);
 	if (client->version >= 13)
 		message_put(m,
-			TAG_PROPLIST, info->props,
+			TAG_OBJECT_PROPLIST, o, info->props,
 			TAG_INVALID);
 	if (client->version >= 19)
 		message_put(m,
@@ -4084,6 +4354,7 @@ static int do_get_info_list(struct client *client, uint32_t command, uint32_t ta
 	struct impl *impl = client->impl;
 	struct pw_manager *manager = client->manager;
 	struct info_list_data info;
+	const char *type;
 
 	pw_log_info(NAME" %p: [%s] %s tag:%u", impl, client->name,
 			commands[command].name, tag);
@@ -4094,24 +4365,31 @@ static int do_get_info_list(struct client *client, uint32_t command, uint32_t ta
 	switch (command) {
 	case COMMAND_GET_CLIENT_INFO_LIST:
 		info.fill_func = fill_client_info;
+		type = PW_TYPE_INTERFACE_Client;
 		break;
 	case COMMAND_GET_MODULE_INFO_LIST:
 		info.fill_func = fill_module_info;
+		type = PW_TYPE_INTERFACE_Module;
 		break;
 	case COMMAND_GET_CARD_INFO_LIST:
 		info.fill_func = fill_card_info;
+		type = PW_TYPE_INTERFACE_Device;
 		break;
 	case COMMAND_GET_SINK_INFO_LIST:
 		info.fill_func = fill_sink_info;
+		type = PW_TYPE_INTERFACE_Node;
 		break;
 	case COMMAND_GET_SOURCE_INFO_LIST:
 		info.fill_func = fill_source_info;
+		type = PW_TYPE_INTERFACE_Node;
 		break;
 	case COMMAND_GET_SINK_INPUT_INFO_LIST:
 		info.fill_func = fill_sink_input_info;
+		type = PW_TYPE_INTERFACE_Node;
 		break;
 	case COMMAND_GET_SOURCE_OUTPUT_INFO_LIST:
 		info.fill_func = fill_source_output_info;
+		type = PW_TYPE_INTERFACE_Node;
 		break;
 	default:
 		return -ENOTSUP;
@@ -4119,7 +4397,8 @@ static int do_get_info_list(struct client *client, uint32_t command, uint32_t ta
 
 	info.reply = reply_new(client, tag);
 	if (info.fill_func)
-		pw_manager_for_each_object(manager, do_list_info, &info);
+		pw_manager_for_each_object_type(manager, type,
+				do_list_info, &info);
 
 	if (command == COMMAND_GET_MODULE_INFO_LIST)
 		pw_map_for_each(&impl->modules, do_info_list_module, &info);
@@ -4892,6 +5171,11 @@ static void impl_free(struct impl *impl)
 	spa_list_consume(s, &impl->servers, link)
 		server_free(s);
 
+	clear_shared_manager(impl);
+
+	if (impl->process_source)
+		pw_loop_destroy_source(impl->loop, impl->process_source);
+
 	pw_map_for_each(&impl->samples, impl_free_sample, impl);
 	pw_map_clear(&impl->samples);
 	pw_map_for_each(&impl->modules, impl_free_module, impl);
@@ -4907,6 +5191,7 @@ static void context_destroy(void *data)
 	struct server *s;
 	spa_list_consume(s, &impl->servers, link)
 		server_free(s);
+	clear_shared_manager(impl);
 	spa_hook_remove(&impl->context_listener);
 	impl->context = NULL;
 }
@@ -5021,12 +5306,20 @@ struct pw_protocol_pulse *pw_protocol_pulse_new(struct pw_context *context,
 	if (impl->work_queue == NULL)
 		goto error_free;
 
+	impl->process_source = pw_loop_add_event(impl->loop, on_process, impl);
+	if (impl->process_source == NULL) {
+		res = -errno;
+		goto error_free;
+	}
+
 	spa_list_init(&impl->servers);
 	impl->rate_limit.interval = 2 * SPA_NSEC_PER_SEC;
 	impl->rate_limit.burst = 1;
 	pw_map_init(&impl->samples, 16, 16);
 	pw_map_init(&impl->modules, 16, 16);
 	spa_list_init(&impl->cleanup_clients);
+	spa_list_init(&impl->sample_players);
+	spa_list_init(&impl->process_streams);
 	spa_list_init(&impl->free_messages);
 
 	str = pw_properties_get(props, "server.address");
@@ -5059,6 +5352,8 @@ struct pw_protocol_pulse *pw_protocol_pulse_new(struct pw_context *context,
 	return (struct pw_protocol_pulse *) impl;
 
 error_free:
+	if (impl->process_source)
+		pw_loop_destroy_source(impl->loop, impl->process_source);
 	free(impl);
 
 error_exit:
@@ -31,77 +31,157 @@
 #include <spa/param/audio/raw.h>
 #include <spa/pod/builder.h>
 #include <spa/utils/hook.h>
+#include <spa/utils/result.h>
 #include <pipewire/context.h>
 #include <pipewire/core.h>
+#include <pipewire/keys.h>
 #include <pipewire/log.h>
+#include <pipewire/loop.h>
 #include <pipewire/properties.h>
 #include <pipewire/stream.h>
+#include <pipewire/private.h>
 
 #include "format.h"
 #include "sample.h"
 #include "sample-play.h"
 
-static void sample_play_stream_state_changed(void *data, enum pw_stream_state old,
-					     enum pw_stream_state state, const char *error)
+#define PLAYER_IDLE_TIMEOUT	5	/* seconds */
+
+struct sample_player {
+	struct spa_list link;
+	struct pw_core *core;
+	uint32_t target_id;
+	struct sample_spec ss;
+	struct channel_map map;
+
+	struct pw_loop *main_loop;
+	struct pw_loop *data_loop;
+	struct spa_source *timer;
+
+	struct pw_stream *stream;
+	struct spa_hook listener;
+	struct spa_io_rate_match *rate_match;
+	uint32_t index;
+	uint32_t stride;
+
+	struct spa_list plays;
+	struct spa_list active;		/* plays mixed in the data loop */
+
+	unsigned int error:1;
+};
+
+static void player_free(struct sample_player *pl);
+
+static void play_finish(struct sample_play *p, int res)
 {
-	struct sample_play *p = data;
+	p->res = res;
+	p->finished = true;
+	pw_loop_signal_event(p->main_loop, p->notify);
+}
+
+static void player_set_idle(struct sample_player *pl, bool idle)
+{
+	struct timespec value = { PLAYER_IDLE_TIMEOUT, 0 };
+
+	if (pl->stream != NULL && !pl->error)
+		pw_stream_set_active(pl->stream, !idle);
+
+	pw_loop_update_timer(pl->main_loop, pl->timer,
+			idle ? &value : NULL, NULL, false);
+}
+
+static int do_finish_plays(struct spa_loop *loop,
+		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct sample_player *pl = user_data;
+	const int *res = data;
+	struct sample_play *p;
+
+	spa_list_consume(p, &pl->active, active_link) {
+		spa_list_remove(&p->active_link);
+		p->active = false;
+		play_finish(p, *res);
+	}
+	return 0;
+}
+
+static void player_set_error(struct sample_player *pl, int res)
+{
+	struct timespec value = { 0, 1 };
+
+	if (pl->error)
+		return;
+
+	pw_log_info("sample player %p: target:%u error: %s", pl,
+			pl->target_id, spa_strerror(res));
+
+	/* don't use this player for new plays and free it soon */
+	pl->error = true;
+	spa_list_remove(&pl->link);
+	spa_list_init(&pl->link);
+
+	/* the plays are finished by the data loop, which might be mixing them */
+	pw_loop_invoke(pl->data_loop, do_finish_plays, 0, &res, sizeof(res), true, pl);
+
+	pw_loop_update_timer(pl->main_loop, pl->timer, &value, NULL, false);
+}
+
+static void player_stream_state_changed(void *data, enum pw_stream_state old,
+					enum pw_stream_state state, const char *error)
+{
+	struct sample_player *pl = data;
+	struct sample_play *p;
 
 	switch (state) {
 	case PW_STREAM_STATE_UNCONNECTED:
 	case PW_STREAM_STATE_ERROR:
-		sample_play_emit_done(p, -EIO);
+		player_set_error(pl, -EIO);
 		break;
 	case PW_STREAM_STATE_PAUSED:
-		p->index = pw_stream_get_node_id(p->stream);
-		sample_play_emit_ready(p, p->index);
+		if (pl->index != SPA_ID_INVALID)
+			break;
+		pl->index = pw_stream_get_node_id(pl->stream);
+		spa_list_for_each(p, &pl->plays, link)
+			pw_loop_signal_event(pl->main_loop, p->notify);
 		break;
 	default:
 		break;
 	}
 }
 
-static void sample_play_stream_io_changed(void *data, uint32_t id, void *area, uint32_t size)
+static void player_stream_io_changed(void *data, uint32_t id, void *area, uint32_t size)
 {
-	struct sample_play *p = data;
+	struct sample_player *pl = data;
 
 	switch (id) {
 	case SPA_IO_RateMatch:
-		p->rate_match = area;
+		pl->rate_match = area;
 		break;
 	}
 }
 
-static void sample_play_stream_destroy(void *data)
+static void player_stream_destroy(void *data)
 {
-	struct sample_play *p = data;
-
-	pw_log_info("destroy %s", p->sample->name);
-	spa_hook_remove(&p->listener);
+	struct sample_player *pl = data;
 
-	if (--p->sample->ref == 0)
-		sample_free(p->sample);
+	spa_hook_remove(&pl->listener);
+	pl->stream = NULL;
 
-	p->stream = NULL;
-	p->sample = NULL;
+	player_set_error(pl, -EIO);
+	player_free(pl);
 }
 
-static void sample_play_stream_process(void *data)
+static void player_stream_process(void *data)
 {
-	struct sample_play *p = data;
-	struct sample *s = p->sample;
+	struct sample_player *pl = data;
+	struct sample_play *p, *t;
 	struct pw_buffer *b;
 	struct spa_buffer *buf;
-	uint32_t size;
-	uint8_t *d;
+	uint32_t i, n_frames, n_samples, avail, n, channels = pl->ss.channels;
+	float *d;
+	const float *s;
 
-	if (p->offset >= s->length) {
-		pw_stream_flush(p->stream, true);
-		return;
-	}
-
-	size = s->length - p->offset;
-
-	if ((b = pw_stream_dequeue_buffer(p->stream)) == NULL) {
+	if ((b = pw_stream_dequeue_buffer(pl->stream)) == NULL) {
 		pw_log_warn("out of buffers: %m");
 		return;
 	}
@@ -110,104 +190,281 @@ static void sample_play_stream_process(void *data)
 	if ((d = buf->datas[0].data) == NULL)
 		return;
 
-	size = SPA_MIN(size, buf->datas[0].maxsize);
-	if (p->rate_match)
-		size = SPA_MIN(size, p->rate_match->size * p->stride);
+	n_frames = buf->datas[0].maxsize / pl->stride;
+	if (pl->rate_match)
+		n_frames = SPA_MIN(n_frames, pl->rate_match->size);
 
-	memcpy(d, s->buffer + p->offset, size);
+	memset(d, 0, n_frames * pl->stride);
 
-	p->offset += size;
+	spa_list_for_each_safe(p, t, &pl->active, active_link) {
+		avail = p->sample->n_frames - p->offset;
+		n = SPA_MIN(avail, n_frames);
+		n_samples = n * channels;
+		s = &p->sample->data[p->offset * channels];
 
-	buf->datas[0].chunk->offset = 0;
-	buf->datas[0].chunk->stride = p->stride;
-	buf->datas[0].chunk->size = size;
+		for (i = 0; i < n_samples; i++)
+			d[i] += s[i];
 
-	pw_stream_queue_buffer(p->stream, b);
-}
+		p->offset += n;
+		if (p->offset >= p->sample->n_frames) {
+			spa_list_remove(&p->active_link);
+			p->active = false;
+			play_finish(p, 0);
+		}
+	}
 
-static void sample_play_stream_drained(void *data)
-{
-	struct sample_play *p = data;
+	buf->datas[0].chunk->offset = 0;
+	buf->datas[0].chunk->stride = pl->stride;
+	buf->datas[0].chunk->size = n_frames * pl->stride;
 
-	sample_play_emit_done(p, 0);
+	pw_stream_queue_buffer(pl->stream, b);
 }
 
-static const struct pw_stream_events sample_play_stream_events = {
+static const struct pw_stream_events player_stream_events = {
 	PW_VERSION_STREAM_EVENTS,
-	.state_changed = sample_play_stream_state_changed,
-	.io_changed = sample_play_stream_io_changed,
-	.destroy = sample_play_stream_destroy,
-	.process = sample_play_stream_process,
-	.drained = sample_play_stream_drained,
+	.state_changed = player_stream_state_changed,
+	.io_changed = player_stream_io_changed,
+	.destroy = player_stream_destroy,
+	.process = player_stream_process,
 };
 
-struct sample_play *sample_play_new(struct pw_core *core,
-				    struct sample *sample, struct pw_properties *props,
-				    size_t user_data_size)
+static void on_player_idle(void *data, uint64_t expirations)
 {
-	struct sample_play *p;
+	struct sample_player *pl = data;
+
+	if (pl->error || spa_list_is_empty(&pl->plays))
+		player_free(pl);
+}
+
+static struct sample_player *player_new(struct pw_core *core, struct spa_list *players,
+		uint32_t target_id, struct sample *sample, struct pw_properties *props)
+{
+	struct sample_player *pl;
+	struct pw_context *context = pw_core_get_context(core);
+	struct pw_properties *stream_props;
 	uint8_t buffer[1024];
 	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
 	const struct spa_pod *params[1];
-	uint32_t n_params = 0;
 	int res;
 
-	p = calloc(1, sizeof(*p) + user_data_size);
-	if (p == NULL) {
-		res = -errno;
+	pl = calloc(1, sizeof(*pl));
+	if (pl == NULL)
+		return NULL;
+
+	pl->core = core;
+	pl->target_id = target_id;
+	pl->index = SPA_ID_INVALID;
+	pl->ss = sample->ss;
+	pl->ss.format = SPA_AUDIO_FORMAT_F32;
+	pl->map = sample->map;
+	pl->stride = sample_spec_frame_size(&pl->ss);
+	pl->main_loop = pw_context_get_main_loop(context);
+	pl->data_loop = context->data_loop;
+	spa_list_init(&pl->plays);
+	spa_list_init(&pl->active);
+	spa_list_append(players, &pl->link);
+
+	pl->timer = pw_loop_add_timer(pl->main_loop, on_player_idle, pl);
+	if (pl->timer == NULL)
+		goto error_errno;
+
+	stream_props = pw_properties_new(
+			PW_KEY_MEDIA_TYPE, "Audio",
+			PW_KEY_MEDIA_CATEGORY, "Playback",
+			PW_KEY_MEDIA_ROLE, "Notification",
+			PW_KEY_MEDIA_NAME, "Sample player",
+			NULL);
+	if (stream_props == NULL)
+		goto error_errno;
+	pw_properties_update(stream_props, &props->dict);
+	pw_properties_setf(stream_props, PW_KEY_NODE_TARGET, "%u", target_id);
+
+	pl->stream = pw_stream_new(core, sample->name, stream_props);
+	if (pl->stream == NULL)
+		goto error_errno;
+
+	pw_stream_add_listener(pl->stream,
+			&pl->listener,
+			&player_stream_events, pl);
+
+	params[0] = format_build_param(&b, SPA_PARAM_EnumFormat,
+			&pl->ss, &pl->map);
+
+	if ((res = pw_stream_connect(pl->stream,
+			PW_DIRECTION_OUTPUT,
+			PW_ID_ANY,
+			PW_STREAM_FLAG_AUTOCONNECT |
+			PW_STREAM_FLAG_MAP_BUFFERS |
+			PW_STREAM_FLAG_RT_PROCESS,
+			params, 1)) < 0)
+		goto error;
+
+	pw_log_info("sample player %p: new target:%u rate:%u channels:%u", pl,
+			target_id, pl->ss.rate, pl->ss.channels);
+
+	return pl;
+
+error_errno:
+	res = -errno;
+error:
+	player_free(pl);
+	errno = -res;
+	return NULL;
+}
+
+static void player_free(struct sample_player *pl)
+{
+	struct sample_play *p;
+
+	pw_log_info("sample player %p: free target:%u", pl, pl->target_id);
+
+	spa_list_remove(&pl->link);
+
+	if (pl->stream) {
+		spa_hook_remove(&pl->listener);
+		pw_stream_destroy(pl->stream);
+	}
+	spa_list_consume(p, &pl->plays, link) {
+		spa_list_remove(&p->link);
+		p->player = NULL;
+		p->active = false;
+	}
+	if (pl->timer)
+		pw_loop_destroy_source(pl->main_loop, pl->timer);
+	free(pl);
+}
+
+/* the stream of a player belongs to the connection of the client, within
+ * the connection all plays of the same format to a sink share the player.
+ * The stream keeps the properties of the play that created it. */
+static struct sample_player *find_player(struct spa_list *players,
+		struct pw_core *core, uint32_t target_id, struct sample *sample)
+{
+	struct sample_player *pl;
+
+	spa_list_for_each(pl, players, link) {
+		if (pl->core == core &&
+		    pl->target_id == target_id &&
+		    pl->ss.rate == sample->ss.rate &&
+		    pl->ss.channels == sample->ss.channels &&
+		    memcmp(pl->map.map, sample->map.map,
+			    sample->map.channels * sizeof(uint32_t)) == 0)
+			return pl;
+	}
+	return NULL;
+}
+
+static int do_add_play(struct spa_loop *loop,
+		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct sample_play *p = user_data;
+	spa_list_append(&p->player->active, &p->active_link);
+	p->active = true;
+	return 0;
+}
+
+static int do_remove_play(struct spa_loop *loop,
+		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct sample_play *p = user_data;
+	if (p->active) {
+		spa_list_remove(&p->active_link);
+		p->active = false;
+	}
+	return 0;
+}
+
+static void on_play_notify(void *data, uint64_t count)
+{
+	struct sample_play *p = data;
+
+	if (!p->ready && p->player != NULL && p->player->index != SPA_ID_INVALID) {
+		p->ready = true;
+		sample_play_emit_ready(p, p->player->index);
+	}
+	if (p->finished && !p->done) {
+		p->done = true;
+		sample_play_emit_done(p, p->res);
+	}
+}
+
+struct sample_play *sample_play_new(struct pw_core *core, struct spa_list *players,
+				    struct sample *sample, struct pw_properties *props,
+				    uint32_t target_id, size_t user_data_size)
+{
+	struct sample_player *pl;
+	struct sample_play *p;
+	int res;
+
+	if (sample->data == NULL) {
+		res = -EINVAL;
 		goto error_free;
 	}
 
-	p->context = pw_core_get_context(core);
-	p->main_loop = pw_context_get_main_loop(p->context);
+	p = calloc(1, sizeof(*p) + user_data_size);
+	if (p == NULL)
+		goto error_errno;
+
+	p->main_loop = pw_context_get_main_loop(pw_core_get_context(core));
 	spa_hook_list_init(&p->hooks);
 	p->user_data = SPA_PTROFF(p, sizeof(struct sample_play), void);
 
+	p->notify = pw_loop_add_event(p->main_loop, on_play_notify, p);
+	if (p->notify == NULL)
+		goto error_errno;
+
 	pw_properties_update(props, &sample->props->dict);
 
-	p->stream = pw_stream_new(core, sample->name, props);
+	pl = find_player(players, core, target_id, sample);
+	if (pl == NULL)
+		pl = player_new(core, players, target_id, sample, props);
+	if (pl == NULL)
+		goto error_errno;
+	pw_properties_free(props);
 	props = NULL;
-	if (p->stream == NULL) {
-		res = -errno;
-		goto error_free;
-	}
 
 	p->sample = sample;
-	p->stride = sample_spec_frame_size(&sample->ss);
 	sample->ref++;
 
-	pw_stream_add_listener(p->stream,
-			&p->listener,
-			&sample_play_stream_events, p);
+	p->player = pl;
+	spa_list_append(&pl->plays, &p->link);
+	pw_loop_invoke(pl->data_loop, do_add_play, 0, NULL, 0, true, p);
 
-	params[n_params++] = format_build_param(&b, SPA_PARAM_EnumFormat,
-			&sample->ss, &sample->map);
+	player_set_idle(pl, false);
 
-	res = pw_stream_connect(p->stream,
-			PW_DIRECTION_OUTPUT,
-			PW_ID_ANY,
-			PW_STREAM_FLAG_AUTOCONNECT |
-			PW_STREAM_FLAG_MAP_BUFFERS |
-			PW_STREAM_FLAG_RT_PROCESS,
-			params, n_params);
-	if (res < 0)
-		goto error_cleanup;
+	/* an existing player is ready, report it from the main loop
+	 * when the listener was added */
+	if (pl->index != SPA_ID_INVALID)
+		pw_loop_signal_event(p->main_loop, p->notify);
 
 	return p;
 
-error_cleanup:
-	pw_stream_destroy(p->stream);
+error_errno:
+	res = -errno;
+	if (p != NULL && p->notify)
+		pw_loop_destroy_source(p->main_loop, p->notify);
+	free(p);
 error_free:
 	pw_properties_free(props);
-	free(p);
 	errno = -res;
 	return NULL;
 }
 
 void sample_play_destroy(struct sample_play *p)
 {
-	if (p->stream)
-		pw_stream_destroy(p->stream);
+	struct sample_player *pl = p->player;
+	struct sample *s = p->sample;
+
+	if (pl != NULL) {
+		pw_loop_invoke(pl->data_loop, do_remove_play, 0, NULL, 0, true, p);
+		spa_list_remove(&p->link);
+		if (spa_list_is_empty(&pl->plays) && !pl->error)
+			player_set_idle(pl, true);
+	}
+	pw_loop_destroy_source(p->main_loop, p->notify);
+
+	if (s != NULL)
+		sample_unref(s);
 
 	free(p);
 }
@@ -25,6 +25,7 @@
 #ifndef PULSER_SERVER_SAMPLE_PLAY_H
 #define PULSER_SERVER_SAMPLE_PLAY_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -32,12 +33,11 @@
 #include <spa/utils/hook.h>
 
 struct sample;
+struct sample_player;
 struct pw_core;
-struct pw_loop;
-struct pw_stream;
-struct pw_context;
 struct pw_properties;
-struct spa_io_rate_match;
+struct pw_loop;
+struct spa_source;
 
 struct sample_play_events {
 #define VERSION_SAMPLE_PLAY_EVENTS	0
@@ -51,24 +51,31 @@ struct sample_play_events {
 #define sample_play_emit_ready(p,i) spa_hook_list_call(&p->hooks, struct sample_play_events, ready, 0, i)
 #define sample_play_emit_done(p,r) spa_hook_list_call(&p->hooks, struct sample_play_events, done, 0, r)
 
+/* One playback of a sample. Samples are mixed by a persistent player stream
+ * per connection, target sink and sample spec, which is created on the first
+ * play and removed again when it was idle for a while. */
 struct sample_play {
-	struct spa_list link;
+	struct spa_list link;		/* link in player plays */
+	struct spa_list active_link;	/* link in player active, data loop */
 	struct sample *sample;
-	struct pw_stream *stream;
-	struct spa_io_rate_match *rate_match;
-	uint32_t index;
-	struct spa_hook listener;
-	struct pw_context *context;
+	struct sample_player *player;
 	struct pw_loop *main_loop;
-	uint32_t offset;
-	uint32_t stride;
+	struct spa_source *notify;
+	uint32_t offset;		/* in frames */
+	int res;
 	struct spa_hook_list hooks;
 	void *user_data;
+	/* only changed in the data loop */
+	unsigned int active:1;		/* mixed by the data loop */
+	unsigned int finished:1;
+	/* only used in the main loop */
+	bool ready;
+	bool done;
 };
 
-struct sample_play *sample_play_new(struct pw_core *core,
+struct sample_play *sample_play_new(struct pw_core *core, struct spa_list *players,
 				    struct sample *sample, struct pw_properties *props,
-				    size_t user_data_size);
+				    uint32_t target_id, size_t user_data_size);
 
 void sample_play_destroy(struct sample_play *p);
 
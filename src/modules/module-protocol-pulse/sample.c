@@ -22,8 +22,12 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <errno.h>
 #include <stdlib.h>
+#include <string.h>
+#include <byteswap.h>
 
+#include <spa/param/audio/raw.h>
 #include <pipewire/log.h>
 #include <pipewire/map.h>
 #include <pipewire/properties.h>
@@ -45,5 +49,101 @@ void sample_free(struct sample *sample)
 	pw_properties_free(sample->props);
 
 	free(sample->buffer);
+	free(sample->data);
 	free(sample);
 }
+
+static inline uint32_t read_u32(const uint8_t *p, bool swap)
+{
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return swap ? bswap_32(v) : v;
+}
+
+static inline uint16_t read_u16(const uint8_t *p, bool swap)
+{
+	uint16_t v;
+	memcpy(&v, p, 2);
+	return swap ? bswap_16(v) : v;
+}
+
+static inline int32_t read_s24(const uint8_t *p, bool be)
+{
+	uint32_t v = be ? (p[0] << 16) | (p[1] << 8) | p[2] :
+		(p[2] << 16) | (p[1] << 8) | p[0];
+	return (int32_t)(v << 8) >> 8;
+}
+
+/* Convert the uploaded data to interleaved float so that playing it only
+ * needs to mix. */
+int sample_convert(struct sample *sample)
+{
+	const uint8_t *s = sample->buffer;
+	uint32_t i, n_samples, frame_size;
+	bool be = false;
+	float *d, f;
+	union { uint32_t i; float f; } u;
+
+	frame_size = sample_spec_frame_size(&sample->ss);
+	if (frame_size == 0 || s == NULL)
+		return -EINVAL;
+
+	sample->n_frames = sample->length / frame_size;
+	n_samples = sample->n_frames * sample->ss.channels;
+
+	if ((d = malloc(SPA_MAX(n_samples, 1u) * sizeof(float))) == NULL)
+		return -errno;
+
+	switch (sample->ss.format) {
+	case SPA_AUDIO_FORMAT_S16_BE:
+	case SPA_AUDIO_FORMAT_S24_BE:
+	case SPA_AUDIO_FORMAT_S24_32_BE:
+	case SPA_AUDIO_FORMAT_S32_BE:
+	case SPA_AUDIO_FORMAT_F32_BE:
+		be = true;
+		break;
+	}
+
+	for (i = 0; i < n_samples; i++) {
+		switch (sample->ss.format) {
+		case SPA_AUDIO_FORMAT_U8:
+			f = (s[i] - 128) / 128.0f;
+			break;
+		case SPA_AUDIO_FORMAT_S16_LE:
+		case SPA_AUDIO_FORMAT_S16_BE:
+			f = (int16_t)read_u16(&s[i * 2], be != (__BYTE_ORDER == __BIG_ENDIAN)) / 32768.0f;
+			break;
+		case SPA_AUDIO_FORMAT_S24_LE:
+		case SPA_AUDIO_FORMAT_S24_BE:
+			f = read_s24(&s[i * 3], be) / 8388608.0f;
+			break;
+		case SPA_AUDIO_FORMAT_S24_32_LE:
+		case SPA_AUDIO_FORMAT_S24_32_BE:
+			u.i = read_u32(&s[i * 4], be != (__BYTE_ORDER == __BIG_ENDIAN));
+			f = ((int32_t)(u.i << 8) >> 8) / 8388608.0f;
+			break;
+		case SPA_AUDIO_FORMAT_S32_LE:
+		case SPA_AUDIO_FORMAT_S32_BE:
+			u.i = read_u32(&s[i * 4], be != (__BYTE_ORDER == __BIG_ENDIAN));
+			f = (int32_t)u.i / 2147483648.0f;
+			break;
+		case SPA_AUDIO_FORMAT_F32_LE:
+		case SPA_AUDIO_FORMAT_F32_BE:
+			u.i = read_u32(&s[i * 4], be != (__BYTE_ORDER == __BIG_ENDIAN));
+			f = u.f;
+			break;
+		default:
+			free(d);
+			return -ENOTSUP;
+		}
+		d[i] = f;
+	}
+
+	free(sample->data);
+	sample->data = d;
+
+	free(sample->buffer);
+	sample->buffer = NULL;
+
+	return 0;
+}
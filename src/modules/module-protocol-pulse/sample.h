@@ -40,10 +40,21 @@ struct sample {
 	struct sample_spec ss;
 	struct channel_map map;
 	struct pw_properties *props;
-	uint32_t length;
-	uint8_t *buffer;
+	uint32_t length;		/* size of the uploaded data in bytes */
+	uint8_t *buffer;		/* uploaded data, freed after conversion */
+
+	/* the samples converted to interleaved float for the mixer */
+	float *data;
+	uint32_t n_frames;
 };
 
+int sample_convert(struct sample *sample);
 void sample_free(struct sample *sample);
 
+static inline void sample_unref(struct sample *sample)
+{
+	if (--sample->ref == 0)
+		sample_free(sample);
+}
+
 #endif /* PULSE_SERVER_SAMPLE_H */
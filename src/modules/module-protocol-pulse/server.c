@@ -105,33 +105,23 @@ finish:
 	return 0;
 }
 
-static int handle_memblock(struct client *client, struct message *msg)
+/* apply the seek of the memblock that is about to be received and
+ * return the ringbuffer index where its data goes */
+static int memblock_seek(struct client *client, struct stream *stream,
+		uint32_t length, uint32_t *index)
 {
-	struct impl * const impl = client->impl;
-	struct stream *stream;
-	uint32_t channel, flags, index;
+	uint32_t flags;
 	int64_t offset, diff;
 	int32_t filled;
-	int res = 0;
 
-	channel = ntohl(client->desc.channel);
 	offset = (int64_t) (
 		(((uint64_t) ntohl(client->desc.offset_hi)) << 32) |
 		(((uint64_t) ntohl(client->desc.offset_lo))));
 	flags = ntohl(client->desc.flags);
 
-	pw_log_debug("client %p: received memblock channel:%d offset:%" PRIi64 " flags:%08x size:%u",
-		     client, channel, offset, flags, msg->length);
-
-	stream = pw_map_lookup(&client->streams, channel);
-	if (stream == NULL || stream->type == STREAM_TYPE_RECORD) {
-		res = -EINVAL;
-		goto finish;
-	}
-
-	filled = spa_ringbuffer_get_write_index(&stream->ring, &index);
-	pw_log_debug("new block %p %p/%u filled:%d index:%d flags:%02x offset:%" PRIu64,
-		     msg, msg->data, msg->length, filled, index, flags, offset);
+	filled = spa_ringbuffer_get_write_index(&stream->ring, index);
+	pw_log_debug("new block stream:%p size:%u filled:%d index:%d flags:%02x offset:%" PRIi64,
+		     stream, length, filled, *index, flags, offset);
 
 	switch (flags & FLAG_SEEKMASK) {
 	case SEEK_RELATIVE:
@@ -147,21 +137,52 @@ static int handle_memblock(struct client *client, struct message *msg)
 	default:
 		pw_log_warn("client %p [%s]: received memblock frame with invalid seek mode: %" PRIu32,
 			    client, client->name, (uint32_t)(flags & FLAG_SEEKMASK));
-		res = -EPROTO;
-		goto finish;
+		return -EPROTO;
 	}
 
-	index += diff;
+	*index += diff;
 	filled += diff;
 	stream->write_index += diff;
 	stream->missing -= diff;
 
 	if (filled < 0) {
 		/* underrun, reported on reader side */
-	} else if (filled + msg->length > stream->attr.maxlength) {
+	} else if (filled + length > stream->attr.maxlength) {
 		/* overrun */
 		stream_send_overflow(stream);
 	}
+	return 0;
+}
+
+/* make length bytes of data written at index available to the reader */
+static void memblock_commit(struct stream *stream, uint32_t index, uint32_t length)
+{
+	index += length;
+	stream->write_index += length;
+	spa_ringbuffer_write_update(&stream->ring, index);
+	stream->requested -= SPA_MIN(length, stream->requested);
+}
+
+static int handle_memblock(struct client *client, struct message *msg)
+{
+	struct impl * const impl = client->impl;
+	struct stream *stream;
+	uint32_t channel, index;
+	int res = 0;
+
+	channel = ntohl(client->desc.channel);
+
+	pw_log_debug("client %p: received memblock channel:%d flags:%08x size:%u",
+		     client, channel, ntohl(client->desc.flags), msg->length);
+
+	stream = pw_map_lookup(&client->streams, channel);
+	if (stream == NULL || stream->type == STREAM_TYPE_RECORD) {
+		res = -EINVAL;
+		goto finish;
+	}
+
+	if ((res = memblock_seek(client, stream, msg->length, &index)) < 0)
+		goto finish;
 
 	/* always write data to ringbuffer, we expect the other side
 	 * to recover */
@@ -170,19 +191,35 @@ static int handle_memblock(struct client *client, struct message *msg)
 			index % stream->attr.maxlength,
 			msg->data,
 			SPA_MIN(msg->length, stream->attr.maxlength));
-	index += msg->length;
-	stream->write_index += msg->length;
-	spa_ringbuffer_write_update(&stream->ring, index);
-	stream->requested -= SPA_MIN(msg->length, stream->requested);
+	memblock_commit(stream, index, msg->length);
 
 finish:
 	message_free(impl, msg, false, false);
 	return res;
 }
 
+/* memblocks for playback streams are received straight into the stream
+ * ringbuffer, from where the process thread copies them into the pw_buffer.
+ * Returns the stream or NULL when the data needs to go to a message. */
+static struct stream *get_direct_stream(struct client *client, uint32_t channel, uint32_t length)
+{
+	struct stream *stream;
+
+	if (channel == (uint32_t) -1)
+		return NULL;
+
+	stream = pw_map_lookup(&client->streams, channel);
+	if (stream == NULL || stream->type != STREAM_TYPE_PLAYBACK ||
+	    stream->buffer == NULL || length > stream->attr.maxlength)
+		return NULL;
+
+	return stream;
+}
+
 static int do_read(struct client *client)
 {
 	struct impl * const impl = client->impl;
+	struct stream *stream = NULL;
 	size_t size;
 	int res = 0;
 	void *data;
@@ -190,6 +227,29 @@ static int do_read(struct client *client)
 	if (client->in_index < sizeof(client->desc)) {
 		data = SPA_PTROFF(&client->desc, client->in_index, void);
 		size = sizeof(client->desc) - client->in_index;
+	} else if (client->in_direct) {
+		uint32_t idx = client->in_index - sizeof(client->desc);
+		uint32_t channel = ntohl(client->desc.channel);
+		uint32_t length = ntohl(client->desc.length);
+
+		stream = get_direct_stream(client, channel, length);
+		if (stream == NULL) {
+			/* the stream went away, receive the rest of the block
+			 * in a message and let handle_memblock() deal with it */
+			client->in_direct = false;
+			client->message = message_alloc(impl, channel, length);
+			if (client->message == NULL) {
+				res = -errno;
+				goto exit;
+			}
+			data = SPA_PTROFF(client->message->data, idx, void);
+			size = length - idx;
+		} else {
+			uint32_t offs = (client->in_ring_index + idx) % stream->attr.maxlength;
+
+			data = SPA_PTROFF(stream->buffer, offs, void);
+			size = SPA_MIN(length - idx, stream->attr.maxlength - offs);
+		}
 	} else {
 		uint32_t idx = client->in_index - sizeof(client->desc);
 
@@ -250,8 +310,25 @@ static int do_read(struct client *client)
 
 		if (client->message)
 			message_free(impl, client->message, false, false);
+		client->message = NULL;
+
+		stream = get_direct_stream(client, channel, length);
+		if (stream != NULL) {
+			pw_log_debug("client %p: receiving memblock channel:%d size:%u",
+				     client, channel, length);
+			res = memblock_seek(client, stream, length, &client->in_ring_index);
+			if (res < 0)
+				goto exit;
+			client->in_direct = true;
+		} else {
+			client->message = message_alloc(impl, channel, length);
+		}
+	} else if (client->in_direct &&
+	    client->in_index >= ntohl(client->desc.length) + sizeof(client->desc)) {
+		client->in_direct = false;
+		client->in_index = 0;
 
-		client->message = message_alloc(impl, channel, length);
+		memblock_commit(stream, client->in_ring_index, ntohl(client->desc.length));
 	} else if (client->message &&
 	    client->in_index >= client->message->length + sizeof(client->desc)) {
 		struct message * const msg = client->message;
@@ -22,9 +22,12 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <errno.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
 
 #include <spa/utils/hook.h>
 #include <spa/utils/ringbuffer.h>
@@ -66,6 +69,7 @@ void stream_free(struct stream *stream)
 	if (stream->stream) {
 		spa_hook_remove(&stream->stream_listener);
 		pw_stream_destroy(stream->stream);
+		spa_list_remove(&stream->process_link);
 	}
 
 	pw_work_queue_cancel(impl->work_queue, stream, SPA_ID_INVALID);
@@ -239,7 +243,35 @@ int stream_send_request(struct stream *stream)
 	if (size == 0)
 		return 0;
 
+	/* add to a request for this stream that is still queued, unless
+	 * other replies were queued after it */
+	spa_list_for_each_reverse(msg, &client->out_messages, link) {
+		uint32_t val;
+
+		if (client->out_index > 0 &&
+		    msg == spa_list_first(&client->out_messages, struct message, link))
+			break;
+		if (msg->extra[0] == COMMAND_SUBSCRIBE_EVENT)
+			continue;
+		if (msg->extra[0] != COMMAND_REQUEST)
+			break;
+		if (msg->extra[1] != stream->channel)
+			continue;
+
+		/* the size is the value of the last TAG_U32 */
+		memcpy(&val, msg->data + msg->length - 4, 4);
+		val = htonl(ntohl(val) + size);
+		memcpy(msg->data + msg->length - 4, &val, 4);
+		pw_log_debug("stream %p: merged REQUEST channel:%d", stream, stream->channel);
+		return 0;
+	}
+
 	msg = message_alloc(impl, -1, 0);
+	if (msg == NULL)
+		return -errno;
+
+	msg->extra[0] = COMMAND_REQUEST;
+	msg->extra[1] = stream->channel;
 	message_put(msg,
 		TAG_U32, COMMAND_REQUEST,
 		TAG_U32, -1,
@@ -47,6 +47,19 @@ struct buffer_attr {
 	uint32_t fragsize;
 };
 
+/* progress of the process thread. The counters are only written from the
+ * process thread and wrap around, the main thread collects the difference
+ * with the values it saw the last time. */
+struct stream_progress {
+	uint32_t read_inc;
+	uint32_t write_inc;
+	uint32_t underrun_for;
+	uint32_t playing_for;
+	uint32_t missing;
+	uint32_t underruns;	/* number of times an underrun started */
+	uint32_t underrun;	/* current underrun state */
+};
+
 struct stream {
 	uint32_t create_tag;
 	uint32_t channel;	/* index in map */
@@ -65,6 +78,11 @@ struct stream {
 	struct pw_stream *stream;
 	struct spa_hook stream_listener;
 
+	struct spa_list process_link;	/* in impl->process_streams */
+	int process_pending;
+	struct stream_progress rt_progress;
+	struct stream_progress progress;
+
 	struct spa_io_rate_match *rate_match;
 	struct spa_ringbuffer ring;
 	void *buffer;
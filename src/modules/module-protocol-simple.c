@@ -49,7 +49,15 @@
 
 #include <pipewire/impl.h>
 
+#include "pcm-ring.h"
+
 /** \page page_module_protocol_simple PipeWire Module: Protocol Simple
+ *
+ * Streams raw PCM over TCP. With a `ring:<path>` server address, the
+ * captured samples are written into a ringbuffer in shared memory instead.
+ * Local readers connect to the unix socket at path, receive the memfd of
+ * the ring and follow the write index without any copies through the
+ * server. See pcm-ring.h for the layout of the memory.
  */
 
 #define NAME "protocol-simple"
@@ -62,6 +70,7 @@
 #define DEFAULT_CHANNELS "2"
 #define DEFAULT_POSITION "[ FL FR ]"
 #define DEFAULT_LATENCY "1024/48000"
+#define DEFAULT_RING_SIZE "1.0"
 
 #define MAX_CLIENTS	10
 
@@ -73,7 +82,8 @@
 			"[ audio.format=<format, default:"DEFAULT_FORMAT"> ] "		\
 			"[ audio.channels=<channels, default:"DEFAULT_CHANNELS"> ] "	\
 			"[ audio.position=<position, default:"DEFAULT_POSITION"> ] "	\
-			"[ server.address=<[ tcp:[<ip>:]<port>[,...] ], default:"DEFAULT_SERVER">"	\
+			"[ server.address=<[ tcp:[<ip>:]<port>|ring:<path>[,...] ], default:"DEFAULT_SERVER"> ] "	\
+			"[ ring.size=<seconds, default:"DEFAULT_RING_SIZE"> ] "
 
 static const struct spa_dict_item module_props[] = {
 	{ PW_KEY_MODULE_AUTHOR, "Wim Taymans <wim.taymans@gmail.com>" },
@@ -129,10 +139,18 @@ struct server {
 #define SERVER_TYPE_INVALID	0
 #define SERVER_TYPE_UNIX	1
 #define SERVER_TYPE_INET	2
+#define SERVER_TYPE_RING	3
 	uint32_t type;
 	struct sockaddr_un addr;
 	struct spa_source *source;
 
+	/* for SERVER_TYPE_RING, one stream writes to the ring that
+	 * is shared with all readers */
+	struct pcm_ring ring;
+	struct pw_core *core;
+	struct pw_stream *capture;
+	struct spa_hook capture_listener;
+
 	struct spa_list client_list;
 	uint32_t n_clients;
 };
@@ -545,6 +563,165 @@ error:
 	return;
 }
 
+static void ring_capture_process(void *data)
+{
+	struct server *server = data;
+	struct pw_buffer *buf;
+	struct spa_data *d;
+	uint32_t size, offset;
+
+	if ((buf = pw_stream_dequeue_buffer(server->capture)) == NULL) {
+		pw_log_warn("%p: server:%p out of capture buffers: %m", server->impl, server);
+		return;
+	}
+	/* the format is interleaved, all samples are in the first data */
+	d = &buf->buffer->datas[0];
+	offset = SPA_MIN(d->chunk->offset, d->maxsize);
+	size = SPA_MIN(d->chunk->size, d->maxsize - offset);
+	pcm_ring_write(&server->ring, SPA_PTROFF(d->data, offset, void), size);
+
+	pw_stream_queue_buffer(server->capture, buf);
+}
+
+static void ring_capture_destroy(void *data)
+{
+	struct server *server = data;
+	spa_hook_remove(&server->capture_listener);
+	server->capture = NULL;
+}
+
+static void ring_state_changed(void *data, enum pw_stream_state old,
+                enum pw_stream_state state, const char *error)
+{
+	struct server *server = data;
+
+	if (state == PW_STREAM_STATE_ERROR)
+		pw_log_warn(NAME" %p: server:%p ring stream error: %s",
+				server->impl, server, error);
+}
+
+static const struct pw_stream_events ring_stream_events = {
+	PW_VERSION_STREAM_EVENTS,
+	.destroy = ring_capture_destroy,
+	.state_changed = ring_state_changed,
+	.process = ring_capture_process
+};
+
+static void
+on_ring_connect(void *data, int fd, uint32_t mask)
+{
+	struct server *server = data;
+	int res;
+
+	if ((res = pcm_ring_accept(&server->ring, fd)) < 0)
+		pw_log_warn(NAME" %p: server:%p can't send ring: %s", server->impl,
+				server, spa_strerror(res));
+	else
+		pw_log_info(NAME" %p: server:%p ring reader connected", server->impl, server);
+}
+
+static int make_ring_stream(struct impl *impl, struct server *server)
+{
+	const struct spa_pod *params[1];
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct pw_properties *props;
+
+	props = pw_properties_new(
+			PW_KEY_CLIENT_API, "protocol-simple",
+			"protocol.server.type", "ring",
+			NULL);
+	if (props == NULL)
+		return -errno;
+
+	server->core = pw_context_connect(impl->context, props, 0);
+	if (server->core == NULL)
+		return -errno;
+
+	props = pw_properties_new(
+			PW_KEY_NODE_LATENCY, DEFAULT_LATENCY,
+			PW_KEY_NODE_TARGET, pw_properties_get(impl->props, "capture.node"),
+			NULL);
+	if (props == NULL)
+		return -errno;
+
+	pw_properties_setf(props, PW_KEY_MEDIA_NAME, "%s capture", server->addr.sun_path);
+	server->capture = pw_stream_new(server->core,
+			pw_properties_get(props, PW_KEY_MEDIA_NAME), props);
+	if (server->capture == NULL)
+		return -errno;
+
+	pw_stream_add_listener(server->capture, &server->capture_listener,
+			&ring_stream_events, server);
+
+	params[0] = spa_format_audio_raw_build(&b, SPA_PARAM_EnumFormat, &impl->info);
+
+	return pw_stream_connect(server->capture,
+			PW_DIRECTION_INPUT,
+			PW_ID_ANY,
+			PW_STREAM_FLAG_AUTOCONNECT |
+			PW_STREAM_FLAG_MAP_BUFFERS |
+			PW_STREAM_FLAG_RT_PROCESS,
+			params, 1);
+}
+
+static int make_ring_socket(struct server *server, const char *name)
+{
+	struct impl *impl = server->impl;
+	const char *str;
+	double seconds;
+	int res, fd;
+
+	if (!impl->capture) {
+		pw_log_error(NAME" %p: ring server needs capture", impl);
+		return -ENOTSUP;
+	}
+	if (impl->playback)
+		pw_log_warn(NAME" %p: ring server only does capture", impl);
+	if (SPA_AUDIO_FORMAT_IS_PLANAR(impl->info.format)) {
+		pw_log_error(NAME" %p: ring server needs an interleaved format", impl);
+		return -ENOTSUP;
+	}
+
+	if ((str = pw_properties_get(impl->props, "ring.size")) == NULL)
+		str = DEFAULT_RING_SIZE;
+	seconds = SPA_CLAMP(pw_properties_parse_double(str), 0.01, 10.0);
+
+	if ((res = pcm_ring_create(&server->ring, "pipewire-pcm-ring",
+			seconds * impl->info.rate * impl->frame_size, impl->frame_size,
+			impl->info.format, impl->info.rate, impl->info.channels)) < 0) {
+		pw_log_error(NAME" %p: can't create ring: %s", server, spa_strerror(res));
+		return res;
+	}
+	/* older kernels can't seal against new writable mappings, the
+	 * readers then could write to the ring but the header is never
+	 * trusted anyway */
+	if ((res = pcm_ring_seal_readers(&server->ring)) == -EINVAL) {
+		pw_log_warn(NAME" %p: can't seal ring for readers: %s", server,
+				spa_strerror(res));
+	} else if (res < 0) {
+		pw_log_error(NAME" %p: can't seal ring: %s", server, spa_strerror(res));
+		return res;
+	}
+	if ((fd = pcm_ring_listen(name, &server->addr)) < 0) {
+		pw_log_error(NAME" %p: can't listen on '%s': %s", server, name,
+				spa_strerror(fd));
+		return fd;
+	}
+	server->type = SERVER_TYPE_RING;
+
+	if ((res = make_ring_stream(impl, server)) < 0) {
+		pw_log_error(NAME" %p: can't create ring stream: %s", server,
+				spa_strerror(res));
+		close(fd);
+		return res;
+	}
+	pw_log_info(NAME" listening on ring:%s, %u bytes", server->addr.sun_path,
+			server->ring.size);
+
+	return fd;
+}
+
 static int make_inet_socket(struct server *server, const char *name)
 {
 	struct sockaddr_in addr;
@@ -618,6 +795,13 @@ static void server_free(struct server *server)
 		client_free(c);
 	if (server->source)
 		pw_loop_destroy_source(impl->loop, server->source);
+	if (server->capture)
+		pw_stream_destroy(server->capture);
+	if (server->core)
+		pw_core_disconnect(server->core);
+	if (server->type == SERVER_TYPE_RING)
+		unlink(server->addr.sun_path);
+	pcm_ring_clear(&server->ring);
 	free(server);
 }
 
@@ -631,11 +815,14 @@ static struct server *create_server(struct impl *impl, const char *address)
 		return NULL;
 
 	server->impl = impl;
+	server->ring = PCM_RING_INIT;
 	spa_list_init(&server->client_list);
 	spa_list_append(&impl->server_list, &server->link);
 
 	if (strstr(address, "tcp:") == address) {
 		fd = make_inet_socket(server, address+4);
+	} else if (strstr(address, "ring:") == address) {
+		fd = make_ring_socket(server, address+5);
 	} else {
 		fd = -EINVAL;
 	}
@@ -643,7 +830,9 @@ static struct server *create_server(struct impl *impl, const char *address)
 		res = fd;
 		goto error;
 	}
-	server->source = pw_loop_add_io(impl->loop, fd, SPA_IO_IN, true, on_connect, server);
+	server->source = pw_loop_add_io(impl->loop, fd, SPA_IO_IN, true,
+			server->type == SERVER_TYPE_RING ? on_ring_connect : on_connect,
+			server);
 	if (server->source == NULL) {
 		res = -errno;
 		pw_log_error(NAME" %p: can't create server source: %m", impl);
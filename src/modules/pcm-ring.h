@@ -0,0 +1,415 @@
+/* PipeWire
+ *
+ * Copyright © 2021 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef PIPEWIRE_PCM_RING_H
+#define PIPEWIRE_PCM_RING_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+
+#include <spa/utils/defs.h>
+#include <spa/utils/ringbuffer.h>
+
+/*
+ * A PCM ringbuffer in a memfd that is shared with local processes.
+ *
+ * The memory starts with a struct pcm_ring_header, followed by the
+ * samples. One process writes samples and advances the write index.
+ * Readers map the memfd, keep their own read index and follow the shared
+ * write index. A reader that falls more than three quarters of the ring
+ * behind might read samples that are being overwritten, it has lost samples
+ * and resyncs.
+ *
+ * The memfd is handed to the other process over a unix socket with
+ * SCM_RIGHTS. It is sealed against shrinking so that a peer can't make us
+ * fault and the size and stride are validated once and kept in struct
+ * pcm_ring, the copy in shared memory is never trusted after that. When
+ * the peers only read, the writer also seals the memfd against new writable
+ * mappings with pcm_ring_seal_readers().
+ */
+
+#if !defined(__FreeBSD__) && !defined(HAVE_MEMFD_CREATE)
+static inline int memfd_create(const char *name, unsigned int flags)
+{
+	return syscall(SYS_memfd_create, name, flags);
+}
+#define HAVE_MEMFD_CREATE 1
+#endif
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC		0x0001U
+#endif
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING	0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS		1033
+#endif
+#ifndef F_GET_SEALS
+#define F_GET_SEALS		1034
+#endif
+#ifndef F_SEAL_SHRINK
+#define F_SEAL_SHRINK		0x0002
+#endif
+#ifndef F_SEAL_GROW
+#define F_SEAL_GROW		0x0004
+#endif
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE	0x0010
+#endif
+
+#define PCM_RING_MAGIC		0x474e4952	/* "RING" */
+#define PCM_RING_VERSION	1
+#define PCM_RING_MAX_SIZE	(64u * 1024 * 1024)
+
+struct pcm_ring_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;			/* size of the sample area, a power of 2 */
+	uint32_t stride;		/* size of one frame */
+	uint32_t format;		/* enum spa_audio_format */
+	uint32_t rate;
+	uint32_t channels;
+	uint32_t flags;
+	uint32_t padding[8];
+	/* on its own cache line, only the indexes change while streaming.
+	 * The read index is only updated when there is a single reader. */
+	struct spa_ringbuffer ring;
+	uint32_t padding2[14];
+};
+
+struct pcm_ring {
+	int fd;
+	struct pcm_ring_header *header;
+	void *data;
+	size_t mapsize;
+	uint32_t size;			/* validated copies of the header fields */
+	uint32_t stride;
+	uint32_t index;			/* our own read or write index */
+};
+
+#define PCM_RING_INIT	(struct pcm_ring) { .fd = -1, }
+
+static inline int pcm_ring_mmap(struct pcm_ring *r, size_t size, bool writable)
+{
+	void *ptr;
+
+	ptr = mmap(NULL, size, PROT_READ | (writable ? PROT_WRITE : 0),
+			MAP_SHARED, r->fd, 0);
+	if (ptr == MAP_FAILED)
+		return -errno;
+
+	r->header = ptr;
+	r->data = SPA_PTROFF(ptr, sizeof(struct pcm_ring_header), void);
+	r->mapsize = size;
+	return 0;
+}
+
+static inline void pcm_ring_clear(struct pcm_ring *r)
+{
+	if (r->header)
+		munmap(r->header, r->mapsize);
+	if (r->fd >= 0)
+		close(r->fd);
+	*r = PCM_RING_INIT;
+}
+
+/* create a new ring with room for at least size bytes */
+static inline int pcm_ring_create(struct pcm_ring *r, const char *name, uint32_t size,
+		uint32_t stride, uint32_t format, uint32_t rate, uint32_t channels)
+{
+	size_t mapsize;
+	int res;
+
+	*r = PCM_RING_INIT;
+
+	if (size == 0 || size > PCM_RING_MAX_SIZE || stride == 0)
+		return -EINVAL;
+	size = 1u << (32 - __builtin_clz(size - 1));
+	if (size < stride)
+		return -EINVAL;
+	mapsize = sizeof(struct pcm_ring_header) + size;
+
+#ifdef HAVE_MEMFD_CREATE
+	r->fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#endif
+	if (r->fd < 0)
+		return -errno;
+
+	if (ftruncate(r->fd, mapsize) < 0) {
+		res = -errno;
+		goto error;
+	}
+	/* peers can't make us fault by shrinking the memory */
+	if (fcntl(r->fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) < 0) {
+		res = -errno;
+		goto error;
+	}
+	if ((res = pcm_ring_mmap(r, mapsize, true)) < 0)
+		goto error;
+
+	r->size = size;
+	r->stride = stride;
+
+	r->header->magic = PCM_RING_MAGIC;
+	r->header->version = PCM_RING_VERSION;
+	r->header->size = size;
+	r->header->stride = stride;
+	r->header->format = format;
+	r->header->rate = rate;
+	r->header->channels = channels;
+	spa_ringbuffer_init(&r->header->ring);
+	return 0;
+
+error:
+	pcm_ring_clear(r);
+	return res;
+}
+
+/* don't allow new writable mappings of the ring, for when all the peers are
+ * readers. Our own mapping stays writable. Kernels before 5.1 don't have the
+ * seal and return -EINVAL. */
+static inline int pcm_ring_seal_readers(struct pcm_ring *r)
+{
+	if (fcntl(r->fd, F_ADD_SEALS, F_SEAL_FUTURE_WRITE) < 0)
+		return -errno;
+	return 0;
+}
+
+/* map a ring received from another process, takes ownership of fd. Readers
+ * start at the current write index. */
+static inline int pcm_ring_map(struct pcm_ring *r, int fd, bool writable)
+{
+	struct pcm_ring_header header;
+	uint32_t index;
+	int res, seals;
+
+	*r = PCM_RING_INIT;
+	r->fd = fd;
+
+	if ((seals = fcntl(fd, F_GET_SEALS)) < 0 || !(seals & F_SEAL_SHRINK)) {
+		res = -EPROTO;
+		goto error;
+	}
+	if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+		res = -EINVAL;
+		goto error;
+	}
+	if (header.magic != PCM_RING_MAGIC ||
+	    header.version != PCM_RING_VERSION ||
+	    header.size == 0 || header.size > PCM_RING_MAX_SIZE ||
+	    (header.size & (header.size - 1)) != 0 ||
+	    header.stride == 0 || header.stride > header.size) {
+		res = -EPROTO;
+		goto error;
+	}
+	if ((res = pcm_ring_mmap(r, sizeof(header) + header.size, writable)) < 0)
+		goto error;
+
+	r->size = header.size;
+	r->stride = header.stride;
+
+	if (writable)
+		spa_ringbuffer_get_write_index(&r->header->ring, &index);
+	else
+		index = __atomic_load_n(&r->header->ring.writeindex, __ATOMIC_ACQUIRE);
+	r->index = index;
+	return 0;
+
+error:
+	pcm_ring_clear(r);
+	return res;
+}
+
+/* append len bytes. When more than the ring size is written at once,
+ * only the last part is kept. Slow readers are overrun. */
+static inline void pcm_ring_write(struct pcm_ring *r, const void *data, uint32_t len)
+{
+	uint32_t size = r->size;
+
+	if (SPA_UNLIKELY(len > size)) {
+		r->index += len - size;
+		data = SPA_PTROFF(data, len - size, void);
+		len = size;
+	}
+	spa_ringbuffer_write_data(&r->header->ring, r->data, size,
+			r->index & (size - 1), data, len);
+	r->index += len;
+	spa_ringbuffer_write_update(&r->header->ring, r->index);
+}
+
+/* the number of bytes that can be read, -EPIPE when we were overrun. The
+ * writer updates the index after writing, the last quarter of the ring is
+ * kept as a margin for a write in progress. */
+static inline int32_t pcm_ring_avail(struct pcm_ring *r)
+{
+	uint32_t index;
+	int32_t avail;
+
+	index = __atomic_load_n(&r->header->ring.writeindex, __ATOMIC_ACQUIRE);
+	avail = index - r->index;
+	if (avail < 0 || avail > (int32_t)(r->size - r->size / 4))
+		return -EPIPE;
+	return avail;
+}
+
+/* read up to len bytes. Returns the number of bytes read or -EPIPE when
+ * samples were lost, reading then continues half a ring behind the writer. */
+static inline int pcm_ring_read(struct pcm_ring *r, void *data, uint32_t len)
+{
+	uint32_t size = r->size, stride = r->stride;
+	int32_t avail;
+
+	if ((avail = pcm_ring_avail(r)) < 0)
+		goto overrun;
+
+	len = SPA_MIN(len, (uint32_t)avail);
+	spa_ringbuffer_read_data(&r->header->ring, r->data, size,
+			r->index & (size - 1), data, len);
+
+	/* the writer might have overwritten what we just copied */
+	if (pcm_ring_avail(r) < 0)
+		goto overrun;
+
+	r->index += len;
+	return len;
+
+overrun:
+	r->index = __atomic_load_n(&r->header->ring.writeindex, __ATOMIC_ACQUIRE) -
+		(size / 2 / stride) * stride;
+	return -EPIPE;
+}
+
+/* listen for readers on a unix socket. Relative paths are placed in
+ * XDG_RUNTIME_DIR, the address of the socket is returned in addr. */
+static inline int pcm_ring_listen(const char *path, struct sockaddr_un *addr)
+{
+	const char *dir;
+	int fd, res;
+
+	spa_zero(*addr);
+	addr->sun_family = AF_UNIX;
+	if (path[0] != '/' && (dir = getenv("XDG_RUNTIME_DIR")) != NULL)
+		res = snprintf(addr->sun_path, sizeof(addr->sun_path), "%s/%s", dir, path);
+	else
+		res = snprintf(addr->sun_path, sizeof(addr->sun_path), "%s", path);
+	if (res < 0 || (size_t)res >= sizeof(addr->sun_path))
+		return -ENAMETOOLONG;
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0)) < 0)
+		return -errno;
+
+	unlink(addr->sun_path);
+	if (bind(fd, (struct sockaddr *) addr, sizeof(*addr)) < 0 ||
+	    listen(fd, 5) < 0) {
+		res = -errno;
+		close(fd);
+		return res;
+	}
+	return fd;
+}
+
+/* send the ring memfd over a connected unix socket */
+static inline int pcm_ring_send(struct pcm_ring *r, int sock)
+{
+	char cbuf[CMSG_SPACE(sizeof(int))];
+	uint8_t version = PCM_RING_VERSION;
+	struct iovec iov = { .iov_base = &version, .iov_len = 1 };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = cbuf,
+		.msg_controllen = sizeof(cbuf),
+	};
+	struct cmsghdr *cmsg;
+
+	spa_zero(cbuf);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &r->fd, sizeof(int));
+
+	while (sendmsg(sock, &msg, MSG_NOSIGNAL) < 0) {
+		if (errno != EINTR)
+			return -errno;
+	}
+	return 0;
+}
+
+/* receive a ring memfd from a unix socket, returns the fd */
+static inline int pcm_ring_receive(int sock)
+{
+	char cbuf[CMSG_SPACE(sizeof(int))];
+	uint8_t version;
+	struct iovec iov = { .iov_base = &version, .iov_len = 1 };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = cbuf,
+		.msg_controllen = sizeof(cbuf),
+	};
+	struct cmsghdr *cmsg;
+	ssize_t len;
+	int fd;
+
+	while ((len = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) < 0) {
+		if (errno != EINTR)
+			return -errno;
+	}
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if (len != 1 || cmsg == NULL ||
+	    cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+	    cmsg->cmsg_len != CMSG_LEN(sizeof(int)))
+		return -EPROTO;
+
+	memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+	if (version != PCM_RING_VERSION) {
+		close(fd);
+		return -EPROTO;
+	}
+	return fd;
+}
+
+/* accept a reader on a listening socket and pass it the ring */
+static inline int pcm_ring_accept(struct pcm_ring *r, int fd)
+{
+	int client_fd, res;
+
+	if ((client_fd = accept4(fd, NULL, NULL, SOCK_CLOEXEC)) < 0)
+		return -errno;
+	res = pcm_ring_send(r, client_fd);
+	close(client_fd);
+	return res;
+}
+
+#endif /* PIPEWIRE_PCM_RING_H */
@@ -0,0 +1,265 @@
+/* PipeWire
+ *
+ * Copyright © 2021 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <poll.h>
+#include <sys/wait.h>
+
+#include <spa/utils/defs.h>
+#include <spa/utils/string.h>
+#include <spa/param/audio/raw.h>
+
+#include "pcm-ring.h"
+
+#define RING_SIZE	16384
+#define CHUNK_FRAMES	256
+#define N_CHUNKS	64
+
+static void write_frames(struct pcm_ring *r, uint32_t *counter, uint32_t n_frames)
+{
+	uint32_t frames[CHUNK_FRAMES], i;
+
+	spa_assert(n_frames <= CHUNK_FRAMES);
+	for (i = 0; i < n_frames; i++)
+		frames[i] = (*counter)++;
+	pcm_ring_write(r, frames, n_frames * sizeof(uint32_t));
+}
+
+/* read n_frames and check that they continue from *expected */
+static int read_frames(struct pcm_ring *r, uint32_t *expected, uint32_t n_frames)
+{
+	uint32_t frames[CHUNK_FRAMES], i;
+	int res;
+
+	spa_assert(n_frames <= CHUNK_FRAMES);
+	if ((res = pcm_ring_read(r, frames, n_frames * sizeof(uint32_t))) < 0)
+		return res;
+	spa_assert(res % sizeof(uint32_t) == 0);
+	for (i = 0; i < res / sizeof(uint32_t); i++)
+		spa_assert_se(frames[i] == (*expected)++);
+	return res / sizeof(uint32_t);
+}
+
+static void test_create(void)
+{
+	struct pcm_ring r;
+
+	spa_assert_se(pcm_ring_create(&r, "test", 0, 4, SPA_AUDIO_FORMAT_S32, 48000, 1) == -EINVAL);
+	spa_assert_se(pcm_ring_create(&r, "test", 1000, 0, SPA_AUDIO_FORMAT_S32, 48000, 1) == -EINVAL);
+
+	spa_assert_se(pcm_ring_create(&r, "test", 1000, 4, SPA_AUDIO_FORMAT_S32, 48000, 1) == 0);
+	spa_assert(r.size == 1024 && r.header->size == 1024);
+	spa_assert(r.stride == 4 && r.header->stride == 4);
+	spa_assert(r.header->rate == 48000);
+	spa_assert(sizeof(struct pcm_ring_header) == 128);
+	pcm_ring_clear(&r);
+	spa_assert(r.fd == -1 && r.header == NULL);
+}
+
+static void test_overrun(void)
+{
+	struct pcm_ring w, r;
+	uint32_t counter = 0, expected, i;
+	uint32_t frames[CHUNK_FRAMES];
+
+	spa_assert_se(pcm_ring_create(&w, "test", RING_SIZE, 4, SPA_AUDIO_FORMAT_S32, 48000, 1) == 0);
+	spa_assert_se(pcm_ring_map(&r, dup(w.fd), false) == 0);
+	spa_assert(r.size == RING_SIZE);
+
+	expected = 0;
+	spa_assert_se(pcm_ring_read(&r, frames, sizeof(frames)) == 0);
+	write_frames(&w, &counter, 100);
+	spa_assert_se(read_frames(&r, &expected, CHUNK_FRAMES) == 100);
+	spa_assert_se(pcm_ring_read(&r, frames, sizeof(frames)) == 0);
+
+	/* wraps around the end of the ring */
+	for (i = 0; i < 40; i++) {
+		write_frames(&w, &counter, CHUNK_FRAMES);
+		spa_assert_se(read_frames(&r, &expected, CHUNK_FRAMES) == CHUNK_FRAMES);
+	}
+
+	/* write more than the ring can hold while the reader sleeps */
+	for (i = 0; i < 16; i++)
+		write_frames(&w, &counter, CHUNK_FRAMES);
+	spa_assert_se(pcm_ring_read(&r, frames, sizeof(frames)) == -EPIPE);
+
+	/* after the overrun, reading continues half a ring behind */
+	expected = counter - RING_SIZE / 2 / sizeof(uint32_t);
+	spa_assert_se(pcm_ring_avail(&r) == RING_SIZE / 2);
+	spa_assert_se(read_frames(&r, &expected, CHUNK_FRAMES) == CHUNK_FRAMES);
+
+	pcm_ring_clear(&r);
+	pcm_ring_clear(&w);
+}
+
+static void test_untrusted_header(void)
+{
+	struct pcm_ring w, r;
+	uint32_t counter = 0, expected = 0, i;
+	uint32_t frames[CHUNK_FRAMES];
+	void *ptr;
+	int fd, res;
+
+	spa_assert_se(pcm_ring_create(&w, "test", RING_SIZE, 4, SPA_AUDIO_FORMAT_S32, 48000, 1) == 0);
+	res = pcm_ring_seal_readers(&w);
+	if (res == -EINVAL) {
+		fprintf(stderr, "no F_SEAL_FUTURE_WRITE, skipping the sealed ring test\n");
+		pcm_ring_clear(&w);
+		return;
+	}
+	spa_assert(res == 0);
+
+	/* readers can't map the ring writable or shrink it */
+	fd = dup(w.fd);
+	ptr = mmap(NULL, w.mapsize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	spa_assert(ptr == MAP_FAILED);
+	spa_assert_se(ftruncate(fd, 0) < 0);
+	spa_assert_se(pcm_ring_map(&r, fd, false) == 0);
+
+	/* a changed header doesn't affect rings that are already mapped */
+	w.header->size = 0x80000000;
+	w.header->stride = 0;
+	write_frames(&w, &counter, 100);
+	spa_assert_se(read_frames(&r, &expected, CHUNK_FRAMES) == 100);
+	for (i = 0; i < 16; i++)
+		write_frames(&w, &counter, CHUNK_FRAMES);
+	spa_assert_se(pcm_ring_read(&r, frames, sizeof(frames)) == -EPIPE);
+	spa_assert_se(pcm_ring_avail(&r) == RING_SIZE / 2);
+
+	/* and new readers refuse it */
+	spa_assert_se(pcm_ring_map(&r, dup(w.fd), false) == -EPROTO);
+
+	pcm_ring_clear(&r);
+	pcm_ring_clear(&w);
+}
+
+static int run_reader(const struct sockaddr_un *addr)
+{
+	struct pcm_ring r;
+	uint32_t expected = CHUNK_FRAMES, total = 0;
+	int sock, fd, res;
+	char c = 1;
+
+	if ((sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+		return 1;
+	if (connect(sock, (const struct sockaddr *)addr, sizeof(*addr)) < 0)
+		return 2;
+	if ((fd = pcm_ring_receive(sock)) < 0)
+		return 3;
+	if (pcm_ring_map(&r, fd, false) < 0)
+		return 4;
+	if (r.stride != sizeof(uint32_t) || r.header->rate != 48000)
+		return 5;
+
+	/* tell the writer that we follow the ring now */
+	if (write(sock, &c, 1) != 1)
+		return 6;
+
+	while (total < N_CHUNKS * CHUNK_FRAMES) {
+		uint32_t frames[CHUNK_FRAMES], i;
+
+		if ((res = pcm_ring_read(&r, frames, sizeof(frames))) < 0)
+			return 7;
+		if (res == 0) {
+			usleep(100);
+			continue;
+		}
+		for (i = 0; i < res / sizeof(uint32_t); i++)
+			if (frames[i] != expected++)
+				return 8;
+		total += res / sizeof(uint32_t);
+
+		/* the writer waits for every chunk so that we can't fall
+		 * behind, however slow this process is scheduled */
+		if (total % CHUNK_FRAMES == 0 && write(sock, &c, 1) != 1)
+			return 9;
+	}
+	pcm_ring_clear(&r);
+	close(sock);
+	return 0;
+}
+
+static void test_reader_process(void)
+{
+	struct sockaddr_un addr;
+	struct pcm_ring w;
+	struct pollfd pfd;
+	char dir[] = "/tmp/pw-test-pcm-ring-XXXXXX", path[128], c;
+	uint32_t counter = 0, i;
+	int listen_fd, client_fd, status;
+	pid_t pid;
+
+	spa_assert_se(mkdtemp(dir) != NULL);
+	snprintf(path, sizeof(path), "%s/ring", dir);
+
+	spa_assert_se(pcm_ring_create(&w, "test", RING_SIZE, 4, SPA_AUDIO_FORMAT_S32, 48000, 1) == 0);
+	listen_fd = pcm_ring_listen(path, &addr);
+	spa_assert(listen_fd >= 0);
+	spa_assert(spa_streq(addr.sun_path, path));
+
+	/* samples written before the reader attached are not seen */
+	write_frames(&w, &counter, CHUNK_FRAMES);
+
+	pid = fork();
+	spa_assert(pid >= 0);
+	if (pid == 0)
+		_exit(run_reader(&addr));
+
+	pfd = (struct pollfd) { .fd = listen_fd, .events = POLLIN };
+	spa_assert_se(poll(&pfd, 1, 5000) == 1);
+	client_fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+	spa_assert(client_fd >= 0);
+	spa_assert_se(pcm_ring_send(&w, client_fd) == 0);
+	spa_assert_se(read(client_fd, &c, 1) == 1);
+
+	for (i = 0; i < N_CHUNKS; i++) {
+		write_frames(&w, &counter, CHUNK_FRAMES);
+		pfd = (struct pollfd) { .fd = client_fd, .events = POLLIN };
+		spa_assert_se(poll(&pfd, 1, 5000) == 1);
+		spa_assert_se(read(client_fd, &c, 1) == 1);
+	}
+
+	spa_assert_se(waitpid(pid, &status, 0) == pid);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		fprintf(stderr, "reader failed with status %d\n", status);
+	spa_assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+	close(client_fd);
+	close(listen_fd);
+	unlink(path);
+	rmdir(dir);
+	pcm_ring_clear(&w);
+}
+
+int main(int argc, char *argv[])
+{
+	test_create();
+	test_overrun();
+	test_untrusted_header();
+	test_reader_process();
+
+	return 0;
+}
@@ -550,6 +550,7 @@ struct pw_node_target {
 	int (*signal) (void *data);
 	void *data;
 	unsigned int active:1;
+	unsigned int wakeup:1;			/* activation has the wakeup field */
 };
 
 struct pw_node_activation {
@@ -602,8 +603,20 @@ struct pw_node_activation {
 	uint32_t command;				/* next command */
 	uint32_t reposition_owner;			/* owner id with new reposition info, last one
 							 * to update wins */
+
+#define PW_NODE_ACTIVATION_WAKEUP_IDLE		0	/* node waits on its eventfd */
+#define PW_NODE_ACTIVATION_WAKEUP_SPIN		1	/* node spins on this field */
+#define PW_NODE_ACTIVATION_WAKEUP_WOKEN		2	/* node was woken up while spinning */
+	uint32_t wakeup;				/* wakeup state, nodes that are spinning
+							 * are woken up without the eventfd. Appended
+							 * later, older peers map a smaller activation,
+							 * see PW_NODE_ACTIVATION_HAS_WAKEUP */
 };
 
+/** the activation mapped with size has the wakeup field */
+#define PW_NODE_ACTIVATION_HAS_WAKEUP(size)					\
+	((size) >= offsetof(struct pw_node_activation, wakeup) + sizeof(uint32_t))
+
 #define ATOMIC_CAS(v,ov,nv)						\
 ({									\
 	__typeof__(v) __ov = (ov);					\
@@ -623,6 +636,14 @@ struct pw_node_activation {
 #define SEQ_READ(s)			ATOMIC_LOAD(s)
 #define SEQ_READ_SUCCESS(s1,s2)		((s1) == (s2) && ((s2) & 1) == 0)
 
+/** wake up a node that is spinning on its activation, returns false when the
+ * node is not spinning and its eventfd needs to be signaled */
+static inline bool pw_node_activation_wakeup(struct pw_node_activation *a)
+{
+	return ATOMIC_CAS(a->wakeup, PW_NODE_ACTIVATION_WAKEUP_SPIN,
+			PW_NODE_ACTIVATION_WAKEUP_WOKEN);
+}
+
 #define pw_impl_node_emit(o,m,v,...) spa_hook_list_call(&o->listener_list, struct pw_impl_node_events, m, v, ##__VA_ARGS__)
 #define pw_impl_node_emit_destroy(n)			pw_impl_node_emit(n, destroy, 0)
 #define pw_impl_node_emit_free(n)			pw_impl_node_emit(n, free, 0)
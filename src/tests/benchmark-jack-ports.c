@@ -0,0 +1,202 @@
+/* PipeWire
+ *
+ * Copyright © 2021 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Simulates the jack_get_ports() calls a DAW makes while restoring the
+ * connections of a large session and compares the port pattern matcher
+ * used by pipewire-jack against plain POSIX regex matching.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <spa/utils/defs.h>
+#include <spa/utils/list.h>
+
+#include "port-pattern.h"
+
+#define N_CLIENTS	64
+#define N_PORTS		32
+#define N_TOTAL		(N_CLIENTS * N_PORTS)
+#define NAME_SIZE	384
+
+struct port {
+	struct spa_list link;
+	char name[NAME_SIZE];
+};
+
+static struct port ports[N_TOTAL];
+static struct spa_list port_hash[PORT_HASH_SIZE];
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void make_session(void)
+{
+	uint32_t i, j, n = 0;
+
+	for (i = 0; i < PORT_HASH_SIZE; i++)
+		spa_list_init(&port_hash[i]);
+
+	for (i = 0; i < N_CLIENTS; i++) {
+		for (j = 0; j < N_PORTS; j++, n++) {
+			struct port *p = &ports[n];
+
+			if (i == 0)
+				snprintf(p->name, NAME_SIZE, "system:%s_%u",
+						j & 1 ? "playback" : "capture", j / 2 + 1);
+			else
+				snprintf(p->name, NAME_SIZE, "Track %u:audio_%s %u",
+						i, j & 1 ? "out" : "in", j / 2 + 1);
+
+			spa_list_append(&port_hash[port_name_hash(p->name)], &p->link);
+		}
+	}
+}
+
+static uint32_t match_regex(const char *pattern)
+{
+	regex_t regex;
+	uint32_t i, count = 0;
+	int res;
+
+	res = regcomp(&regex, pattern, REG_EXTENDED | REG_NOSUB);
+	spa_assert_se(res == 0);
+	for (i = 0; i < N_TOTAL; i++) {
+		if (regexec(&regex, ports[i].name, 0, NULL, 0) == 0)
+			count++;
+	}
+	regfree(&regex);
+	return count;
+}
+
+static uint32_t match_pattern(const char *pattern)
+{
+	struct port_pattern pat;
+	uint32_t i, count = 0;
+	int res;
+
+	res = port_pattern_init(&pat, pattern);
+	spa_assert_se(res == 0);
+	for (i = 0; i < N_TOTAL; i++) {
+		if (port_pattern_match(&pat, ports[i].name))
+			count++;
+	}
+	port_pattern_clear(&pat);
+	return count;
+}
+
+/* what jack_get_ports() does for exact names, only the ports in the
+ * bucket of the name are compared */
+static uint32_t match_name_index(const char *pattern)
+{
+	struct port_pattern pat;
+	struct port *p;
+	uint32_t count = 0;
+	int res;
+
+	res = port_pattern_init(&pat, pattern);
+	spa_assert_se(res == 0);
+	spa_assert_se(pat.type == PORT_PATTERN_EXACT);
+
+	spa_list_for_each(p, &port_hash[port_name_hash(pat.literal)], link) {
+		if (port_pattern_match(&pat, p->name))
+			count++;
+	}
+	port_pattern_clear(&pat);
+	return count;
+}
+
+static void run_test(const char *pattern, enum port_pattern_type type, uint32_t n_calls)
+{
+	struct port_pattern pat;
+	uint64_t t1, t2, t3;
+	uint32_t i, c1 = 0, c2 = 0;
+	int res;
+
+	res = port_pattern_init(&pat, pattern);
+	spa_assert_se(res == 0);
+	spa_assert_se(pat.type == type);
+	port_pattern_clear(&pat);
+
+	t1 = get_time_ns();
+	for (i = 0; i < n_calls; i++)
+		c1 += match_regex(pattern);
+	t2 = get_time_ns();
+	for (i = 0; i < n_calls; i++)
+		c2 += match_pattern(pattern);
+	t3 = get_time_ns();
+
+	spa_assert_se(c1 == c2);
+
+	fprintf(stderr, "%-28s %5u matches, regex: %8.0f ns/call, pattern: %8.0f ns/call (%.1fx)\n",
+			pattern, c1 / n_calls,
+			(double)(t2 - t1) / n_calls, (double)(t3 - t2) / n_calls,
+			(double)(t2 - t1) / SPA_MAX(t3 - t2, 1u));
+}
+
+static void run_name_test(const char *pattern, uint32_t n_calls)
+{
+	uint64_t t1, t2, t3;
+	uint32_t i, c1 = 0, c2 = 0;
+
+	t1 = get_time_ns();
+	for (i = 0; i < n_calls; i++)
+		c1 += match_pattern(pattern);
+	t2 = get_time_ns();
+	for (i = 0; i < n_calls; i++)
+		c2 += match_name_index(pattern);
+	t3 = get_time_ns();
+
+	spa_assert_se(c1 == n_calls);
+	spa_assert_se(c1 == c2);
+
+	fprintf(stderr, "%-28s %5u matches, pattern: %8.0f ns/call, index: %8.0f ns/call (%.1fx)\n",
+			pattern, c1 / n_calls,
+			(double)(t2 - t1) / n_calls, (double)(t3 - t2) / n_calls,
+			(double)(t2 - t1) / SPA_MAX(t3 - t2, 1u));
+}
+
+int main(int argc, char *argv[])
+{
+	make_session();
+
+	/* one lookup per connection of the session */
+	run_test("^Track 42:audio_out 3$", PORT_PATTERN_EXACT, N_TOTAL);
+	run_test("Track 42:audio_out 3", PORT_PATTERN_SUBSTRING, N_TOTAL);
+	run_test("^system:playback_", PORT_PATTERN_PREFIX, N_TOTAL);
+	run_test("audio_in 7$", PORT_PATTERN_SUFFIX, N_TOTAL);
+	run_test("^Track 1\\.?:audio_out [0-9]+$", PORT_PATTERN_REGEX, N_TOTAL / 16);
+
+	/* exact names are looked up in the name index */
+	run_name_test("^Track 42:audio_out 3$", N_TOTAL);
+	run_name_test("^Track 63:audio_in 16$", N_TOTAL);
+
+	return 0;
+}
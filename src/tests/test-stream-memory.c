@@ -0,0 +1,171 @@
+/* PipeWire
+ *
+ * Copyright © 2021 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Creates many streams on a self connected context and reports how much
+ * memory each exported stream costs.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <malloc.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/main-loop.h>
+#include <pipewire/stream.h>
+
+#include <spa/param/audio/format-utils.h>
+
+#define N_STREAMS	64
+/* both the client and the server side of the stream live in this process.
+ * A stream allocates about 3.65MiB, most of it are the buffers. With the
+ * inline pool of mix slots it was about 4.2MiB. The resident size depends
+ * on which pages the allocator touches, only the allocated size is
+ * checked. */
+#define MAX_STREAM_HEAP	(4 * 1024 * 1024)
+
+struct data {
+	struct pw_main_loop *loop;
+	struct pw_core *core;
+	struct spa_hook core_listener;
+	int pending;
+};
+
+static void on_core_done(void *data, uint32_t id, int seq)
+{
+	struct data *d = data;
+	if (id == PW_ID_CORE && seq == d->pending)
+		pw_main_loop_quit(d->loop);
+}
+
+static const struct pw_core_events core_events = {
+	PW_VERSION_CORE_EVENTS,
+	.done = on_core_done,
+};
+
+static void roundtrip(struct data *d)
+{
+	d->pending = pw_core_sync(d->core, PW_ID_CORE, 0);
+	pw_main_loop_run(d->loop);
+}
+
+static size_t get_rss(void)
+{
+	unsigned long size, resident;
+	FILE *f;
+
+	if ((f = fopen("/proc/self/statm", "r")) == NULL)
+		return 0;
+	if (fscanf(f, "%lu %lu", &size, &resident) != 2)
+		resident = 0;
+	fclose(f);
+
+	return resident * sysconf(_SC_PAGESIZE);
+}
+
+/* bytes allocated with malloc, including the large blocks that were mmapped */
+static size_t get_heap(void)
+{
+	struct mallinfo2 mi = mallinfo2();
+	return mi.uordblks + mi.hblkhd;
+}
+
+static void test_stream_memory(void)
+{
+	struct data d = { 0, };
+	struct pw_context *context;
+	struct pw_stream *streams[N_STREAMS];
+	uint8_t buffer[1024];
+	struct spa_pod_builder b;
+	const struct spa_pod *params[1];
+	size_t rss_start = 0, rss_end, heap_start = 0, heap_end;
+	size_t per_stream, heap_per_stream;
+	uint32_t i;
+
+	d.loop = pw_main_loop_new(NULL);
+	context = pw_context_new(pw_main_loop_get_loop(d.loop), NULL, 0);
+	spa_assert(context != NULL);
+	d.core = pw_context_connect_self(context, NULL, 0);
+	spa_assert(d.core != NULL);
+	pw_core_add_listener(d.core, &d.core_listener, &core_events, &d);
+
+	/* create and export one stream first so that all plugins and
+	 * shared state are loaded before measuring */
+	for (i = 0; i < N_STREAMS; i++) {
+		if (i == 1) {
+			roundtrip(&d);
+			rss_start = get_rss();
+			heap_start = get_heap();
+		}
+
+		streams[i] = pw_stream_new(d.core, "test",
+				pw_properties_new(
+					PW_KEY_MEDIA_TYPE, "Audio",
+					PW_KEY_MEDIA_CATEGORY, "Playback",
+					NULL));
+		spa_assert(streams[i] != NULL);
+
+		b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+		params[0] = spa_format_audio_raw_build(&b, SPA_PARAM_EnumFormat,
+				&SPA_AUDIO_INFO_RAW_INIT(
+					.format = SPA_AUDIO_FORMAT_F32,
+					.channels = 2,
+					.rate = 48000));
+
+		spa_assert(pw_stream_connect(streams[i], PW_DIRECTION_OUTPUT,
+				PW_ID_ANY, PW_STREAM_FLAG_MAP_BUFFERS,
+				params, 1) >= 0);
+	}
+	roundtrip(&d);
+	rss_end = get_rss();
+	heap_end = get_heap();
+
+	per_stream = rss_end > rss_start ? (rss_end - rss_start) / (N_STREAMS - 1) : 0;
+	heap_per_stream = heap_end > heap_start ? (heap_end - heap_start) / (N_STREAMS - 1) : 0;
+	fprintf(stderr, "%d streams: rss %zu -> %zu KiB, %zu KiB per stream\n",
+			N_STREAMS, rss_start / 1024, rss_end / 1024, per_stream / 1024);
+	fprintf(stderr, "%d streams: heap %zu -> %zu KiB, %zu KiB per stream\n",
+			N_STREAMS, heap_start / 1024, heap_end / 1024, heap_per_stream / 1024);
+
+	spa_assert(heap_per_stream > 0);
+	spa_assert(heap_per_stream < MAX_STREAM_HEAP);
+
+	for (i = 0; i < N_STREAMS; i++)
+		pw_stream_destroy(streams[i]);
+
+	spa_hook_remove(&d.core_listener);
+	pw_context_destroy(context);
+	pw_main_loop_destroy(d.loop);
+}
+
+int main(int argc, char *argv[])
+{
+	pw_init(&argc, &argv);
+
+	test_stream_memory();
+
+	pw_deinit();
+
+	return 0;
+}
@@ -34,6 +34,7 @@
 #include <unistd.h>
 #include <assert.h>
 #include <ctype.h>
+#include <limits.h>
 
 #include <sndfile.h>
 
@@ -44,6 +45,7 @@
 #include <spa/utils/result.h>
 #include <spa/utils/string.h>
 #include <spa/utils/json.h>
+#include <spa/utils/ringbuffer.h>
 #include <spa/debug/types.h>
 #include <spa/debug/pod.h>
 
@@ -66,6 +68,11 @@
 #define DEFAULT_FORMAT		"s16"
 #define DEFAULT_VOLUME		1.0
 #define DEFAULT_QUALITY		4
+#define DEFAULT_IO_BUFFER	2.0
+
+#define IO_CHUNK_FRAMES		4096u
+/* the fill level of the ring is a signed 32 bits difference of the indexes */
+#define IO_MAX_SIZE		(1u << 30)
 
 enum mode {
 	mode_none,
@@ -160,6 +167,42 @@ struct data {
 		struct midi_file *file;
 		struct midi_file_info info;
 	} midi;
+
+	/* the file is read and written in a separate thread, the process
+	 * function only touches the ringbuffer */
+	struct {
+		double secs;
+		fill_fn fill;
+		struct pw_thread_loop *loop;
+		struct spa_source *wakeup;
+		struct spa_ringbuffer ring;
+		void *buffer;		/* n_planes rings of size bytes */
+		uint32_t size;
+		uint32_t n_planes;
+		uint32_t frame_size;	/* bytes of one frame in a plane */
+		void *chunk;
+		bool eof;
+		bool prefill;		/* the file can be read ahead before starting */
+
+		/* statistics, updated by the process and the io thread and
+		 * read by the main thread */
+		uint32_t min_fill;
+		uint32_t max_fill;
+		uint32_t xruns;
+		uint64_t disk_count;
+		uint64_t disk_nsec;
+		uint64_t disk_max_nsec;
+	} io;
+
+	double prealloc;
+	int fd;
+
+	/* record groups of channels into separate files */
+	struct {
+		int channels;
+		int n_files;
+		SNDFILE **files;
+	} split;
 };
 
 static inline int
@@ -277,6 +320,39 @@ sf_format_samplesize(int format)
 	return -1;
 }
 
+static inline int
+sf_container_from_filename(const char *filename)
+{
+	const char *ext = strrchr(filename, '.');
+
+	if (spa_streq(ext, ".w64"))
+		return SF_FORMAT_W64;
+	if (spa_streq(ext, ".rf64"))
+		return SF_FORMAT_RF64;
+	if (spa_streq(ext, ".caf"))
+		return SF_FORMAT_CAF;
+	return SF_FORMAT_WAV;
+}
+
+static inline enum spa_audio_format
+format_to_planar(enum spa_audio_format format)
+{
+	switch (format) {
+	case SPA_AUDIO_FORMAT_U8:
+		return SPA_AUDIO_FORMAT_U8P;
+	case SPA_AUDIO_FORMAT_S16:
+		return SPA_AUDIO_FORMAT_S16P;
+	case SPA_AUDIO_FORMAT_S32:
+		return SPA_AUDIO_FORMAT_S32P;
+	case SPA_AUDIO_FORMAT_F32:
+		return SPA_AUDIO_FORMAT_F32P;
+	case SPA_AUDIO_FORMAT_F64:
+		return SPA_AUDIO_FORMAT_F64P;
+	default:
+		return SPA_AUDIO_FORMAT_UNKNOWN;
+	}
+}
+
 static int sf_playback_fill_x8(struct data *d, void *dest, unsigned int n_frames)
 {
 	sf_count_t rn;
@@ -792,6 +868,355 @@ static const struct pw_registry_events registry_events = {
 	.global_remove = registry_event_global_remove,
 };
 
+static inline uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+#define STAT_LOAD(s)		__atomic_load_n(&(s), __ATOMIC_RELAXED)
+#define STAT_STORE(s,v)		__atomic_store_n(&(s), (v), __ATOMIC_RELAXED)
+#define STAT_INC(s)		__atomic_fetch_add(&(s), 1, __ATOMIC_RELAXED)
+
+/* called from the process function, the only writer of the fill levels */
+static void io_update_fill(struct data *d, int32_t filled)
+{
+	uint32_t fill = SPA_MAX(filled, 0);
+	STAT_STORE(d->io.min_fill, SPA_MIN(STAT_LOAD(d->io.min_fill), fill));
+	STAT_STORE(d->io.max_fill, SPA_MAX(STAT_LOAD(d->io.max_fill), fill));
+}
+
+#define INTERLEAVE(type)								\
+{											\
+	type *d = dst;									\
+	for (i = 0; i < n_frames; i++)							\
+		for (c = 0; c < n_channels; c++)					\
+			*d++ = ((const type *)SPA_PTROFF(src, c * plane_size, void))[i];	\
+}
+
+static void interleave(void *dst, const void *src, uint32_t plane_size,
+		uint32_t n_channels, uint32_t samplesize, uint32_t n_frames)
+{
+	uint32_t i, c;
+
+	switch (samplesize) {
+	case 1:
+		INTERLEAVE(uint8_t);
+		break;
+	case 2:
+		INTERLEAVE(uint16_t);
+		break;
+	case 4:
+		INTERLEAVE(uint32_t);
+		break;
+	case 8:
+		INTERLEAVE(uint64_t);
+		break;
+	}
+}
+
+static sf_count_t split_write_file(struct data *d, SNDFILE *file, void *src,
+		uint32_t n_frames, uint32_t n_channels)
+{
+	switch (d->spa_format) {
+	case SPA_AUDIO_FORMAT_U8:
+		return sf_write_raw(file, src, n_frames * n_channels) / n_channels;
+	case SPA_AUDIO_FORMAT_S16:
+		return sf_writef_short(file, src, n_frames);
+	case SPA_AUDIO_FORMAT_S32:
+		return sf_writef_int(file, src, n_frames);
+	case SPA_AUDIO_FORMAT_F32:
+		return sf_writef_float(file, src, n_frames);
+	case SPA_AUDIO_FORMAT_F64:
+		return sf_writef_double(file, src, n_frames);
+	default:
+		return -ENOTSUP;
+	}
+}
+
+/* d->io.chunk has one plane per channel, write the planes to the files.
+ * A file with one channel is written straight from its plane. */
+static int split_write(struct data *d, uint32_t n_frames)
+{
+	uint32_t plane_size = IO_CHUNK_FRAMES * d->io.frame_size;
+	void *tmp = SPA_PTROFF(d->io.chunk, plane_size * d->io.n_planes, void);
+	int i, res = n_frames;
+
+	for (i = 0; i < d->split.n_files; i++) {
+		uint32_t first = i * d->split.channels;
+		uint32_t n_channels = SPA_MIN((uint32_t)d->split.channels, d->channels - first);
+		void *src = SPA_PTROFF(d->io.chunk, first * plane_size, void);
+		sf_count_t rn;
+
+		if (n_channels > 1) {
+			interleave(tmp, src, plane_size, n_channels,
+					d->io.frame_size, n_frames);
+			src = tmp;
+		}
+		rn = split_write_file(d, d->split.files[i], src, n_frames, n_channels);
+		if (rn < res)
+			res = rn;
+	}
+	return res;
+}
+
+/* called from the io thread, moves data between the file and the ring in
+ * chunks of IO_CHUNK_FRAMES. With flush, the last partial chunk is written
+ * as well. */
+static void io_transfer(struct data *d, bool flush)
+{
+	uint32_t index, frames, mask = d->io.size - 1;
+	uint64_t t1, t2;
+	int32_t filled;
+	int n;
+
+	while (true) {
+		if (d->mode == mode_playback) {
+			if (__atomic_load_n(&d->io.eof, __ATOMIC_ACQUIRE))
+				break;
+
+			filled = spa_ringbuffer_get_write_index(&d->io.ring, &index);
+			frames = (d->io.size - SPA_MAX(filled, 0)) / d->stride;
+			if (frames < IO_CHUNK_FRAMES)
+				break;
+			frames = IO_CHUNK_FRAMES;
+
+			t1 = get_time_ns();
+			n = d->io.fill(d, d->io.chunk, frames);
+			t2 = get_time_ns();
+
+			if (n > 0) {
+				spa_ringbuffer_write_data(&d->io.ring, d->io.buffer, d->io.size,
+						index & mask, d->io.chunk, n * d->stride);
+				spa_ringbuffer_write_update(&d->io.ring, index + n * d->stride);
+			} else {
+				if (n < 0)
+					fprintf(stderr, "fill error %d\n", n);
+				__atomic_store_n(&d->io.eof, true, __ATOMIC_RELEASE);
+			}
+		} else {
+			uint32_t i, plane_size = IO_CHUNK_FRAMES * d->io.frame_size;
+
+			filled = spa_ringbuffer_get_read_index(&d->io.ring, &index);
+			frames = SPA_MAX(filled, 0) / d->io.frame_size;
+			if (frames == 0 || (frames < IO_CHUNK_FRAMES && !flush))
+				break;
+			frames = SPA_MIN(frames, IO_CHUNK_FRAMES);
+
+			for (i = 0; i < d->io.n_planes; i++)
+				spa_ringbuffer_read_data(&d->io.ring,
+						SPA_PTROFF(d->io.buffer, i * d->io.size, void),
+						d->io.size, index & mask,
+						SPA_PTROFF(d->io.chunk, i * plane_size, void),
+						frames * d->io.frame_size);
+			spa_ringbuffer_read_update(&d->io.ring, index + frames * d->io.frame_size);
+
+			t1 = get_time_ns();
+			if (d->split.channels > 0)
+				n = split_write(d, frames);
+			else
+				n = d->io.fill(d, d->io.chunk, frames);
+			t2 = get_time_ns();
+
+			if (n < (int)frames)
+				fprintf(stderr, "short write %d < %u\n", n, frames);
+		}
+		STAT_INC(d->io.disk_count);
+		STAT_STORE(d->io.disk_nsec, STAT_LOAD(d->io.disk_nsec) + t2 - t1);
+		STAT_STORE(d->io.disk_max_nsec, SPA_MAX(STAT_LOAD(d->io.disk_max_nsec), t2 - t1));
+	}
+}
+
+static void on_io_wakeup(void *userdata, uint64_t count)
+{
+	struct data *data = userdata;
+	io_transfer(data, false);
+}
+
+/* called from the process function instead of the file fill functions */
+static int io_playback_fill(struct data *d, void *dest, unsigned int n_frames)
+{
+	uint32_t index, size;
+	int32_t avail;
+
+	avail = spa_ringbuffer_get_read_index(&d->io.ring, &index);
+	io_update_fill(d, avail);
+
+	size = SPA_MIN((uint32_t)SPA_MAX(avail, 0) / d->stride, n_frames) * d->stride;
+	if (size == 0) {
+		if (__atomic_load_n(&d->io.eof, __ATOMIC_ACQUIRE) &&
+		    spa_ringbuffer_get_read_index(&d->io.ring, &index) <= 0)
+			return 0;
+
+		/* the disk could not keep up, play silence and keep going */
+		STAT_INC(d->io.xruns);
+		if (d->position)
+			n_frames = SPA_MIN(n_frames, d->position->clock.duration);
+		memset(dest, d->spa_format == SPA_AUDIO_FORMAT_U8 ? 0x80 : 0,
+				n_frames * d->stride);
+		pw_loop_signal_event(pw_thread_loop_get_loop(d->io.loop), d->io.wakeup);
+		return n_frames;
+	}
+	spa_ringbuffer_read_data(&d->io.ring, d->io.buffer, d->io.size,
+			index & (d->io.size - 1), dest, size);
+	spa_ringbuffer_read_update(&d->io.ring, index + size);
+
+	if (d->io.size - (avail - size) >= IO_CHUNK_FRAMES * d->stride)
+		pw_loop_signal_event(pw_thread_loop_get_loop(d->io.loop), d->io.wakeup);
+
+	return size / d->stride;
+}
+
+static int io_record_fill(struct data *d, void *src, unsigned int n_frames)
+{
+	uint32_t index, size = n_frames * d->io.frame_size;
+	int32_t filled;
+
+	filled = spa_ringbuffer_get_write_index(&d->io.ring, &index);
+	io_update_fill(d, filled);
+
+	if (filled < 0 || (uint32_t)filled + size > d->io.size) {
+		/* the disk could not keep up, drop the data */
+		STAT_INC(d->io.xruns);
+	} else {
+		spa_ringbuffer_write_data(&d->io.ring, d->io.buffer, d->io.size,
+				index & (d->io.size - 1), src, size);
+		spa_ringbuffer_write_update(&d->io.ring, index + size);
+		filled += size;
+	}
+	if ((uint32_t)SPA_MAX(filled, 0) >= IO_CHUNK_FRAMES * d->io.frame_size)
+		pw_loop_signal_event(pw_thread_loop_get_loop(d->io.loop), d->io.wakeup);
+
+	return n_frames;
+}
+
+/* like io_record_fill but for planar data, one plane per channel */
+static int io_record_planes(struct data *d, struct spa_buffer *buf)
+{
+	uint32_t i, index, n_frames = UINT32_MAX, size;
+	int32_t filled;
+
+	if (buf->n_datas < d->io.n_planes)
+		return 0;
+
+	for (i = 0; i < d->io.n_planes; i++) {
+		struct spa_data *dd = &buf->datas[i];
+		if (dd->data == NULL)
+			return 0;
+		n_frames = SPA_MIN(n_frames, SPA_MIN(dd->chunk->size, dd->maxsize) / d->io.frame_size);
+	}
+	size = n_frames * d->io.frame_size;
+
+	filled = spa_ringbuffer_get_write_index(&d->io.ring, &index);
+	io_update_fill(d, filled);
+
+	if (filled < 0 || (uint32_t)filled + size > d->io.size) {
+		STAT_INC(d->io.xruns);
+	} else {
+		for (i = 0; i < d->io.n_planes; i++) {
+			struct spa_data *dd = &buf->datas[i];
+			uint32_t offset = SPA_MIN(dd->chunk->offset, dd->maxsize - size);
+
+			spa_ringbuffer_write_data(&d->io.ring,
+					SPA_PTROFF(d->io.buffer, i * d->io.size, void),
+					d->io.size, index & (d->io.size - 1),
+					SPA_PTROFF(dd->data, offset, void), size);
+		}
+		spa_ringbuffer_write_update(&d->io.ring, index + size);
+		filled += size;
+	}
+	if ((uint32_t)SPA_MAX(filled, 0) >= IO_CHUNK_FRAMES * d->io.frame_size)
+		pw_loop_signal_event(pw_thread_loop_get_loop(d->io.loop), d->io.wakeup);
+
+	return n_frames;
+}
+
+static void io_print_stats(struct data *d)
+{
+	uint64_t disk_count = STAT_LOAD(d->io.disk_count);
+
+	printf("io: buffer=%u fill=%u..%u xruns=%u disk calls=%"PRIu64" "
+			"avg=%"PRIu64"us max=%"PRIu64"us\n",
+			d->io.size, STAT_LOAD(d->io.min_fill), STAT_LOAD(d->io.max_fill),
+			STAT_LOAD(d->io.xruns), disk_count,
+			disk_count ? STAT_LOAD(d->io.disk_nsec) / disk_count / 1000 : 0,
+			STAT_LOAD(d->io.disk_max_nsec) / 1000);
+}
+
+static int io_setup(struct data *d)
+{
+	double size;
+	int res;
+
+	d->io.n_planes = d->split.channels > 0 ? d->channels : 1;
+	d->io.frame_size = d->stride / d->io.n_planes;
+
+	size = SPA_MAX(d->io.secs, 0.0) * d->rate * d->io.frame_size;
+	size = SPA_MAX(size, (double)IO_CHUNK_FRAMES * d->io.frame_size * 2);
+	d->io.size = 1;
+	while (d->io.size < size && d->io.size < IO_MAX_SIZE)
+		d->io.size <<= 1;
+
+	d->io.buffer = malloc((size_t)d->io.size * d->io.n_planes);
+	/* with split files, room to interleave a group after the planes */
+	d->io.chunk = malloc(IO_CHUNK_FRAMES * d->stride * (d->split.channels > 0 ? 2 : 1));
+	if (d->io.buffer == NULL || d->io.chunk == NULL)
+		return -errno;
+
+	spa_ringbuffer_init(&d->io.ring);
+	d->io.min_fill = UINT32_MAX;
+	d->io.fill = d->fill;
+	d->fill = d->mode == mode_playback ? io_playback_fill : io_record_fill;
+
+	/* start with a full ring when the file can be read ahead. A pipe
+	 * might not have that much data yet, it is filled from the io
+	 * thread as soon as it runs */
+	if (d->mode == mode_playback && d->io.prefill)
+		io_transfer(d, false);
+
+	d->io.loop = pw_thread_loop_new("pw-cat-io", NULL);
+	if (d->io.loop == NULL)
+		return -errno;
+
+	d->io.wakeup = pw_loop_add_event(pw_thread_loop_get_loop(d->io.loop),
+			on_io_wakeup, d);
+	if (d->io.wakeup == NULL)
+		return -errno;
+
+	if ((res = pw_thread_loop_start(d->io.loop)) < 0)
+		return res;
+
+	if (d->mode == mode_playback && !d->io.prefill)
+		pw_loop_signal_event(pw_thread_loop_get_loop(d->io.loop), d->io.wakeup);
+
+	if (d->verbose)
+		printf("io buffer %u bytes in %u planes (%.3fs)\n", d->io.size, d->io.n_planes,
+				(double)d->io.size / (d->rate * d->io.frame_size));
+	return 0;
+}
+
+static void io_cleanup(struct data *d)
+{
+	if (d->io.loop) {
+		pw_thread_loop_stop(d->io.loop);
+		if (d->io.wakeup)
+			pw_loop_destroy_source(pw_thread_loop_get_loop(d->io.loop), d->io.wakeup);
+		pw_thread_loop_destroy(d->io.loop);
+		d->io.loop = NULL;
+
+		/* write out what is left */
+		if (d->mode == mode_record)
+			io_transfer(d, true);
+		if (d->verbose)
+			io_print_stats(d);
+	}
+	free(d->io.buffer);
+	free(d->io.chunk);
+	d->io.buffer = NULL;
+	d->io.chunk = NULL;
+}
+
 static void
 on_state_changed(void *userdata, enum pw_stream_state old,
 		 enum pw_stream_state state, const char *error)
@@ -887,6 +1312,10 @@ static void on_process(void *userdata)
 			have_data = true;
 		} else if (n_fill_frames < 0)
 			fprintf(stderr, "fill error %d\n", n_fill_frames);
+	} else if (data->split.channels > 0) {
+		n_fill_frames = io_record_planes(data, buf);
+
+		have_data = true;
 	} else {
 		offset = SPA_MIN(d->chunk->offset, d->maxsize);
 		size = SPA_MIN(d->chunk->size, d->maxsize - offset);
@@ -944,6 +1373,8 @@ static void do_print_delay(void *userdata, uint64_t expirations)
 		time.now,
 		time.rate.num, time.rate.denom,
 		time.ticks, time.delay, time.queued);
+	if (data->io.loop)
+		io_print_stats(data);
 }
 
 enum {
@@ -959,6 +1390,9 @@ enum {
 	OPT_FORMAT,
 	OPT_VOLUME,
 	OPT_LIST_TARGETS,
+	OPT_IO_BUFFER,
+	OPT_PREALLOC,
+	OPT_SPLIT,
 };
 
 static const struct option long_options[] = {
@@ -986,6 +1420,9 @@ static const struct option long_options[] = {
 	{ "quality",		required_argument, NULL, 'q' },
 
 	{ "list-targets",	no_argument, NULL, OPT_LIST_TARGETS },
+	{ "io-buffer",		required_argument, NULL, OPT_IO_BUFFER },
+	{ "prealloc",		required_argument, NULL, OPT_PREALLOC },
+	{ "split",		required_argument, NULL, OPT_SPLIT },
 
 	{ NULL, 0, NULL, 0 }
 };
@@ -1015,11 +1452,17 @@ static void show_usage(const char *name, bool is_error)
 	     "                                          or direct samples (256)\n"
 	     "                                          the rate is the one of the source file\n"
 	     "      --list-targets                    List available targets for --target\n"
+	     "      --io-buffer                       Seconds of audio buffered between the\n"
+	     "                                          stream and the file (default %.1f)\n"
+	     "      --prealloc                        Preallocate disk space for this many\n"
+	     "                                          seconds of recording\n"
+	     "      --split                           Record this many channels per file\n"
 	     "\n"),
 	     DEFAULT_MEDIA_TYPE,
 	     DEFAULT_MEDIA_CATEGORY_PLAYBACK,
 	     DEFAULT_MEDIA_ROLE,
-	     DEFAULT_TARGET, DEFAULT_LATENCY_PLAY);
+	     DEFAULT_TARGET, DEFAULT_LATENCY_PLAY,
+	     DEFAULT_IO_BUFFER);
 
 	fprintf(fp,
            _("      --rate                            Sample rate (req. for rec) (default %u)\n"
@@ -1209,6 +1652,51 @@ static int fill_properties(struct data *data)
 	return 0;
 }
 
+static int setup_split_files(struct data *data, SF_INFO *info)
+{
+	const char *ext;
+	int i, len;
+
+	if (spa_streq(data->filename, "-")) {
+		fprintf(stderr, "error: can't split channels to stdout\n");
+		return -EINVAL;
+	}
+	if (format_to_planar(sf_format_to_pw(info->format)) == SPA_AUDIO_FORMAT_UNKNOWN) {
+		fprintf(stderr, "error: format \"%s\" can't be split\n", data->format);
+		return -EINVAL;
+	}
+
+	data->split.n_files = (info->channels + data->split.channels - 1) / data->split.channels;
+	data->split.files = calloc(data->split.n_files, sizeof(SNDFILE *));
+	if (data->split.files == NULL)
+		return -errno;
+
+	/* name.wav becomes name-01.wav, name-02.wav, ... */
+	ext = strrchr(data->filename, '.');
+	if (ext == NULL || strchr(ext, '/') != NULL)
+		ext = data->filename + strlen(data->filename);
+	len = ext - data->filename;
+
+	for (i = 0; i < data->split.n_files; i++) {
+		SF_INFO finfo = *info;
+		char path[PATH_MAX];
+
+		finfo.channels = SPA_MIN(data->split.channels,
+				info->channels - i * data->split.channels);
+
+		snprintf(path, sizeof(path), "%.*s-%02d%s", len, data->filename, i + 1, ext);
+		data->split.files[i] = sf_open(path, SFM_WRITE, &finfo);
+		if (data->split.files[i] == NULL) {
+			fprintf(stderr, "error: failed to open audio file \"%s\": %s\n",
+					path, sf_strerror(NULL));
+			return -EIO;
+		}
+		if (data->verbose)
+			printf("opened file \"%s\" channels:%d\n", path, finfo.channels);
+	}
+	return 0;
+}
+
 static int setup_sndfile(struct data *data)
 {
 	SF_INFO info;
@@ -1235,7 +1723,7 @@ static int setup_sndfile(struct data *data)
 			fprintf(stderr, "error: unknown format \"%s\"\n", data->format);
 			return -EINVAL;
 		}
-		info.format |= SF_FORMAT_WAV;
+		info.format |= sf_container_from_filename(data->filename);
 #if __BYTE_ORDER == __BIG_ENDIAN
 		info.format |= SF_ENDIAN_BIG;
 #else
@@ -1243,10 +1731,27 @@ static int setup_sndfile(struct data *data)
 #endif
 	}
 
-	data->file = sf_open(data->filename,
-			data->mode == mode_playback ? SFM_READ : SFM_WRITE,
-			&info);
-	if (!data->file) {
+	if (data->split.channels > 0) {
+		int res;
+		if ((res = setup_split_files(data, &info)) < 0)
+			return res;
+		if (data->prealloc > 0.0)
+			fprintf(stderr, "warning: --prealloc is ignored with --split\n");
+	} else if (data->mode == mode_record && data->prealloc > 0.0 &&
+	    !spa_streq(data->filename, "-")) {
+		data->fd = open(data->filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+		if (data->fd < 0) {
+			fprintf(stderr, "error: failed to open audio file \"%s\": %m\n",
+					data->filename);
+			return -EIO;
+		}
+		data->file = sf_open_fd(data->fd, SFM_WRITE, &info, SF_FALSE);
+	} else {
+		data->file = sf_open(data->filename,
+				data->mode == mode_playback ? SFM_READ : SFM_WRITE,
+				&info);
+	}
+	if (!data->file && data->split.channels == 0) {
 		fprintf(stderr, "error: failed to open audio file \"%s\": %s\n",
 				data->filename, sf_strerror(NULL));
 		return -EIO;
@@ -1263,6 +1768,7 @@ static int setup_sndfile(struct data *data)
 
 	data->rate = info.samplerate;
 	data->channels = info.channels;
+	data->io.prefill = info.seekable;
 
 	if (data->mode == mode_playback) {
 		if (data->channelmap.n_channels == 0) {
@@ -1294,6 +1800,17 @@ static int setup_sndfile(struct data *data)
 			sf_fmt_playback_fill_fn(info.format) :
 			sf_fmt_record_fill_fn(info.format);
 
+	if (data->fd >= 0) {
+		/* reserve the blocks without changing the file size, this avoids
+		 * allocating while recording and keeps the file contiguous */
+		off_t len = data->prealloc * data->rate * data->stride;
+		if (fallocate(data->fd, FALLOC_FL_KEEP_SIZE, 0, len) < 0)
+			fprintf(stderr, "warning: can't preallocate %"PRIi64" bytes: %m\n",
+					(int64_t)len);
+		else if (data->verbose)
+			printf("preallocated %"PRIi64" bytes\n", (int64_t)len);
+	}
+
 	data->latency_unit = unit_none;
 
 	s = data->latency;
@@ -1395,6 +1912,8 @@ int main(int argc, char *argv[])
 	/* negative means no volume adjustment */
 	data.volume = -1.0;
 	data.quality = -1;
+	data.io.secs = DEFAULT_IO_BUFFER;
+	data.fd = -1;
 
 	/* initialize list every time */
 	spa_list_init(&data.targets);
@@ -1507,6 +2026,23 @@ int main(int argc, char *argv[])
 			data.list_targets = true;
 			break;
 
+		case OPT_IO_BUFFER:
+			data.io.secs = atof(optarg);
+			break;
+
+		case OPT_PREALLOC:
+			data.prealloc = atof(optarg);
+			break;
+
+		case OPT_SPLIT:
+			ret = atoi(optarg);
+			if (ret <= 0) {
+				fprintf(stderr, "error: bad split channels %d\n", ret);
+				goto error_usage;
+			}
+			data.split.channels = ret;
+			break;
+
 		default:
 			fprintf(stderr, "error: unknown option '%c'\n", c);
 			goto error_usage;
@@ -1518,6 +2054,11 @@ int main(int argc, char *argv[])
 		goto error_usage;
 	}
 
+	if (data.split.channels > 0 && (data.mode != mode_record || data.is_midi)) {
+		fprintf(stderr, "error: --split is only supported for audio recording\n");
+		goto error_usage;
+	}
+
 	if (!data.media_type) {
 		if (data.is_midi)
 			data.media_type = DEFAULT_MIDI_MEDIA_TYPE;
@@ -1637,9 +2178,11 @@ int main(int argc, char *argv[])
 		}
 
 		if (!data.is_midi) {
+			/* with split files, let the stream deinterleave for us */
 			info = SPA_AUDIO_INFO_RAW_INIT(
 				.flags = data.channelmap.n_channels ? 0 : SPA_AUDIO_FLAG_UNPOSITIONED,
-				.format = data.spa_format,
+				.format = data.split.channels > 0 ?
+					format_to_planar(data.spa_format) : data.spa_format,
 				.rate = data.rate,
 				.channels = data.channels);
 
@@ -1647,6 +2190,11 @@ int main(int argc, char *argv[])
 				memcpy(info.position, data.channelmap.channels, data.channels * sizeof(int));
 
 			params[0] = spa_format_audio_raw_build(&b, SPA_PARAM_EnumFormat, &info);
+
+			if ((ret = io_setup(&data)) < 0) {
+				fprintf(stderr, "error: io setup failed: %s\n", spa_strerror(ret));
+				goto error_no_stream;
+			}
 		} else {
 			params[0] = spa_pod_builder_add_object(&b,
 					SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat,
@@ -1750,6 +2298,7 @@ error_connect_fail:
 	if (data.stream)
 		pw_stream_destroy(data.stream);
 error_no_stream:
+	io_cleanup(&data);
 	if (data.metadata)
 		pw_proxy_destroy((struct pw_proxy*)data.metadata);
 	if (data.registry)
@@ -1766,6 +2315,18 @@ error_bad_file:
 	pw_properties_free(data.props);
 	if (data.file)
 		sf_close(data.file);
+	for (c = 0; c < data.split.n_files; c++) {
+		if (data.split.files[c])
+			sf_close(data.split.files[c]);
+	}
+	free(data.split.files);
+	if (data.fd >= 0) {
+		/* release the preallocated blocks we did not use */
+		off_t end = lseek(data.fd, 0, SEEK_END);
+		if (end >= 0 && ftruncate(data.fd, end) < 0)
+			fprintf(stderr, "warning: truncate failed: %m\n");
+		close(data.fd);
+	}
 	if (data.midi.file)
 		midi_file_close(data.midi.file);
 	pw_deinit();
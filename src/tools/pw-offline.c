@@ -0,0 +1,932 @@
+/* PipeWire
+ *
+ * Copyright © 2021 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Runs the graph of a config file in this process, without a daemon and
+ * without audio hardware. A file source and a file sink are linked to the
+ * graph and scheduled together with a freewheeling driver, which starts
+ * the next cycle as soon as the previous one completed. When the input
+ * file is rendered, the time spent in every node is reported.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <signal.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <sndfile.h>
+
+#include <spa/utils/result.h>
+#include <spa/utils/string.h>
+#include <spa/utils/names.h>
+#include <spa/param/audio/format-utils.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/impl.h>
+#include <pipewire/conf.h>
+#include <pipewire/private.h>
+
+#define DEFAULT_QUANTUM		1024u
+#define MAX_NODES		64
+#define MAX_NAME		128
+#define MAX_RETRIES		100
+#define MAX_LINKS		(2 * SPA_AUDIO_MAX_CHANNELS)
+
+#define OFFLINE_GROUP		"pw-offline"
+#define SOURCE_NAME		"pw-offline.source"
+#define SINK_NAME		"pw-offline.sink"
+
+struct node_stats {
+	uint32_t id;
+	char name[MAX_NAME];
+	uint64_t cycles;
+	uint64_t total_ns;
+	uint64_t max_ns;
+};
+
+struct link {
+	struct data *data;
+	struct pw_impl_link *link;
+	struct spa_hook listener;
+	bool active;
+};
+
+struct data {
+	struct pw_main_loop *loop;
+	struct pw_context *context;
+
+	struct pw_core *core;
+	struct spa_hook core_listener;
+
+	struct spa_hook driver_listener;
+
+	const char *config;
+	const char *input_node;
+	const char *output_node;
+	uint32_t quantum;
+	uint32_t channels;
+	double tail;
+
+	SNDFILE *in_file;
+	SF_INFO in_info;
+	SNDFILE *out_file;
+	SF_INFO out_info;
+
+	struct pw_proxy *driver;
+
+	struct pw_stream *source;
+	struct spa_hook source_listener;
+	struct pw_stream *sink;
+	struct spa_hook sink_listener;
+
+	struct pw_impl_node *configured[4];
+	uint32_t n_configured;
+
+	uint32_t n_links;
+	struct link links[MAX_LINKS];
+
+	int sync;
+	int retries;
+	int res;
+
+	int ready;
+
+	/* only touched from the data thread while running */
+	bool started;
+	bool eof;
+	bool done;
+	uint64_t frames_in;
+	uint64_t frames_out;
+	uint64_t frames_total;
+	uint64_t start_ns;
+	uint64_t end_ns;
+	uint64_t cycles;
+	uint64_t max_cycle_ns;
+	uint64_t first_ns;
+	uint64_t last_ns;
+
+	uint32_t n_nodes;
+	struct node_stats nodes[MAX_NODES];
+};
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void do_quit(void *data, int signal_number)
+{
+	struct data *d = data;
+	d->res = -EINTR;
+	pw_main_loop_quit(d->loop);
+}
+
+static int do_finish(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct data *d = user_data;
+	pw_main_loop_quit(d->loop);
+	return 0;
+}
+
+static void fail(struct data *d, int res, const char *msg)
+{
+	fprintf(stderr, "error: %s: %s\n", msg, spa_strerror(res));
+	d->res = res;
+	pw_main_loop_quit(d->loop);
+}
+
+static struct node_stats *find_stats(struct data *d, struct pw_impl_node *node)
+{
+	struct node_stats *s;
+	uint32_t i;
+
+	for (i = 0; i < d->n_nodes; i++) {
+		if (d->nodes[i].id == node->info.id)
+			return &d->nodes[i];
+	}
+	if (d->n_nodes == MAX_NODES)
+		return NULL;
+
+	s = &d->nodes[d->n_nodes++];
+	s->id = node->info.id;
+	snprintf(s->name, sizeof(s->name), "%s", node->name);
+	return s;
+}
+
+/* called from the data thread when the driver completed a cycle */
+static void driver_complete(void *data, struct pw_impl_node *node)
+{
+	struct data *d = data;
+	struct pw_node_target *t;
+	uint64_t now;
+
+	if (!d->started || d->done || !spa_streq(node->group, OFFLINE_GROUP))
+		return;
+
+	now = node->rt.activation->finish_time;
+	if (d->last_ns != 0)
+		d->max_cycle_ns = SPA_MAX(d->max_cycle_ns, now - d->last_ns);
+	else
+		d->first_ns = now;
+	d->last_ns = now;
+	d->cycles++;
+
+	spa_list_for_each(t, &node->rt.target_list, link) {
+		struct pw_impl_node *n = t->node;
+		struct pw_node_activation *a;
+		struct node_stats *s;
+		uint64_t busy;
+
+		if (n == NULL || n == node)
+			continue;
+
+		a = n->rt.activation;
+		if (a->finish_time < a->awake_time)
+			continue;
+		if ((s = find_stats(d, n)) == NULL)
+			continue;
+
+		busy = a->finish_time - a->awake_time;
+		s->cycles++;
+		s->total_ns += busy;
+		s->max_ns = SPA_MAX(s->max_ns, busy);
+	}
+}
+
+static const struct pw_context_driver_events driver_events = {
+	PW_VERSION_CONTEXT_DRIVER_EVENTS,
+	.complete = driver_complete,
+};
+
+static void on_source_process(void *userdata)
+{
+	struct data *d = userdata;
+	struct pw_buffer *b;
+	struct spa_buffer *buf;
+	float *dst;
+	uint32_t stride, n_frames;
+	sf_count_t n = 0;
+
+	/* don't queue anything before the graph is linked */
+	if (!d->started) {
+		if (!__atomic_load_n(&d->ready, __ATOMIC_ACQUIRE))
+			return;
+		d->started = true;
+		d->start_ns = get_time_ns();
+	}
+
+	if ((b = pw_stream_dequeue_buffer(d->source)) == NULL)
+		return;
+
+	buf = b->buffer;
+	if ((dst = buf->datas[0].data) == NULL)
+		return;
+
+	stride = sizeof(float) * d->in_info.channels;
+	n_frames = SPA_MIN(buf->datas[0].maxsize / stride, d->quantum);
+
+	if (!d->eof) {
+		n = sf_readf_float(d->in_file, dst, n_frames);
+		if (n < 0)
+			n = 0;
+		d->frames_in += n;
+		if ((uint32_t)n < n_frames) {
+			d->eof = true;
+			d->frames_total = d->frames_in +
+				(uint64_t)(d->tail * d->in_info.samplerate);
+		}
+	}
+	/* silence after the end of the file */
+	memset(&dst[n * d->in_info.channels], 0, (n_frames - n) * stride);
+
+	buf->datas[0].chunk->offset = 0;
+	buf->datas[0].chunk->stride = stride;
+	buf->datas[0].chunk->size = n_frames * stride;
+
+	pw_stream_queue_buffer(d->source, b);
+}
+
+static void on_sink_process(void *userdata)
+{
+	struct data *d = userdata;
+	struct pw_buffer *b;
+	struct spa_buffer *buf;
+	uint32_t stride, offset, size;
+	uint64_t n_frames;
+	float *src;
+
+	if ((b = pw_stream_dequeue_buffer(d->sink)) == NULL)
+		return;
+
+	buf = b->buffer;
+	if (!d->started || d->done || (src = buf->datas[0].data) == NULL)
+		goto done;
+
+	stride = sizeof(float) * d->out_info.channels;
+	offset = SPA_MIN(buf->datas[0].chunk->offset, buf->datas[0].maxsize);
+	size = SPA_MIN(buf->datas[0].chunk->size, buf->datas[0].maxsize - offset);
+
+	n_frames = SPA_MIN(size / stride, d->frames_total - d->frames_out);
+	if (n_frames > 0)
+		sf_writef_float(d->out_file, SPA_PTROFF(src, offset, float), n_frames);
+	d->frames_out += n_frames;
+
+	if (d->frames_out >= d->frames_total) {
+		d->done = true;
+		d->end_ns = get_time_ns();
+		pw_loop_invoke(pw_main_loop_get_loop(d->loop),
+				do_finish, 1, NULL, 0, false, d);
+	}
+done:
+	pw_stream_queue_buffer(d->sink, b);
+}
+
+static void on_stream_state_changed(void *userdata, enum pw_stream_state old,
+		enum pw_stream_state state, const char *error)
+{
+	struct data *d = userdata;
+
+	if (state == PW_STREAM_STATE_ERROR)
+		fail(d, -EIO, error ? error : "stream error");
+}
+
+static const struct pw_stream_events source_events = {
+	PW_VERSION_STREAM_EVENTS,
+	.state_changed = on_stream_state_changed,
+	.process = on_source_process,
+};
+
+static const struct pw_stream_events sink_events = {
+	PW_VERSION_STREAM_EVENTS,
+	.state_changed = on_stream_state_changed,
+	.process = on_sink_process,
+};
+
+static const uint32_t default_layouts[][8] = {
+	{ SPA_AUDIO_CHANNEL_MONO, },
+	{ SPA_AUDIO_CHANNEL_FL, SPA_AUDIO_CHANNEL_FR, },
+	{ SPA_AUDIO_CHANNEL_FL, SPA_AUDIO_CHANNEL_FR, SPA_AUDIO_CHANNEL_LFE, },
+	{ SPA_AUDIO_CHANNEL_FL, SPA_AUDIO_CHANNEL_FR, SPA_AUDIO_CHANNEL_RL,
+	  SPA_AUDIO_CHANNEL_RR, },
+	{ SPA_AUDIO_CHANNEL_FL, SPA_AUDIO_CHANNEL_FR, SPA_AUDIO_CHANNEL_FC,
+	  SPA_AUDIO_CHANNEL_RL, SPA_AUDIO_CHANNEL_RR, },
+	{ SPA_AUDIO_CHANNEL_FL, SPA_AUDIO_CHANNEL_FR, SPA_AUDIO_CHANNEL_FC,
+	  SPA_AUDIO_CHANNEL_LFE, SPA_AUDIO_CHANNEL_RL, SPA_AUDIO_CHANNEL_RR, },
+	{ SPA_AUDIO_CHANNEL_FL, SPA_AUDIO_CHANNEL_FR, SPA_AUDIO_CHANNEL_FC,
+	  SPA_AUDIO_CHANNEL_RL, SPA_AUDIO_CHANNEL_RR, SPA_AUDIO_CHANNEL_SL,
+	  SPA_AUDIO_CHANNEL_SR, },
+	{ SPA_AUDIO_CHANNEL_FL, SPA_AUDIO_CHANNEL_FR, SPA_AUDIO_CHANNEL_FC,
+	  SPA_AUDIO_CHANNEL_LFE, SPA_AUDIO_CHANNEL_RL, SPA_AUDIO_CHANNEL_RR,
+	  SPA_AUDIO_CHANNEL_SL, SPA_AUDIO_CHANNEL_SR, },
+};
+
+static struct spa_audio_info_raw get_audio_info(SF_INFO *info)
+{
+	struct spa_audio_info_raw raw;
+
+	spa_zero(raw);
+	raw.format = SPA_AUDIO_FORMAT_F32;
+	raw.rate = info->samplerate;
+	raw.channels = info->channels;
+	if (raw.channels <= SPA_N_ELEMENTS(default_layouts))
+		memcpy(raw.position, default_layouts[raw.channels - 1],
+				raw.channels * sizeof(uint32_t));
+	else
+		raw.flags = SPA_AUDIO_FLAG_UNPOSITIONED;
+	return raw;
+}
+
+static void link_destroy(void *data)
+{
+	struct link *l = data;
+	spa_hook_remove(&l->listener);
+	l->link = NULL;
+}
+
+static void link_state_changed(void *data, enum pw_link_state old,
+		enum pw_link_state state, const char *error)
+{
+	struct link *l = data;
+	struct data *d = l->data;
+	uint32_t i;
+
+	if (state == PW_LINK_STATE_ERROR) {
+		fail(d, -EPIPE, error ? error : "link error");
+		return;
+	}
+	l->active = state == PW_LINK_STATE_ACTIVE;
+
+	for (i = 0; i < d->n_links; i++) {
+		if (!d->links[i].active)
+			return;
+	}
+	__atomic_store_n(&d->ready, 1, __ATOMIC_RELEASE);
+}
+
+static const struct pw_impl_link_events link_events = {
+	PW_VERSION_IMPL_LINK_EVENTS,
+	.destroy = link_destroy,
+	.state_changed = link_state_changed,
+};
+
+struct find_node {
+	const char *name;
+	const char *classes[2];
+	uint32_t skip_id;
+	struct pw_impl_node *node;
+};
+
+static int find_node_func(void *data, struct pw_global *global)
+{
+	struct find_node *find = data;
+	const struct pw_properties *props;
+	const char *str;
+
+	if (!pw_global_is_type(global, PW_TYPE_INTERFACE_Node) ||
+	    pw_global_get_id(global) == find->skip_id)
+		return 0;
+
+	props = pw_global_get_properties(global);
+	if (find->name != NULL) {
+		str = pw_properties_get(props, PW_KEY_NODE_NAME);
+		if (!spa_streq(str, find->name))
+			return 0;
+	} else {
+		str = pw_properties_get(props, PW_KEY_MEDIA_CLASS);
+		if (!spa_streq(str, find->classes[0]) &&
+		    !spa_streq(str, find->classes[1]))
+			return 0;
+	}
+	find->node = pw_global_get_object(global);
+	return 1;
+}
+
+static struct pw_impl_node *find_node(struct data *d, const char *name,
+		const char *class1, const char *class2, uint32_t skip_id)
+{
+	struct find_node find = {
+		.name = name,
+		.classes = { class1, class2 },
+		.skip_id = skip_id,
+	};
+	pw_context_for_each_global(d->context, find_node_func, &find);
+	return find.node;
+}
+
+static struct pw_impl_node *stream_node(struct data *d, struct pw_stream *stream)
+{
+	struct pw_global *global;
+	uint32_t id;
+
+	if ((id = pw_stream_get_node_id(stream)) == SPA_ID_INVALID ||
+	    (global = pw_context_find_global(d->context, id)) == NULL)
+		return NULL;
+	return pw_global_get_object(global);
+}
+
+/* Without a session manager nobody configures the ports of the nodes. Do
+ * what it would do and split them into one port per channel of the file.
+ * The ports of exported nodes appear some time after this. */
+static bool configure_node(struct data *d, struct pw_impl_node *node,
+		enum pw_direction direction, SF_INFO *info)
+{
+	const struct pw_node_info *ni;
+	struct spa_audio_info_raw raw;
+	struct spa_pod *param, *format;
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	uint32_t i, n_ports;
+
+	if (node == NULL)
+		return false;
+
+	ni = pw_impl_node_get_info(node);
+	n_ports = direction == PW_DIRECTION_INPUT ?
+		ni->n_input_ports : ni->n_output_ports;
+	if (n_ports == (uint32_t)info->channels)
+		return true;
+
+	for (i = 0; i < d->n_configured; i++) {
+		if (d->configured[i] == node)
+			return false;
+	}
+	if (d->n_configured < SPA_N_ELEMENTS(d->configured))
+		d->configured[d->n_configured++] = node;
+
+	raw = get_audio_info(info);
+	format = spa_format_audio_raw_build(&b, SPA_PARAM_Format, &raw);
+	param = spa_pod_builder_add_object(&b,
+			SPA_TYPE_OBJECT_ParamPortConfig, SPA_PARAM_PortConfig,
+			SPA_PARAM_PORT_CONFIG_direction, SPA_POD_Id(direction),
+			SPA_PARAM_PORT_CONFIG_mode,      SPA_POD_Id(SPA_PARAM_PORT_CONFIG_MODE_dsp),
+			SPA_PARAM_PORT_CONFIG_monitor,   SPA_POD_Bool(false),
+			SPA_PARAM_PORT_CONFIG_format,    SPA_POD_Pod(format));
+
+	spa_node_set_param(pw_impl_node_get_implementation(node),
+			SPA_PARAM_PortConfig, 0, param);
+	return false;
+}
+
+struct port_list {
+	uint32_t n_ports;
+	struct pw_impl_port *ports[SPA_AUDIO_MAX_CHANNELS];
+};
+
+static int collect_port(void *data, struct pw_impl_port *port)
+{
+	struct port_list *list = data;
+	if (list->n_ports < SPA_N_ELEMENTS(list->ports))
+		list->ports[list->n_ports++] = port;
+	return 0;
+}
+
+static int link_nodes(struct data *d, struct pw_impl_node *output,
+		struct pw_impl_node *input)
+{
+	struct port_list out = { 0 }, in = { 0 };
+	uint32_t i;
+	int res;
+
+	pw_impl_node_for_each_port(output, PW_DIRECTION_OUTPUT, collect_port, &out);
+	pw_impl_node_for_each_port(input, PW_DIRECTION_INPUT, collect_port, &in);
+
+	for (i = 0; i < SPA_MIN(out.n_ports, in.n_ports); i++) {
+		struct link *l;
+
+		if (d->n_links == SPA_N_ELEMENTS(d->links))
+			return -ENOSPC;
+
+		l = &d->links[d->n_links];
+		l->data = d;
+		l->link = pw_context_create_link(d->context,
+				out.ports[i], in.ports[i], NULL, NULL, 0);
+		if (l->link == NULL)
+			return -errno;
+
+		d->n_links++;
+		pw_impl_link_add_listener(l->link, &l->listener, &link_events, l);
+		if ((res = pw_impl_link_register(l->link, NULL)) < 0)
+			return res;
+	}
+	return 0;
+}
+
+static int link_graph(struct data *d)
+{
+	struct pw_impl_node *source, *sink, *input, *output;
+	bool ready;
+	int res;
+
+	source = stream_node(d, d->source);
+	sink = stream_node(d, d->sink);
+	if (source == NULL || sink == NULL)
+		return -EAGAIN;
+
+	input = find_node(d, d->input_node, "Audio/Sink", "Stream/Input/Audio",
+			pw_stream_get_node_id(d->sink));
+	output = find_node(d, d->output_node, "Stream/Output/Audio", "Audio/Source",
+			pw_stream_get_node_id(d->source));
+
+	ready = configure_node(d, source, PW_DIRECTION_OUTPUT, &d->in_info);
+	ready &= configure_node(d, input, PW_DIRECTION_INPUT, &d->in_info);
+	ready &= configure_node(d, output, PW_DIRECTION_OUTPUT, &d->out_info);
+	ready &= configure_node(d, sink, PW_DIRECTION_INPUT, &d->out_info);
+	if (!ready)
+		return -EAGAIN;
+
+	if ((res = link_nodes(d, source, input)) < 0 ||
+	    (res = link_nodes(d, output, sink)) < 0)
+		return res;
+	return 0;
+}
+
+static void on_core_done(void *data, uint32_t id, int seq)
+{
+	struct data *d = data;
+	int res;
+
+	if (id != PW_ID_CORE || seq != d->sync)
+		return;
+
+	/* the nodes of the streams and of the graph are exported
+	 * asynchronously, try again until they all appeared */
+	if ((res = link_graph(d)) == -EAGAIN && ++d->retries < MAX_RETRIES)
+		d->sync = pw_core_sync(d->core, PW_ID_CORE, d->sync);
+	else if (res == -EAGAIN)
+		fail(d, -ENOENT, "can't find and configure the nodes to link");
+	else if (res < 0)
+		fail(d, res, "can't link the graph");
+}
+
+static void on_core_error(void *data, uint32_t id, int seq, int res, const char *message)
+{
+	struct data *d = data;
+
+	pw_log_error("error id:%u seq:%d res:%d (%s): %s",
+			id, seq, res, spa_strerror(res), message);
+
+	if (id == PW_ID_CORE)
+		fail(d, res, message);
+}
+
+static const struct pw_core_events core_events = {
+	PW_VERSION_CORE_EVENTS,
+	.done = on_core_done,
+	.error = on_core_error,
+};
+
+static int ensure_module(struct data *d, const char *factory, const char *module)
+{
+	if (pw_context_find_factory(d->context, factory) != NULL)
+		return 0;
+	if (pw_context_load_module(d->context, module, NULL, NULL) == NULL)
+		return -errno;
+	return 0;
+}
+
+static struct pw_stream *create_stream(struct data *d, const char *name,
+		const char *category, SF_INFO *info)
+{
+	struct pw_properties *props;
+
+	props = pw_properties_new(
+			PW_KEY_MEDIA_TYPE, "Audio",
+			PW_KEY_MEDIA_CATEGORY, category,
+			PW_KEY_NODE_NAME, name,
+			PW_KEY_NODE_GROUP, OFFLINE_GROUP,
+			NULL);
+	if (props == NULL)
+		return NULL;
+
+	pw_properties_setf(props, PW_KEY_NODE_LATENCY, "%u/%u",
+			d->quantum, info->samplerate);
+
+	return pw_stream_new(d->core, name, props);
+}
+
+static int connect_stream(struct pw_stream *stream, enum pw_direction direction,
+		SF_INFO *info)
+{
+	struct spa_audio_info_raw raw;
+	const struct spa_pod *params[1];
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+
+	raw = get_audio_info(info);
+	params[0] = spa_format_audio_raw_build(&b, SPA_PARAM_EnumFormat, &raw);
+
+	return pw_stream_connect(stream,
+			direction,
+			PW_ID_ANY,
+			PW_STREAM_FLAG_MAP_BUFFERS |
+			PW_STREAM_FLAG_RT_PROCESS,
+			params, 1);
+}
+
+static int create_driver(struct data *d)
+{
+	struct pw_properties *props;
+
+	props = pw_properties_new(
+			SPA_KEY_FACTORY_NAME, SPA_NAME_SUPPORT_NODE_DRIVER,
+			SPA_KEY_LIBRARY_NAME, "support/libspa-support",
+			PW_KEY_NODE_NAME, "pw-offline.driver",
+			PW_KEY_NODE_GROUP, OFFLINE_GROUP,
+			"node.freewheel", "true",
+			NULL);
+	if (props == NULL)
+		return -errno;
+
+	d->driver = pw_core_create_object(d->core,
+			"spa-node-factory",
+			PW_TYPE_INTERFACE_Node,
+			PW_VERSION_NODE,
+			&props->dict, 0);
+	pw_properties_free(props);
+
+	return d->driver == NULL ? -errno : 0;
+}
+
+static void print_report(struct data *d)
+{
+	double secs, wall, cycle_secs, avg_cycle;
+	uint32_t i;
+
+	if (d->cycles == 0)
+		return;
+
+	secs = (double)d->frames_in / d->in_info.samplerate;
+	wall = (double)(d->end_ns - d->start_ns) / SPA_NSEC_PER_SEC;
+	cycle_secs = (double)d->quantum / d->in_info.samplerate;
+	avg_cycle = d->cycles > 1 ?
+		(double)(d->last_ns - d->first_ns) / (d->cycles - 1) : 0.0;
+
+	fprintf(stdout, "rendered %"PRIu64" frames (%.3f s) in %.3f s, %.1fx realtime\n",
+			d->frames_in, secs, wall, wall > 0.0 ? secs / wall : 0.0);
+	fprintf(stdout, "%"PRIu64" cycles of %u frames, %.1f us per cycle, max %.1f us\n",
+			d->cycles, d->quantum,
+			avg_cycle / 1e3, d->max_cycle_ns / 1e3);
+	fprintf(stdout, "%5s %-32s %10s %10s %7s %10s\n",
+			"ID", "NAME", "AVG(us)", "MAX(us)", "LOAD", "SPEED");
+
+	for (i = 0; i < d->n_nodes; i++) {
+		struct node_stats *s = &d->nodes[i];
+		double avg = (double)s->total_ns / SPA_MAX(s->cycles, 1u) / SPA_NSEC_PER_SEC;
+
+		fprintf(stdout, "%5u %-32.32s %10.1f %10.1f %6.1f%% %9.1fx\n",
+				s->id, s->name, avg * 1e6, s->max_ns / 1e3,
+				wall > 0.0 ? 100.0 * s->total_ns / SPA_NSEC_PER_SEC / wall : 0.0,
+				avg > 0.0 ? cycle_secs / avg : 0.0);
+	}
+}
+
+static void show_help(struct data *d, const char *name)
+{
+	fprintf(stdout, "%s [options] <config> <input file> <output file>\n"
+		"  -h, --help                            Show this help\n"
+		"      --version                         Show version\n"
+		"  -i, --input                           Name of the graph input node\n"
+		"                                          (default: first sink)\n"
+		"  -o, --output                          Name of the graph output node\n"
+		"                                          (default: first output stream)\n"
+		"  -q, --quantum                         Frames per cycle (default %u)\n"
+		"  -c, --channels                        Channels of the output file\n"
+		"                                          (default: same as the input)\n"
+		"  -t, --tail                            Seconds to render after the end\n"
+		"                                          of the input (default 0)\n",
+		name, DEFAULT_QUANTUM);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { 0 };
+	struct pw_properties *props, *conf;
+	struct pw_loop *l;
+	char path[PATH_MAX];
+	static const struct option long_options[] = {
+		{ "help",		no_argument,		NULL, 'h' },
+		{ "version",		no_argument,		NULL, 'V' },
+		{ "input",		required_argument,	NULL, 'i' },
+		{ "output",		required_argument,	NULL, 'o' },
+		{ "quantum",		required_argument,	NULL, 'q' },
+		{ "channels",		required_argument,	NULL, 'c' },
+		{ "tail",		required_argument,	NULL, 't' },
+		{ NULL, 0, NULL, 0}
+	};
+	int c, res = -1;
+
+	pw_init(&argc, &argv);
+
+	data.quantum = DEFAULT_QUANTUM;
+	data.frames_total = UINT64_MAX;
+
+	while ((c = getopt_long(argc, argv, "hVi:o:q:c:t:", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'h':
+			show_help(&data, argv[0]);
+			return 0;
+		case 'V':
+			fprintf(stdout, "%s\n"
+				"Compiled with libpipewire %s\n"
+				"Linked with libpipewire %s\n",
+				argv[0],
+				pw_get_headers_version(),
+				pw_get_library_version());
+			return 0;
+		case 'i':
+			data.input_node = optarg;
+			break;
+		case 'o':
+			data.output_node = optarg;
+			break;
+		case 'q':
+			data.quantum = atoi(optarg);
+			break;
+		case 'c':
+			data.channels = atoi(optarg);
+			break;
+		case 't':
+			data.tail = atof(optarg);
+			break;
+		default:
+			show_help(&data, argv[0]);
+			return -1;
+		}
+	}
+	if (optind + 3 != argc || data.quantum == 0 || data.tail < 0.0) {
+		show_help(&data, argv[0]);
+		return -1;
+	}
+
+	/* a config file in the current directory takes precedence over
+	 * the one with the same name in the config directories */
+	data.config = argv[optind];
+	if (access(data.config, R_OK) == 0 && realpath(data.config, path) != NULL)
+		data.config = path;
+
+	if ((conf = pw_properties_new(NULL, NULL)) == NULL)
+		goto exit;
+	res = pw_conf_load_conf(NULL, data.config, conf);
+	pw_properties_free(conf);
+	if (res < 0) {
+		fprintf(stderr, "can't load config '%s': %s\n",
+				data.config, spa_strerror(res));
+		res = -1;
+		goto exit;
+	}
+	res = -1;
+
+	data.in_file = sf_open(argv[optind + 1], SFM_READ, &data.in_info);
+	if (data.in_file == NULL) {
+		fprintf(stderr, "can't open input file '%s': %s\n",
+				argv[optind + 1], sf_strerror(NULL));
+		goto exit;
+	}
+	data.out_info.samplerate = data.in_info.samplerate;
+	data.out_info.channels = data.channels ? (int)data.channels : data.in_info.channels;
+	data.out_info.format = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+	if ((uint32_t)data.out_info.channels > SPA_AUDIO_MAX_CHANNELS ||
+	    (uint32_t)data.in_info.channels > SPA_AUDIO_MAX_CHANNELS) {
+		fprintf(stderr, "too many channels\n");
+		goto exit;
+	}
+	data.out_file = sf_open(argv[optind + 2], SFM_WRITE, &data.out_info);
+	if (data.out_file == NULL) {
+		fprintf(stderr, "can't open output file '%s': %s\n",
+				argv[optind + 2], sf_strerror(NULL));
+		goto exit;
+	}
+
+	data.loop = pw_main_loop_new(NULL);
+	if (data.loop == NULL) {
+		fprintf(stderr, "can't create main loop: %m\n");
+		goto exit;
+	}
+
+	l = pw_main_loop_get_loop(data.loop);
+	pw_loop_add_signal(l, SIGINT, do_quit, &data);
+	pw_loop_add_signal(l, SIGTERM, do_quit, &data);
+
+	/* every connection made by the modules of the config goes to
+	 * the core of this context instead of to a daemon */
+	props = pw_properties_new(
+			PW_KEY_CONFIG_NAME, data.config,
+			PW_KEY_REMOTE_NAME, "internal",
+			NULL);
+	if (props == NULL)
+		goto exit;
+	pw_properties_setf(props, "default.clock.rate", "%u", data.in_info.samplerate);
+	pw_properties_setf(props, "default.clock.quantum", "%u", data.quantum);
+
+	data.context = pw_context_new(l, props, 0);
+	if (data.context == NULL) {
+		fprintf(stderr, "can't create context: %m\n");
+		goto exit;
+	}
+
+	if ((res = ensure_module(&data, "client-node", "libpipewire-module-client-node")) < 0 ||
+	    (res = ensure_module(&data, "adapter", "libpipewire-module-adapter")) < 0 ||
+	    (res = ensure_module(&data, "spa-node-factory", "libpipewire-module-spa-node-factory")) < 0) {
+		fprintf(stderr, "can't load modules: %s\n", spa_strerror(res));
+		res = -1;
+		goto exit;
+	}
+	res = -1;
+
+	data.core = pw_context_connect_self(data.context, NULL, 0);
+	if (data.core == NULL) {
+		fprintf(stderr, "can't connect: %m\n");
+		goto exit;
+	}
+	pw_core_add_listener(data.core, &data.core_listener, &core_events, &data);
+
+	if (create_driver(&data) < 0) {
+		fprintf(stderr, "can't create driver: %m\n");
+		goto exit;
+	}
+
+	data.source = create_stream(&data, SOURCE_NAME, "Playback", &data.in_info);
+	data.sink = create_stream(&data, SINK_NAME, "Capture", &data.out_info);
+	if (data.source == NULL || data.sink == NULL) {
+		fprintf(stderr, "can't create streams: %m\n");
+		goto exit;
+	}
+	pw_stream_add_listener(data.source, &data.source_listener, &source_events, &data);
+	pw_stream_add_listener(data.sink, &data.sink_listener, &sink_events, &data);
+
+	spa_hook_list_append(&data.context->driver_listener_list,
+			&data.driver_listener, &driver_events, &data);
+
+	if ((res = connect_stream(data.source, PW_DIRECTION_OUTPUT, &data.in_info)) < 0 ||
+	    (res = connect_stream(data.sink, PW_DIRECTION_INPUT, &data.out_info)) < 0) {
+		fprintf(stderr, "can't connect streams: %s\n", spa_strerror(res));
+		res = -1;
+		goto exit;
+	}
+
+	/* link when the stream nodes were exported */
+	data.sync = pw_core_sync(data.core, PW_ID_CORE, 0);
+
+	pw_main_loop_run(data.loop);
+
+	if (data.res < 0) {
+		res = -1;
+		goto exit;
+	}
+
+	print_report(&data);
+	res = 0;
+exit:
+	for (c = 0; c < (int)data.n_links; c++) {
+		if (data.links[c].link)
+			pw_impl_link_destroy(data.links[c].link);
+	}
+	if (data.source)
+		pw_stream_destroy(data.source);
+	if (data.sink)
+		pw_stream_destroy(data.sink);
+	if (data.driver_listener.link.next)
+		spa_hook_remove(&data.driver_listener);
+	if (data.driver)
+		pw_proxy_destroy(data.driver);
+	if (data.core)
+		pw_core_disconnect(data.core);
+	if (data.context)
+		pw_context_destroy(data.context);
+	if (data.loop)
+		pw_main_loop_destroy(data.loop);
+	if (data.in_file)
+		sf_close(data.in_file);
+	if (data.out_file)
+		sf_close(data.out_file);
+	pw_deinit();
+
+	return res;
+}
@@ -0,0 +1,196 @@
+/* PipeWire
+ *
+ * Copyright © 2021 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Renders a file through a filter-chain that halves the volume with the
+ * builtin mixer and checks the output file. Takes the path of pw-offline
+ * as the argument.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <math.h>
+#include <sys/wait.h>
+
+#include <sndfile.h>
+
+#include <spa/utils/defs.h>
+
+#define RATE		48000
+#define CHANNELS	2
+#define N_FRAMES	(RATE / 2)
+#define QUANTUM		256
+/* the streams and the filter add a few cycles of latency to the output */
+#define MAX_LATENCY	(8 * QUANTUM)
+
+static const char config[] =
+	"context.spa-libs = {\n"
+	"    audio.convert.* = audioconvert/libspa-audioconvert\n"
+	"    support.*       = support/libspa-support\n"
+	"}\n"
+	"context.modules = [\n"
+	"    { name = libpipewire-module-protocol-native }\n"
+	"    { name = libpipewire-module-client-node }\n"
+	"    { name = libpipewire-module-adapter }\n"
+	"    { name = libpipewire-module-filter-chain\n"
+	"        args = {\n"
+	"            node.name = \"test.gain\"\n"
+	"            audio.channels = 2\n"
+	"            audio.position = [ FL FR ]\n"
+	"            filter.graph = {\n"
+	"                nodes = [\n"
+	"                    {\n"
+	"                        type = builtin\n"
+	"                        name = mix\n"
+	"                        label = mixer\n"
+	"                        control = { \"Gain 1\" = 0.5 }\n"
+	"                    }\n"
+	"                ]\n"
+	"                inputs = [ \"mix:In 1\" ]\n"
+	"                outputs = [ \"mix:Out\" ]\n"
+	"            }\n"
+	"            capture.props = {\n"
+	"                media.class = Audio/Sink\n"
+	"            }\n"
+	"            playback.props = {\n"
+	"                node.passive = true\n"
+	"            }\n"
+	"        }\n"
+	"    }\n"
+	"]\n";
+
+static float sample(uint32_t frame, uint32_t channel)
+{
+	/* never silent, the start of the output is found by the first
+	 * sample that is not zero */
+	return 0.25f + 0.5f * sinf(2.0f * (float)M_PI * 440.0f * (channel + 1) * frame / RATE);
+}
+
+static void write_file(const char *path, const char *data)
+{
+	FILE *f;
+
+	spa_assert_se((f = fopen(path, "w")) != NULL);
+	spa_assert_se(fputs(data, f) >= 0);
+	spa_assert_se(fclose(f) == 0);
+}
+
+static void write_input(const char *path)
+{
+	SF_INFO info = { 0 };
+	SNDFILE *file;
+	float buf[N_FRAMES * CHANNELS];
+	uint32_t i, c;
+
+	info.samplerate = RATE;
+	info.channels = CHANNELS;
+	info.format = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+
+	for (i = 0; i < N_FRAMES; i++)
+		for (c = 0; c < CHANNELS; c++)
+			buf[i * CHANNELS + c] = sample(i, c);
+
+	spa_assert_se((file = sf_open(path, SFM_WRITE, &info)) != NULL);
+	spa_assert_se(sf_writef_float(file, buf, N_FRAMES) == N_FRAMES);
+	spa_assert_se(sf_close(file) == 0);
+}
+
+static void check_output(const char *path)
+{
+	SF_INFO info = { 0 };
+	SNDFILE *file;
+	float buf[N_FRAMES * CHANNELS];
+	uint32_t i, c, start;
+
+	spa_assert_se((file = sf_open(path, SFM_READ, &info)) != NULL);
+	spa_assert(info.samplerate == RATE);
+	spa_assert(info.channels == CHANNELS);
+	spa_assert(info.frames == N_FRAMES);
+	spa_assert_se(sf_readf_float(file, buf, N_FRAMES) == N_FRAMES);
+	spa_assert_se(sf_close(file) == 0);
+
+	/* the latency of the graph is silence at the start */
+	for (start = 0; start < N_FRAMES; start++) {
+		if (buf[start * CHANNELS] != 0.0f)
+			break;
+	}
+	fprintf(stderr, "output starts after %u frames\n", start);
+	spa_assert(start <= MAX_LATENCY);
+
+	for (i = start; i < N_FRAMES; i++) {
+		for (c = 0; c < CHANNELS; c++) {
+			float expected = 0.5f * sample(i - start, c);
+			spa_assert(fabsf(buf[i * CHANNELS + c] - expected) < 1e-6f);
+		}
+	}
+}
+
+static int render(const char *pw_offline, const char *conf,
+		const char *input, const char *output)
+{
+	char quantum[16];
+	pid_t pid;
+	int status;
+
+	snprintf(quantum, sizeof(quantum), "%u", QUANTUM);
+
+	spa_assert_se((pid = fork()) >= 0);
+	if (pid == 0) {
+		execl(pw_offline, pw_offline, "-q", quantum, conf, input, output, NULL);
+		_exit(127);
+	}
+	spa_assert_se(waitpid(pid, &status, 0) == pid);
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int main(int argc, char *argv[])
+{
+	char dir[] = "/tmp/test-pw-offline-XXXXXX";
+	char conf[PATH_MAX], input[PATH_MAX], output[PATH_MAX];
+
+	spa_assert_se(argc == 2);
+	spa_assert_se(mkdtemp(dir) != NULL);
+
+	snprintf(conf, sizeof(conf), "%s/gain.conf", dir);
+	snprintf(input, sizeof(input), "%s/input.wav", dir);
+	snprintf(output, sizeof(output), "%s/output.wav", dir);
+
+	write_file(conf, config);
+	write_input(input);
+
+	spa_assert_se(render(argv[1], conf, input, output) == 0);
+
+	check_output(output);
+
+	unlink(conf);
+	unlink(input);
+	unlink(output);
+	rmdir(dir);
+
+	return 0;
+}